@@ -26,8 +26,10 @@
 
 #define NOMINMAX
 #include "ACES.h"
+#include "taskScheduler.h"
 
 #include <algorithm>
+#include <math.h>
 using std::max;
 using std::min;
 
@@ -488,7 +490,10 @@ Float3 clamp(const Float3& a, const float b, const float c)
 }
 
 static const float TINY = 1e-10f;
+// <math.h> defines it on some platforms
+#ifndef M_PI
 static const float M_PI = 3.1415927f;
+#endif
 static const float HALF_MAX = 65504.0f;
 
 static const Float3x3 AP0_2_XYZ_MAT =
@@ -1181,4 +1186,51 @@ Float3 EvalACES(Float3 InColor, const ACESparams& Params)
 	return outputCV;
 }
 
+template <typename T>
+static void BakeAcesLUT(T *out, int dimx, int dimy, int dimz, const std::function<float(float)> &shaper, const ACESparams &Params, T(*convert)(float), T one)
+{
+	const TaskBox lut = { 0, 0, 0, dimx, dimy, dimz };
+
+	// a few whole rows per piece, every cell is independent
+	GetTaskScheduler().ParallelFor(lut, dimx, 4, 1, [&](const TaskBox &box)
+	{
+		for (int i = box.z0; i < box.z1; i++)
+		{
+			float z = shaper((i + 0.5f) / float(dimz));
+
+			for (int j = box.y0; j < box.y1; j++)
+			{
+				float y = shaper((j + 0.5f) / float(dimy));
+				T *walk = out + (size_t(i * dimy + j) * dimx + box.x0) * 4;
+
+				for (int k = box.x0; k < box.x1; k++)
+				{
+					float x = shaper((k + 0.5f) / float(dimx));
+					Float3 color = { x, y, z };
+					Float3 temp = EvalACES(color, Params);
+					walk[0] = convert(temp.X);
+					walk[1] = convert(temp.Y);
+					walk[2] = convert(temp.Z);
+					walk[3] = one;
+
+					walk += 4;
+				}
+			}
+		}
+	});
+}
+
+static float identity(float f)
+{
+	return f;
+}
 
+void BakeAcesLUT(unsigned short *out, int dimx, int dimy, int dimz, const std::function<float(float)> &shaper, const ACESparams &Params)
+{
+	BakeAcesLUT<unsigned short>(out, dimx, dimy, dimz, shaper, Params, float2half, 0x3c00); // 1.0 half
+}
+
+void BakeAcesLUT(float *out, int dimx, int dimy, int dimz, const std::function<float(float)> &shaper, const ACESparams &Params)
+{
+	BakeAcesLUT<float>(out, dimx, dimy, dimz, shaper, Params, identity, 1.0f);
+}
@@ -28,6 +28,8 @@
 
 #pragma once
 
+#include <functional>
+
 
 
 /*
@@ -161,8 +163,9 @@ inline unsigned short float2half(float f)
 
 	if (exp < -14)
 	{
+		// below the normal range, flushed to zero
 		exp = 0;
-		mant = (0x400 & mant) >> (-exp - 14);
+		mant = 0;
 	}
 	else if (exp < 16)
 	{
@@ -226,4 +229,17 @@ struct ACESparams
 	float saturationLevel;
 };
 
-Float3 EvalACES(Float3 InColor, const ACESparams& Params);
\ No newline at end of file
+Float3 EvalACES(Float3 InColor, const ACESparams& Params);
+
+// SMPTE ST 2084, PQ code in [0,1] to cd/m^2 and back
+float pq_f(float N);
+float pq_r(float C);
+
+// Reverse monitor curve, the sRGB style encode used by the ODTs
+float moncurve_r(float y, float gamma, float offs);
+
+// Fill a dimx*dimy*dimz RGBA LUT, red fastest, alpha 1
+// Each cell centre is mapped through shaper before being run through EvalACES,
+// rows are baked on the task scheduler so shaper is called from several threads
+void BakeAcesLUT(unsigned short *out, int dimx, int dimy, int dimz, const std::function<float(float)> &shaper, const ACESparams &Params);
+void BakeAcesLUT(float *out, int dimx, int dimy, int dimz, const std::function<float(float)> &shaper, const ACESparams &Params);
@@ -29,6 +29,8 @@
 #include "acesTonemapper.h"
 
 #include "ACES.h"
+#include "perftracker_cpu.h"
+#include "pixelPool.h"
 
 void TW_CALL AcesSettings::Apply1000nitHDR(void *data)
 {
@@ -187,54 +189,13 @@ void LutACES::SetupTonemapShader(ID3D11DeviceContext* ctx, ID3D11ShaderResourceV
 
 const float linearGray = 0.18f;
 
-// Base functions from SMPTE ST 2084-2014
-
-// Constants from SMPTE ST 2084-2014
-static const float pq_m1 = 0.1593017578125; // ( 2610.0 / 4096.0 ) / 4.0;
-static const float pq_m2 = 78.84375; // ( 2523.0 / 4096.0 ) * 128.0;
-static const float pq_c1 = 0.8359375; // 3424.0 / 4096.0 or pq_c3 - pq_c2 + 1.0;
-static const float pq_c2 = 18.8515625; // ( 2413.0 / 4096.0 ) * 32.0;
-static const float pq_c3 = 18.6875; // ( 2392.0 / 4096.0 ) * 32.0;
-
-static const float pq_C = 10000.0;
-
-// Converts from the non-linear perceptually quantized space to linear cd/m^2
-// Note that this is in float, and assumes normalization from 0 - 1
-// (0 - pq_C for linear) and does not handle the integer coding in the Annex 
-// sections of SMPTE ST 2084-2014
-static float pq_f(float N)
-{
-	// Note that this does NOT handle any of the signal range
-	// considerations from 2084 - this assumes full range (0 - 1)
-	float Np = powf(N, 1.0f / pq_m2);
-	float L = Np - pq_c1;
-	if (L < 0.0)
-		L = 0.0;
-	L = L / (pq_c2 - pq_c3 * Np);
-	L = powf(L, 1.0f / pq_m1);
-	return L * pq_C; // returns cd/m^2
-}
-
-// Converts from linear cd/m^2 to the non-linear perceptually quantized space
-// Note that this is in float, and assumes normalization from 0 - 1
-// (0 - pq_C for linear) and does not handle the integer coding in the Annex 
-// sections of SMPTE ST 2084-2014
-static float pq_r(float C)
-{
-	// Note that this does NOT handle any of the signal range
-	// considerations from 2084 - this returns full range (0 - 1)
-	float L = C / pq_C;
-	float Lm = pow(L, pq_m1);
-	float N = (pq_c1 + pq_c2 * Lm) / (1.0f + pq_c3 * Lm);
-	N = pow(N, pq_m2);
-	return N;
-}
-
 // whether to use fp32 for the LUT, primarily debugging
 #define USE_FLOAT 0
 
 void LutACES::UpdateLUT()
 {
+	PERF_CPU_SCOPED("CPU > ACES LUT");
+
 	SAFE_RELEASE(LUTtex);
 	SAFE_RELEASE(LUTsrv);
 	SAFE_RELEASE(LUTsamp);
@@ -296,62 +257,14 @@ void LutACES::UpdateLUT()
 
 
 #if !USE_FLOAT
-	unsigned short *data = new unsigned short[current.LUTdimx * current.LUTdimy * current.LUTdimz * 4];
-
-	unsigned short *walk = data;
-
-	for (int i = 0; i < current.LUTdimz; i++)
-	{
-		for (int j = 0; j < current.LUTdimy; j++)
-		{
-			for (int k = 0; k < current.LUTdimx; k++)
-			{
-				float x = (k + 0.5f) / float(current.LUTdimx);
-				float y = (j + 0.5f) / float(current.LUTdimy);
-				float z = (i + 0.5f) / float(current.LUTdimz);
-				x = shaper_func(x);
-				y = shaper_func(y);
-				z = shaper_func(z);
-				Float3 color = { x, y, z };
-				Float3 temp = EvalACES(color, params);
-				walk[0] = float2half(temp.X);
-				walk[1] = float2half(temp.Y);
-				walk[2] = float2half(temp.Z);
-				walk[3] = 0x3b00; // 1.0 half
-
-				walk += 4;
-			}
-		}
-	}
+	PixelLease lease = LeasePixels<unsigned short>(size_t(current.LUTdimx) * current.LUTdimy * current.LUTdimz * 4);
+	unsigned short *data = lease.As<unsigned short>();
 #else
-	float *data = new float[current.LUTdimx * current.LUTdimy * current.LUTdimz * 4];
-
-	float *walk = data;
-
-	for (int i = 0; i < current.LUTdimz; i++)
-	{
-		for (int j = 0; j < current.LUTdimy; j++)
-		{
-			for (int k = 0; k < current.LUTdimx; k++)
-			{
-				float x = (k + 0.5f) / float(current.LUTdimx);
-				float y = (j + 0.5f) / float(current.LUTdimy);
-				float z = (i + 0.5f) / float(current.LUTdimz);
-				x = shaper_func(x);
-				y = shaper_func(y);
-				z = shaper_func(z);
-				Float3 color = { x, y, z };
-				Float3 temp = EvalACES(color, params);
-				walk[0] = temp.X;
-				walk[1] = temp.Y;
-				walk[2] = temp.Z;
-				walk[3] = 1.0f;
-
-				walk += 4;
-			}
-		}
-	}
+	PixelLease lease = LeasePixels<float>(size_t(current.LUTdimx) * current.LUTdimy * current.LUTdimz * 4);
+	float *data = lease.As<float>();
 #endif
+	BakeAcesLUT(data, current.LUTdimx, current.LUTdimy, current.LUTdimz, shaper_func, params);
+
 	DXGI_FORMAT format = USE_FLOAT ? DXGI_FORMAT_R32G32B32A32_FLOAT : DXGI_FORMAT_R16G16B16A16_FLOAT;
 	unsigned int stride = USE_FLOAT ? 16 : 8;
 
@@ -375,8 +288,6 @@ void LutACES::UpdateLUT()
 
 	device->CreateTexture3D(&tDesc, &srData, &LUTtex);
 
-	delete[]data;
-
 	D3D11_SHADER_RESOURCE_VIEW_DESC sDesc;
 	sDesc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE3D;
 	sDesc.Format = format;
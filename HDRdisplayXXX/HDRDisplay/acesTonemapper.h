@@ -72,6 +72,24 @@ struct AcesSettings
 		midGrayScale = 1.0f;
 	}
 
+	void TrackState(FrameState &state) const
+	{
+		state.Track(selectedColorMatrix);
+		state.Track(selectedCurve);
+		state.Track(outputMode);
+		state.Track(minStops);
+		state.Track(maxStops);
+		state.Track(maxLevel);
+		state.Track(midGrayScale);
+		state.Track(surroundGamma);
+		state.Track(toneCurveSaturation);
+		state.Track(outputGamma);
+		state.Track(adjustWP);
+		state.Track(desaturate);
+		state.Track(dimSurround);
+		state.Track(luminanceOnly);
+	}
+
 	void InitPresets(TwBar* settings_bar)
 	{
 		TwAddButton(settings_bar, "HDR1000", Apply1000nitHDR, this, "label='Apply HDR 1000 nit preset'");
@@ -180,7 +198,7 @@ public:
 
 	ParameterizedACES(ID3D11Device * inDevice) : Tonemapper(inDevice)
 	{
-		shader = CompilePS("ACES/ACES_parameterized.hlsl", "main");
+		WatchPS(&shader, "ACES/ACES_parameterized.hlsl", "main");
 
 		D3D11_BUFFER_DESC desc;
 		ZeroMemory(&desc, sizeof(desc));
@@ -212,6 +230,12 @@ public:
 	static void TW_CALL ApplySDR(void *data);
 	static void TW_CALL ApplyEDRExtreme(void* data);
 
+	void TrackState(FrameState &state) const override
+	{
+		state.TrackConstants(constants);
+		settings.TrackState(state);
+	}
+
 	TwBar* InitUI() override
 	{
 		Apply1000nitHDR(this);
@@ -266,7 +290,7 @@ public:
 
 	LutACES(ID3D11Device * inDevice) : Tonemapper(inDevice), LUTtex(nullptr), LUTsrv(nullptr), LUTsamp(nullptr)
 	{
-		shader = CompilePS("ACES/ACES_lut.hlsl", "main");
+		WatchPS(&shader, "ACES/ACES_lut.hlsl", "main");
 
 		D3D11_BUFFER_DESC desc;
 		ZeroMemory(&desc, sizeof(desc));
@@ -304,6 +328,16 @@ public:
 
 
 
+	void TrackState(FrameState &state) const override
+	{
+		state.TrackConstants(constants);
+		state.Track(current.LUTdimx);
+		state.Track(current.LUTdimy);
+		state.Track(current.LUTdimz);
+		state.Track(current.shaper);
+		current.aces.TrackState(state);
+	}
+
 	TwBar* InitUI() override
 	{
 		TwBar* settings_bar = TwNewBar("LUT_ACES");
@@ -365,7 +399,7 @@ public:
 
 	LDR_ss(ID3D11Device * inDevice) : Tonemapper(inDevice)
 	{
-		shader = CompilePS("ACES/ACES_parameterized.hlsl", "main");
+		WatchPS(&shader, "ACES/ACES_parameterized.hlsl", "main");
 
 		D3D11_BUFFER_DESC desc;
 		ZeroMemory(&desc, sizeof(desc));
@@ -394,6 +428,12 @@ public:
 	void SetupTonemapShader(ID3D11DeviceContext* ctx, ID3D11ShaderResourceView* srcData) override;
 
 
+	void TrackState(FrameState &state) const override
+	{
+		state.TrackConstants(constants);
+		settings.TrackState(state);
+	}
+
 	TwBar* InitUI() override
 	{
 		AcesSettings::ApplySDR(&settings);
@@ -0,0 +1,235 @@
+// Adaptive level selection for luminance response measurements
+
+#include "adaptiveSampler.h"
+
+#include <algorithm>
+#include <cmath>
+
+AdaptiveSampler::AdaptiveSampler(float inMinLevel, float inMaxLevel, const AdaptiveSettings &inSettings) :
+	minLevel(std::min(inMinLevel, inMaxLevel)),
+	maxLevel(std::max(inMinLevel, inMaxLevel)),
+	settings(inSettings)
+{
+}
+
+AdaptiveSampler::AdaptiveSampler(const std::vector<float> &inCandidates, const AdaptiveSettings &inSettings) :
+	minLevel(0.0f),
+	maxLevel(0.0f),
+	candidates(inCandidates),
+	settings(inSettings)
+{
+	std::sort(candidates.begin(), candidates.end());
+	candidates.erase(std::unique(candidates.begin(), candidates.end()), candidates.end());
+
+	if (!candidates.empty())
+	{
+		minLevel = candidates.front();
+		maxLevel = candidates.back();
+	}
+}
+
+std::vector<MeasurementPoint> AdaptiveSampler::Sorted(const std::vector<MeasurementPoint> &measured)
+{
+	std::vector<MeasurementPoint> sorted;
+
+	// a provisional point without readings carries no information
+	for (auto it = measured.begin(); it != measured.end(); it++)
+	{
+		if (it->repeats > 0)
+			sorted.push_back(*it);
+	}
+
+	std::sort(sorted.begin(), sorted.end(), [](const MeasurementPoint &a, const MeasurementPoint &b) { return a.level < b.level; });
+
+	return sorted;
+}
+
+// standard error of the mean of a point
+static double StdErr(const MeasurementPoint &p)
+{
+	return p.repeats > 0 ? p.stddev / sqrt(double(p.repeats)) : 0.0;
+}
+
+// true if b is not significantly brighter than a
+static bool Flat(const MeasurementPoint &a, const MeasurementPoint &b, float tolerance)
+{
+	double ea = StdErr(a);
+	double eb = StdErr(b);
+	return b.luminance - a.luminance <= tolerance * fabs(a.luminance) + 2.0 * sqrt(ea * ea + eb * eb);
+}
+
+int AdaptiveSampler::SaturationIndex(const std::vector<MeasurementPoint> &sorted) const
+{
+	const int n = int(sorted.size());
+	int found = -1;
+
+	// walk down from the top while every point above stays flat relative to j
+	for (int j = n - 2; j >= 1; j--)
+	{
+		bool flat = true;
+		for (int t = j + 1; t < n && flat; t++)
+			flat = Flat(sorted[j], sorted[t], settings.saturationTolerance);
+
+		if (!flat)
+			break;
+
+		if (n - j >= settings.saturationPoints)
+			found = j;
+	}
+
+	// a response that is flat from the first point is crushed blacks, not saturation
+	if (found > 0 && Flat(sorted[0], sorted[found], settings.saturationTolerance))
+		return -1;
+
+	return found;
+}
+
+float AdaptiveSampler::SaturationLevel(const std::vector<MeasurementPoint> &measured) const
+{
+	std::vector<MeasurementPoint> sorted = Sorted(measured);
+	int index = SaturationIndex(sorted);
+
+	return index >= 0 ? sorted[index].level : maxLevel;
+}
+
+double AdaptiveSampler::Curvature(const std::vector<MeasurementPoint> &sorted, size_t i)
+{
+	if (i == 0 || i + 1 >= sorted.size())
+		return -1.0;
+
+	const MeasurementPoint &a = sorted[i - 1];
+	const MeasurementPoint &b = sorted[i];
+	const MeasurementPoint &c = sorted[i + 1];
+
+	double h1 = b.level - a.level;
+	double h2 = c.level - b.level;
+
+	if (h1 <= 0.0 || h2 <= 0.0)
+		return -1.0;
+
+	// second divided difference and its standard error from the repeat spread
+	double k = 2.0 / (h1 + h2);
+	double d2 = k * ((c.luminance - b.luminance) / h2 - (b.luminance - a.luminance) / h1);
+
+	double ea = StdErr(a) / h1;
+	double eb = StdErr(b) * (1.0 / h1 + 1.0 / h2);
+	double ec = StdErr(c) / h2;
+	double sigma = k * sqrt(ea * ea + eb * eb + ec * ec);
+
+	return fabs(d2) + 2.0 * sigma;
+}
+
+bool AdaptiveSampler::Measured(float level, const std::vector<MeasurementPoint> &sorted) const
+{
+	const float eps = 1e-4f * std::max(1.0f, maxLevel - minLevel);
+
+	for (auto it = sorted.begin(); it != sorted.end(); it++)
+	{
+		if (fabs(it->level - level) <= eps)
+			return true;
+	}
+	return false;
+}
+
+bool AdaptiveSampler::Pick(float lo, float hi, float target, const std::vector<MeasurementPoint> &sorted, float *level) const
+{
+	if (candidates.empty())
+	{
+		if (hi - lo < 2.0f * settings.minSpacing)
+			return false;
+
+		*level = target;
+		return true;
+	}
+
+	bool found = false;
+	float best = 0.0f;
+
+	for (auto it = candidates.begin(); it != candidates.end(); it++)
+	{
+		if (*it <= lo || *it >= hi)
+			continue;
+		if (*it - lo < settings.minSpacing || hi - *it < settings.minSpacing)
+			continue;
+		if (Measured(*it, sorted))
+			continue;
+
+		if (!found || fabs(*it - target) < fabs(best - target))
+		{
+			best = *it;
+			found = true;
+		}
+	}
+
+	if (found)
+		*level = best;
+
+	return found;
+}
+
+bool AdaptiveSampler::Next(const std::vector<MeasurementPoint> &measured, float *level) const
+{
+	std::vector<MeasurementPoint> sorted = Sorted(measured);
+
+	if (int(sorted.size()) >= settings.maxPoints || maxLevel < minLevel)
+		return false;
+
+	int saturated = SaturationIndex(sorted);
+	float upper = saturated >= 0 ? sorted[saturated].level : maxLevel;
+
+	// coarse ascending pass, cut short once the top has gone flat
+	const int coarse = std::max(2, settings.initialPoints);
+	for (int i = 0; i < coarse; i++)
+	{
+		float target = minLevel + (maxLevel - minLevel) * i / (coarse - 1);
+
+		if (!candidates.empty())
+		{
+			auto it = std::lower_bound(candidates.begin(), candidates.end(), target);
+			if (it == candidates.end())
+				it--;
+			else if (it != candidates.begin() && target - *(it - 1) < *it - target)
+				it--;
+			target = *it;
+		}
+
+		if (saturated >= 0 && target > upper)
+			break;
+
+		if (!Measured(target, sorted))
+		{
+			*level = target;
+			return true;
+		}
+	}
+
+	// refine the interval with the largest estimated interpolation error
+	double worst = settings.errorTarget;
+	bool found = false;
+
+	for (size_t i = 0; i + 1 < sorted.size(); i++)
+	{
+		const MeasurementPoint &a = sorted[i];
+		const MeasurementPoint &b = sorted[i + 1];
+
+		if (b.level > upper)
+			break;
+
+		double curvature = std::max(Curvature(sorted, i), Curvature(sorted, i + 1));
+		double h = b.level - a.level;
+		double scale = std::max(0.5 * (a.luminance + b.luminance), double(settings.luminanceFloor));
+
+		// nothing known about the shape yet, split anyway
+		double error = curvature < 0.0 ? HUGE_VAL : curvature * h * h / 8.0 / scale;
+
+		float pick;
+		if (error > worst && Pick(a.level, b.level, 0.5f * (a.level + b.level), sorted, &pick))
+		{
+			worst = error;
+			*level = pick;
+			found = true;
+		}
+	}
+
+	return found;
+}
@@ -0,0 +1,75 @@
+// Adaptive level selection for luminance response measurements
+//
+// Instead of sweeping a dense uniform list (hdr_pattern_gen_range.mat), measure
+// a coarse ascending pass, stop it once the response has saturated, then keep
+// splitting the interval where linear interpolation of the curve is least
+// certain until the estimated error is below the target.
+
+#pragma once
+
+#include "measurement.h"
+
+#include <vector>
+
+struct AdaptiveSettings
+{
+	int initialPoints;			// uniformly spaced levels of the coarse pass, including both ends
+	int maxPoints;				// hard limit on the number of levels measured
+	float minSpacing;			// never place two levels closer than this
+	float errorTarget;			// stop when no interval has a larger relative interpolation error
+	float luminanceFloor;		// cd/m^2, relative errors are taken against at least this much
+	float saturationTolerance;	// relative rise below which the response counts as flat
+	int saturationPoints;		// flat points needed at the top before the sweep stops
+
+	AdaptiveSettings() :
+		initialPoints(9),
+		maxPoints(40),
+		minSpacing(0.05f),
+		errorTarget(0.01f),
+		luminanceFloor(0.5f),
+		saturationTolerance(0.01f),
+		saturationPoints(2)
+	{}
+};
+
+/*
+* Picks the next level from the curvature of the response measured so far
+*
+* The interpolation error of an interval is estimated as |f''| h^2 / 8, with the
+* second difference widened by twice its standard error from the repeat spread,
+* so intervals next to noisy readings are refined as well as curved ones.
+*/
+class AdaptiveSampler : public LevelSchedule
+{
+public:
+	// Any level in [minLevel, maxLevel] can be shown
+	AdaptiveSampler(float minLevel, float maxLevel, const AdaptiveSettings &inSettings = AdaptiveSettings());
+
+	// Only the given levels can be shown, e.g. the pattern files on disk
+	AdaptiveSampler(const std::vector<float> &inCandidates, const AdaptiveSettings &inSettings = AdaptiveSettings());
+
+	bool Next(const std::vector<MeasurementPoint> &measured, float *level) const override;
+
+	// Lowest level from which the response is flat up to the highest level measured,
+	// or the top of the range if no saturation has been seen
+	float SaturationLevel(const std::vector<MeasurementPoint> &measured) const;
+
+protected:
+	// Completed points in ascending level order
+	static std::vector<MeasurementPoint> Sorted(const std::vector<MeasurementPoint> &measured);
+
+	int SaturationIndex(const std::vector<MeasurementPoint> &sorted) const;
+
+	// Upper bound on |f''| at an interior point, negative if it has no neighbours
+	static double Curvature(const std::vector<MeasurementPoint> &sorted, size_t i);
+
+	// Showable level closest to target strictly inside (lo, hi), false if none
+	bool Pick(float lo, float hi, float target, const std::vector<MeasurementPoint> &sorted, float *level) const;
+
+	bool Measured(float level, const std::vector<MeasurementPoint> &sorted) const;
+
+	float minLevel;
+	float maxLevel;
+	std::vector<float> candidates;		// sorted, empty when any level is allowed
+	AdaptiveSettings settings;
+};
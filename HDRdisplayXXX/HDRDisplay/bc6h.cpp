@@ -0,0 +1,620 @@
+// CPU BC6H_UF16 encoder for loaded images, with an on disk cache
+
+#include "bc6h.h"
+
+#include "ACES.h"
+#include "taskScheduler.h"
+
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#endif
+
+// Interpolation weights for 4 bit indices, from the BC6H spec
+static const int Weights[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+static const int EndpointBits = 10;
+static const int EndpointMax = (1 << EndpointBits) - 1;
+
+// largest finite half, as bits
+static const int HalfMax = 0x7bff;
+
+static uint16_t FloatToHalf(float f)
+{
+	// unsigned format, NaN and negatives to 0, the rest clamped to the largest half
+	if (!(f > 0.0f))
+		return 0;
+	if (f >= 65504.0f)
+		return HalfMax;
+
+	int e;
+	float m = frexpf(f, &e);	// f = m * 2^e, m in [0.5, 1)
+
+	if (e < -13)
+	{
+		// denormal, 2^-24 steps
+		return uint16_t(lrintf(ldexpf(f, 24)));
+	}
+
+	// 11 significant bits, rounding can carry into the exponent which the bit pattern absorbs
+	int mant = int(lrintf(ldexpf(m, 11)));
+	return uint16_t(std::min(((e + 14) << 10) + mant - 1024, HalfMax));
+}
+
+static float HalfToFloat(uint16_t h)
+{
+	int e = h >> 10 & 31;
+	int m = h & 1023;
+
+	if (e == 0)
+		return ldexpf(float(m), -24);
+
+	return ldexpf(float(m + 1024), e - 25);
+}
+
+// the 10 bit endpoint to the 16 bit value that is interpolated
+static int Unquantize(int q)
+{
+	if (q == 0)
+		return 0;
+	if (q == EndpointMax)
+		return 0xffff;
+	return ((q << 16) + 0x8000) >> EndpointBits;
+}
+
+// interpolated value to half bits
+static int Finish(int v)
+{
+	return (v * 31) >> 6;
+}
+
+// nearest endpoint for a value in the interpolation space
+static int Quantize(float v)
+{
+	int q = int(floorf((v - 32.0f) / 64.0f + 0.5f));
+	return std::min(std::max(q, 0), EndpointMax);
+}
+
+struct Block
+{
+	int pixels[16][3];		// half bits
+};
+
+struct Fit
+{
+	int q[2][3];			// quantized endpoints
+	int index[16];
+	int64_t error;
+};
+
+// Pick the nearest of the 16 palette entries for each pixel, as the decoder will build them
+static void AssignIndices(const Block &block, Fit &fit)
+{
+	int palette[16][3];
+
+	for (int c = 0; c < 3; c++)
+	{
+		int a = Unquantize(fit.q[0][c]);
+		int b = Unquantize(fit.q[1][c]);
+
+		for (int i = 0; i < 16; i++)
+			palette[i][c] = Finish((a * (64 - Weights[i]) + b * Weights[i] + 32) >> 6);
+	}
+
+	fit.error = 0;
+
+	for (int p = 0; p < 16; p++)
+	{
+		int64_t best = INT64_MAX;
+
+		for (int i = 0; i < 16; i++)
+		{
+			int64_t d = 0;
+
+			for (int c = 0; c < 3; c++)
+			{
+				int64_t t = palette[i][c] - block.pixels[p][c];
+				d += t * t;
+			}
+
+			if (d < best)
+			{
+				best = d;
+				fit.index[p] = i;
+			}
+		}
+
+		fit.error += best;
+	}
+}
+
+// Endpoints at the extremes of the principal axis, in the interpolation space
+static void FitPrincipalAxis(const Block &block, float endpoints[2][3])
+{
+	float u[16][3];
+	float mean[3] = { 0.0f, 0.0f, 0.0f };
+
+	for (int p = 0; p < 16; p++)
+	{
+		for (int c = 0; c < 3; c++)
+		{
+			u[p][c] = block.pixels[p][c] * (64.0f / 31.0f);
+			mean[c] += u[p][c] / 16.0f;
+		}
+	}
+
+	float cov[6] = { 0.0f, 0.0f, 0.0f, 0.0f, 0.0f, 0.0f };
+
+	for (int p = 0; p < 16; p++)
+	{
+		float d[3] = { u[p][0] - mean[0], u[p][1] - mean[1], u[p][2] - mean[2] };
+
+		cov[0] += d[0] * d[0];
+		cov[1] += d[0] * d[1];
+		cov[2] += d[0] * d[2];
+		cov[3] += d[1] * d[1];
+		cov[4] += d[1] * d[2];
+		cov[5] += d[2] * d[2];
+	}
+
+	// power iteration from the grey axis, which is where most blocks lean
+	float axis[3] = { 1.0f, 1.0f, 1.0f };
+
+	for (int i = 0; i < 8; i++)
+	{
+		float next[3] =
+		{
+			cov[0] * axis[0] + cov[1] * axis[1] + cov[2] * axis[2],
+			cov[1] * axis[0] + cov[3] * axis[1] + cov[4] * axis[2],
+			cov[2] * axis[0] + cov[4] * axis[1] + cov[5] * axis[2],
+		};
+
+		float len = sqrtf(next[0] * next[0] + next[1] * next[1] + next[2] * next[2]);
+
+		if (len < 1e-6f)
+			break;
+
+		for (int c = 0; c < 3; c++)
+			axis[c] = next[c] / len;
+	}
+
+	float lo = 0.0f, hi = 0.0f;
+
+	for (int p = 0; p < 16; p++)
+	{
+		float t = (u[p][0] - mean[0]) * axis[0] + (u[p][1] - mean[1]) * axis[1] + (u[p][2] - mean[2]) * axis[2];
+		lo = std::min(lo, t);
+		hi = std::max(hi, t);
+	}
+
+	for (int c = 0; c < 3; c++)
+	{
+		endpoints[0][c] = mean[c] + axis[c] * lo;
+		endpoints[1][c] = mean[c] + axis[c] * hi;
+	}
+}
+
+// Least squares endpoints for the current indices, false if they are degenerate
+static bool RefitEndpoints(const Block &block, const Fit &fit, float endpoints[2][3])
+{
+	float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+	float ax[3] = { 0.0f, 0.0f, 0.0f };
+	float bx[3] = { 0.0f, 0.0f, 0.0f };
+
+	for (int p = 0; p < 16; p++)
+	{
+		float w = Weights[fit.index[p]] / 64.0f;
+		float a = 1.0f - w;
+
+		aa += a * a;
+		ab += a * w;
+		bb += w * w;
+
+		for (int c = 0; c < 3; c++)
+		{
+			float u = block.pixels[p][c] * (64.0f / 31.0f);
+			ax[c] += a * u;
+			bx[c] += w * u;
+		}
+	}
+
+	float det = aa * bb - ab * ab;
+
+	if (fabsf(det) < 1e-6f)
+		return false;
+
+	for (int c = 0; c < 3; c++)
+	{
+		endpoints[0][c] = (bb * ax[c] - ab * bx[c]) / det;
+		endpoints[1][c] = (aa * bx[c] - ab * ax[c]) / det;
+	}
+
+	return true;
+}
+
+static void QuantizeEndpoints(const float endpoints[2][3], Fit &fit)
+{
+	for (int e = 0; e < 2; e++)
+		for (int c = 0; c < 3; c++)
+			fit.q[e][c] = Quantize(endpoints[e][c]);
+}
+
+static void EncodeFit(const Block &block, int quality, Fit &best)
+{
+	float endpoints[2][3];
+
+	FitPrincipalAxis(block, endpoints);
+	QuantizeEndpoints(endpoints, best);
+	AssignIndices(block, best);
+
+	if (quality >= 1)
+	{
+		for (int i = 0; i < 2 && best.error > 0; i++)
+		{
+			Fit trial = best;
+
+			if (!RefitEndpoints(block, best, endpoints))
+				break;
+
+			QuantizeEndpoints(endpoints, trial);
+			AssignIndices(block, trial);
+
+			if (trial.error >= best.error)
+				break;
+
+			best = trial;
+		}
+	}
+
+	if (quality >= 2)
+	{
+		static const int steps[4] = { -2, -1, 1, 2 };
+
+		for (int pass = 0; pass < 4 && best.error > 0; pass++)
+		{
+			bool improved = false;
+
+			for (int e = 0; e < 2; e++)
+			{
+				for (int c = 0; c < 3; c++)
+				{
+					for (int s = 0; s < 4; s++)
+					{
+						Fit trial = best;
+						trial.q[e][c] = std::min(std::max(best.q[e][c] + steps[s], 0), EndpointMax);
+						AssignIndices(block, trial);
+
+						if (trial.error < best.error)
+						{
+							best = trial;
+							improved = true;
+						}
+					}
+				}
+			}
+
+			if (!improved)
+				break;
+		}
+	}
+}
+
+// Little endian bit stream over the 128 bit block
+struct BitWriter
+{
+	uint8_t *out;
+	int pos;
+
+	void Write(uint32_t value, int bits)
+	{
+		for (int i = 0; i < bits; i++, pos++)
+		{
+			if (value >> i & 1)
+				out[pos >> 3] |= uint8_t(1 << (pos & 7));
+		}
+	}
+};
+
+struct BitReader
+{
+	const uint8_t *in;
+	int pos;
+
+	uint32_t Read(int bits)
+	{
+		uint32_t value = 0;
+
+		for (int i = 0; i < bits; i++, pos++)
+			value |= uint32_t(in[pos >> 3] >> (pos & 7) & 1) << i;
+
+		return value;
+	}
+};
+
+// mode 11, m[4:0] = 00011, written low bit first
+static const uint32_t Mode11 = 0x03;
+
+static void PackBlock(Fit &fit, uint8_t out[16])
+{
+	// the first index is stored without its top bit, so it has to be below 8
+	if (fit.index[0] >= 8)
+	{
+		for (int c = 0; c < 3; c++)
+			std::swap(fit.q[0][c], fit.q[1][c]);
+		for (int p = 0; p < 16; p++)
+			fit.index[p] = 15 - fit.index[p];
+	}
+
+	memset(out, 0, 16);
+
+	BitWriter writer = { out, 0 };
+
+	writer.Write(Mode11, 5);
+
+	for (int e = 0; e < 2; e++)
+		for (int c = 0; c < 3; c++)
+			writer.Write(fit.q[e][c], EndpointBits);
+
+	writer.Write(fit.index[0], 3);
+
+	for (int p = 1; p < 16; p++)
+		writer.Write(fit.index[p], 4);
+}
+
+void DecodeBC6HBlock(const uint8_t block[16], uint16_t rgb[16][3])
+{
+	BitReader reader = { block, 0 };
+
+	if (reader.Read(5) != Mode11)
+	{
+		memset(rgb, 0, sizeof(uint16_t) * 16 * 3);
+		return;
+	}
+
+	int q[2][3];
+
+	for (int e = 0; e < 2; e++)
+		for (int c = 0; c < 3; c++)
+			q[e][c] = Unquantize(int(reader.Read(EndpointBits)));
+
+	for (int p = 0; p < 16; p++)
+	{
+		int w = Weights[reader.Read(p == 0 ? 3 : 4)];
+
+		for (int c = 0; c < 3; c++)
+			rgb[p][c] = uint16_t(Finish((q[0][c] * (64 - w) + q[1][c] * w + 32) >> 6));
+	}
+}
+
+void EncodeBC6H(const float *rgba, int width, int height, int quality, BC6HImage &image)
+{
+	const int blocksX = width / 4;
+	const int blocksY = height / 4;
+
+	image.width = width;
+	image.height = height;
+	image.quality = quality;
+	image.blocks.assign(size_t(blocksX) * blocksY * 16, 0);
+
+	// a row of blocks at a time, each is independent
+	GetTaskScheduler().ParallelFor(0, blocksY, 1, [&](int first, int last)
+	{
+		for (int by = first; by < last; by++)
+		{
+			for (int bx = 0; bx < blocksX; bx++)
+			{
+				Block block;
+
+				for (int p = 0; p < 16; p++)
+				{
+					const float *src = rgba + (size_t(by * 4 + p / 4) * width + bx * 4 + p % 4) * 4;
+
+					for (int c = 0; c < 3; c++)
+						block.pixels[p][c] = FloatToHalf(src[c]);
+				}
+
+				Fit fit;
+				EncodeFit(block, quality, fit);
+				PackBlock(fit, &image.blocks[(size_t(by) * blocksX + bx) * 16]);
+			}
+		}
+	});
+
+	image.error = MeasureBC6H(rgba, image);
+}
+
+// PQ code values of the BT.2100 LMS for a linear Rec.709 colour, 1.0 = 80 cd/m^2
+static void PQLMS(const float rgb[3], float lms[3])
+{
+	static const float REC709_2_LMS[9] =
+	{
+		// BT.2100 LMS from BT.2020, times the Rec.709 to BT.2020 matrix
+		0.29581f, 0.62309f, 0.08110f,
+		0.15625f, 0.72730f, 0.11645f,
+		0.03514f, 0.15656f, 0.80830f,
+	};
+
+	for (int r = 0; r < 3; r++)
+	{
+		float v = REC709_2_LMS[r * 3 + 0] * rgb[0] + REC709_2_LMS[r * 3 + 1] * rgb[1] + REC709_2_LMS[r * 3 + 2] * rgb[2];
+		lms[r] = pq_r(std::min(std::max(v * 80.0f, 0.0f), 10000.0f));
+	}
+}
+
+BC6HError MeasureBC6H(const float *rgba, const BC6HImage &image)
+{
+	const int blocksX = image.width / 4;
+	const int blocksY = image.height / 4;
+
+	double squared = 0.0;
+	double sumDeltaE = 0.0;
+	double maxDeltaE = 0.0;
+
+	for (int by = 0; by < blocksY; by++)
+	{
+		for (int bx = 0; bx < blocksX; bx++)
+		{
+			uint16_t decoded[16][3];
+			DecodeBC6HBlock(&image.blocks[(size_t(by) * blocksX + bx) * 16], decoded);
+
+			for (int p = 0; p < 16; p++)
+			{
+				const float *src = rgba + (size_t(by * 4 + p / 4) * image.width + bx * 4 + p % 4) * 4;
+
+				// against what the format could hold at best, so clamping isn't counted
+				float ref[3], got[3];
+
+				for (int c = 0; c < 3; c++)
+				{
+					ref[c] = HalfToFloat(FloatToHalf(src[c]));
+					got[c] = HalfToFloat(decoded[p][c]);
+				}
+
+				float a[3], b[3];
+				PQLMS(ref, a);
+				PQLMS(got, b);
+
+				// PSNR over the PQ coded L'M'S'
+				for (int c = 0; c < 3; c++)
+					squared += double(a[c] - b[c]) * (a[c] - b[c]);
+
+				// ICtCp from L'M'S', Delta E ITP weights T at half of Ct
+				float dI = 0.5f * (a[0] - b[0]) + 0.5f * (a[1] - b[1]);
+				float dT = 0.5f * (6610.0f * (a[0] - b[0]) - 13613.0f * (a[1] - b[1]) + 7003.0f * (a[2] - b[2])) / 4096.0f;
+				float dP = (17933.0f * (a[0] - b[0]) - 17390.0f * (a[1] - b[1]) - 543.0f * (a[2] - b[2])) / 4096.0f;
+
+				double deltaE = 720.0 * sqrt(double(dI) * dI + double(dT) * dT + double(dP) * dP);
+
+				sumDeltaE += deltaE;
+				maxDeltaE = std::max(maxDeltaE, deltaE);
+			}
+		}
+	}
+
+	const double samples = double(blocksX) * blocksY * 16;
+
+	BC6HError error;
+	error.meanDeltaE = samples > 0.0 ? sumDeltaE / samples : 0.0;
+	error.maxDeltaE = maxDeltaE;
+	error.psnr = squared > 0.0 ? 10.0 * log10(samples * 3.0 / squared) : 99.0;
+
+	return error;
+}
+
+// cache file layout, followed by the blocks
+struct CacheHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint32_t width, height;
+	uint32_t quality;
+	uint32_t pad;
+	uint64_t sourceSize;
+	uint64_t sourceTime;
+	BC6HError error;
+};
+
+static const uint32_t CacheVersion = 2;
+
+static bool SourceStamp(const std::string &source, uint64_t &size, uint64_t &time)
+{
+	// st_mtime is whole seconds, a same size save within the second would be missed
+#ifdef _WIN32
+	WIN32_FILE_ATTRIBUTE_DATA data;
+
+	if (!GetFileAttributesExA(source.c_str(), GetFileExInfoStandard, &data))
+		return false;
+
+	size = uint64_t(data.nFileSizeHigh) << 32 | data.nFileSizeLow;
+	time = uint64_t(data.ftLastWriteTime.dwHighDateTime) << 32 | data.ftLastWriteTime.dwLowDateTime;
+#else
+	struct stat info;
+
+	if (stat(source.c_str(), &info) != 0)
+		return false;
+
+	size = uint64_t(info.st_size);
+#ifdef __APPLE__
+	time = uint64_t(info.st_mtimespec.tv_sec) * 1000000000 + uint64_t(info.st_mtimespec.tv_nsec);
+#else
+	time = uint64_t(info.st_mtim.tv_sec) * 1000000000 + uint64_t(info.st_mtim.tv_nsec);
+#endif
+#endif
+
+	return true;
+}
+
+bool ReadBC6HCache(const std::string &source, int quality, BC6HImage &image)
+{
+	uint64_t size, time;
+
+	if (!SourceStamp(source, size, time))
+		return false;
+
+	FILE *fp = fopen((source + ".bc6h").c_str(), "rb");
+
+	if (!fp)
+		return false;
+
+	CacheHeader header;
+	bool ok = fread(&header, sizeof(header), 1, fp) == 1
+		&& !memcmp(header.magic, "BC6H", 4)
+		&& header.version == CacheVersion
+		&& header.quality == uint32_t(quality)
+		&& header.sourceSize == size
+		&& header.sourceTime == time
+		&& header.width % 4 == 0 && header.height % 4 == 0;
+
+	if (ok)
+	{
+		image.width = int(header.width);
+		image.height = int(header.height);
+		image.quality = quality;
+		image.error = header.error;
+		image.blocks.resize(size_t(header.width / 4) * (header.height / 4) * 16);
+
+		ok = fread(image.blocks.data(), 1, image.blocks.size(), fp) == image.blocks.size();
+	}
+
+	fclose(fp);
+	return ok;
+}
+
+bool WriteBC6HCache(const std::string &source, const BC6HImage &image)
+{
+	CacheHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, "BC6H", 4);
+	header.version = CacheVersion;
+	header.width = uint32_t(image.width);
+	header.height = uint32_t(image.height);
+	header.quality = uint32_t(image.quality);
+	header.error = image.error;
+
+	if (!SourceStamp(source, header.sourceSize, header.sourceTime))
+		return false;
+
+	FILE *fp = fopen((source + ".bc6h").c_str(), "wb");
+
+	if (!fp)
+		return false;
+
+	bool ok = fwrite(&header, sizeof(header), 1, fp) == 1
+		&& fwrite(image.blocks.data(), 1, image.blocks.size(), fp) == image.blocks.size();
+
+	// a short write must not look like a valid cache next time
+	if (fclose(fp) != 0 || !ok)
+	{
+		remove((source + ".bc6h").c_str());
+		return false;
+	}
+
+	return true;
+}
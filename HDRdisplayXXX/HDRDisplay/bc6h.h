@@ -0,0 +1,50 @@
+// CPU BC6H_UF16 encoder for loaded images, with an on disk cache
+//
+// Blocks are encoded in parallel as BC6H mode 11, one subset with 10 bit
+// endpoints and 4 bit indices, fitted in the half float bit pattern space
+// the format interpolates in. quality trades time for error:
+//   0  endpoints at the extremes of the block's principal axis
+//   1  plus least squares refits of the endpoints to the chosen indices
+//   2  plus a search of each endpoint channel a few steps either way
+// Negative values clamp to 0 as the format is unsigned.
+//
+// The result is compared against the source as PSNR of its PQ coded LMS
+// (1.0 = 80 cd/m^2, as BT.2100) and as Delta E ITP (BT.2124), where 1 is about a
+// just noticeable difference. The cache goes next to the source as
+// name.bc6h and is tied to its size, time and the quality. Portable, no D3D.
+
+#pragma once
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+static const int BC6HMaxQuality = 2;
+
+struct BC6HError
+{
+	double psnr;			// dB over PQ code values
+	double meanDeltaE;		// Delta E ITP
+	double maxDeltaE;
+};
+
+struct BC6HImage
+{
+	int width, height;		// multiples of 4
+	int quality;
+	BC6HError error;
+	std::vector<uint8_t> blocks;	// 16 bytes per 4x4 block, rows of blocks top down
+};
+
+// rgba is width x height float RGBA, alpha ignored. Rows of blocks are shared
+// out over the task scheduler. Also fills in image.error.
+void EncodeBC6H(const float *rgba, int width, int height, int quality, BC6HImage &image);
+
+// Half float bits of a block written by EncodeBC6H, other modes decode black
+void DecodeBC6HBlock(const uint8_t block[16], uint16_t rgb[16][3]);
+
+BC6HError MeasureBC6H(const float *rgba, const BC6HImage &image);
+
+// source's cache, false if missing or stale for source or quality
+bool ReadBC6HCache(const std::string &source, int quality, BC6HImage &image);
+bool WriteBC6HCache(const std::string &source, const BC6HImage &image);
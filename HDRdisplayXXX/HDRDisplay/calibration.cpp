@@ -0,0 +1,227 @@
+// Display calibration from a measured luminance response
+
+#include "calibration.h"
+#include "ACES.h"
+#include "measurement.h"
+#include "gsdf.h"
+#include "perftracker_cpu.h"
+#include "mappedFile.h"
+#include "rgbeReader.h"
+#include "rgbe.h"
+
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+// scRGB reference white
+static const float scRGBWhite = 80.0f;
+
+bool DisplayResponse::Set(const std::vector<float> &inLevels, const std::vector<float> &inLuminance)
+{
+	levels.clear();
+	luminance.clear();
+
+	size_t count = std::min(inLevels.size(), inLuminance.size());
+	for (size_t i = 0; i < count; i++)
+	{
+		if (!luminance.empty() && inLuminance[i] <= luminance.back())
+			break;
+
+		levels.push_back(inLevels[i]);
+		luminance.push_back(inLuminance[i]);
+	}
+
+	if (luminance.size() < 2 || luminance.front() <= 0.0f)
+	{
+		fprintf(stderr, "DisplayResponse: need at least two increasing, positive luminance values\n");
+		levels.clear();
+		luminance.clear();
+		return false;
+	}
+
+	return true;
+}
+
+bool DisplayResponse::Load(const char *path)
+{
+	std::vector<float> inLevels, inLuminance;
+
+	if (!ReadLuminanceTable(path, inLevels, inLuminance))
+	{
+		fprintf(stderr, "DisplayResponse: unable to read %s\n", path);
+		return false;
+	}
+
+	return Set(inLevels, inLuminance);
+}
+
+float DisplayResponse::Level(double L) const
+{
+	if (!Valid())
+		return 0.0f;
+
+	L = std::min(std::max(L, double(luminance.front())), double(luminance.back()));
+
+	size_t hi = std::upper_bound(luminance.begin(), luminance.end(), float(L)) - luminance.begin();
+	hi = std::min(std::max(hi, size_t(1)), luminance.size() - 1);
+	size_t lo = hi - 1;
+
+	double t = (L - luminance[lo]) / (luminance[hi] - luminance[lo]);
+	return float(levels[lo] + t * (levels[hi] - levels[lo]));
+}
+
+CalibrationLUT::CalibrationLUT()
+{
+}
+
+bool CalibrationLUT::Build(const DisplayResponse &response, const CalibrationSettings &inSettings)
+{
+	PERF_CPU_SCOPED("CPU > Calibration LUT");
+
+	table.clear();
+	settings = inSettings;
+
+	if (!response.Valid())
+		return false;
+
+	const double minL = response.MinLuminance();
+	const double maxL = response.MaxLuminance();
+
+	std::vector<float> target(Size);
+
+	switch (settings.target)
+	{
+	case CalibrationGSDF:
+	{
+		double jMin = GSDFIndexFast(minL);
+		double jMax = GSDFIndexFast(maxL);
+
+		for (int i = 0; i < Size; i++)
+			target[i] = float(jMin + (jMax - jMin) * i / (Size - 1));
+
+		GSDFLuminanceFast(target.data(), target.data(), Size);
+		break;
+	}
+	case CalibrationGamma:
+		for (int i = 0; i < Size; i++)
+			target[i] = float(minL + (maxL - minL) * pow(double(i) / (Size - 1), double(settings.gamma)));
+		break;
+	case CalibrationPQ:
+		for (int i = 0; i < Size; i++)
+			target[i] = pq_f(float(i) / (Size - 1));
+		break;
+	default:
+		return false;
+	}
+
+	// the measured response is monotone, so the LUT is too
+	table.resize(Size);
+	for (int i = 0; i < Size; i++)
+		table[i] = response.Level(target[i]);
+
+	return true;
+}
+
+float CalibrationLUT::Coordinate(float signal) const
+{
+	float u;
+
+	if (settings.target == CalibrationPQ)
+		u = pq_r(std::max(signal, 0.0f) * scRGBWhite);	// the ACES.h curve does not clamp
+	else
+		u = settings.inputWhite > 0.0f ? signal / settings.inputWhite : 0.0f;
+
+	return std::min(std::max(u, 0.0f), 1.0f);
+}
+
+float CalibrationLUT::Apply(float signal) const
+{
+	if (table.empty())
+		return signal;
+
+	float x = Coordinate(signal) * (Size - 1);
+	int i = std::min(int(x), Size - 2);
+	float f = x - i;
+
+	return table[i] + f * (table[i + 1] - table[i]);
+}
+
+void CalibrationLUT::Apply(float *pixels, size_t pixelCount, int channels) const
+{
+	const int colors = std::min(channels, 3);
+
+	for (size_t i = 0; i < pixelCount; i++)
+	{
+		for (int c = 0; c < colors; c++)
+			pixels[i * channels + c] = Apply(pixels[i * channels + c]);
+	}
+}
+
+bool CalibrationLUT::ConvertFile(const char *inPath, const char *outPath) const
+{
+	MappedFile file;
+
+	if (!file.Open(inPath))
+	{
+		fprintf(stderr, "%s: unable to open\n", inPath);
+		return false;
+	}
+
+	// batches run unattended, so a malformed file has to fail rather than run past its data
+	RGBEReader reader(file.Data(), file.Size());
+	int width = 0, height = 0;
+	std::vector<float> pixels;
+	bool ok = reader.ReadHeader(width, height);
+
+	if (ok)
+	{
+		pixels.resize(size_t(width) * height * 3);
+		ok = reader.ReadImage(pixels.data());
+	}
+	file.Close();
+
+	if (!ok)
+	{
+		fprintf(stderr, "%s: unable to read\n", inPath);
+		return false;
+	}
+
+	Apply(pixels.data(), size_t(width) * height, 3);
+
+	FILE *fp = fopen(outPath, "wb");
+	if (!fp)
+	{
+		fprintf(stderr, "%s: unable to create\n", outPath);
+		return false;
+	}
+
+	ok = RGBE_WriteHeader(fp, width, height, nullptr) == RGBE_RETURN_SUCCESS &&
+		RGBE_WritePixels_RLE(fp, pixels.data(), width, height) == RGBE_RETURN_SUCCESS;
+	fclose(fp);
+
+	if (!ok)
+		fprintf(stderr, "%s: write failed\n", outPath);
+
+	return ok;
+}
+
+static const char *targetNames[CalibrationTargetCount] = { "gsdf", "gamma", "pq" };
+
+const char *CalibrationTargetName(CalibrationTarget target)
+{
+	return target >= 0 && target < CalibrationTargetCount ? targetNames[target] : "";
+}
+
+bool CalibrationTargetFromName(const char *name, CalibrationTarget *target)
+{
+	for (int i = 0; i < CalibrationTargetCount; i++)
+	{
+		if (!strcmp(name, targetNames[i]))
+		{
+			*target = CalibrationTarget(i);
+			return true;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,110 @@
+// Display calibration from a measured luminance response
+//
+// A measured table (input level -> cd/m^2, as written by -measure) is inverted
+// into a 1D LUT that takes the signal the viewer wants to show to the level
+// that makes this display produce the target luminance. The same LUT drives
+// the final shader pass and the CPU export path.
+
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+/*
+* Measured input level to luminance response of a display
+*/
+class DisplayResponse
+{
+public:
+	DisplayResponse() {}
+
+	// Keeps the rising part of the table, the response is cut where the luminance
+	// stops increasing (saturation), so the inverse is unique
+	bool Set(const std::vector<float> &inLevels, const std::vector<float> &inLuminance);
+
+	// Read with ReadLuminanceTable, then Set
+	bool Load(const char *path);
+
+	// Input level producing L, linear between measurements, clamped to the measured range
+	float Level(double L) const;
+
+	float MinLuminance() const { return luminance.empty() ? 0.0f : luminance.front(); }
+	float MaxLuminance() const { return luminance.empty() ? 0.0f : luminance.back(); }
+
+	bool Valid() const { return luminance.size() >= 2; }
+
+protected:
+	std::vector<float> levels;
+	std::vector<float> luminance;
+};
+
+enum CalibrationTarget
+{
+	CalibrationGSDF = 0,	// equal JND steps between the display black and white
+	CalibrationGamma,		// power law between the display black and white
+	CalibrationPQ,			// absolute luminance, scRGB 1.0 = 80 cd/m^2, clipped to the display range
+
+	CalibrationTargetCount
+};
+
+struct CalibrationSettings
+{
+	CalibrationTarget target;
+	float gamma;		// for CalibrationGamma
+	float inputWhite;	// input signal mapped to the display white for the relative targets
+
+	CalibrationSettings() :
+		target(CalibrationGSDF),
+		gamma(2.2f),
+		inputWhite(1.0f)
+	{}
+
+	bool operator==(const CalibrationSettings &o) const
+	{
+		return target == o.target && gamma == o.gamma && inputWhite == o.inputWhite;
+	}
+	bool operator!=(const CalibrationSettings &o) const { return !(*this == o); }
+};
+
+/*
+* Signal to display level LUT
+*
+* The LUT is indexed by u in [0,1], entry i at u = i / (Size - 1). For the
+* relative targets u = signal / inputWhite, for PQ u is the ST 2084 code of
+* the signal, which spaces the entries evenly in perceived brightness.
+*/
+class CalibrationLUT
+{
+public:
+	static const int Size = 4096;
+
+	CalibrationLUT();
+
+	bool Build(const DisplayResponse &response, const CalibrationSettings &inSettings);
+
+	const CalibrationSettings &Settings() const { return settings; }
+	const float *Table() const { return table.data(); }
+	bool Valid() const { return !table.empty(); }
+
+	// LUT coordinate for an input signal
+	float Coordinate(float signal) const;
+
+	// CPU equivalent of calibrate.hlsl
+	float Apply(float signal) const;
+
+	// In place on interleaved pixels, the first three channels of each pixel are calibrated
+	void Apply(float *pixels, size_t pixelCount, int channels) const;
+
+	// Calibrate an .hdr image for offline use
+	bool ConvertFile(const char *inPath, const char *outPath) const;
+
+protected:
+	std::vector<float> table;
+	CalibrationSettings settings;
+};
+
+// Name of a target as used on the command line and in exported file names
+const char *CalibrationTargetName(CalibrationTarget target);
+
+// Parse a target name, false if unknown
+bool CalibrationTargetFromName(const char *name, CalibrationTarget *target);
@@ -0,0 +1,187 @@
+// Final display calibration pass
+//
+// Applies a CalibrationLUT to the composited image on its way to the back
+// buffer. The measured table must have been taken with the same output mode
+// the viewer is run in (scRGB with the linear tonemapper for the .hdr patterns).
+
+#pragma once
+
+#include "tonemapper.h"
+#include "calibration.h"
+
+class CalibrationPass : public Tonemapper
+{
+protected:
+	ID3D11PixelShader *shader;
+	ID3D11Buffer *cb;
+	ID3D11Texture1D *LUTtex;
+	ID3D11ShaderResourceView *LUTsrv;
+
+	struct Constants
+	{
+		unsigned int target;
+		float inputWhite;
+		unsigned int lutSize;
+		float pad;
+	};
+
+	struct Settings
+	{
+		bool enabled;
+		CalibrationSettings calibration;
+	};
+
+	Settings active;
+	Settings current;
+	bool lutValid;
+
+	DisplayResponse response;
+	CalibrationLUT lut;
+
+	void UpdateLUT()
+	{
+		SAFE_RELEASE(LUTtex);
+		SAFE_RELEASE(LUTsrv);
+
+		active = current;
+		lutValid = lut.Build(response, current.calibration);
+
+		if (!lutValid)
+			return;
+
+		D3D11_TEXTURE1D_DESC desc;
+		ZeroMemory(&desc, sizeof(desc));
+		desc.Width = CalibrationLUT::Size;
+		desc.MipLevels = 1;
+		desc.ArraySize = 1;
+		desc.Format = DXGI_FORMAT_R32_FLOAT;
+		desc.Usage = D3D11_USAGE_IMMUTABLE;
+		desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+		D3D11_SUBRESOURCE_DATA data;
+		data.pSysMem = lut.Table();
+		data.SysMemPitch = CalibrationLUT::Size * sizeof(float);
+		data.SysMemSlicePitch = 0;
+
+		HRESULT hr = device->CreateTexture1D(&desc, &data, &LUTtex);
+		if (SUCCEEDED(hr))
+		{
+			hr = device->CreateShaderResourceView(LUTtex, nullptr, &LUTsrv);
+		}
+		lutValid = SUCCEEDED(hr);
+	}
+
+public:
+
+	CalibrationPass(ID3D11Device * inDevice) : Tonemapper(inDevice), LUTtex(nullptr), LUTsrv(nullptr), lutValid(false)
+	{
+		WatchPS(&shader, "calibrate.hlsl", "main");
+
+		D3D11_BUFFER_DESC desc;
+		ZeroMemory(&desc, sizeof(desc));
+
+		desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+		desc.ByteWidth = sizeof(Constants);
+		desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+		desc.MiscFlags = 0;
+		desc.StructureByteStride = 0;
+		desc.Usage = D3D11_USAGE_DYNAMIC;
+
+		device->CreateBuffer(&desc, nullptr, &cb);
+
+		current.enabled = false;
+		active = current;
+	}
+
+	~CalibrationPass()
+	{
+		SAFE_RELEASE(shader);
+		SAFE_RELEASE(cb);
+		SAFE_RELEASE(LUTtex);
+		SAFE_RELEASE(LUTsrv);
+	}
+
+	// Load a measured input level to luminance table, enables the pass
+	bool Load(const char *path, const CalibrationSettings &settings)
+	{
+		if (!response.Load(path))
+			return false;
+
+		current.calibration = settings;
+		current.enabled = true;
+		UpdateLUT();
+
+		return lutValid;
+	}
+
+	// True if the composite has to go through this pass, rebuilds the LUT after UI changes
+	bool Active()
+	{
+		if (!current.enabled || !response.Valid())
+			return false;
+
+		if (active.calibration != current.calibration)
+		{
+			UpdateLUT();
+		}
+
+		return lutValid;
+	}
+
+	void SetupTonemapShader(ID3D11DeviceContext* ctx, ID3D11ShaderResourceView* srcData) override
+	{
+		Constants constants;
+		constants.target = current.calibration.target;
+		constants.inputWhite = current.calibration.inputWhite;
+		constants.lutSize = CalibrationLUT::Size;
+		constants.pad = 0.0f;
+
+		D3D11_MAPPED_SUBRESOURCE mapObj;
+		ctx->Map(cb, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapObj);
+		memcpy(mapObj.pData, &constants, sizeof(constants));
+		ctx->Unmap(cb, 0);
+
+		ID3D11ShaderResourceView *srvs[2] = { srcData, LUTsrv };
+
+		ctx->PSSetConstantBuffers(0, 1, &cb);
+		ctx->PSSetShader(shader, nullptr, 0);
+		ctx->PSSetShaderResources(0, 2, srvs);
+	}
+
+	void TrackState(FrameState &state) const override
+	{
+		state.Track(current.enabled);
+		state.Track(current.calibration.target);
+		state.Track(current.calibration.gamma);
+		state.Track(current.calibration.inputWhite);
+	}
+
+	TwBar* InitUI() override
+	{
+		TwBar* settings_bar = TwNewBar("Calibration");
+		TwDefine("Calibration " TONEMAPPER_UI_SETTINGS);
+		TwDefine("Calibration iconified=true ");
+
+		TwAddVarRW(settings_bar, "Enabled", TW_TYPE_BOOLCPP, &current.enabled, "");
+
+		{
+			TwEnumVal enumModeTypeEV[] = {
+					{ CalibrationGSDF, "DICOM GSDF" },
+					{ CalibrationGamma, "Gamma" },
+					{ CalibrationPQ, "PQ (absolute)" }
+			};
+			TwType enumModeType = TwDefineEnum("CalibrationTarget", enumModeTypeEV, sizeof(enumModeTypeEV) / sizeof(enumModeTypeEV[0]));
+			TwAddVarRW(settings_bar, "Target", enumModeType, &current.calibration.target, "");
+		}
+
+		TwAddVarRW(settings_bar, "Gamma", TW_TYPE_FLOAT, &current.calibration.gamma, "min=1.0 max=3.0 step=0.05 precision=2");
+		TwAddVarRW(settings_bar, "Input white", TW_TYPE_FLOAT, &current.calibration.inputWhite, "min=0.01 step=0.1 precision=2");
+
+		return settings_bar;
+	}
+
+	const CalibrationLUT &LUT() const
+	{
+		return lut;
+	}
+};
@@ -55,7 +55,7 @@ public:
 
 	Compositor(ID3D11Device * inDevice) : Tonemapper(inDevice)
 	{
-		shader = CompilePS("composite.hlsl", "main");
+		WatchPS(&shader, "composite.hlsl", "main");
 
 		D3D11_BUFFER_DESC desc;
 		ZeroMemory(&desc, sizeof(desc));
@@ -123,6 +123,49 @@ public:
 
 
 
+	// Fullscreen shows one image with a fade, which the fused kernels apply themselves
+	bool Fusable() const { return constants.mode == 0; }
+
+	// 0 HDR, 1 LDR, 2 Original, the image a fullscreen composite shows
+	unsigned int Image() const { return constants.texA; }
+
+	// Bind the constants where fused.hlsl reads the fade
+	void SetupFusedFade(ID3D11DeviceContext* ctx)
+	{
+		D3D11_MAPPED_SUBRESOURCE mapObj;
+		ctx->Map(cb, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapObj);
+		memcpy(mapObj.pData, &constants, sizeof(constants));
+		ctx->Unmap(cb, 0);
+
+		ctx->PSSetConstantBuffers(5, 1, &cb);
+	}
+
+	bool Reference(const float in[3], float out[3]) const override
+	{
+		if (!Fusable())
+			return false;
+
+		for (int c = 0; c < 3; c++)
+			out[c] = in[c];
+
+		ReferenceFade(constants.fade, out);
+		return true;
+	}
+
+	void TrackState(FrameState &state) const override
+	{
+		Constants tracked = constants;
+
+		// the scroll offset advances every frame but only shows in scrolling mode
+		if (tracked.mode != 3)
+		{
+			tracked.scroll[0] = 0.0f;
+			tracked.scroll[1] = 0.0f;
+		}
+
+		state.TrackConstants(tracked);
+	}
+
 	TwBar* InitUI() override
 	{
 		TwBar* settings_bar = TwNewBar("Composite");
@@ -0,0 +1,223 @@
+// Konica Minolta CS-2000/CS-2000A driver over RS-232
+
+#include "cs2000.h"
+
+#define NOMINMAX
+#include <windows.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// replies to anything but a measurement come back well within this
+static const double replyTimeout = 5.0;
+
+CS2000::CS2000(const char *portName) :
+	port(portName),
+	handle(INVALID_HANDLE_VALUE),
+	measureDeadline(0.0),
+	busy(false)
+{
+}
+
+CS2000::~CS2000()
+{
+	Close();
+}
+
+bool CS2000::Open()
+{
+	if (handle != INVALID_HANDLE_VALUE)
+		return true;
+
+	// the \\.\ prefix is needed for COM10 and above
+	std::string path = "\\\\.\\" + port;
+
+	handle = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_EXISTING, 0, nullptr);
+
+	if (handle == INVALID_HANDLE_VALUE)
+	{
+		fprintf(stderr, "CS2000: unable to open %s\n", port.c_str());
+		return false;
+	}
+
+	DCB dcb;
+	ZeroMemory(&dcb, sizeof(dcb));
+	dcb.DCBlength = sizeof(dcb);
+	GetCommState(handle, &dcb);
+
+	dcb.BaudRate = CBR_38400;
+	dcb.ByteSize = 8;
+	dcb.StopBits = ONESTOPBIT;
+	dcb.Parity = NOPARITY;
+	dcb.fBinary = TRUE;
+	dcb.fOutxCtsFlow = FALSE;
+	dcb.fOutxDsrFlow = FALSE;
+	dcb.fDtrControl = DTR_CONTROL_ENABLE;
+	dcb.fRtsControl = RTS_CONTROL_DISABLE;
+	dcb.fOutX = FALSE;
+	dcb.fInX = FALSE;
+
+	// short read timeouts, Get() loops until its own deadline
+	COMMTIMEOUTS timeouts;
+	ZeroMemory(&timeouts, sizeof(timeouts));
+	timeouts.ReadIntervalTimeout = 50;
+	timeouts.ReadTotalTimeoutConstant = 100;
+	timeouts.WriteTotalTimeoutConstant = 1000;
+
+	if (!SetCommState(handle, &dcb) || !SetCommTimeouts(handle, &timeouts))
+	{
+		fprintf(stderr, "CS2000: unable to configure %s\n", port.c_str());
+		CloseHandle(handle);
+		handle = INVALID_HANDLE_VALUE;
+		return false;
+	}
+
+	PurgeComm(handle, PURGE_RXCLEAR | PURGE_TXCLEAR);
+
+	// enter remote mode
+	std::string reply;
+	if (!Command("RMTS,1", reply, replyTimeout))
+	{
+		Close();
+		return false;
+	}
+
+	busy = false;
+	return true;
+}
+
+void CS2000::Close()
+{
+	if (handle == INVALID_HANDLE_VALUE)
+		return;
+
+	// leave remote mode, ignore the reply
+	std::string reply;
+	if (Send("RMTS,0"))
+		Get(reply, replyTimeout);
+
+	CloseHandle(handle);
+	handle = INVALID_HANDLE_VALUE;
+}
+
+bool CS2000::Send(const char *command)
+{
+	std::string line = std::string(command) + "\r";
+	DWORD written = 0;
+
+	if (!WriteFile(handle, line.c_str(), DWORD(line.size()), &written, nullptr))
+		return false;
+
+	return written == line.size();
+}
+
+bool CS2000::Get(std::string &reply, double timeout)
+{
+	reply.clear();
+	double deadline = MeasurementClock() + timeout;
+
+	while (MeasurementClock() < deadline)
+	{
+		char c;
+		DWORD count = 0;
+
+		if (!ReadFile(handle, &c, 1, &count, nullptr))
+			return false;
+
+		if (count == 0)
+			continue;
+
+		if (c == '\r')
+			return true;
+
+		// some firmware sends CRLF
+		if (c != '\n')
+			reply.push_back(c);
+	}
+
+	fprintf(stderr, "CS2000: timeout waiting for reply\n");
+	return false;
+}
+
+bool CS2000::Command(const char *command, std::string &reply, double timeout)
+{
+	if (!Send(command) || !Get(reply, timeout))
+		return false;
+
+	if (reply.compare(0, 4, "OK00") != 0)
+	{
+		fprintf(stderr, "CS2000: %s returned %s\n", command, reply.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+bool CS2000::BeginMeasurement(double *integrationSeconds)
+{
+	if (handle == INVALID_HANDLE_VALUE || busy)
+		return false;
+
+	// pre-measurement reply is "OK00,<seconds>"
+	std::string reply;
+	if (!Command("MEAS,1", reply, replyTimeout))
+		return false;
+
+	double seconds = reply.size() > 5 ? atof(reply.c_str() + 5) : 0.0;
+
+	measureDeadline = MeasurementClock() + seconds;
+	busy = true;
+
+	if (integrationSeconds)
+		*integrationSeconds = seconds;
+
+	return true;
+}
+
+bool CS2000::WaitMeasurement()
+{
+	if (!busy)
+		return false;
+
+	busy = false;
+
+	// second reply arrives when the integration is done
+	std::string reply;
+	double timeout = measureDeadline - MeasurementClock() + replyTimeout;
+
+	if (!Get(reply, timeout))
+		return false;
+
+	if (reply.compare(0, 4, "OK00") != 0)
+	{
+		fprintf(stderr, "CS2000: measurement returned %s\n", reply.c_str());
+		return false;
+	}
+
+	return true;
+}
+
+bool CS2000::ReadResult(MeasurementSample &result)
+{
+	if (handle == INVALID_HANDLE_VALUE || busy)
+		return false;
+
+	// colorimetric data, reply is "OK00,x,y,Y"
+	std::string reply;
+	if (!Command("MEDR,2,0,02", reply, replyTimeout))
+		return false;
+
+	float x, y, Y;
+	if (sscanf(reply.c_str(), "OK00,%f,%f,%f", &x, &y, &Y) != 3)
+	{
+		fprintf(stderr, "CS2000: unable to parse %s\n", reply.c_str());
+		return false;
+	}
+
+	result.Y = Y;
+	result.x = x;
+	result.y = y;
+
+	return true;
+}
@@ -0,0 +1,41 @@
+// Konica Minolta CS-2000/CS-2000A driver over RS-232
+//
+// Same protocol as cs2000Class.m / rs232ClassCS2000.m: 38400 8N1, no flow
+// control, commands and replies terminated by a carriage return.
+
+#pragma once
+
+#include <string>
+
+#include "measurement.h"
+
+class CS2000 : public Instrument
+{
+public:
+	// portName as in the MATLAB scripts, e.g. "COM7"
+	CS2000(const char *portName);
+	~CS2000();
+
+	bool Open() override;
+	void Close() override;
+
+	bool BeginMeasurement(double *integrationSeconds) override;
+	bool WaitMeasurement() override;
+	bool ReadResult(MeasurementSample &result) override;
+
+protected:
+	// send a string followed by CR
+	bool Send(const char *command);
+
+	// receive up to the next CR, giving up after timeout seconds
+	bool Get(std::string &reply, double timeout);
+
+	// send a command and check the reply starts with OK00
+	bool Command(const char *command, std::string &reply, double timeout);
+
+	std::string port;
+	void *handle;		// HANDLE of the open port, INVALID_HANDLE_VALUE when closed
+
+	double measureDeadline;
+	bool busy;
+};
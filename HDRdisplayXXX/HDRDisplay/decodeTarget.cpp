@@ -0,0 +1,91 @@
+// Destination of an image decode
+
+#include "decodeTarget.h"
+
+#include "ACES.h"
+#include "rgbeReader.h"
+
+#include <algorithm>
+#include <string.h>
+#include <vector>
+
+// scanlines decoded at a time, the scratch stays in cache while it is stored
+static const int DecodeBand = 16;
+
+size_t DecodeBytesPerPixel(DecodeFormat format)
+{
+	return format == DecodeRGBA16F ? 8 : 16;
+}
+
+DecodeTarget PackedTarget(void *buffer, int width, int height, DecodeFormat format)
+{
+	DecodeTarget target = { buffer, size_t(width) * DecodeBytesPerPixel(format), width, height, format };
+	return target;
+}
+
+// Stores rows of RGB floats, alpha 1, at row y of target onwards
+static void StoreRGBRows(const float *rgb, int y, int rows, const DecodeTarget &target)
+{
+	for (int row = 0; row < rows; row++)
+	{
+		const float *src = rgb + size_t(row) * target.width * 3;
+
+		if (target.format == DecodeRGBA16F)
+		{
+			uint16_t *dst = reinterpret_cast<uint16_t*>(target.Row(y + row));
+
+			for (int x = 0; x < target.width; x++)
+			{
+				dst[x * 4 + 0] = float2half(src[x * 3 + 0]);
+				dst[x * 4 + 1] = float2half(src[x * 3 + 1]);
+				dst[x * 4 + 2] = float2half(src[x * 3 + 2]);
+				dst[x * 4 + 3] = 0x3c00;	// 1.0
+			}
+		}
+		else
+		{
+			float *dst = reinterpret_cast<float*>(target.Row(y + row));
+
+			for (int x = 0; x < target.width; x++)
+			{
+				dst[x * 4 + 0] = src[x * 3 + 0];
+				dst[x * 4 + 1] = src[x * 3 + 1];
+				dst[x * 4 + 2] = src[x * 3 + 2];
+				dst[x * 4 + 3] = 1.0f;
+			}
+		}
+	}
+}
+
+bool DecodeRGBE(RGBEReader &reader, const DecodeTarget &target)
+{
+	// scanlines that are not rows top down can land anywhere, decode the whole image first
+	if (!reader.RowOrder())
+	{
+		if (target.width != reader.Width() || target.height != reader.Height())
+			return false;
+
+		std::vector<float> rgb(size_t(target.width) * target.height * 3);
+
+		if (!reader.ReadImage(rgb.data()))
+			return false;
+
+		StoreRGBRows(rgb.data(), 0, target.height, target);
+
+		return true;
+	}
+
+	std::vector<float> rgb(size_t(target.width) * DecodeBand * 3);
+
+	for (int y = 0; y < target.height; y += DecodeBand)
+	{
+		const int rows = (std::min)(DecodeBand, target.height - y);
+
+		if (!reader.ReadPixels(rgb.data(), target.width, rows))
+			return false;
+
+		StoreRGBRows(rgb.data(), y, rows, target);
+	}
+
+	return true;
+}
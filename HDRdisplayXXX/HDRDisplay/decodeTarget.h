@@ -0,0 +1,40 @@
+// Destination of an image decode
+//
+// A target is width x height pixels of one format, rows top down at a byte
+// pitch, so a decoder can write straight into a mapped staging texture with
+// the driver's row pitch as easily as into a packed heap buffer. Decoding
+// into mapped memory saves the copy from a heap buffer into the upload.
+// Portable, no D3D.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+class RGBEReader;
+
+enum DecodeFormat
+{
+	DecodeRGBA32F,			// DXGI_FORMAT_R32G32B32A32_FLOAT
+	DecodeRGBA16F,			// DXGI_FORMAT_R16G16B16A16_FLOAT
+};
+
+size_t DecodeBytesPerPixel(DecodeFormat format);
+
+struct DecodeTarget
+{
+	void *data;
+	size_t rowPitch;		// bytes from one row to the next
+	int width, height;
+	DecodeFormat format;
+
+	uint8_t *Row(int y) const { return static_cast<uint8_t*>(data) + size_t(y) * rowPitch; }
+};
+
+// Rows packed one after another in buffer
+DecodeTarget PackedTarget(void *buffer, int width, int height, DecodeFormat format);
+
+// Decodes the next target.height rows of reader into target. A reader whose
+// scanlines are not rows (RGBEReader::RowOrder) is decoded whole, so target
+// has to be the whole image.
+bool DecodeRGBE(RGBEReader &reader, const DecodeTarget &target);
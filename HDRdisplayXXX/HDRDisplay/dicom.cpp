@@ -0,0 +1,297 @@
+// Minimal DICOM reader for uncompressed grayscale images
+
+#include "dicom.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+
+#define DICOM_UNDEFINED_LENGTH 0xffffffffu
+
+#define DICOM_TAG(group, element) ((unsigned int)(group) << 16 | (unsigned int)(element))
+
+// tags this reader cares about
+#define TAG_TRANSFER_SYNTAX		DICOM_TAG(0x0002, 0x0010)
+#define TAG_SAMPLES_PER_PIXEL	DICOM_TAG(0x0028, 0x0002)
+#define TAG_PHOTOMETRIC			DICOM_TAG(0x0028, 0x0004)
+#define TAG_ROWS				DICOM_TAG(0x0028, 0x0010)
+#define TAG_COLUMNS				DICOM_TAG(0x0028, 0x0011)
+#define TAG_BITS_ALLOCATED		DICOM_TAG(0x0028, 0x0100)
+#define TAG_BITS_STORED			DICOM_TAG(0x0028, 0x0101)
+#define TAG_PIXEL_REPRESENTATION DICOM_TAG(0x0028, 0x0103)
+#define TAG_PIXEL_DATA			DICOM_TAG(0x7fe0, 0x0010)
+#define TAG_ITEM				DICOM_TAG(0xfffe, 0xe000)
+#define TAG_ITEM_END			DICOM_TAG(0xfffe, 0xe00d)
+#define TAG_SEQUENCE_END		DICOM_TAG(0xfffe, 0xe0dd)
+
+static unsigned int Read16(const unsigned char *p)
+{
+	return p[0] | p[1] << 8;
+}
+
+static unsigned int Read32(const unsigned char *p)
+{
+	return p[0] | p[1] << 8 | p[2] << 16 | (unsigned int)p[3] << 24;
+}
+
+// VRs with a 2 byte reserved field and a 32 bit length in explicit VR encoding
+static bool LongVR(const unsigned char *vr)
+{
+	static const char *longVRs[] = { "OB", "OD", "OF", "OL", "OV", "OW", "SQ", "SV", "UC", "UN", "UR", "UT", "UV" };
+
+	for (size_t i = 0; i < sizeof(longVRs) / sizeof(longVRs[0]); i++)
+	{
+		if (vr[0] == longVRs[i][0] && vr[1] == longVRs[i][1])
+			return true;
+	}
+	return false;
+}
+
+static std::string ReadString(const unsigned char *p, unsigned int length)
+{
+	std::string s((const char *)p, length);
+
+	// values are padded to even length with spaces or a NUL
+	while (s.size() && (s.back() == ' ' || s.back() == '\0'))
+		s.pop_back();
+
+	return s;
+}
+
+bool ReadDicom(const char *path, DicomImage &image)
+{
+	FILE *fp = fopen(path, "rb");
+
+	if (!fp)
+	{
+		fprintf(stderr, "%s: unable to open\n", path);
+		return false;
+	}
+
+	std::vector<unsigned char> data;
+	fseek(fp, 0, SEEK_END);
+	long size = ftell(fp);
+	fseek(fp, 0, SEEK_SET);
+
+	if (size > 0)
+	{
+		data.resize(size);
+		if (fread(data.data(), 1, size, fp) != size_t(size))
+			data.clear();
+	}
+	fclose(fp);
+
+	if (data.empty())
+	{
+		fprintf(stderr, "%s: unable to read\n", path);
+		return false;
+	}
+
+	const unsigned char *p = data.data();
+	const unsigned char *end = p + data.size();
+
+	// Part 10 files have a preamble and an explicit VR meta header, otherwise assume a
+	// bare implicit VR little endian data set
+	size_t offset = 0;
+	if (data.size() >= 132 && !memcmp(p + 128, "DICM", 4))
+		offset = 132;
+
+	p += offset;
+
+	bool explicitVR = offset != 0;
+	bool metaHeader = offset != 0;
+	std::string transferSyntax = "1.2.840.10008.1.2";
+
+	int rows = 0, columns = 0, samples = 1, bitsAllocated = 0, bitsStored = 0, pixelRepresentation = 0;
+	std::string photometric = "MONOCHROME2";
+	const unsigned char *pixelData = nullptr;
+	unsigned int pixelLength = 0;
+
+	// nesting of undefined length sequences, only top level elements are used
+	int depth = 0;
+
+	while (p + 8 <= end && !pixelData)
+	{
+		unsigned int group = Read16(p);
+
+		// the meta header is always explicit VR, the data set uses the transfer syntax
+		if (metaHeader && group != 0x0002)
+		{
+			metaHeader = false;
+
+			if (transferSyntax == "1.2.840.10008.1.2")
+				explicitVR = false;
+			else if (transferSyntax == "1.2.840.10008.1.2.1")
+				explicitVR = true;
+			else
+			{
+				fprintf(stderr, "%s: unsupported transfer syntax %s\n", path, transferSyntax.c_str());
+				return false;
+			}
+		}
+
+		unsigned int tag = DICOM_TAG(group, Read16(p + 2));
+		unsigned int length;
+		bool sequence = false;
+
+		if (group == 0xfffe)
+		{
+			// item and delimitation tags never have a VR
+			length = Read32(p + 4);
+			p += 8;
+		}
+		else if (explicitVR)
+		{
+			sequence = p[4] == 'S' && p[5] == 'Q';
+
+			if (LongVR(p + 4))
+			{
+				if (p + 12 > end)
+					break;
+				length = Read32(p + 8);
+				p += 12;
+			}
+			else
+			{
+				length = Read16(p + 6);
+				p += 8;
+			}
+		}
+		else
+		{
+			length = Read32(p + 4);
+			p += 8;
+		}
+
+		if (tag == TAG_ITEM)
+		{
+			// step into items of sequences being walked, skip the rest
+			if (depth > 0 || length == DICOM_UNDEFINED_LENGTH)
+				continue;
+		}
+		else if (tag == TAG_ITEM_END)
+		{
+			continue;
+		}
+		else if (tag == TAG_SEQUENCE_END)
+		{
+			if (depth > 0)
+				depth--;
+			continue;
+		}
+
+		if (length == DICOM_UNDEFINED_LENGTH)
+		{
+			if (tag == TAG_PIXEL_DATA)
+			{
+				fprintf(stderr, "%s: compressed pixel data is not supported\n", path);
+				return false;
+			}
+
+			// undefined length sequences (and UN with implicit VR content) end with a delimiter
+			depth++;
+			continue;
+		}
+
+		if (length > size_t(end - p))
+		{
+			fprintf(stderr, "%s: truncated element (%04x,%04x)\n", path, tag >> 16, tag & 0xffff);
+			return false;
+		}
+
+		if (sequence && depth == 0)
+		{
+			// defined length sequence, none of its content is needed
+			p += length;
+			continue;
+		}
+
+		if (depth == 0)
+		{
+			switch (tag)
+			{
+			case TAG_TRANSFER_SYNTAX:
+				transferSyntax = ReadString(p, length);
+				break;
+			case TAG_SAMPLES_PER_PIXEL:
+				samples = length >= 2 ? Read16(p) : 0;
+				break;
+			case TAG_PHOTOMETRIC:
+				photometric = ReadString(p, length);
+				break;
+			case TAG_ROWS:
+				rows = length >= 2 ? Read16(p) : 0;
+				break;
+			case TAG_COLUMNS:
+				columns = length >= 2 ? Read16(p) : 0;
+				break;
+			case TAG_BITS_ALLOCATED:
+				bitsAllocated = length >= 2 ? Read16(p) : 0;
+				break;
+			case TAG_BITS_STORED:
+				bitsStored = length >= 2 ? Read16(p) : 0;
+				break;
+			case TAG_PIXEL_REPRESENTATION:
+				pixelRepresentation = length >= 2 ? Read16(p) : 0;
+				break;
+			case TAG_PIXEL_DATA:
+				pixelData = p;
+				pixelLength = length;
+				break;
+			}
+		}
+
+		p += length;
+	}
+
+	if (!pixelData)
+	{
+		fprintf(stderr, "%s: no pixel data\n", path);
+		return false;
+	}
+
+	if (samples != 1 || (photometric != "MONOCHROME2" && photometric != "MONOCHROME1"))
+	{
+		fprintf(stderr, "%s: only grayscale images are supported (%s)\n", path, photometric.c_str());
+		return false;
+	}
+
+	if ((bitsAllocated != 8 && bitsAllocated != 16) || bitsStored < 1 || bitsStored > bitsAllocated)
+	{
+		fprintf(stderr, "%s: unsupported pixel layout (%d of %d bits)\n", path, bitsStored, bitsAllocated);
+		return false;
+	}
+
+	size_t count = size_t(rows) * size_t(columns);
+	if (count == 0 || pixelLength < count * (bitsAllocated / 8))
+	{
+		fprintf(stderr, "%s: pixel data does not match %d x %d\n", path, columns, rows);
+		return false;
+	}
+
+	image.width = columns;
+	image.height = rows;
+	image.bitsStored = bitsStored;
+	image.pixels.resize(count);
+
+	const unsigned int mask = (1u << bitsStored) - 1;
+	const unsigned int signBit = 1u << (bitsStored - 1);
+	const bool invert = photometric == "MONOCHROME1";
+
+	for (size_t i = 0; i < count; i++)
+	{
+		unsigned int v = bitsAllocated == 16 ? Read16(pixelData + 2 * i) : pixelData[i];
+		v &= mask;
+
+		// signed data is clamped at zero, there is no display value below black
+		if (pixelRepresentation && (v & signBit))
+			v = 0;
+
+		if (invert)
+			v = (pixelRepresentation ? signBit - 1 : mask) - v;
+
+		image.pixels[i] = (unsigned short)v;
+	}
+
+	return true;
+}
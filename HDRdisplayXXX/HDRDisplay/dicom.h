@@ -0,0 +1,22 @@
+// Minimal DICOM reader for uncompressed grayscale images
+//
+// Handles Part 10 files (128 byte preamble + "DICM") and bare data sets, with
+// implicit or explicit VR little endian transfer syntax. Compressed
+// (encapsulated) pixel data is rejected.
+
+#pragma once
+
+#include <vector>
+
+struct DicomImage
+{
+	int width;
+	int height;
+	int bitsStored;						// significant bits per pixel, 12 for the TG18 patterns
+	std::vector<unsigned short> pixels;	// row major, MONOCHROME2 (0 is black)
+
+	DicomImage() : width(0), height(0), bitsStored(0) {}
+};
+
+// Returns false and prints the reason to stderr if the file can't be read
+bool ReadDicom(const char *path, DicomImage &image);
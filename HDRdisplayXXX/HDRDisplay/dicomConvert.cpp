@@ -0,0 +1,113 @@
+// DICOM to HDR conversion calibrated to the GSDF
+
+#include "dicomConvert.h"
+#include "calibration.h"
+#include "gsdf.h"
+#include "perftracker_cpu.h"
+#include "rgbe.h"
+#include "taskScheduler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <stdio.h>
+
+GSDFCalibration::GSDFCalibration() :
+	minLuminance(0.0f),
+	maxLuminance(0.0f)
+{
+	std::fill(table, table + CodeCount, 0.0f);
+}
+
+bool GSDFCalibration::Build(const std::vector<float> &levels, const std::vector<float> &luminance)
+{
+	// keeps the rising part of the curve, interp1 needs unique luminance values
+	DisplayResponse response;
+	if (!response.Set(levels, luminance))
+		return false;
+
+	minLuminance = response.MinLuminance();
+	maxLuminance = response.MaxLuminance();
+
+	// exact inverse of the table, so the end codes land on Lmin and Lmax
+	double jMin = GSDFIndexFast(minLuminance);
+	double jMax = GSDFIndexFast(maxLuminance);
+
+	// same normalization as the script, X = dicom / 4096
+	std::vector<float> target(CodeCount);
+	for (int code = 0; code < CodeCount; code++)
+		target[code] = float(jMin + double(code) / CodeCount * (jMax - jMin));
+
+	GSDFLuminanceFast(target.data(), target.data(), CodeCount);
+
+	for (int code = 0; code < CodeCount; code++)
+		table[code] = response.Level(target[code]);
+
+	return true;
+}
+
+void GSDFCalibration::Convert(const DicomImage &image, std::vector<float> &rgb) const
+{
+	const size_t count = image.pixels.size();
+	rgb.resize(count * 3);
+
+	// codes wider than 12 bits are scaled down so the full range maps onto the table
+	const int shift = std::max(image.bitsStored - 12, 0);
+
+	for (size_t i = 0; i < count; i++)
+	{
+		float v = Lookup(image.pixels[i] >> shift);
+		rgb[3 * i + 0] = v;
+		rgb[3 * i + 1] = v;
+		rgb[3 * i + 2] = v;
+	}
+}
+
+bool GSDFCalibration::ConvertFile(const char *inPath, const char *outPath) const
+{
+	PERF_CPU_SCOPED("CPU > DICOM Convert");
+
+	DicomImage image;
+
+	if (!ReadDicom(inPath, image))
+		return false;
+
+	std::vector<float> rgb;
+	Convert(image, rgb);
+
+	FILE *fp = fopen(outPath, "wb");
+
+	if (!fp)
+	{
+		fprintf(stderr, "%s: unable to create\n", outPath);
+		return false;
+	}
+
+	bool ok = RGBE_WriteHeader(fp, image.width, image.height, nullptr) == RGBE_RETURN_SUCCESS &&
+		RGBE_WritePixels_RLE(fp, rgb.data(), image.width, image.height) == RGBE_RETURN_SUCCESS;
+
+	fclose(fp);
+
+	if (!ok)
+		fprintf(stderr, "%s: write failed\n", outPath);
+
+	return ok;
+}
+
+int ConvertDicomFiles(const GSDFCalibration &calibration, const std::vector<std::string> &inPaths, const std::vector<std::string> &outPaths)
+{
+	const size_t count = std::min(inPaths.size(), outPaths.size());
+
+	std::atomic<int> converted(0);
+
+	// one file per task, the images are big enough that finer grain doesn't pay
+	GetTaskScheduler().ParallelFor(0, int(count), 1, [&](int first, int last)
+	{
+		for (int i = first; i < last; i++)
+		{
+			if (calibration.ConvertFile(inPaths[i].c_str(), outPaths[i].c_str()))
+				converted++;
+		}
+	});
+
+	return converted;
+}
@@ -0,0 +1,48 @@
+// DICOM to HDR conversion calibrated to the GSDF
+//
+// Native version of DICOM2HDR/dicom2hdr_gsdf.m. The measured response of the
+// display is turned into one table from 12 bit DICOM code to HDR pixel value,
+// so converting an image is a single lookup per pixel.
+
+#pragma once
+
+#include "dicom.h"
+
+#include <string>
+#include <vector>
+
+class GSDFCalibration
+{
+public:
+	// 12 bit input, codes above are clamped
+	static const int CodeCount = 4096;
+
+	GSDFCalibration();
+
+	// Build the table from a measured response, lumdata(:,1) and lumdata(:,2)
+	// The table is cut where the luminance stops increasing (saturation)
+	bool Build(const std::vector<float> &levels, const std::vector<float> &luminance);
+
+	// HDR pixel value for a DICOM code
+	float Lookup(unsigned int code) const
+	{
+		return table[code < CodeCount ? code : CodeCount - 1];
+	}
+
+	float MinLuminance() const { return minLuminance; }
+	float MaxLuminance() const { return maxLuminance; }
+
+	// Gray RGB float pixels, 3 per input pixel
+	void Convert(const DicomImage &image, std::vector<float> &rgb) const;
+
+	// Read a DICOM file and write it as a Radiance .hdr
+	bool ConvertFile(const char *inPath, const char *outPath) const;
+
+protected:
+	float table[CodeCount];
+	float minLuminance;
+	float maxLuminance;
+};
+
+// Convert inPaths[i] to outPaths[i] on all cores, returns the number of files converted
+int ConvertDicomFiles(const GSDFCalibration &calibration, const std::vector<std::string> &inPaths, const std::vector<std::string> &outPaths);
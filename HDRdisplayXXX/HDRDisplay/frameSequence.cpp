@@ -0,0 +1,210 @@
+// Numbered image sequences, decoded ahead of playback
+
+#include "frameSequence.h"
+
+#include <algorithm>
+#include <sys/stat.h>
+
+// The text either side of the frame number, and its zero padded width
+static bool SplitPattern(const std::string &pattern, std::string &prefix, int &width, std::string &suffix)
+{
+	size_t hash = pattern.find('#');
+
+	if (hash != std::string::npos)
+	{
+		size_t end = pattern.find_first_not_of('#', hash);
+
+		if (end == std::string::npos)
+			end = pattern.size();
+
+		prefix = pattern.substr(0, hash);
+		width = int(end - hash);
+		suffix = pattern.substr(end);
+		return true;
+	}
+
+	// %d or %0Nd, nothing else is a frame number
+	for (size_t percent = pattern.find('%'); percent != std::string::npos; percent = pattern.find('%', percent + 1))
+	{
+		size_t end = percent + 1;
+		width = 0;
+
+		while (end < pattern.size() && pattern[end] >= '0' && pattern[end] <= '9')
+			width = width * 10 + (pattern[end++] - '0');
+
+		if (end < pattern.size() && pattern[end] == 'd' && width <= 16)
+		{
+			prefix = pattern.substr(0, percent);
+			suffix = pattern.substr(end + 1);
+			return true;
+		}
+	}
+
+	return false;
+}
+
+static std::string FrameName(const std::string &prefix, int width, const std::string &suffix, int number)
+{
+	std::string digits = std::to_string(number);
+
+	if (int(digits.size()) < width)
+		digits.insert(0, width - digits.size(), '0');
+
+	return prefix + digits + suffix;
+}
+
+static bool Exists(const std::string &file)
+{
+	struct stat info;
+	return stat(file.c_str(), &info) == 0;
+}
+
+bool FindSequence(const std::string &pattern, std::vector<std::string> &files)
+{
+	std::string prefix, suffix;
+	int width;
+
+	files.clear();
+
+	if (!SplitPattern(pattern, prefix, width, suffix))
+		return false;
+
+	// clips usually start at 0 or 1, but anywhere in the first 10000 will do
+	int number = 0;
+
+	while (number < 10000 && !Exists(FrameName(prefix, width, suffix, number)))
+		number++;
+
+	for (std::string file; Exists(file = FrameName(prefix, width, suffix, number)); number++)
+		files.push_back(file);
+
+	return !files.empty();
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+SequenceReader::SequenceReader(const std::vector<std::string> &files, const Decoder &decode, size_t readAhead, unsigned int decoders) :
+	files(files),
+	decode(decode),
+	readAhead((std::max)(readAhead, size_t(1))),
+	quit(false),
+	epoch(0),
+	first(0),
+	next(0),
+	handed(0),
+	running(0),
+	cancel(std::make_shared<TaskCancel>())
+{
+	if (decoders == 0)
+		decoders = (std::max)(GetTaskScheduler().Threads() / 2, 1u);
+
+	// the rest of the pool stays free for the loaders and bakers sharing it
+	this->decoders = (std::min)(size_t(decoders), this->readAhead);
+
+	std::lock_guard<std::mutex> guard(lock);
+	Start();
+}
+
+SequenceReader::~SequenceReader()
+{
+	std::vector<TaskScheduler::Handle> outstanding;
+
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		quit = true;
+		cancel->Cancel();
+		outstanding.swap(tasks);
+	}
+
+	// decodes already running still need this reader to finish in
+	for (auto &task : outstanding)
+		GetTaskScheduler().Wait(task);
+}
+
+bool SequenceReader::Latest(int64_t position, SequenceFrame &frame)
+{
+	bool found = false;
+
+	std::lock_guard<std::mutex> guard(lock);
+
+	auto newest = ready.upper_bound(position);
+
+	if (newest != ready.begin())
+	{
+		--newest;
+		frame = std::move(newest->second);
+		found = true;
+		handed = frame.position + 1;
+
+		ready.erase(ready.begin(), ++newest);
+	}
+
+	// what is due now is still wanted if it has not arrived, after that only what follows it
+	first = (std::max)(first, found && frame.position == position ? position + 1 : position);
+	next = (std::max)(next, first);
+
+	Start();
+
+	return found;
+}
+
+void SequenceReader::Seek(int64_t position)
+{
+	std::lock_guard<std::mutex> guard(lock);
+
+	// decodes from before that are already running finish, but are not counted or kept
+	cancel->Cancel();
+	cancel = std::make_shared<TaskCancel>();
+
+	epoch++;
+	running = 0;
+	ready.clear();
+	first = position;
+	next = position;
+	handed = position;
+
+	Start();
+}
+
+void SequenceReader::Start()
+{
+	if (quit || files.empty())
+		return;
+
+	TaskScheduler &scheduler = GetTaskScheduler();
+
+	tasks.erase(std::remove_if(tasks.begin(), tasks.end(), [&](const TaskScheduler::Handle &task) { return scheduler.Done(task); }), tasks.end());
+
+	while (running < decoders && next < first + int64_t(readAhead))
+	{
+		const int64_t position = next++;
+		const uint64_t started = epoch;
+
+		// the task holds on to its cancel, the scheduler only keeps a pointer
+		std::shared_ptr<TaskCancel> stop = cancel;
+
+		running++;
+		tasks.push_back(scheduler.Submit([this, position, started, stop]() { Decode(position, started); }, std::vector<TaskScheduler::Handle>(), stop.get()));
+	}
+}
+
+void SequenceReader::Decode(int64_t position, uint64_t started)
+{
+	SequenceFrame frame;
+	frame.position = position;
+
+	bool decoded = decode(files[size_t(position % int64_t(files.size()))], frame);
+
+	std::lock_guard<std::mutex> guard(lock);
+
+	if (started != epoch)
+		return;
+
+	running--;
+
+	// late is still better than what is on screen, older than that is no use
+	if (decoded && position >= handed)
+		ready[position] = std::move(frame);
+
+	Start();
+}
@@ -0,0 +1,105 @@
+// Numbered image sequences, decoded ahead of playback
+//
+// A sequence is named by a pattern with the frame number as a run of # or a
+// printf style %d / %04d, e.g. clip.####.exr, and covers the consecutive
+// files from the first number that exists. Playback positions count up
+// forever and wrap around the files, so clips loop.
+//
+// SequenceReader keeps up to readAhead positions from the next one wanted
+// decoded or being decoded, as tasks on the shared TaskScheduler, with the
+// decoding left to the caller. Latest() hands over the newest decoded frame that is due and
+// drops those before it. Decoders that fall behind skip ahead to what is
+// due rather than decoding frames that can no longer be shown on time.
+// Portable, no D3D.
+
+#pragma once
+
+#include "taskScheduler.h"
+
+#include <functional>
+#include <map>
+#include <math.h>
+#include <memory>
+#include <mutex>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+// Files of pattern, false if it has no frame number or no file matches
+bool FindSequence(const std::string &pattern, std::vector<std::string> &files);
+
+struct SequenceFrame
+{
+	int64_t position;
+	int width, height;
+	std::vector<uint16_t> rgba;		// half float, rows top down
+};
+
+class SequenceReader
+{
+public:
+	// Fills in width, height and rgba of frame from file, called on scheduler threads
+	typedef std::function<bool(const std::string &file, SequenceFrame &frame)> Decoder;
+
+	// At most decoders frames are decoded at once, 0 for half the scheduler's threads
+	SequenceReader(const std::vector<std::string> &files, const Decoder &decode, size_t readAhead, unsigned int decoders = 0);
+	~SequenceReader();
+
+	// Newest decoded frame at or before position, false if there is none yet.
+	// Frames up to position are done with afterwards.
+	bool Latest(int64_t position, SequenceFrame &frame);
+
+	// Drops everything read and carries on from position
+	void Seek(int64_t position);
+
+	size_t Files() const { return files.size(); }
+
+protected:
+	// Submits decodes until decoders are busy or readAhead is covered, lock held
+	void Start();
+	void Decode(int64_t position, uint64_t started);
+
+	std::vector<std::string> files;
+	Decoder decode;
+	size_t readAhead;
+	size_t decoders;
+
+	std::mutex lock;
+	bool quit;
+	uint64_t epoch;			// bumped by Seek() so frames in flight from before are thrown away
+	int64_t first;			// first position still wanted
+	int64_t next;			// next position for a decoder to take
+	int64_t handed;			// one past the last position Latest() returned
+	size_t running;			// decodes of this epoch submitted and not finished
+	std::map<int64_t, SequenceFrame> ready;
+
+	std::shared_ptr<TaskCancel> cancel;			// this epoch's, Seek() stops decodes that have not started
+	std::vector<TaskScheduler::Handle> tasks;	// not known to be done, the destructor waits on them
+};
+
+// Which position is due on a fixed frame rate
+class SequenceClock
+{
+public:
+	explicit SequenceClock(double fps) : fps(fps), startTime(0.0), startPosition(0) {}
+
+	// position is due at time now, in seconds
+	void Start(double now, int64_t position)
+	{
+		startTime = now;
+		startPosition = position;
+	}
+
+	int64_t Due(double now) const
+	{
+		// a hair early counts as on time, now is sampled before the present it is for
+		return startPosition + int64_t(floor((now - startTime) * fps + 1e-3));
+	}
+
+	double Rate() const { return fps; }
+
+protected:
+	double fps;
+	double startTime;
+	int64_t startPosition;
+};
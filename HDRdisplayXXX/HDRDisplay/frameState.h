@@ -0,0 +1,52 @@
+// Change tracking for the render on change frame loop
+//
+// Each frame the scene folds everything its output depends on into a
+// FrameState. While the hash matches the last rendered frame there is nothing
+// new to draw, and the window keeps showing the previous one.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <type_traits>
+
+class FrameState
+{
+public:
+	FrameState() : hash(14695981039346656037ull) {}
+
+	// 64 bit FNV-1a over the raw bytes
+	void Track(const void *data, size_t size)
+	{
+		const unsigned char *bytes = (const unsigned char*)data;
+
+		for (size_t i = 0; i < size; i++)
+		{
+			hash ^= bytes[i];
+			hash *= 1099511628211ull;
+		}
+	}
+
+	// A scalar or an array of them. Structs are tracked field by field: the
+	// padding between a bool and the next float is indeterminate, hashing it
+	// would redraw frames where nothing changed.
+	template <class T>
+	void Track(const T &value)
+	{
+		static_assert(std::is_scalar<typename std::remove_all_extents<T>::type>::value, "track structs field by field");
+		Track(&value, sizeof(value));
+	}
+
+	// A constant buffer mirror, all 4 byte fields as HLSL packs them, so no padding
+	template <class T>
+	void TrackConstants(const T &constants)
+	{
+		static_assert(std::is_trivially_copyable<T>::value && alignof(T) == 4 && sizeof(T) % 4 == 0, "not a constant buffer layout");
+		Track(&constants, sizeof(constants));
+	}
+
+	uint64_t Hash() const { return hash; }
+
+protected:
+	uint64_t hash;
+};
@@ -0,0 +1,115 @@
+// CPU versions of the per pixel stages a fused kernel runs
+
+#include "fusedReference.h"
+
+#include "ACES.h"
+
+#include <math.h>
+
+static const float sRGB_2_XYZ[9] =
+{
+	0.41239089f, 0.35758430f, 0.18048084f,
+	0.21263906f, 0.71516860f, 0.07219233f,
+	0.01933082f, 0.11919472f, 0.95053232f
+};
+
+// sRGB_2_Linear from utilities.hlsl, applied to counteract a Windows display driver transform
+static float DriverDecode(float c)
+{
+	return c <= 0.04045f ? c / 12.92f : powf(c + 0.055f, 2.4f) / 1.055f;
+}
+
+void ReferenceXform(const XformReference &settings, const float in[3], float out[3])
+{
+	float scale = 1.0f;
+
+	if (settings.applyAutoExposure)
+		scale *= 0.18f / exp2f(settings.exposure);
+
+	if (settings.scaleStops != 0.0f)
+		scale *= exp2f(settings.scaleStops);
+
+	for (int c = 0; c < 3; c++)
+	{
+		// the NaN filter, max() returns the other operand for a NaN
+		float v = in[c] > -65505.0f ? in[c] : -65505.0f;
+		v = v == -65505.0f ? 0.0f : v;
+
+		v *= scale;
+
+		if (settings.expansion != 1.0f)
+		{
+			float t = powf(fabsf(v) / 0.18f, settings.expansion) * 0.18f;
+			v = v < 0.0f ? -t : t;
+		}
+
+		out[c] = v;
+	}
+}
+
+void ReferenceEncode(int mode, float gamma, float rgb[3])
+{
+	for (int c = 0; c < 3; c++)
+	{
+		if (mode == 0)
+			rgb[c] = moncurve_r(rgb[c], 2.4f, 0.055f);
+		else if (mode == 1)
+			rgb[c] = powf(rgb[c] > 0.0f ? rgb[c] : 0.0f, 1.0f / gamma);
+		else if (mode == 2)
+			rgb[c] = pq_r(rgb[c]);
+
+		if (mode != 3)
+			rgb[c] = DriverDecode(rgb[c]);
+	}
+}
+
+void ReferenceLinear(float scale, float gamma, int mode, const float matrix[12], const float in[3], float out[3])
+{
+	float rgb[3] = { in[0] * scale, in[1] * scale, in[2] * scale };
+	float xyz[3];
+
+	for (int r = 0; r < 3; r++)
+		xyz[r] = sRGB_2_XYZ[r * 3 + 0] * rgb[0] + sRGB_2_XYZ[r * 3 + 1] * rgb[1] + sRGB_2_XYZ[r * 3 + 2] * rgb[2];
+
+	for (int r = 0; r < 3; r++)
+		out[r] = matrix[r * 4 + 0] * xyz[0] + matrix[r * 4 + 1] * xyz[1] + matrix[r * 4 + 2] * xyz[2];
+
+	ReferenceEncode(mode, gamma, out);
+}
+
+void ReferenceReinhard(float maxOutput, float gamma, int mode, const float in[3], float out[3])
+{
+	for (int c = 0; c < 3; c++)
+	{
+		out[c] = in[c] / (1.0f + in[c]);
+
+		if (mode == 2)
+			out[c] *= maxOutput;
+		else if (mode == 3)
+			out[c] *= maxOutput / 80.0f;
+	}
+
+	ReferenceEncode(mode, gamma, out);
+}
+
+void ReferenceFade(float fade, float rgb[3])
+{
+	for (int c = 0; c < 3; c++)
+		rgb[c] = rgb[c] * (1.0f - fade);
+}
+
+bool ReferenceMatch(const float a[3], const float b[3], float tolerance)
+{
+	for (int c = 0; c < 3; c++)
+	{
+		if (!isfinite(b[c]))
+			continue;
+
+		float limit = tolerance * (fabsf(b[c]) > 1.0f ? fabsf(b[c]) : 1.0f);
+
+		if (!(fabsf(a[c] - b[c]) <= limit))
+			return false;
+	}
+
+	return true;
+}
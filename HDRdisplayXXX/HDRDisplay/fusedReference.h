@@ -0,0 +1,33 @@
+// CPU versions of the per pixel stages a fused kernel runs
+//
+// Mirror the shader math of xform_input.hlsl (exposure and expansion, not the
+// grading), linear.hlsl, reinhard.hlsl and the composite fade one pixel at a
+// time, including the shaders' quirks, so the GPU result under the probe can
+// be checked against them. Portable, no D3D.
+
+#pragma once
+
+struct XformReference
+{
+	bool applyAutoExposure;
+	float exposure;		// log2 average the exposure pass computed
+	float scaleStops;
+	float expansion;
+};
+
+void ReferenceXform(const XformReference &settings, const float in[3], float out[3]);
+
+// EOTF encode shared by linear.hlsl and reinhard.hlsl, 0 sRGB, 1 gamma, 2 PQ, 3 scRGB
+// Scales for PQ and scRGB are left to the caller, as the shaders differ there
+void ReferenceEncode(int mode, float gamma, float rgb[3]);
+
+// matrix is the row_major float3x3 from linear.hlsl, three rows padded to four floats
+void ReferenceLinear(float scale, float gamma, int mode, const float matrix[12], const float in[3], float out[3]);
+
+void ReferenceReinhard(float maxOutput, float gamma, int mode, const float in[3], float out[3]);
+
+void ReferenceFade(float fade, float rgb[3]);
+
+// True if each channel of a is within tolerance of b, relative above 1 and absolute below
+// Channels that are not finite in b are skipped, the shaders are undefined there
+bool ReferenceMatch(const float a[3], const float b[3], float tolerance);
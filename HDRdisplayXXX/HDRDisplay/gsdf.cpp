@@ -0,0 +1,314 @@
+// DICOM Grayscale Standard Display Function (PS 3.14)
+
+#include "gsdf.h"
+
+#include <math.h>
+#include <algorithm>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define GSDF_SSE2
+#endif
+
+#define GSDF_TABLE_SIZE (GSDF_MAX_INDEX - GSDF_MIN_INDEX + 1)
+
+// inverse lookup buckets per octave of luminance
+#define GSDF_BUCKET_STEPS 16
+
+double GSDFLuminance(double j)
+{
+	const double a = -1.3011877;
+	const double b = -2.584019E-2;
+	const double c = 8.0242636E-2;
+	const double d = -1.0320229E-1;
+	const double e = 1.3646699E-1;
+	const double f = 2.8745620E-2;
+	const double g = -2.5468404E-2;
+	const double h = -3.1978977E-3;
+	const double k = 1.2992634E-4;
+	const double m = 1.3635334E-3;
+
+	double x = log(j);
+	double x2 = x * x;
+	double x3 = x2 * x;
+	double x4 = x3 * x;
+	double x5 = x4 * x;
+
+	double r = (a + c * x + e * x2 + g * x3 + m * x4) /
+		(1.0 + b * x + d * x2 + f * x3 + h * x4 + k * x5);
+
+	return pow(10.0, r);
+}
+
+double GSDFIndex(double L)
+{
+	const double A = 71.498068;
+	const double B = 94.593053;
+	const double C = 41.912053;
+	const double D = 9.8247004;
+	const double E = 0.28175407;
+	const double F = -1.1878455;
+	const double G = -0.18014349;
+	const double H = 0.14710899;
+	const double I = -0.017046845;
+
+	double x = log10(L);
+
+	// Horner form of the 8th order polynomial in log10(L)
+	return A + x * (B + x * (C + x * (D + x * (E + x * (F + x * (G + x * (H + x * I)))))));
+}
+
+/*
+* Luminance per JND index, with a bucket index for the inverse
+*
+* Built once (log/pow are not constexpr), initialization of the function
+* local static is thread safe. Adjacent entries are about 1% apart, so linear
+* interpolation in L stays within a few thousandths of a JND of the curve and
+* needs no log/pow per value.
+*/
+struct GSDFTables
+{
+	double L[GSDF_TABLE_SIZE];
+	float Lf[GSDF_TABLE_SIZE];		// the same in float for the batch calls
+
+	// buckets are 1/GSDF_BUCKET_STEPS of an octave, found from the binary exponent
+	int minExponent;
+	std::vector<unsigned short> bucket;
+
+	GSDFTables()
+	{
+		for (int i = 0; i < GSDF_TABLE_SIZE; i++)
+		{
+			L[i] = GSDFLuminance(GSDF_MIN_INDEX + i);
+			Lf[i] = float(L[i]);
+		}
+
+		int maxExponent;
+		frexp(L[0], &minExponent);
+		frexp(L[GSDF_TABLE_SIZE - 1], &maxExponent);
+
+		// first entry at or below the bottom of each bucket
+		int count = (maxExponent - minExponent + 1) * GSDF_BUCKET_STEPS;
+		bucket.resize(count);
+
+		int i = 0;
+		for (int b = 0; b < count; b++)
+		{
+			double start = ldexp(0.5 + 0.5 * (b % GSDF_BUCKET_STEPS) / GSDF_BUCKET_STEPS, minExponent + b / GSDF_BUCKET_STEPS);
+			while (i + 2 < GSDF_TABLE_SIZE && L[i + 1] <= start)
+				i++;
+			bucket[b] = (unsigned short)i;
+		}
+	}
+
+	int Bucket(double value) const
+	{
+		int e;
+		double m = frexp(value, &e);
+		int b = (e - minExponent) * GSDF_BUCKET_STEPS + int((m - 0.5) * 2.0 * GSDF_BUCKET_STEPS);
+		return std::min(std::max(b, 0), int(bucket.size()) - 1);
+	}
+};
+
+static const GSDFTables &Tables()
+{
+	static const GSDFTables tables;
+	return tables;
+}
+
+const double *GSDFTable()
+{
+	return Tables().L;
+}
+
+static double LuminanceFromTable(const GSDFTables &t, double j)
+{
+	double x = std::min(std::max(j, double(GSDF_MIN_INDEX)), double(GSDF_MAX_INDEX)) - GSDF_MIN_INDEX;
+	int i = std::min(int(x), GSDF_TABLE_SIZE - 2);
+	double f = x - i;
+
+	return t.L[i] + f * (t.L[i + 1] - t.L[i]);
+}
+
+static double IndexFromTable(const GSDFTables &t, double L)
+{
+	const double *table = t.L;
+
+	if (!(L > table[0]))
+		return GSDF_MIN_INDEX;
+	if (L >= table[GSDF_TABLE_SIZE - 1])
+		return GSDF_MAX_INDEX;
+
+	// the bucket gives the start, a step or two reaches the bracketing entry
+	int i = t.bucket[t.Bucket(L)];
+	while (i + 2 < GSDF_TABLE_SIZE && table[i + 1] <= L)
+		i++;
+
+	double f = (L - table[i]) / (table[i + 1] - table[i]);
+	return GSDF_MIN_INDEX + i + f;
+}
+
+double GSDFLuminanceFast(double j)
+{
+	return LuminanceFromTable(Tables(), j);
+}
+
+double GSDFIndexFast(double L)
+{
+	return IndexFromTable(Tables(), L);
+}
+
+#ifdef GSDF_SSE2
+
+// Four values at a time in float against the float table. SSE2 has no
+// gather, so the table entries are loaded a lane at a time and everything
+// around them is vector arithmetic.
+static size_t LuminanceSSE2(const GSDFTables &t, const float *j, float *L, size_t count)
+{
+	const __m128 lo = _mm_set1_ps(float(GSDF_MIN_INDEX));
+	const __m128 hi = _mm_set1_ps(float(GSDF_MAX_INDEX));
+	const __m128i last = _mm_set1_epi32(GSDF_TABLE_SIZE - 2);
+
+	size_t n = count & ~size_t(3);
+
+	for (size_t i = 0; i < n; i += 4)
+	{
+		__m128 x = _mm_sub_ps(_mm_min_ps(_mm_max_ps(_mm_loadu_ps(j + i), lo), hi), lo);
+		__m128i k = _mm_cvttps_epi32(x);
+
+		// no _mm_min_epi32 in SSE2
+		__m128i over = _mm_cmpgt_epi32(k, last);
+		k = _mm_or_si128(_mm_andnot_si128(over, k), _mm_and_si128(over, last));
+
+		__m128 f = _mm_sub_ps(x, _mm_cvtepi32_ps(k));
+
+		alignas(16) int lane[4];
+		_mm_store_si128((__m128i*)lane, k);
+
+		__m128 a = _mm_setr_ps(t.Lf[lane[0]], t.Lf[lane[1]], t.Lf[lane[2]], t.Lf[lane[3]]);
+		__m128 b = _mm_setr_ps(t.Lf[lane[0] + 1], t.Lf[lane[1] + 1], t.Lf[lane[2] + 1], t.Lf[lane[3] + 1]);
+
+		_mm_storeu_ps(L + i, _mm_add_ps(a, _mm_mul_ps(f, _mm_sub_ps(b, a))));
+	}
+
+	return n;
+}
+
+// The bucket comes straight from the float bits: exponent and the top four
+// mantissa bits are frexp's exponent and (m - 0.5) * 32 for 16 steps an octave.
+// The walk to the bracketing entry is per lane, the interpolation vector.
+static size_t IndexSSE2(const GSDFTables &t, const float *L, float *j, size_t count)
+{
+	static_assert(GSDF_BUCKET_STEPS == 16, "bucket from float bits assumes 16 steps an octave");
+
+	const __m128 first = _mm_set1_ps(t.Lf[0]);
+	const __m128 end = _mm_set1_ps(t.Lf[GSDF_TABLE_SIZE - 1]);
+	const __m128 lo = _mm_set1_ps(float(GSDF_MIN_INDEX));
+	const __m128 hi = _mm_set1_ps(float(GSDF_MAX_INDEX));
+	const __m128i bucketBias = _mm_set1_epi32((t.minExponent + 126) * GSDF_BUCKET_STEPS);
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i bucketLast = _mm_set1_epi32(int(t.bucket.size()) - 1);
+
+	size_t n = count & ~size_t(3);
+
+	for (size_t i = 0; i < n; i += 4)
+	{
+		__m128 v = _mm_loadu_ps(L + i);
+
+		// lanes off either end still need a bucket in range, their result is replaced below
+		__m128i b = _mm_sub_epi32(_mm_srli_epi32(_mm_castps_si128(v), 19), bucketBias);
+		b = _mm_andnot_si128(_mm_cmplt_epi32(b, zero), b);
+		__m128i over = _mm_cmpgt_epi32(b, bucketLast);
+		b = _mm_or_si128(_mm_andnot_si128(over, b), _mm_and_si128(over, bucketLast));
+
+		alignas(16) int lane[4];
+		alignas(16) float value[4];
+		_mm_store_si128((__m128i*)lane, b);
+		_mm_store_ps(value, v);
+
+		for (int l = 0; l < 4; l++)
+		{
+			int k = t.bucket[lane[l]];
+			while (k + 2 < GSDF_TABLE_SIZE && t.Lf[k + 1] <= value[l])
+				k++;
+			lane[l] = k;
+		}
+
+		__m128i k = _mm_load_si128((const __m128i*)lane);
+		__m128 a = _mm_setr_ps(t.Lf[lane[0]], t.Lf[lane[1]], t.Lf[lane[2]], t.Lf[lane[3]]);
+		__m128 c = _mm_setr_ps(t.Lf[lane[0] + 1], t.Lf[lane[1] + 1], t.Lf[lane[2] + 1], t.Lf[lane[3] + 1]);
+
+		__m128 f = _mm_div_ps(_mm_sub_ps(v, a), _mm_sub_ps(c, a));
+		__m128 r = _mm_add_ps(_mm_add_ps(lo, _mm_cvtepi32_ps(k)), f);
+
+		// at or below the first entry (and NaN) is the bottom, at or above the last the top
+		__m128 below = _mm_cmpngt_ps(v, first);
+		__m128 above = _mm_cmpge_ps(v, end);
+		r = _mm_or_ps(_mm_andnot_ps(below, r), _mm_and_ps(below, lo));
+		r = _mm_or_ps(_mm_andnot_ps(above, r), _mm_and_ps(above, hi));
+
+		_mm_storeu_ps(j + i, r);
+	}
+
+	return n;
+}
+
+#endif
+
+void GSDFLuminanceFast(const float *j, float *L, size_t count)
+{
+	const GSDFTables &t = Tables();
+	size_t i = 0;
+
+#ifdef GSDF_SSE2
+	i = LuminanceSSE2(t, j, L, count);
+#endif
+
+	for (; i < count; i++)
+		L[i] = float(LuminanceFromTable(t, j[i]));
+}
+
+void GSDFIndexFast(const float *L, float *j, size_t count)
+{
+	const GSDFTables &t = Tables();
+	size_t i = 0;
+
+#ifdef GSDF_SSE2
+	i = IndexSSE2(t, L, j, count);
+#endif
+
+	for (; i < count; i++)
+		j[i] = float(IndexFromTable(t, L[i]));
+}
+
+float GSDFConformance(const std::vector<float> &luminance, std::vector<float> &deviation)
+{
+	deviation.clear();
+
+	const size_t n = luminance.size();
+	if (n < 2)
+		return -1.0f;
+
+	// the ideal display spreads the JNDs between its end points evenly over the steps
+	double j0 = GSDFIndexFast(luminance.front());
+	double step = (GSDFIndexFast(luminance.back()) - j0) / (n - 1);
+
+	float worst = 0.0f;
+
+	for (size_t i = 0; i + 1 < n; i++)
+	{
+		double a = luminance[i];
+		double b = luminance[i + 1];
+		double measured = 2.0 * (b - a) / (b + a);
+
+		double ea = GSDFLuminanceFast(j0 + i * step);
+		double eb = GSDFLuminanceFast(j0 + (i + 1) * step);
+		double expected = 2.0 * (eb - ea) / (eb + ea);
+
+		float d = expected != 0.0 ? float(measured / expected - 1.0) : 0.0f;
+		deviation.push_back(d);
+		worst = std::max(worst, float(fabs(d)));
+	}
+
+	return worst;
+}
@@ -0,0 +1,42 @@
+// DICOM Grayscale Standard Display Function (PS 3.14)
+//
+// Same formulas as DICOM2HDR/gsdf.m and gsdfinv.m, plus table driven versions
+// for when many values are converted. The table holds L at every integer JND
+// index and is filled on first use.
+
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+
+// JND index range covered by the standard, 0.05 to 4000 cd/m^2
+#define GSDF_MIN_INDEX 1
+#define GSDF_MAX_INDEX 1023
+
+// Luminance in cd/m^2 for a JND index, evaluates the rational polynomial
+double GSDFLuminance(double j);
+
+// JND index for a luminance in cd/m^2, evaluates the fitted polynomial
+// Not an exact inverse of GSDFLuminance and not guaranteed monotone
+double GSDFIndex(double L);
+
+// Luminance at JND index GSDF_MIN_INDEX + i, GSDF_MAX_INDEX - GSDF_MIN_INDEX + 1 entries
+const double *GSDFTable();
+
+// Table versions, interpolated linearly between JND indices and clamped to the range
+// GSDFIndexFast is the exact, monotone inverse of GSDFLuminanceFast
+double GSDFLuminanceFast(double j);
+double GSDFIndexFast(double L);
+
+// Batch versions of the above, in and out may be the same array. With SSE2
+// four values go at a time in float against a float copy of the table, which
+// stays within float rounding of the double versions and just as monotone.
+void GSDFLuminanceFast(const float *j, float *L, size_t count);
+void GSDFIndexFast(const float *L, float *j, size_t count);
+
+// Conformance of a measured display to the GSDF, the AAPM TG18 contrast response
+// luminance is measured at equally spaced input levels in ascending order. For
+// each step, deviation receives the measured contrast per JND divided by the
+// expected one, minus one. Returns the largest absolute deviation (TG18 asks
+// for 0.1 on primary displays), or a negative value with fewer than two points.
+float GSDFConformance(const std::vector<float> &luminance, std::vector<float> &deviation);
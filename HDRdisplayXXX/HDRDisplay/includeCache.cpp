@@ -0,0 +1,139 @@
+// Process wide cache of shader source files
+
+#include "includeCache.h"
+
+#include <stdio.h>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/types.h>
+#include <sys/stat.h>
+#endif
+
+IncludeCache::IncludeCache(const std::vector<std::string> &inSearchPaths) :
+	searchPaths(inSearchPaths)
+{
+}
+
+bool IncludeCache::Stat(const std::string &path, int64_t *modified, int64_t *size)
+{
+	// st_mtime is whole seconds, a same size save within the second would be missed
+#ifdef _WIN32
+	WIN32_FILE_ATTRIBUTE_DATA data;
+	if (!GetFileAttributesExA(path.c_str(), GetFileExInfoStandard, &data))
+		return false;
+
+	*modified = int64_t(uint64_t(data.ftLastWriteTime.dwHighDateTime) << 32 | data.ftLastWriteTime.dwLowDateTime);
+	*size = int64_t(uint64_t(data.nFileSizeHigh) << 32 | data.nFileSizeLow);
+#else
+	struct stat s;
+	if (stat(path.c_str(), &s) != 0)
+		return false;
+
+#ifdef __APPLE__
+	*modified = int64_t(s.st_mtimespec.tv_sec) * 1000000000 + s.st_mtimespec.tv_nsec;
+#else
+	*modified = int64_t(s.st_mtim.tv_sec) * 1000000000 + s.st_mtim.tv_nsec;
+#endif
+	*size = int64_t(s.st_size);
+#endif
+
+	return true;
+}
+
+std::string IncludeCache::Resolve(const std::string &file, const std::string &alternate)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	std::string key = file + "|" + alternate;
+	auto it = resolved.find(key);
+	if (it != resolved.end())
+		return it->second;
+
+	std::string result = file;
+	int64_t modified, size;
+
+	for (auto &searchPath : searchPaths)
+	{
+		std::string path = searchPath + file;
+
+		if (Stat(path, &modified, &size))
+		{
+			result = path;
+			break;
+		}
+
+		// try adding the sub-path
+		if (alternate.size())
+		{
+			path = searchPath + alternate + file;
+
+			if (Stat(path, &modified, &size))
+			{
+				result = path;
+				break;
+			}
+		}
+	}
+
+	resolved[key] = result;
+	return result;
+}
+
+IncludeCache::Buffer IncludeCache::Read(const std::string &path)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	auto it = files.find(path);
+	if (it != files.end() && it->second.contents)
+		return it->second.contents;
+
+	FileState state;
+	state.exists = Stat(path, &state.modified, &state.size);
+
+	// remember missing files too, so Refresh() notices when they appear
+	if (state.exists)
+	{
+		FILE *fp = fopen(path.c_str(), "rb");
+
+		if (fp)
+		{
+			std::shared_ptr<std::vector<char>> contents = std::make_shared<std::vector<char>>(size_t(state.size));
+
+			if (fread(contents->data(), 1, contents->size(), fp) == contents->size())
+				state.contents = contents;
+
+			fclose(fp);
+		}
+	}
+
+	files[path] = state;
+	return state.contents;
+}
+
+void IncludeCache::Refresh(std::vector<std::string> &changed)
+{
+	std::lock_guard<std::mutex> lock(mutex);
+
+	for (auto &file : files)
+	{
+		FileState &state = file.second;
+		int64_t modified = 0, size = 0;
+		bool exists = Stat(file.first, &modified, &size);
+
+		if (exists == state.exists && (!exists || (modified == state.modified && size == state.size)))
+			continue;
+
+		state.contents = nullptr;
+		state.exists = exists;
+		state.modified = modified;
+		state.size = size;
+		changed.push_back(file.first);
+	}
+
+	// a new or deleted file can change what an include name resolves to
+	if (changed.size())
+		resolved.clear();
+}
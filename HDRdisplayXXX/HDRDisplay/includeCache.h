@@ -0,0 +1,52 @@
+// Process wide cache of shader source files
+//
+// Resolves include names against the search paths once and keeps the file
+// contents in memory, so compiles that share includes stop hitting the disk.
+// Nothing is re-checked on its own, Refresh() stats every known file and drops
+// the ones whose modification time or size changed.
+
+#pragma once
+
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <stdint.h>
+
+class IncludeCache
+{
+public:
+	typedef std::shared_ptr<const std::vector<char>> Buffer;
+
+	// Candidates are tried in order, each as path + file, then path + alternate + file
+	IncludeCache(const std::vector<std::string> &inSearchPaths);
+
+	// First candidate that exists, or file itself if none do
+	std::string Resolve(const std::string &file, const std::string &alternate = std::string());
+
+	// Contents of a resolved path, null if it cannot be read
+	// The buffer stays valid for as long as it is held, even across a Refresh()
+	Buffer Read(const std::string &path);
+
+	// Re-stat every file read so far, changed gets the ones that were modified,
+	// created or deleted since. Any change also forgets all resolved names.
+	void Refresh(std::vector<std::string> &changed);
+
+protected:
+	struct FileState
+	{
+		Buffer contents;	// null until read again after a change
+		bool exists = false;
+		int64_t modified = 0;	// in the platform's finest file time unit, only compared
+		int64_t size = 0;
+	};
+
+	static bool Stat(const std::string &path, int64_t *modified, int64_t *size);
+
+	std::mutex mutex;
+	std::vector<std::string> searchPaths;
+	std::map<std::string, std::string> resolved;	// file + '|' + alternate
+	std::map<std::string, FileState> files;
+};
@@ -27,6 +27,11 @@
 #pragma once
 
 #include "tonemapper.h"
+#include "tileDispatch.h"
+#include "tileCache.h"
+
+#include <algorithm>
+#include <math.h>
 
 /*
 * transform pass that performs optional operations on the input
@@ -54,7 +59,7 @@ protected:
 		float xlrScaleC;
 		float xlrBiasA;
 		float xlrBiasB;
-		float pad;
+		int readback_radius;
 		float rgbSaturation[4];
 		float rgbContrast[4];
 		float rgbGamma[4];
@@ -66,7 +71,8 @@ protected:
 		float iptBiasC;
 		float iptBiasA;
 		float iptBiasB;
-		float pad2[2];
+		float pan[2];
+		float sourceWindow[4];	// image uv to texture uv, scale xy and offset zw
 	};
 
 	Constants constants;
@@ -76,11 +82,14 @@ protected:
 	bool gradeIPT;
 	bool gradeSplitScreen;
 
+	// the source is a window onto a larger image, see SetSourceWindow()
+	bool sourceWindowed;
+
 public:
 
 	XformPass(ID3D11Device * inDevice) : Tonemapper(inDevice)
 	{
-		shader = CompilePS("xform_input.hlsl", "main");
+		WatchPS(&shader, "xform_input.hlsl", "main");
 
 		D3D11_BUFFER_DESC desc;
 		ZeroMemory(&desc, sizeof(desc));
@@ -112,6 +121,9 @@ public:
 		constants.xlrScaleC = 1.0f;
 		constants.xlrBiasA = 0.0f;
 		constants.xlrBiasB = 0.0f;
+		constants.readback_pos[0] = 0;
+		constants.readback_pos[1] = 0;
+		constants.readback_radius = 0;
 
 		constants.iptContrastL = 1.0f;
 		constants.iptContrastC = 1.0f;
@@ -120,6 +132,15 @@ public:
 		constants.iptBiasA = 0.0f;
 		constants.iptBiasB = 0.0f;
 
+		constants.pan[0] = 0.0f;
+		constants.pan[1] = 0.0f;
+
+		constants.sourceWindow[0] = 1.0f;
+		constants.sourceWindow[1] = 1.0f;
+		constants.sourceWindow[2] = 0.0f;
+		constants.sourceWindow[3] = 0.0f;
+		sourceWindowed = false;
+
 		for (int i = 0; i < 3; i++)
 		{
 			constants.rgbSaturation[i] = 1.0f;
@@ -144,10 +165,102 @@ public:
 		constants.size_data[3] = outY;
 	}
 
-	void SetReadback(int x, int y) override
+	// The source texture holds part of the image, at window[0..1] * uv + window[2..3].
+	// nullptr for a texture of the whole image. Tiling is off while windowed.
+	void SetSourceWindow(const float *window)
+	{
+		static const float whole[4] = { 1.0f, 1.0f, 0.0f, 0.0f };
+
+		sourceWindowed = window != nullptr;
+		memcpy(constants.sourceWindow, window ? window : whole, sizeof(constants.sourceWindow));
+	}
+
+	// What the pass shows, for picking the tiles of a windowed source
+	TileView View() const
+	{
+		TileView view;
+		view.outWidth = constants.size_data[2];
+		view.outHeight = constants.size_data[3];
+		view.zoom = constants.zoom;
+		view.filter = constants.filter != 0;
+		view.matchAspect = constants.match_aspect != 0;
+		view.pan[0] = constants.pan[0];
+		view.pan[1] = constants.pan[1];
+		return view;
+	}
+
+	// Output pixels the image can cover, everything outside is black letterbox
+	// Rounded out by a pixel for the bilinear footprint
+	TileRect ImageRect() const
+	{
+		const int inX = constants.size_data[0];
+		const int inY = constants.size_data[1];
+		const int outX = constants.size_data[2];
+		const int outY = constants.size_data[3];
+
+		TileRect rect = { 0, 0, outX, outY };
+
+		if (inX <= 0 || inY <= 0)
+		{
+			rect.x1 = 0;
+			rect.y1 = 0;
+			return rect;
+		}
+
+		const float zoomScale = powf(2.0f, float(-constants.zoom));
+		float width, height;
+
+		if (constants.filter)
+		{
+			// the wrap sampler repeats the image when tiling
+			if (constants.tile && !sourceWindowed)
+				return rect;
+
+			const float aspectIn = float(inX) / float(inY);
+			const float aspectOut = float(outX) / float(outY);
+			float aspectScaleX = 1.0f, aspectScaleY = 1.0f;
+
+			if (constants.match_aspect)
+			{
+				aspectScaleX = aspectIn < aspectOut ? aspectOut / aspectIn : 1.0f;
+				aspectScaleY = aspectIn > aspectOut ? aspectIn / aspectOut : 1.0f;
+			}
+
+			// uv in [0, 1] as xform_input.hlsl maps it
+			width = outX / (zoomScale * aspectScaleX);
+			height = outY / (zoomScale * aspectScaleY);
+		}
+		else
+		{
+			// Load() outside the texture returns 0
+			width = inX / zoomScale;
+			height = inY / zoomScale;
+		}
+
+		// panning by a whole image moves it its own size the other way
+		const float centerX = outX * 0.5f - constants.pan[0] * width;
+		const float centerY = outY * 0.5f - constants.pan[1] * height;
+
+		rect.x0 = (std::max)(int(floorf(centerX - width * 0.5f)) - 1, 0);
+		rect.y0 = (std::max)(int(floorf(centerY - height * 0.5f)) - 1, 0);
+		rect.x1 = (std::min)(int(ceilf(centerX + width * 0.5f)) + 1, outX);
+		rect.y1 = (std::min)(int(ceilf(centerY + height * 0.5f)) + 1, outY);
+
+		// panned off screen
+		if (rect.x0 >= rect.x1 || rect.y0 >= rect.y1)
+		{
+			rect.x0 = rect.x1 = 0;
+			rect.y0 = rect.y1 = 0;
+		}
+
+		return rect;
+	}
+
+	void SetReadback(int x, int y, int radius) override
 	{
 		constants.readback_pos[0] = x;
 		constants.readback_pos[1] = y;
+		constants.readback_radius = radius;
 	}
 
 	void SetupTonemapShader(ID3D11DeviceContext* ctx, ID3D11ShaderResourceView* srcData) override
@@ -156,27 +269,77 @@ public:
 	}
 
 	void SetupTransformPass(ID3D11DeviceContext* ctx, ID3D11ShaderResourceView* srcData, ID3D11ShaderResourceView* autoExposure)
+	{
+		UpdateConstants(ctx);
+
+		ctx->PSSetConstantBuffers(0, 1, &cb);
+		ctx->PSSetShader(shader, nullptr, 0);
+		ctx->PSSetShaderResources(0, 1, &srcData);
+		ctx->PSSetShaderResources(1, 1, &autoExposure);
+	}
+
+	// Bind the transform where fused.hlsl expects it, for a fused kernel to run in place of this pass
+	void SetupFusedStage(ID3D11DeviceContext* ctx, ID3D11ShaderResourceView* srcData, ID3D11ShaderResourceView* autoExposure)
+	{
+		UpdateConstants(ctx);
+
+		ctx->PSSetConstantBuffers(4, 1, &cb);
+		ctx->PSSetShaderResources(4, 1, &srcData);
+		ctx->PSSetShaderResources(5, 1, &autoExposure);
+	}
+
+	// Exposure and expansion only, the auto exposure value and the grades stay on the GPU
+	bool Reference(const float in[3], float out[3]) const override
+	{
+		if (constants.applyAutoExposure || gradeXLR || gradeRGB || gradeIPT)
+			return false;
+
+		XformReference settings;
+		settings.applyAutoExposure = false;
+		settings.exposure = 0.0f;
+		settings.scaleStops = constants.scale;
+		settings.expansion = constants.expansion;
+
+		ReferenceXform(settings, in, out);
+		return true;
+	}
+
+protected:
+	void UpdateConstants(ID3D11DeviceContext* ctx)
 	{
 		constants.gradingFlags = gradeXLR ? 0x1 : 0x0;
 		constants.gradingFlags |= gradeRGB ? 0x2 : 0x0;
 		constants.gradingFlags |= gradeIPT ? 0x4 : 0x0;
 		constants.gradingFlags |= gradeSplitScreen ? 0x8 : 0x0;
 
+		// a window can't wrap, only the part of the image on screen is in it
+		Constants data = constants;
+
+		if (sourceWindowed)
+			data.tile = 0;
+
 		D3D11_MAPPED_SUBRESOURCE mapObj;
 		ctx->Map(cb, 0, D3D11_MAP_WRITE_DISCARD, 0, &mapObj);
-		memcpy(mapObj.pData, &constants, sizeof(constants));
+		memcpy(mapObj.pData, &data, sizeof(data));
 		ctx->Unmap(cb, 0);
-
-		ctx->PSSetConstantBuffers(0, 1, &cb);
-		ctx->PSSetShader(shader, nullptr, 0);
-		ctx->PSSetShaderResources(0, 1, &srcData);
-		ctx->PSSetShaderResources(1, 1, &autoExposure);
 	}
 
+public:
+
 #define SUPPORT_XLR_GRADE 0
 #define SUPPORT_IPT_GRADE 1
 #define SUPPORT_RGB_GRADE 1
 
+	void TrackState(FrameState &state) const override
+	{
+		state.TrackConstants(constants);
+		state.Track(gradeXLR);
+		state.Track(gradeRGB);
+		state.Track(gradeIPT);
+		state.Track(gradeSplitScreen);
+		state.Track(sourceWindowed);
+	}
+
 	TwBar* InitUI() override
 	{
 		TwBar* settings_bar = TwNewBar("Input_Xform");
@@ -201,6 +364,9 @@ public:
 			TwAddVarRW(settings_bar, "Zoom", enumModeType, &constants.zoom, "");
 		}
 
+		TwAddVarRW(settings_bar, "Pan X", TW_TYPE_FLOAT, &constants.pan[0], "min=-1.0 max=1.0 step=0.01 precision=2");
+		TwAddVarRW(settings_bar, "Pan Y", TW_TYPE_FLOAT, &constants.pan[1], "min=-1.0 max=1.0 step=0.01 precision=2");
+
 		TwAddVarRW(settings_bar, "AutoExposure", TW_TYPE_BOOL32, &constants.applyAutoExposure, "");
 		TwAddVarRW(settings_bar, "ExposureBias (stops)", TW_TYPE_FLOAT, &constants.scale, "min=-12.0  max=12.0 step=0.25  precision=2");
 
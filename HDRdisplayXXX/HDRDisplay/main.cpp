@@ -37,9 +37,21 @@
 #include "inputTransform.h"
 #include "acesTonemapper.h"
 #include "compositor.h"
+#include "calibrationPass.h"
 #include "Exposure.h"
+#include "pixelProbe.h"
+#include "tiledPass.h"
+#include "tiledImageSource.h"
+#include "sequenceSource.h"
+#include "pixelPool.h"
+#include "decodeTarget.h"
+#include "mappedFile.h"
+#include "rgbeReader.h"
 
 #include "rgbe.h"
+#include "rgb9e5.h"
+#include "bc6h.h"
+#include "mipChain.h"
 
 #include <d3dcommon.h>
 #include <dxgi.h>
@@ -55,6 +67,17 @@
 
 #include "uhdDisplay.h"
 
+#include "measurement.h"
+#include "adaptiveSampler.h"
+#include "cs2000.h"
+#include "dicomConvert.h"
+
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <thread>
+
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 // Globals
@@ -130,6 +153,41 @@ TonemapCreator* TonemapperList[] =
 	&ReinhardTM
 };
 
+// Defines of the fused and tiled variants (see Tonemapper::FusedPS and TiledCS)
+const D3D_SHADER_MACRO FusedDefines[] = { { "FUSED", "1" }, { NULL, NULL } };
+const D3D_SHADER_MACRO TiledDefines[] = { { "TILED", "1" }, { NULL, NULL } };
+
+// Every shader the tonemappers above and the helper passes compile, built in
+// parallel before they are created. Anything missing here is still compiled
+// by its pass, just serially.
+const ShaderJob StartupShaders[] =
+{
+	{ "vs_quad.hlsl", "main", "vs_5_0" },
+	{ "vis_range.hlsl", "main", "ps_5_0" },
+	{ "linear.hlsl", "main", "ps_5_0" },
+	{ "ACES/ACES_parameterized.hlsl", "main", "ps_5_0" },
+	{ "ACES/ACES_lut.hlsl", "main", "ps_5_0" },
+	{ "reinhard.hlsl", "main", "ps_5_0" },
+	{ "xform_input.hlsl", "main", "ps_5_0" },
+	{ "test_generator.hlsl", "main", "ps_5_0" },
+	{ "composite.hlsl", "main", "ps_5_0" },
+	{ "calibrate.hlsl", "main", "ps_5_0" },
+	{ "exposure_reduction.hlsl", "main", "cs_5_0" },
+
+	// variants, built with the passes so the first fused or compute frame does not stall on them
+	{ "vis_range.hlsl", "main", "ps_5_0", FusedDefines },
+	{ "linear.hlsl", "main", "ps_5_0", FusedDefines },
+	{ "ACES/ACES_parameterized.hlsl", "main", "ps_5_0", FusedDefines },
+	{ "ACES/ACES_lut.hlsl", "main", "ps_5_0", FusedDefines },
+	{ "reinhard.hlsl", "main", "ps_5_0", FusedDefines },
+	{ "xform_input.hlsl", "main", "ps_5_0", FusedDefines },
+	{ "vis_range.hlsl", "tiledMain", "cs_5_0", TiledDefines },
+	{ "linear.hlsl", "tiledMain", "cs_5_0", TiledDefines },
+	{ "ACES/ACES_parameterized.hlsl", "tiledMain", "cs_5_0", TiledDefines },
+	{ "ACES/ACES_lut.hlsl", "tiledMain", "cs_5_0", TiledDefines },
+	{ "reinhard.hlsl", "tiledMain", "cs_5_0", TiledDefines },
+};
+
 typedef enum eDisplayPrimaries
 {
 	PRIM_REC709 = 0,
@@ -152,12 +210,84 @@ bool g_HDRon = false;
 
 float g_Red = 0.0f, g_Green = 0.0f, g_Blue = 0.0f;
 
+// colour probe under the mouse, g_ProbeSize pixels square, the centre also goes to g_Red/g_Green/g_Blue
+int g_ProbeSize = 1;
+ProbeResult g_Probe;
+
 int g_MouseX = 0, g_MouseY = 0;
 
 std::vector<std::string> g_Textures;
 
+// numbered image sequences to play, as clip.####.exr or clip.%04d.hdr, at g_SequenceFPS
+// with up to g_SequenceReadAhead frames decoded ahead
+std::vector<std::string> g_Sequences;
+double g_SequenceFPS = 24.0;
+int g_SequenceReadAhead = 8;
+
 unsigned int g_tex_index = 0;
 
+// What each g_tex_index shows, filled in by the scene once it has loaded: the
+// images that loaded, then the sequences, then the test pattern
+struct TextureListing
+{
+	std::string name;		// image file, sequence pattern or "Test Pattern"
+	bool image;				// a still image read from name
+};
+std::vector<TextureListing> g_TextureListings;
+
+// image the measurement thread wants shown, applied to g_tex_index by the render thread in Animate
+const unsigned int NoTexRequest = ~0u;
+std::atomic<unsigned int> g_TexRequest(NoTexRequest);
+
+// serial port of the CS-2000 and output file when running a measurement sweep
+std::string g_MeasurePort;
+std::string g_MeasureOutput;
+bool g_MeasureAdaptive = false;
+
+// batch DICOM conversion instead of running the viewer
+std::string g_DicomTable;
+std::string g_DicomInput;
+std::string g_DicomOutput;
+
+// measured response for the calibration pass, and where to write calibrated copies of the images
+std::string g_CalibrationTable;
+CalibrationSettings g_CalibrationSettings;
+std::string g_CalibrationExport;
+
+// performance trace, written on F2 and on exit if given on the command line
+std::string g_TraceFile = "perftrace.json";
+bool g_TraceOnExit = false;
+
+// recompile edited shaders about once a second, F5 checks at any time
+bool g_ShaderHotReload = false;
+
+// render every vsync instead of only when something on screen changed
+bool g_Continuous = false;
+
+// draw fullscreen composites with one fused kernel, and check it against the CPU reference under the probe
+bool g_FusedPipeline = true;
+bool g_ValidateFused = false;
+
+// run the multi-pass tonemaps as tiled compute, skipping the letterbox
+bool g_ComputeTonemap = false;
+
+// upload .hdr images as RGB9E5, 4 bytes a pixel instead of 16
+bool g_RGB9E5 = false;
+
+// compress loaded images to BC6H at this quality, -1 for off, keeping those with a mean Delta E ITP
+// up to g_BC6HMaxDeltaE (0 for any)
+int g_BC6HQuality = -1;
+float g_BC6HMaxDeltaE = 0.0f;
+
+// build mip chains for float and half images, so zooming out is filtered
+bool g_MipMaps = true;
+
+// stream every image from a tile store, not just those too large for a texture
+bool g_TiledImages = false;
+
+// tiles kept in memory for streamed images, 512 KB each
+const size_t g_TileCacheTiles = 512;
+
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 // Chromacities for setting up UHD monitor metadata
 ////////////////////////////////////////////////////////////////////////////////////////////////////
@@ -186,6 +316,15 @@ private:
 		ID3D11Texture2D *texPtr;
 		ID3D11ShaderResourceView *srvPtr;
 		int width, height;
+
+		// streamed from disk in place of texPtr and srvPtr
+		TiledImageSource *tiled;
+
+		// played back in place of texPtr and srvPtr
+		SequenceSource *sequence;
+
+		// listed in the UI as
+		std::string name;
 	};
 
 	ID3D11Buffer*				quad_verts;
@@ -206,9 +345,13 @@ private:
 	// compositor
 	Compositor*					compositor;
 
+	// display calibration after the composite
+	CalibrationPass*			calibration;
+
 	ID3D11RasterizerState*		rs_state;
 
 	ID3D11SamplerState*			samp_linear_wrap;
+	ID3D11SamplerState*			samp_aniso_wrap;
 
 	ID3D11DepthStencilState*	ds_state;
 	ID3D11DepthStencilState*	ds_state_disabled;
@@ -220,11 +363,10 @@ private:
 	ID3D11Texture2D*			intermediateTex[intermediateCount];
 	ID3D11ShaderResourceView*	intermediateSRV[intermediateCount];
 	ID3D11RenderTargetView*		intermediateRTV[intermediateCount];
+	ID3D11UnorderedAccessView*	intermediateUAV[intermediateCount];
 
-	// buffers to read back data
-	ID3D11Buffer*				feedbackBuf;
-	ID3D11UnorderedAccessView*  feedbackUAV;
-	ID3D11Buffer*				readbackBuf;
+	// colour probe written by the transform pass
+	PixelProbe*					probe;
 
 	// Texture for test patterns
 	ID3D11Texture2D*			patternTex;
@@ -233,6 +375,9 @@ private:
 
 	// Auto-exposure controls
 	ExposureReduction*			exposurePass;
+
+	// tiled compute dispatch of the tonemaps
+	TiledPass*					tiledPass;
 	ID3D11Buffer*				exposureBuffer;
 	ID3D11ShaderResourceView*	exposureSRV;
 	ID3D11UnorderedAccessView*	exposureUAV;
@@ -246,7 +391,11 @@ private:
 
 	float						internalTime;
 
-	bool CreateImmutableTexture(ID3D11Device* device, DXGI_FORMAT format, int width, int height, const D3D11_SUBRESOURCE_DATA *data, ID3D11Texture2D **tex, ID3D11ShaderResourceView **srv)
+	// FrameState hash of the last frame handed to the device manager
+	uint64_t					renderedState;
+
+	// data holds one subresource per mip level
+	bool CreateImmutableTexture(ID3D11Device* device, DXGI_FORMAT format, int width, int height, const D3D11_SUBRESOURCE_DATA *data, ID3D11Texture2D **tex, ID3D11ShaderResourceView **srv, UINT mipLevels = 1)
 	{
 		D3D11_TEXTURE2D_DESC tex_desc;
 		ZeroMemory(&tex_desc, sizeof(tex_desc));
@@ -255,7 +404,7 @@ private:
 		tex_desc.Format = format;
 		tex_desc.Width = width;
 		tex_desc.Height = height;
-		tex_desc.MipLevels = 1;
+		tex_desc.MipLevels = mipLevels;
 		tex_desc.SampleDesc.Count = 1;
 		tex_desc.SampleDesc.Quality = 0;
 		tex_desc.Usage = D3D11_USAGE_IMMUTABLE;
@@ -270,7 +419,7 @@ private:
 		ZeroMemory(&srv_desc, sizeof(srv_desc));
 		srv_desc.Format = format;
 		srv_desc.ViewDimension = D3D11_SRV_DIMENSION_TEXTURE2D;
-		srv_desc.Texture2D.MipLevels = 1;
+		srv_desc.Texture2D.MipLevels = mipLevels;
 		srv_desc.Texture2D.MostDetailedMip = 0;
 
 		hr = device->CreateShaderResourceView(*tex, &srv_desc, srv);
@@ -283,11 +432,218 @@ private:
 		return true;
 	}
 
+	// Decodes straight into a mapped staging texture and copies that into the texture sampled,
+	// for images with no CPU work after the decode
+	bool CreateDecodedTexture(ID3D11Device* device, DXGI_FORMAT format, DecodeFormat decodeFormat, int width, int height,
+		const std::function<bool(const DecodeTarget&)>& decode, HDRTexture& texStruct)
+	{
+		D3D11_TEXTURE2D_DESC tex_desc;
+		ZeroMemory(&tex_desc, sizeof(tex_desc));
+		tex_desc.ArraySize = 1;
+		tex_desc.Format = format;
+		tex_desc.Width = width;
+		tex_desc.Height = height;
+		tex_desc.MipLevels = 1;
+		tex_desc.SampleDesc.Count = 1;
+		tex_desc.Usage = D3D11_USAGE_STAGING;
+		tex_desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+
+		ID3D11Texture2D* staging = nullptr;
+
+		if (FAILED(device->CreateTexture2D(&tex_desc, nullptr, &staging)))
+			return false;
+
+		ID3D11DeviceContext* ctx = nullptr;
+		device->GetImmediateContext(&ctx);
+
+		D3D11_MAPPED_SUBRESOURCE mapped;
+		bool decoded = false;
+
+		if (SUCCEEDED(ctx->Map(staging, 0, D3D11_MAP_WRITE, 0, &mapped)))
+		{
+			DecodeTarget target = { mapped.pData, mapped.RowPitch, width, height, decodeFormat };
+			decoded = decode(target);
+			ctx->Unmap(staging, 0);
+		}
+
+		ID3D11Texture2D* new_texture = nullptr;
+		ID3D11ShaderResourceView *srv = nullptr;
+
+		tex_desc.Usage = D3D11_USAGE_DEFAULT;
+		tex_desc.CPUAccessFlags = 0;
+		tex_desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+		bool created = decoded && SUCCEEDED(device->CreateTexture2D(&tex_desc, nullptr, &new_texture));
+
+		if (created && FAILED(device->CreateShaderResourceView(new_texture, nullptr, &srv)))
+		{
+			SAFE_RELEASE(new_texture);
+			created = false;
+		}
+
+		if (created)
+		{
+			ctx->CopyResource(new_texture, staging);
+
+			texStruct.texPtr = new_texture;
+			texStruct.srvPtr = srv;
+			texStruct.width = width;
+			texStruct.height = height;
+		}
+
+		SAFE_RELEASE(ctx);
+		SAFE_RELEASE(staging);
+
+		return created;
+	}
+
+	// The whole data window of file into target, which has to be RGBA16F
+	static void ReadEXR(Imf_2_2::RgbaInputFile& file, const DecodeTarget& target)
+	{
+		Imath_2_2::Box2i dw = file.dataWindow();
+
+		const size_t stride = target.rowPitch / sizeof(Imf_2_2::Rgba);
+		Imf_2_2::Rgba *pixels = static_cast<Imf_2_2::Rgba*>(target.data);
+
+		file.setFrameBuffer(pixels - dw.min.x - ptrdiff_t(dw.min.y) * ptrdiff_t(stride), 1, stride);
+		file.readPixels(dw.min.y, dw.max.y);
+	}
+
+	// Mip chain below a float RGBA image, its levels appended to data
+	void AppendFloatMips(const float* rgba, int width, int height, std::vector<MipLevel>& mips, std::vector<D3D11_SUBRESOURCE_DATA>& data)
+	{
+		PERF_CPU_SCOPED("CPU > Mip Chain");
+
+		BuildMipChain(rgba, width, height, mips);
+
+		for (auto& level : mips)
+		{
+			D3D11_SUBRESOURCE_DATA sub;
+			ZeroMemory(&sub, sizeof(sub));
+			sub.pSysMem = level.rgba.data();
+			sub.SysMemPitch = level.width * 16;
+			data.push_back(sub);
+		}
+	}
+
+	bool UseTiles(int width, int height)
+	{
+		return g_TiledImages || (std::max)(width, height) > D3D11_REQ_TEXTURE2D_U_OR_V_DIMENSION;
+	}
+
+	// Streams the image from its tile store, writing the store first with fill if there is none up to date
+	bool CreateTiledTexture(ID3D11Device* device, const std::string& texName, int width, int height,
+		const std::function<bool(TileStoreWriter&)>& fill, HDRTexture& texStruct)
+	{
+		std::unique_ptr<TileStore> store(new TileStore);
+
+		if (!store->Open(texName))
+		{
+			PERF_CPU_SCOPED("CPU > Tile Store");
+
+			TileStoreWriter writer;
+
+			bool written = writer.Begin(texName, width, height) && fill(writer) && writer.End();
+
+			if (!written || !store->Open(texName))
+			{
+				printf("%s: could not write %s.tiles\n", texName.c_str(), texName.c_str());
+				return false;
+			}
+		}
+
+		texStruct.texPtr = nullptr;
+		texStruct.srvPtr = nullptr;
+		texStruct.width = width;
+		texStruct.height = height;
+		texStruct.tiled = new TiledImageSource(device, store.release(), g_TileCacheTiles);
+
+		return true;
+	}
+
+	bool CreateBC6HTexture(ID3D11Device* device, const BC6HImage& image, HDRTexture& texStruct)
+	{
+		ID3D11Texture2D* new_texture = nullptr;
+		ID3D11ShaderResourceView *srv = nullptr;
+
+		D3D11_SUBRESOURCE_DATA data;
+		ZeroMemory(&data, sizeof(data));
+		data.pSysMem = image.blocks.data();
+		data.SysMemPitch = (image.width / 4) * 16;
+
+		if (!CreateImmutableTexture(device, DXGI_FORMAT_BC6H_UF16, image.width, image.height, &data, &new_texture, &srv))
+			return false;
+
+		texStruct.texPtr = new_texture;
+		texStruct.srvPtr = srv;
+		texStruct.width = image.width;
+		texStruct.height = image.height;
+
+		return true;
+	}
+
+	// report how close image is to its source, false if it is too far off to use
+	bool BC6HAcceptable(const std::string& texName, const BC6HImage& image)
+	{
+		printf("%s: BC6H quality %d, PSNR %.2f dB, Delta E ITP mean %.2f max %.2f\n", texName.c_str(), image.quality,
+			image.error.psnr, image.error.meanDeltaE, image.error.maxDeltaE);
+
+		if (g_BC6HMaxDeltaE > 0.0f && image.error.meanDeltaE > g_BC6HMaxDeltaE)
+		{
+			printf("%s: mean Delta E above %.2f, left uncompressed\n", texName.c_str(), g_BC6HMaxDeltaE);
+			return false;
+		}
+
+		return true;
+	}
+
+	// The compressed copy cached next to texName, rejected is set if there is one but it is too far off
+	bool LoadCachedBC6H(ID3D11Device* device, const std::string& texName, HDRTexture& texStruct, bool& rejected)
+	{
+		BC6HImage image;
+
+		rejected = false;
+
+		if (!ReadBC6HCache(texName, g_BC6HQuality, image))
+			return false;
+
+		rejected = !BC6HAcceptable(texName, image);
+
+		return !rejected && CreateBC6HTexture(device, image, texStruct);
+	}
+
+	// Compress rgba and cache the result whether it is used or not, so the next load skips the encode
+	bool EncodeBC6HTexture(ID3D11Device* device, const std::string& texName, const float* rgba, int width, int height, HDRTexture& texStruct)
+	{
+		if (width % 4 || height % 4)
+		{
+			printf("%s: %d x %d is not a multiple of the 4x4 blocks, left uncompressed\n", texName.c_str(), width, height);
+			return false;
+		}
+
+		BC6HImage image;
+
+		{
+			PERF_CPU_SCOPED("CPU > BC6H Encode");
+			EncodeBC6H(rgba, width, height, g_BC6HQuality, image);
+		}
+
+		WriteBC6HCache(texName, image);
+
+		return BC6HAcceptable(texName, image) && CreateBC6HTexture(device, image, texStruct);
+	}
+
 	bool CreateEXRTexture(ID3D11Device* device, const std::string& texName, HDRTexture& texStruct)
 	{
+		PERF_CPU_SCOPED("CPU > Image Load");
+
+		bool cacheRejected = false;
+
+		if (g_BC6HQuality >= 0 && !g_TiledImages && LoadCachedBC6H(device, texName, texStruct, cacheRejected))
+			return true;
+
 		try
 		{
-			Imf_2_2::Array2D<Imf_2_2::Rgba> pixels;
 			int width;
 			int height;
 
@@ -297,20 +653,130 @@ private:
 
 			width = dw.max.x - dw.min.x + 1;
 			height = dw.max.y - dw.min.y + 1;
-			pixels.resizeErase(height, width);
 
-			file.setFrameBuffer(&pixels[0][0] - dw.min.x - dw.min.y * width, 1, width);
-			file.readPixels(dw.min.y, dw.max.y);
+			if (UseTiles(width, height))
+			{
+				// a band of tile rows at a time
+				auto fill = [&](TileStoreWriter& writer)
+				{
+					Imf_2_2::Array2D<Imf_2_2::Rgba> band(VirtualTileSize, width);
+					std::vector<float> rgba(size_t(width) * VirtualTileSize * 4);
+
+					for (int y = 0; y < height; y += VirtualTileSize)
+					{
+						const int rows = (std::min)(VirtualTileSize, height - y);
+
+						file.setFrameBuffer(&band[0][0] - dw.min.x - ptrdiff_t(dw.min.y + y) * width, 1, width);
+						file.readPixels(dw.min.y + y, dw.min.y + y + rows - 1);
+
+						for (size_t i = 0; i < size_t(width) * rows; i++)
+						{
+							const Imf_2_2::Rgba &pixel = band[0][i];
+
+							rgba[i * 4 + 0] = pixel.r;
+							rgba[i * 4 + 1] = pixel.g;
+							rgba[i * 4 + 2] = pixel.b;
+							rgba[i * 4 + 3] = pixel.a;
+						}
+
+						if (!writer.AddRows(rgba.data(), rows))
+							return false;
+					}
+
+					return true;
+				};
+
+				return CreateTiledTexture(device, texName, width, height, fill, texStruct);
+			}
+
+			const bool encode = g_BC6HQuality >= 0 && !cacheRejected;
+
+			// nothing needs the pixels on the CPU, decode into the upload itself
+			if (!encode && !g_MipMaps)
+			{
+				auto decode = [&](const DecodeTarget& target)
+				{
+					try
+					{
+						ReadEXR(file, target);
+					}
+					catch (...)
+					{
+						return false;
+					}
+
+					return true;
+				};
+
+				return CreateDecodedTexture(device, DXGI_FORMAT_R16G16B16A16_FLOAT, DecodeRGBA16F, width, height, decode, texStruct);
+			}
+
+			PixelLease pixelLease = LeasePixels<Imf_2_2::Rgba>(size_t(width) * height);
+
+			if (!pixelLease)
+				return false;
+
+			Imf_2_2::Rgba *pixels = pixelLease.As<Imf_2_2::Rgba>();
+
+			ReadEXR(file, PackedTarget(pixels, width, height, DecodeRGBA16F));
+
+			// float copy for the BC6H encoder and the mip chain
+			PixelLease rgbaLease;
+			float *rgba = nullptr;
+
+			if (encode || g_MipMaps)
+			{
+				rgbaLease = LeasePixels<float>(size_t(width) * height * 4);
+				rgba = rgbaLease.As<float>();
+
+				if (!rgba)
+					return false;
+
+				for (size_t i = 0; i < size_t(width) * height; i++)
+				{
+					const Imf_2_2::Rgba &pixel = pixels[i];
+
+					rgba[i * 4 + 0] = pixel.r;
+					rgba[i * 4 + 1] = pixel.g;
+					rgba[i * 4 + 2] = pixel.b;
+					rgba[i * 4 + 3] = pixel.a;
+				}
+			}
+
+			if (encode && EncodeBC6HTexture(device, texName, rgba, width, height, texStruct))
+				return true;
 
 			ID3D11Texture2D* new_texture = nullptr;
 			ID3D11ShaderResourceView *srv = nullptr;
 
-			D3D11_SUBRESOURCE_DATA data;
-			ZeroMemory(&data, sizeof(data));
-			data.pSysMem = pixels[0];
-			data.SysMemPitch = width * 8;
+			std::vector<D3D11_SUBRESOURCE_DATA> data(1);
+			ZeroMemory(data.data(), sizeof(D3D11_SUBRESOURCE_DATA));
+			data[0].pSysMem = pixels;
+			data[0].SysMemPitch = width * 8;
+
+			// the chain is filtered in float and stored back as half
+			std::vector<MipLevel> mips;
+			std::vector<std::vector<Imf_2_2::Rgba>> halfMips;
 
-			if (!CreateImmutableTexture(device, DXGI_FORMAT_R16G16B16A16_FLOAT, width, height, &data, &new_texture, &srv))
+			if (g_MipMaps)
+			{
+				AppendFloatMips(rgba, width, height, mips, data);
+				halfMips.resize(mips.size());
+
+				for (size_t level = 0; level < mips.size(); level++)
+				{
+					const std::vector<float> &src = mips[level].rgba;
+					halfMips[level].resize(src.size() / 4);
+
+					for (size_t i = 0; i < halfMips[level].size(); i++)
+						halfMips[level][i] = Imf_2_2::Rgba(src[i * 4 + 0], src[i * 4 + 1], src[i * 4 + 2], src[i * 4 + 3]);
+
+					data[level + 1].pSysMem = halfMips[level].data();
+					data[level + 1].SysMemPitch = mips[level].width * 8;
+				}
+			}
+
+			if (!CreateImmutableTexture(device, DXGI_FORMAT_R16G16B16A16_FLOAT, width, height, data.data(), &new_texture, &srv, UINT(data.size())))
 				return false;
 
 			texStruct.texPtr = new_texture;
@@ -325,74 +791,232 @@ private:
 		return true;
 	}
 
-	bool CreateHDRTexture(ID3D11Device *device, const std::string &texName, HDRTexture &texStruct)
+	// RGBE bytes straight to RGB9E5, falls back to float if the image goes past what RGB9E5 holds
+	bool CreateRGB9E5Texture(ID3D11Device *device, RGBEReader &reader, const std::string &texName, int width, int height, HDRTexture &texStruct)
 	{
-		int width, height;
-		FILE *fp = fopen(texName.c_str(), "rb");
+		const size_t pixels = size_t(width) * height;
+		PixelLease rgbeLease = LeasePixels<unsigned char>(pixels * 4);
+		PixelLease packedLease = LeasePixels<uint32_t>(pixels);
+		PixelLease rgbaLease;
+
+		unsigned char *rgbe = rgbeLease.As<unsigned char>();
+		uint32_t *packed = packedLease.As<uint32_t>();
+
+		if (!rgbe || !packed || !reader.ReadImageRaw(rgbe))
+			return false;
+
+		ConvertRGBEToRGB9E5(rgbe, packed, pixels);
 
-		if (fp)
+		RGB9E5Check check = CheckRGB9E5(rgbe, packed, pixels);
+
+		D3D11_SUBRESOURCE_DATA data;
+		ZeroMemory(&data, sizeof(data));
+		data.pSysMem = packed;
+		data.SysMemPitch = width * 4;
+
+		DXGI_FORMAT format = DXGI_FORMAT_R9G9B9E5_SHAREDEXP;
+
+		if (check.clamped || check.maxError > RGB9E5Tolerance)
 		{
-			rgbe_header_info header;
+			printf("%s: %d pixels above %g, max error %g, loading as float\n", texName.c_str(), int(check.clamped), RGB9E5Max, check.maxError);
+
+			rgbaLease = LeasePixels<float>(pixels * 4);
+			float *rgba = rgbaLease.As<float>();
 
-			if (!RGBE_ReadHeader(fp, &width, &height, &header))
+			if (!rgba)
+				return false;
+
+			for (size_t i = 0; i < pixels; i++)
 			{
+				rgbe2float(&rgba[i * 4 + 0], &rgba[i * 4 + 1], &rgba[i * 4 + 2], &rgbe[i * 4]);
+				rgba[i * 4 + 3] = 1.0f;
+			}
+
+			data.pSysMem = rgba;
+			data.SysMemPitch = width * 16;
+			format = DXGI_FORMAT_R32G32B32A32_FLOAT;
+		}
+
+		ID3D11Texture2D* new_texture = nullptr;
+		ID3D11ShaderResourceView *srv = nullptr;
+
+		if (!CreateImmutableTexture(device, format, width, height, &data, &new_texture, &srv))
+			return false;
 
-				float* data = new float[width*height * 3];
+		texStruct.texPtr = new_texture;
+		texStruct.srvPtr = srv;
+		texStruct.width = width;
+		texStruct.height = height;
 
-				if (!RGBE_ReadPixels_RLE(fp, (float*)data, width, height)) {
-					float* rgba = new float[width*height * 4];
+		return true;
+	}
+
+	bool CreateHDRTexture(ID3D11Device *device, const std::string &texName, HDRTexture &texStruct)
+	{
+		PERF_CPU_SCOPED("CPU > Image Load");
+
+		bool cacheRejected = false;
+
+		if (g_BC6HQuality >= 0 && !g_TiledImages && LoadCachedBC6H(device, texName, texStruct, cacheRejected))
+			return true;
+
+		MappedFile file;
 
-					//convert to rgba
-					for (int i = 0; i < (width*height); i++)
+		if (!file.Open(texName.c_str()))
+			return false;
+
+		RGBEReader reader(file.Data(), file.Size());
+		rgbe_header_info header;
+		int width, height;
+
+		if (!reader.ReadHeader(width, height, &header))
+			return false;
+
+		if (UseTiles(width, height))
+		{
+			// scanlines follow the header, read a band of tile rows at a time
+			auto fill = [&](TileStoreWriter& writer)
+			{
+				// scanlines that are not rows top down need the whole image before any band is complete
+				if (!reader.RowOrder())
+				{
+					PixelLease imageLease = LeasePixels<float>(size_t(width) * height * 4);
+					float* image = imageLease.As<float>();
+
+					if (!image || !DecodeRGBE(reader, PackedTarget(image, width, height, DecodeRGBA32F)))
+						return false;
+
+					for (int y = 0; y < height; y += VirtualTileSize)
 					{
-						rgba[i * 4 + 0] = data[i * 3 + 0];
-						rgba[i * 4 + 1] = data[i * 3 + 1];
-						rgba[i * 4 + 2] = data[i * 3 + 2];
-						rgba[i * 4 + 3] = 1.0f;
+						if (!writer.AddRows(image + size_t(y) * width * 4, (std::min)(VirtualTileSize, height - y)))
+							return false;
 					}
 
-					ID3D11Texture2D* new_texture = nullptr;
-					ID3D11ShaderResourceView *srv = nullptr;
+					return true;
+				}
 
-					D3D11_SUBRESOURCE_DATA data;
-					ZeroMemory(&data, sizeof(data));
-					data.pSysMem = rgba;
-					data.SysMemPitch = width * 16;
+				std::vector<float> rgba(size_t(width) * VirtualTileSize * 4);
 
-					if (!CreateImmutableTexture(device, DXGI_FORMAT_R32G32B32A32_FLOAT, width, height, &data, &new_texture, &srv))
+				for (int y = 0; y < height; y += VirtualTileSize)
+				{
+					const int rows = (std::min)(VirtualTileSize, height - y);
+
+					if (!DecodeRGBE(reader, PackedTarget(rgba.data(), width, rows, DecodeRGBA32F)))
+						return false;
+
+					if (!writer.AddRows(rgba.data(), rows))
 						return false;
+				}
+
+				return true;
+			};
+
+			return CreateTiledTexture(device, texName, width, height, fill, texStruct);
+		}
+
+		if (g_RGB9E5 && (g_BC6HQuality < 0 || cacheRejected))
+			return CreateRGB9E5Texture(device, reader, texName, width, height, texStruct);
+
+		const bool encode = g_BC6HQuality >= 0 && !cacheRejected;
+
+		// nothing needs the pixels on the CPU, decode into the upload itself
+		if (!encode && !g_MipMaps)
+		{
+			auto decode = [&](const DecodeTarget& target) { return DecodeRGBE(reader, target); };
+
+			return CreateDecodedTexture(device, DXGI_FORMAT_R32G32B32A32_FLOAT, DecodeRGBA32F, width, height, decode, texStruct);
+		}
+
+		PixelLease rgbaLease = LeasePixels<float>(size_t(width) * height * 4);
+		float* rgba = rgbaLease.As<float>();
+
+		if (!rgba || !DecodeRGBE(reader, PackedTarget(rgba, width, height, DecodeRGBA32F)))
+			return false;
+
+		if (encode && EncodeBC6HTexture(device, texName, rgba, width, height, texStruct))
+			return true;
+
+		ID3D11Texture2D* new_texture = nullptr;
+		ID3D11ShaderResourceView *srv = nullptr;
+
+		std::vector<D3D11_SUBRESOURCE_DATA> data(1);
+		ZeroMemory(data.data(), sizeof(D3D11_SUBRESOURCE_DATA));
+		data[0].pSysMem = rgba;
+		data[0].SysMemPitch = width * 16;
+
+		std::vector<MipLevel> mips;
+
+		if (g_MipMaps)
+			AppendFloatMips(rgba, width, height, mips, data);
+
+		if (!CreateImmutableTexture(device, DXGI_FORMAT_R32G32B32A32_FLOAT, width, height, data.data(), &new_texture, &srv, UINT(data.size())))
+			return false;
+
+		texStruct.texPtr = new_texture;
+		texStruct.srvPtr = srv;
+		texStruct.width = width;
+		texStruct.height = height;
+
+		return true;
+	}
+
+	// One frame of a sequence as half RGBA, on the reader's threads. A width of 0
+	// takes whatever size the file is, otherwise it has to match.
+	static bool DecodeSequenceFrame(const std::string& file, int width, int height, SequenceFrame& frame)
+	{
+		PERF_CPU_SCOPED("CPU > Sequence Decode");
+
+		if (file.rfind(".exr") != std::string::npos)
+		{
+			try
+			{
+				Imf_2_2::RgbaInputFile input(file.c_str());
+				Imath_2_2::Box2i dw = input.dataWindow();
+
+				frame.width = dw.max.x - dw.min.x + 1;
+				frame.height = dw.max.y - dw.min.y + 1;
+
+				if (width && (frame.width != width || frame.height != height))
+					return false;
+
+				// Imf_2_2::Rgba is the same four halves the texture takes
+				frame.rgba.resize(size_t(frame.width) * frame.height * 4);
+				ReadEXR(input, PackedTarget(frame.rgba.data(), frame.width, frame.height, DecodeRGBA16F));
+			}
+			catch (...)
+			{
+				return false;
+			}
+
+			return true;
+		}
+
+		MappedFile mapped;
+
+		if (!mapped.Open(file.c_str()))
+			return false;
 
-					texStruct.texPtr = new_texture;
-					texStruct.srvPtr = srv;
-					texStruct.width = width;
-					texStruct.height = height;
+		RGBEReader reader(mapped.Data(), mapped.Size());
 
-					delete[] rgba;
+		if (!reader.ReadHeader(frame.width, frame.height) || (width && (frame.width != width || frame.height != height)))
+			return false;
 
-				}
-				delete[] data;
+		frame.rgba.resize(size_t(frame.width) * frame.height * 4);
 
-			}
-			else
-			{
-				fclose(fp);
-				return false;
-			}
-			fclose(fp);
-			return true;
-		}
-		return false;
+		return DecodeRGBE(reader, PackedTarget(frame.rgba.data(), frame.width, frame.height, DecodeRGBA16F));
 	}
 
 public:
 	SceneController() :
 		tonemapperSettings(nullptr),
 		activeTonemapper(VIEW_MODE_INVALID),
-		internalTime(0.0f)
+		internalTime(0.0f),
+		renderedState(0)
 	{
 		memset(intermediateTex, 0, sizeof(intermediateTex));
 		memset(intermediateSRV, 0, sizeof(intermediateSRV));
 		memset(intermediateRTV, 0, sizeof(intermediateRTV));
+		memset(intermediateUAV, 0, sizeof(intermediateUAV));
 	}
 
 
@@ -422,6 +1046,7 @@ public:
 			SAFE_RELEASE(intermediateTex[i]);
 			SAFE_RELEASE(intermediateSRV[i]);
 			SAFE_RELEASE(intermediateRTV[i]);
+			SAFE_RELEASE(intermediateUAV[i]);
 		}
 
 		D3D11_TEXTURE2D_DESC tDesc;
@@ -431,7 +1056,7 @@ public:
 		tDesc.Height = g_Height;
 		tDesc.ArraySize = 1;
 		tDesc.MipLevels = 1;
-		tDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D10_BIND_RENDER_TARGET;
+		tDesc.BindFlags = D3D11_BIND_SHADER_RESOURCE | D3D10_BIND_RENDER_TARGET | D3D11_BIND_UNORDERED_ACCESS;
 		tDesc.SampleDesc.Count = 1;
 		tDesc.SampleDesc.Quality = 0;
 		tDesc.Usage = D3D11_USAGE_DEFAULT;
@@ -451,6 +1076,13 @@ public:
 		rDesc.ViewDimension = D3D11_RTV_DIMENSION_TEXTURE2D;
 		rDesc.Texture2D.MipSlice = 0;
 
+
+		D3D11_UNORDERED_ACCESS_VIEW_DESC uDesc;
+		ZeroMemory(&uDesc, sizeof(uDesc));
+		uDesc.Format = DXGI_FORMAT_R16G16B16A16_FLOAT;
+		uDesc.ViewDimension = D3D11_UAV_DIMENSION_TEXTURE2D;
+		uDesc.Texture2D.MipSlice = 0;
+
 		printf("Creating intermediates at %d x %d\n", g_Width, g_Height);
 
 		for (int i = 0; i < intermediateCount; i++)
@@ -458,12 +1090,15 @@ public:
 			SAFE_RELEASE(intermediateTex[i]);
 			SAFE_RELEASE(intermediateRTV[i]);
 			SAFE_RELEASE(intermediateSRV[i]);
+			SAFE_RELEASE(intermediateUAV[i]);
 
 			device->CreateTexture2D(&tDesc, nullptr, &intermediateTex[i]);
 
 			device->CreateShaderResourceView(intermediateTex[i], &sDesc, &intermediateSRV[i]);
 
 			device->CreateRenderTargetView(intermediateTex[i], &rDesc, &intermediateRTV[i]);
+
+			device->CreateUnorderedAccessView(intermediateTex[i], &uDesc, &intermediateUAV[i]);
 		}
 
 	}
@@ -491,6 +1126,11 @@ public:
 			_ASSERT(!FAILED(hr));
 		}
 
+		{
+			PERF_CPU_SCOPED("CPU > Shader Compile");
+			PrecompileShaders(StartupShaders, sizeof(StartupShaders) / sizeof(StartupShaders[0]), D3D10_SHADER_ENABLE_STRICTNESS);
+		}
+
 		ID3DBlob* pShaderBuffer = NULL;
 		void* ShaderBufferData;
 		SIZE_T  ShaderBufferSize;
@@ -523,6 +1163,24 @@ public:
 			compositor = new Compositor(device);
 			compositor->InitUI();
 
+			// take the fused and tiled variants while the precompiled ones are still around
+			for (auto creator : TonemapperList)
+			{
+				tonemappers[creator->Mode]->FusedPS();
+				tonemappers[creator->Mode]->TiledCS();
+			}
+
+			ldr->FusedPS();
+			ldr->TiledCS();
+			xform->FusedPS();
+
+			calibration = new CalibrationPass(device);
+			calibration->InitUI();
+			if (g_CalibrationTable.size())
+			{
+				calibration->Load(g_CalibrationTable.c_str(), g_CalibrationSettings);
+			}
+
 		}
 		{
 			D3D11_RASTERIZER_DESC desc;
@@ -553,6 +1211,11 @@ public:
 			desc.MinLOD = 0;
 			desc.MaxLOD = D3D11_FLOAT32_MAX;
 			device->CreateSamplerState(&desc, &this->samp_linear_wrap);
+
+			// same, anisotropic for the transform's source when the aspect is stretched
+			desc.Filter = D3D11_FILTER_ANISOTROPIC;
+			desc.MaxAnisotropy = 8;
+			device->CreateSamplerState(&desc, &this->samp_aniso_wrap);
 		}
 		{
 			D3D11_DEPTH_STENCIL_DESC desc;
@@ -579,43 +1242,8 @@ public:
 			desc.RenderTarget[0].RenderTargetWriteMask = D3D11_COLOR_WRITE_ENABLE_ALL;
 			device->CreateBlendState(&desc, &this->blend_state_disabled);
 		}
-		{
-			D3D11_BUFFER_DESC desc;
-			ZeroMemory(&desc, sizeof(desc));
-			desc.ByteWidth = 256;
-			desc.Usage = D3D11_USAGE_DEFAULT;
-			desc.BindFlags = D3D11_BIND_UNORDERED_ACCESS;
-			desc.CPUAccessFlags = 0;
-			desc.MiscFlags = 0;
-			desc.StructureByteStride = 0;
-
-			device->CreateBuffer(&desc, nullptr, &feedbackBuf);
-		}
-
-		{
-			D3D11_BUFFER_DESC desc;
-			ZeroMemory(&desc, sizeof(desc));
-			desc.ByteWidth = 256;
-			desc.Usage = D3D11_USAGE_DYNAMIC;
-			desc.BindFlags = D3D11_BIND_VERTEX_BUFFER;
-			desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE; //actually cheating and reading
-			desc.MiscFlags = 0;
-			desc.StructureByteStride = 0;
-
-			device->CreateBuffer(&desc, nullptr, &readbackBuf);
-		}
-
-		{
-			D3D11_UNORDERED_ACCESS_VIEW_DESC desc;
-			ZeroMemory(&desc, sizeof(desc));
-			desc.Format = DXGI_FORMAT_R32_FLOAT;
-			desc.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
-			desc.Buffer.FirstElement = 0;
-			desc.Buffer.NumElements = 8;
-			desc.Buffer.Flags = 0;
-
-			device->CreateUnorderedAccessView(feedbackBuf, &desc, &feedbackUAV);
-		}
+		probe = new PixelProbe(device);
+		probe->SetSize(g_ProbeSize);
 
 		// Data used for auto-exposure
 		{
@@ -662,6 +1290,10 @@ public:
 
 		exposurePass = new ExposureReduction(device);
 
+		tiledPass = new TiledPass(device);
+
+		ReleasePrecompiledShaders();
+
 		//create the intermediate surface
 		CreateIntermediate(device);
 
@@ -671,6 +1303,9 @@ public:
 			{
 				std::string &filepath = *it;
 				HDRTexture texStruct;
+				texStruct.tiled = nullptr;
+				texStruct.sequence = nullptr;
+				texStruct.name = filepath;
 
 				if (filepath.rfind(".exr") != std::string::npos)
 				{
@@ -695,6 +1330,40 @@ public:
 				}
 
 
+				textures.push_back(texStruct);
+			}
+
+			// sequences follow the images, paged to with v/V the same way
+			for (auto it = g_Sequences.begin(); it < g_Sequences.end(); it++)
+			{
+				std::vector<std::string> files;
+				SequenceFrame first;
+
+				if (!FindSequence(*it, files) || !DecodeSequenceFrame(files[0], 0, 0, first))
+				{
+					printf("%s: no frames found\n", it->c_str());
+					continue;
+				}
+
+				const int width = first.width;
+				const int height = first.height;
+
+				auto decode = [width, height](const std::string& file, SequenceFrame& frame)
+				{
+					return DecodeSequenceFrame(file, width, height, frame);
+				};
+
+				HDRTexture texStruct;
+				texStruct.texPtr = nullptr;
+				texStruct.srvPtr = nullptr;
+				texStruct.width = width;
+				texStruct.height = height;
+				texStruct.tiled = nullptr;
+				texStruct.sequence = new SequenceSource(device, files, decode, width, height, g_SequenceFPS, g_SequenceReadAhead);
+				texStruct.name = *it;
+
+				printf("%s: %d frames of %d x %d at %g fps\n", it->c_str(), int(files.size()), width, height, g_SequenceFPS);
+
 				textures.push_back(texStruct);
 			}
 		}
@@ -735,6 +1404,9 @@ public:
 			texStruct.srvPtr = patternSRV;
 			texStruct.width = patternGen->Width();
 			texStruct.height = patternGen->Height();
+			texStruct.tiled = nullptr;
+			texStruct.sequence = nullptr;
+			texStruct.name = "Test Pattern";
 
 			textures.push_back(texStruct);
 			
@@ -747,6 +1419,14 @@ public:
 			hr = device->CreateRenderTargetView(patternTex, &rtv_desc, &patternRTV);
 		}
 
+		// files that failed to load are left out, so the UI lists what is here rather than the command line
+		g_TextureListings.clear();
+		for (auto &texture : textures)
+		{
+			TextureListing listing = { texture.name, !texture.sequence && texture.srvPtr != patternSRV };
+			g_TextureListings.push_back(listing);
+		}
+
 		return S_OK;
 	}
 
@@ -757,6 +1437,7 @@ public:
 		SAFE_RELEASE(this->quad_vs);
 		SAFE_RELEASE(this->rs_state);
 		SAFE_RELEASE(this->samp_linear_wrap);
+		SAFE_RELEASE(this->samp_aniso_wrap);
 		SAFE_RELEASE(this->ds_state);
 		SAFE_RELEASE(this->ds_state_disabled);
 		SAFE_RELEASE(this->blend_state_disabled);
@@ -765,11 +1446,11 @@ public:
 			SAFE_RELEASE(intermediateTex[i]);
 			SAFE_RELEASE(intermediateSRV[i]);
 			SAFE_RELEASE(intermediateRTV[i]);
+			SAFE_RELEASE(intermediateUAV[i]);
 		}
 
-		SAFE_RELEASE(feedbackBuf);
-		SAFE_RELEASE(readbackBuf);
-		SAFE_RELEASE(feedbackUAV);
+		delete probe;
+		probe = nullptr;
 
 		SAFE_RELEASE(exposureSRV);
 		SAFE_RELEASE(exposureUAV);
@@ -778,6 +1459,9 @@ public:
 		delete exposurePass;
 		exposurePass = nullptr;
 
+		delete tiledPass;
+		tiledPass = nullptr;
+
 		// Tex handle and srv taken care of since they are in the texture array
 		SAFE_RELEASE(patternRTV);
 
@@ -785,10 +1469,25 @@ public:
 		{
 			SAFE_RELEASE(it->texPtr);
 			SAFE_RELEASE(it->srvPtr);
+			delete it->tiled;
+
+			if (it->sequence)
+			{
+				const SequenceSource::Stats &stats = it->sequence->PlaybackStats();
+				printf("Sequence played %llu frames, %llu dropped, %llu late\n",
+					(unsigned long long)stats.shown, (unsigned long long)stats.dropped, (unsigned long long)stats.late);
+			}
+
+			delete it->sequence;
 		}
 
 		textures.resize(0);
 
+		PixelPoolStats poolStats = GetPixelPool().Stats();
+		printf("Pixel pool: %llu leases, %llu reused, peak %.1f MB\n", (unsigned long long)poolStats.leases,
+			(unsigned long long)poolStats.reused, poolStats.peakBytes / (1024.0 * 1024.0));
+		GetPixelPool().Trim();
+
 		for (auto it = tonemappers.begin(); it != tonemappers.end(); it++)
 		{
 			delete it->second;
@@ -803,6 +1502,9 @@ public:
 
 		delete patternGen;
 		patternGen = nullptr;
+
+		delete calibration;
+		calibration = nullptr;
 	}
 
 	virtual void BackBufferResized(ID3D11Device* device, const DXGI_SURFACE_DESC* surface_desc)
@@ -815,6 +1517,42 @@ public:
 		CreateIntermediate(device);
 	}
 
+	// The pass whose fused kernel draws the frame, nullptr when the composite needs the images separately
+	Tonemapper* FusedStage()
+	{
+		if (!g_FusedPipeline || !compositor->Fusable())
+			return nullptr;
+
+		// in the order of the compositor's image list
+		Tonemapper *stages[] = { tonemappers[activeTonemapper], ldr, xform };
+		Tonemapper *stage = stages[compositor->Image() % 3];
+
+		return stage->FusedPS() ? stage : nullptr;
+	}
+
+	// Run the probe centre through the CPU reference of each fused stage, report when the GPU disagrees
+	void ValidateFused(const ProbeResult &result)
+	{
+		Tonemapper *stage = FusedStage();
+		float rgb[3];
+
+		// the stage may have changed in the frames the result took to arrive
+		if (!stage || !xform->Reference(result.center, rgb))
+			return;
+
+		if (stage != xform && !stage->Reference(rgb, rgb))
+			return;
+
+		if (!compositor->Reference(rgb, rgb))
+			return;
+
+		if (!ReferenceMatch(result.output, rgb, 1e-3f))
+		{
+			fprintf(stderr, "Fused kernel differs from the CPU reference at %d, %d: GPU %g %g %g, CPU %g %g %g\n",
+				result.x, result.y, result.output[0], result.output[1], result.output[2], rgb[0], rgb[1], rgb[2]);
+		}
+	}
+
 	virtual void Render(ID3D11Device* device, ID3D11DeviceContext* ctx, ID3D11RenderTargetView* pRTV, ID3D11DepthStencilView* pDSV)
 	{
 		if (activeTonemapper != g_view_mode)
@@ -829,25 +1567,12 @@ public:
 
 		}
 
-
-		//readback the last color values
-		{
-			D3D11_MAPPED_SUBRESOURCE map;
-			ctx->Map( readbackBuf, 0, D3D11_MAP_WRITE_NO_OVERWRITE, 0, &map);
-
-			float* data = (float*)map.pData;
-
-			//reading  white mapped NOOVERWRITE is wrong, but it works well enough here
-			//it alos avoids extraneous code to manage queued feedback
-			g_Red = data[0];
-			g_Green = data[1];
-			g_Blue = data[2];
-
-			ctx->Unmap(readbackBuf,0);
-		}
+		PERF_FRAME_BEGIN(ctx);
 
 		{
+			PERF_EVENT_SCOPED(ctx, "Render Scene");
 			{
+				PERF_EVENT_SCOPED(ctx, "Render > Main");
 
 				float clear_color_scene[4]    = { 1.00f, 1.00f, 1.00f, 0.0f };
 				ctx->ClearRenderTargetView(pRTV, clear_color_scene);
@@ -857,119 +1582,469 @@ public:
 
 				ID3D11ShaderResourceView *srv = nullptr;
 				int tWidth = 0, tHeight = 0;
+				int exposureWidth = 0, exposureHeight = 0;
+				const float *sourceWindow = nullptr;
+
 				if (textures.size())
 				{
 					const HDRTexture &ref = textures[g_tex_index % unsigned int(textures.size())];
-					srv = ref.srvPtr;
-					tWidth = ref.width;
-					tHeight = ref.height;
+					srv = ref.sequence ? ref.sequence->SRV() : ref.srvPtr;
+					tWidth = exposureWidth = ref.width;
+					tHeight = exposureHeight = ref.height;
+
+					//fill the window of a streamed image for what the transform will show
+					if (ref.tiled)
+					{
+						PERF_EVENT_SCOPED(ctx, "Render > Tile Upload");
+
+						xform->SetDimensions(tWidth, tHeight, g_Width, g_Height);
+						srv = ref.tiled->Update(ctx, xform->View());
+						sourceWindow = ref.tiled->Window();
+						exposureWidth = ref.tiled->ValidWidth();
+						exposureHeight = ref.tiled->ValidHeight();
+					}
+				}
+
+				xform->SetSourceWindow(sourceWindow);
+
+				// Compute auto-exposure from the image, or the part of it on screen when streamed
+				PERF_EVENT_BEGIN(ctx, "Render > Exposure");
+				exposurePass->Process(ctx, srv, exposureUAV, exposureWidth, exposureHeight);
+				PERF_EVENT_END(ctx);
+
+				// Common sampler setup for all shaders, and the mip sampler for the source image
+				ctx->PSSetSamplers(0, 1, &samp_linear_wrap);
+				ctx->PSSetSamplers(2, 1, &samp_aniso_wrap);
+
+				// Full screen quad to fill the background
+				UINT quad_strides = sizeof(float) * 2;
+				UINT quad_offsets = 0;
+				ctx->VSSetShader(this->quad_vs, nullptr, 0);
+				ctx->IASetInputLayout(this->quad_layout);
+				ctx->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+				ctx->IASetVertexBuffers(0, 1, &this->quad_verts, &quad_strides, &quad_offsets);
+				ctx->OMSetDepthStencilState(this->ds_state_disabled, 0xFF);
+
+				ctx->OMSetBlendState(this->blend_state_disabled, nullptr, 0xFFFFFFFF);
+				ctx->RSSetState(this->rs_state);
+
+				D3D11_RECT default_scissor =
+				{
+					0,
+					0,
+					g_Width,
+					g_Height
+				};
+				ctx->RSSetScissorRects(1, &default_scissor);
+
+				D3D11_VIEWPORT viewport =
+				{
+					0.0f, 0.0f, // top left coords
+					float(g_Width), float(g_Height), // width height
+					0.0f, 1.0f // min/max depth
+				};
+
+				// render the test pattern if necessary
+				if (patternGen->Dirty())
+				{
+					viewport.Width = float(patternGen->Width());
+					viewport.Height = float(patternGen->Height());
+					ctx->OMSetRenderTargets(1, &patternRTV, nullptr);
+					ctx->RSSetViewports( 1, &viewport);
+
+					patternGen->SetupTonemapShader(ctx, nullptr);
+					ctx->Draw(6, 0);
+				}
+
+				viewport.Width = float(g_Width);
+				viewport.Height = float(g_Height);
+				ctx->RSSetViewports(1, &viewport);
+
+				xform->SetDimensions( tWidth, tHeight, g_Width, g_Height);
+				xform->SetReadback(g_MouseX, g_MouseY, probe->Radius());
+
+				ID3D11UnorderedAccessView *probeUAV = probe->Begin(ctx, g_MouseX, g_MouseY);
+
+				//composite, through the spare intermediate when calibrating
+				const bool calibrate = calibration->Active();
+				ID3D11RenderTargetView *compositeRTV = calibrate ? intermediateRTV[3] : pRTV;
+
+				Tonemapper *fused = FusedStage();
+
+				if (fused)
+				{
+					//transform, tonemap and composite in one kernel, straight to the composite target
+					PERF_EVENT_BEGIN(ctx, "Render > Fused");
+					ctx->OMSetRenderTargetsAndUnorderedAccessViews(1, &compositeRTV, pDSV, 1, 1, &probeUAV, nullptr);
+
+					if (fused != xform)
+						fused->SetupTonemapShader(ctx, nullptr);
+
+					xform->SetupFusedStage(ctx, srv, exposureSRV);
+					compositor->SetupFusedFade(ctx);
+					ctx->PSSetShader(fused->FusedPS(), nullptr, 0);
+
+					ctx->Draw(6, 0);
+
+					probe->End(ctx);
+					PERF_EVENT_END(ctx);
+				}
+				else
+				{
+					//Run a pre transform on the scene to allow exposure adjustment and grading tweaks
+					PERF_EVENT_BEGIN(ctx, "Render > Transform");
+					ctx->OMSetRenderTargetsAndUnorderedAccessViews(1, &intermediateRTV[0], nullptr, 1, 1, &probeUAV, nullptr);
+
+					//have the tonemapper setup its parameters
+					xform->SetupTransformPass(ctx, srv, exposureSRV);
+
+					ctx->Draw(6, 0);
+
+					probe->End(ctx);
+					PERF_EVENT_END(ctx);
+
+					//the tonemaps only need the tiles the image covers
+					const TileRect imageRect = xform->ImageRect();
+
+					if (g_ComputeTonemap)
+						ctx->OMSetRenderTargets(0, nullptr, nullptr);
+
+					//render hdr tonemap
+					PERF_EVENT_BEGIN(ctx, "Render > Tonemap");
+					if (!g_ComputeTonemap || !tiledPass->Run(ctx, tonemapper, intermediateSRV[0], intermediateUAV[1], g_Width, g_Height, imageRect))
+					{
+						ctx->OMSetRenderTargets(1, &intermediateRTV[1], pDSV);
+
+						//have the tonemapper setup its parameters
+						tonemapper->SetupTonemapShader(ctx, intermediateSRV[0]);
+
+						ctx->Draw(6, 0);
+					}
+					PERF_EVENT_END(ctx);
+
+					//render ldr tonemap
+					PERF_EVENT_BEGIN(ctx, "Render > LDR");
+					if (!g_ComputeTonemap || !tiledPass->Run(ctx, ldr, intermediateSRV[0], intermediateUAV[2], g_Width, g_Height, imageRect))
+					{
+						ctx->OMSetRenderTargets(1, &intermediateRTV[2], pDSV);
+
+						ldr->SetupTonemapShader(ctx, intermediateSRV[0]);
+						ctx->Draw(6, 0);
+					}
+					PERF_EVENT_END(ctx);
+
+					ctx->OMSetRenderTargets(1, &compositeRTV, pDSV);
+
+					PERF_EVENT_BEGIN(ctx, "Render > Composite");
+					compositor->SetupShader(ctx, intermediateSRV + 1);
+
+					ctx->Draw(6, 0);
+					PERF_EVENT_END(ctx);
+				}
+
+				if (calibrate)
+				{
+					PERF_EVENT_BEGIN(ctx, "Render > Calibration");
+					ctx->OMSetRenderTargets(1, &pRTV, pDSV);
+
+					calibration->SetupTonemapShader(ctx, intermediateSRV[3]);
+
+					ctx->Draw(6, 0);
+					PERF_EVENT_END(ctx);
 				}
 
-				// Compute auto-exposure from the image
-				exposurePass->Process(ctx, srv, exposureUAV, tWidth, tHeight);
+				ctx->RSSetScissorRects(1, &default_scissor);
+
+			}
+
+			// Reset RT and SRV state
+			ID3D11ShaderResourceView* nullAttach[16] = {nullptr};
+			ctx->PSSetShaderResources(0, 16, nullAttach);
+			ctx->OMSetRenderTargets(0, nullptr, nullptr);
+		}
+
+		PERF_FRAME_END(ctx);
+	}
+
+	virtual void Animate(double fElapsedTimeSeconds) override
+	{
+		internalTime = float(fmod(internalTime + fElapsedTimeSeconds, 60.0));
+		compositor->setScroll(internalTime / 15.0f, 0.0f);
+
+		ID3D11DeviceContext *ctx = nullptr;
+		g_device_manager->GetDevice()->GetImmediateContext(&ctx);
+
+		unsigned int request = g_TexRequest.exchange(NoTexRequest);
+
+		if (request != NoTexRequest)
+			g_tex_index = request;
+
+		FrameState state;
+		state.Track(g_tex_index);
+		state.Track(g_view_mode);
+		state.Track(g_Width);
+		state.Track(g_Height);
+		state.Track(g_MouseX);
+		state.Track(g_MouseY);
+
+		if (textures.size())
+		{
+			const HDRTexture &ref = textures[g_tex_index % unsigned(textures.size())];
+
+			// streamed tiles arriving change the picture
+			if (ref.tiled)
+				state.Track(ref.tiled->Poll());
+
+			// a playing sequence presents every refresh, so each one shows the frame due for it
+			if (ref.sequence)
+			{
+				ref.sequence->Update(ctx, PerfTracker::clock_seconds());
+				g_device_manager->Invalidate();
+			}
+		}
+
+		tonemappers[g_view_mode]->TrackState(state);
+		xform->TrackState(state);
+		ldr->TrackState(state);
+		patternGen->TrackState(state);
+		compositor->TrackState(state);
+		calibration->TrackState(state);
+
+		if (state.Hash() != renderedState)
+		{
+			renderedState = state.Hash();
+			g_device_manager->Invalidate();
+		}
+
+		// probe values arrive a few frames late, redraw the HUD once they do
+		if (probe->Poll(ctx))
+		{
+			const ProbeResult &latest = probe->Latest();
+
+			if (memcmp(&latest, &g_Probe, offsetof(ProbeResult, frame)) != 0)
+				g_device_manager->Invalidate();
+
+			if (g_ValidateFused && latest.hasOutput)
+				ValidateFused(latest);
+
+			g_Probe = latest;
+			g_Red = latest.center[0];
+			g_Green = latest.center[1];
+			g_Blue = latest.center[2];
+		}
+
+		SAFE_RELEASE(ctx);
+	}
+
+	// probe copies and streamed tiles complete without a window message to wake the loop
+	virtual DWORD IdleTimeout() override
+	{
+		if (probe && probe->Pending())
+			return 10;
+
+		if (textures.size())
+		{
+			const HDRTexture &ref = textures[g_tex_index % unsigned(textures.size())];
+
+			if (ref.tiled && ref.tiled->Loading())
+				return 10;
+		}
+
+		return INFINITE;
+	}
+};
+
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Measurement sweep
+//  Steps through the image list while a CS-2000 measures each pattern, replacing the SendKeys
+//  loop in hdr_pattern_measure.m. Pattern levels come from the filename_gen.m file names.
+////////////////////////////////////////////////////////////////////////////////////////////////////
+
+class ViewerPatternSource : public PatternSource
+{
+public:
+	std::vector<float> levels;
+	std::vector<unsigned int> indices;		// texture index showing each level
+	std::atomic<bool> cancel;
+
+	// from the images the scene loaded, so a file that failed to load does not shift the rest
+	ViewerPatternSource() : cancel(false)
+	{
+		for (size_t i = 0; i < g_TextureListings.size(); i++)
+		{
+			const TextureListing &listing = g_TextureListings[i];
+			float level;
+
+			if (!listing.image || !PatternLevelFromFilename(listing.name, &level))
+				continue;
+
+			// Show() could only ever bring up the first of two
+			if (std::find(levels.begin(), levels.end(), level) != levels.end())
+			{
+				fprintf(stderr, "%s: level %g is already measured from another file, skipped\n", listing.name.c_str(), level);
+				continue;
+			}
 
-				// Common sampler setup for all shaders
-				ctx->PSSetSamplers(0, 1, &samp_linear_wrap);
+			levels.push_back(level);
+			indices.push_back(unsigned(i));
+		}
+	}
 
-				// Full screen quad to fill the background
-				UINT quad_strides = sizeof(float) * 2;
-				UINT quad_offsets = 0;
-				ctx->VSSetShader(this->quad_vs, nullptr, 0);
-				ctx->IASetInputLayout(this->quad_layout);
-				ctx->IASetPrimitiveTopology(D3D11_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-				ctx->IASetVertexBuffers(0, 1, &this->quad_verts, &quad_strides, &quad_offsets);
-				ctx->OMSetDepthStencilState(this->ds_state_disabled, 0xFF);
+	bool Show(float level) override
+	{
+		if (cancel)
+			return false;
 
-				ctx->OMSetBlendState(this->blend_state_disabled, nullptr, 0xFFFFFFFF);
-				ctx->RSSetState(this->rs_state);
+		for (size_t i = 0; i < levels.size(); i++)
+		{
+			if (levels[i] == level)
+			{
+				g_TexRequest = indices[i];
+				g_device_manager->Wake();
+				return true;
+			}
+		}
+		return false;
+	}
 
-				D3D11_RECT default_scissor =
-				{
-					0,
-					0,
-					g_Width,
-					g_Height
-				};
-				ctx->RSSetScissorRects(1, &default_scissor);
+	// the panel needs a moment after the next vsync, especially with local dimming
+	double SettleTime() const override { return 1.0; }
+};
 
-				D3D11_VIEWPORT viewport =
-				{
-					0.0f, 0.0f, // top left coords
-					float(g_Width), float(g_Height), // width height
-					0.0f, 1.0f // min/max depth
-				};
+void RunMeasurement(ViewerPatternSource *source)
+{
+	CS2000 instrument(g_MeasurePort.c_str());
 
-				// render the test pattern if necessary
-				if (patternGen->Dirty())
-				{
-					viewport.Width = float(patternGen->Width());
-					viewport.Height = float(patternGen->Height());
-					ctx->OMSetRenderTargets(1, &patternRTV, nullptr);
-					ctx->RSSetViewports( 1, &viewport);
+	if (instrument.Open())
+	{
+		MeasurementSequencer sequencer(&instrument, source);
+		std::vector<MeasurementPoint> points;
 
-					patternGen->SetupTonemapShader(ctx, nullptr);
-					ctx->Draw(6, 0);
-				}
+		bool ok;
+		if (g_MeasureAdaptive)
+		{
+			// only measure the patterns needed to pin down the curve
+			ok = sequencer.Run(AdaptiveSampler(source->levels), points);
+			std::sort(points.begin(), points.end(), [](const MeasurementPoint &a, const MeasurementPoint &b) { return a.level < b.level; });
+		}
+		else
+		{
+			ok = sequencer.Run(source->levels, points);
+		}
 
-				viewport.Width = float(g_Width);
-				viewport.Height = float(g_Height);
-				ctx->RSSetViewports(1, &viewport);
+		if (ok)
+		{
+			if (!WriteMeasurementCSV(g_MeasureOutput.c_str(), points))
+			{
+				fprintf(stderr, "Unable to write %s\n", g_MeasureOutput.c_str());
+			}
+		}
+		instrument.Close();
+	}
 
-				//Run a pre transform on the scene to allow exposure adjustment and grading tweaks
-				ctx->OMSetRenderTargetsAndUnorderedAccessViews(1, &intermediateRTV[0], nullptr, 1, 1, &feedbackUAV, nullptr);
-				
-				xform->SetDimensions( tWidth, tHeight, g_Width, g_Height);
-				xform->SetReadback(g_MouseX, g_MouseY);
-				
-				//have the tonemapper setup its parameters
-				xform->SetupTransformPass(ctx, srv, exposureSRV);
+	// done, same as the escape key the script used to send
+	if (!source->cancel)
+	{
+		PostMessage(g_device_manager->GetHWND(), WM_CLOSE, 0, 0);
+	}
+}
 
-				ctx->Draw(6, 0);
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// DICOM conversion
+//  Batch version of dicom2hdr_gsdf.m, input is a .dcm file or a directory of them
+////////////////////////////////////////////////////////////////////////////////////////////////////
 
-				ctx->CopyResource( readbackBuf, feedbackBuf);
+int ConvertDicom()
+{
+	std::vector<float> levels, luminance;
 
-				//render the real scene
-				ctx->OMSetRenderTargets(1, &pRTV, pDSV);
+	if (!ReadLuminanceTable(g_DicomTable.c_str(), levels, luminance))
+	{
+		fprintf(stderr, "Unable to read luminance table %s\n", g_DicomTable.c_str());
+		return 1;
+	}
 
-				//render hdr tonemap
-				ctx->OMSetRenderTargets(1, &intermediateRTV[1], pDSV);
+	GSDFCalibration calibration;
+	if (!calibration.Build(levels, luminance))
+		return 1;
 
-				//have the tonemapper setup its parameters
-				tonemapper->SetupTonemapShader(ctx, intermediateSRV[0]);
+	printf("GSDF calibration from %.3f to %.3f cd/m^2\n", calibration.MinLuminance(), calibration.MaxLuminance());
 
-				ctx->Draw(6, 0);
+	std::string inDir;
+	std::vector<std::string> names;
 
-				//render ldr tonemap
-				ctx->OMSetRenderTargets(1, &intermediateRTV[2], pDSV);
+	DWORD attributes = GetFileAttributesA(g_DicomInput.c_str());
+	if (attributes != INVALID_FILE_ATTRIBUTES && (attributes & FILE_ATTRIBUTE_DIRECTORY))
+	{
+		inDir = g_DicomInput + "\\";
 
-				ldr->SetupTonemapShader(ctx, intermediateSRV[0]);
-				ctx->Draw(6, 0);
+		WIN32_FIND_DATAA find;
+		HANDLE h = FindFirstFileA((inDir + "*.dcm").c_str(), &find);
+		if (h != INVALID_HANDLE_VALUE)
+		{
+			do
+			{
+				if (!(find.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY))
+					names.push_back(find.cFileName);
+			} while (FindNextFileA(h, &find));
+			FindClose(h);
+		}
+	}
+	else
+	{
+		size_t pos = g_DicomInput.find_last_of("\\/");
+		inDir = pos != std::string::npos ? g_DicomInput.substr(0, pos + 1) : "";
+		names.push_back(g_DicomInput.substr(inDir.size()));
+	}
 
-				//render composite
-				ctx->OMSetRenderTargets(1, &pRTV, pDSV);
+	std::string outDir = g_DicomOutput.size() ? g_DicomOutput + "\\" : inDir;
 
-				compositor->setScroll(internalTime / 15.0f, 0.0f);
+	// same naming as the script, name.dcm -> name_gsdf.hdr
+	std::vector<std::string> inPaths, outPaths;
+	for (auto it = names.begin(); it != names.end(); it++)
+	{
+		std::string base = it->substr(0, it->rfind('.'));
+		inPaths.push_back(inDir + *it);
+		outPaths.push_back(outDir + base + "_gsdf.hdr");
+	}
 
-				compositor->SetupShader(ctx, intermediateSRV + 1);
+	int converted = ConvertDicomFiles(calibration, inPaths, outPaths);
+	printf("Converted %d of %d files\n", converted, int(inPaths.size()));
 
-				ctx->Draw(6, 0);
+	return converted == int(inPaths.size()) ? 0 : 1;
+}
 
-				ctx->RSSetScissorRects(1, &default_scissor);
+////////////////////////////////////////////////////////////////////////////////////////////////////
+// Calibrated export
+//  CPU path of the calibration pass, writes name_<target>.hdr for each .hdr image in the list
+////////////////////////////////////////////////////////////////////////////////////////////////////
 
-			}
+int ExportCalibrated()
+{
+	DisplayResponse response;
+	CalibrationLUT lut;
 
-			// Reset RT and SRV state
-			ID3D11ShaderResourceView* nullAttach[16] = {nullptr};
-			ctx->PSSetShaderResources(0, 16, nullAttach);
-			ctx->OMSetRenderTargets(0, nullptr, nullptr);
-		}
-	}
+	if (!response.Load(g_CalibrationTable.c_str()) || !lut.Build(response, g_CalibrationSettings))
+		return 1;
 
-	virtual void Animate(double fElapsedTimeSeconds) override
+	int failed = 0;
+	for (auto it = g_Textures.begin(); it != g_Textures.end(); it++)
 	{
-		internalTime = float(fmod(internalTime + fElapsedTimeSeconds, 60.0));
+		if (it->rfind(".hdr") == std::string::npos)
+			continue;
+
+		size_t slash = it->find_last_of("\\/");
+		std::string name = slash != std::string::npos ? it->substr(slash + 1) : *it;
+		std::string outPath = g_CalibrationExport + "\\" + name.substr(0, name.rfind('.')) + "_" + CalibrationTargetName(g_CalibrationSettings.target) + ".hdr";
+
+		if (lut.ConvertFile(it->c_str(), outPath.c_str()))
+			printf("%s -> %s\n", it->c_str(), outPath.c_str());
+		else
+			failed++;
 	}
-};
+
+	return failed ? 1 : 0;
+}
 
 ////////////////////////////////////////////////////////////////////////////////////////////////////
 // UI Controller
@@ -1019,8 +2094,14 @@ private:
 	HDRprops uiHdrProps;
 	HDRprops appliedHdrProps;
 
+	// the dialogs wait for the first Animate, after the scene has loaded what they list
+	bool dialogsPending;
+
 public:
-	UIController()
+	UIController() :
+		settings_bar(nullptr),
+		hdr_bar(nullptr),
+		dialogsPending(false)
 	{
 		uiHdrProps.hdrEnabled = g_HDRon;
 	}
@@ -1068,6 +2149,17 @@ public:
 				PerfTracker::ui_toggle_visibility();
 				break;
 
+			case VK_F2:
+				// dump the frames recorded so far
+				if (PerfTracker::trace_write(g_TraceFile.c_str()))
+					printf("Wrote performance trace to %s\n", g_TraceFile.c_str());
+				break;
+
+			case VK_F5:
+				printf("Reloaded %d shaders\n", ReloadChangedShaders());
+				g_device_manager->Invalidate();
+				break;
+
 			case VK_ESCAPE:
 				PostQuitMessage(0);
 				break;
@@ -1082,6 +2174,11 @@ public:
 
 	virtual void Animate(double fElapsedTimeSeconds)
 	{
+		if (dialogsPending)
+		{
+			dialogsPending = false;
+			InitDialogs();
+		}
 
 		this->ui_update_time -= (float) fElapsedTimeSeconds;
 		if (this->ui_update_time <= 0)
@@ -1090,6 +2187,13 @@ public:
 			std::vector<PerfTracker::FrameMeasurements> perf_measurements;
 			PerfTracker::get_results(perf_measurements);
 			PerfTracker::ui_update(perf_measurements);
+
+			// keep the panel live, one frame a second when nothing else changes
+			if (PerfTracker::ui_visible())
+				g_device_manager->Invalidate();
+
+			if (g_ShaderHotReload && ReloadChangedShaders())
+				g_device_manager->Invalidate();
 		}
 
 		if (uiHdrProps != appliedHdrProps)
@@ -1099,6 +2203,15 @@ public:
 		}
 	}
 
+	// the once a second update above only needs waking for while it has something to do
+	virtual DWORD IdleTimeout() override
+	{
+		if (!g_ShaderHotReload && !PerfTracker::ui_visible())
+			return INFINITE;
+
+		return DWORD((std::max)(ui_update_time, 0.0f) * 1000.0f) + 1;
+	}
+
 	virtual void Render(ID3D11Device*, ID3D11DeviceContext*, ID3D11RenderTargetView*, ID3D11DepthStencilView*) 
 	{ 
 		if (g_bRenderHUD)
@@ -1124,6 +2237,23 @@ public:
 			TwAddTextLine(msg, 0xFF0000FF, 0xFF000000);
 			TwEndText();
 
+			if (g_Probe.radius > 0)
+			{
+				const int size = 2 * g_Probe.radius + 1;
+				const unsigned int colors[3] = { 0xFFFF0000, 0xFF00FF00, 0xFF0000FF };
+				const char *names[3] = { "R", "G", "B" };
+
+				TwBeginText(g_Width - 300, 60, 0, 0);
+				sprintf_s(msg, "%dx%d (%d px)   mean / min / max", size, size, g_Probe.count);
+				TwAddTextLine(msg, 0xFFFFFFFF, 0xFF000000);
+				for (int c = 0; c < 3; c++)
+				{
+					sprintf_s(msg, "%s  %0.4f / %0.4f / %0.4f", names[c], g_Probe.mean[c], g_Probe.min[c], g_Probe.max[c]);
+					TwAddTextLine(msg, colors[c], 0xFF000000);
+				}
+				TwEndText();
+			}
+
 			TwDraw();
 		}
 	}
@@ -1132,7 +2262,7 @@ public:
 	{ 
 		TwInit(TW_DIRECT3D11, pDevice);        
 		TwDefine("GLOBAL fontstyle=fixed contained=true");
-		InitDialogs();
+		dialogsPending = true;
 
 		return S_OK;
 	}
@@ -1158,22 +2288,13 @@ public:
 		TwDefine("Settings color='19 25 19' alpha=255 text=light size='500 150' iconified=false valueswidth=200 position='10 15'");
 
 		{
+			// images, sequences and the pattern generator last, as the scene loaded them
 			std::vector<TwEnumVal> texEnums;
-			if (g_Textures.size())
-			{
-				for (size_t i = 0; i < g_Textures.size(); i++)
-				{
-					TwEnumVal e;
-					e.Value = int(i);
-					e.Label = g_Textures[i].c_str();
-					texEnums.push_back(e);
-				}
-			}
-			// add the pattern generator
+			for (size_t i = 0; i < g_TextureListings.size(); i++)
 			{
 				TwEnumVal e;
-				e.Value = int(g_Textures.size());
-				e.Label = "Test Pattern";
+				e.Value = int(i);
+				e.Label = g_TextureListings[i].name.c_str();
 				texEnums.push_back(e);
 			}
 			TwType enumModeType = TwDefineEnum("Texture_index", &texEnums[0], unsigned int(texEnums.size()));
@@ -1266,6 +2387,191 @@ void ParseCommandline()
 		{
 			g_sRGB = true;
 		}
+		else if (!wcscmp(L"-measure", __wargv[i]))
+		{
+			// -measure <port> <output.csv>
+			char mbcs[256];
+			i += 1;
+			if (i < __argc)
+			{
+				wcstombs(mbcs, __wargv[i], 256);
+				g_MeasurePort = mbcs;
+			}
+			i += 1;
+			if (i < __argc)
+			{
+				wcstombs(mbcs, __wargv[i], 256);
+				g_MeasureOutput = mbcs;
+			}
+		}
+		else if (!wcscmp(L"-adaptive", __wargv[i]))
+		{
+			g_MeasureAdaptive = true;
+		}
+		else if (!wcscmp(L"-trace", __wargv[i]))
+		{
+			// -trace <file.json or file.csv>
+			char mbcs[256];
+			i += 1;
+			if (i < __argc)
+			{
+				wcstombs(mbcs, __wargv[i], 256);
+				g_TraceFile = mbcs;
+				g_TraceOnExit = true;
+			}
+		}
+		else if (!wcscmp(L"-shadercache", __wargv[i]))
+		{
+			// -shadercache <dir>, "none" compiles every shader from source
+			char mbcs[256];
+			i += 1;
+			if (i < __argc)
+			{
+				wcstombs(mbcs, __wargv[i], 256);
+				SetShaderCacheDirectory(strcmp(mbcs, "none") ? mbcs : "");
+			}
+		}
+		else if (!wcscmp(L"-probe", __wargv[i]))
+		{
+			// -probe <n>, colour statistics over an n x n window under the mouse
+			i += 1;
+			if (i < __argc)
+			{
+				g_ProbeSize = _wtoi(__wargv[i]);
+			}
+		}
+		else if (!wcscmp(L"-continuous", __wargv[i]))
+		{
+			g_Continuous = true;
+		}
+		else if (!wcscmp(L"-multipass", __wargv[i]))
+		{
+			g_FusedPipeline = false;
+		}
+		else if (!wcscmp(L"-validatefused", __wargv[i]))
+		{
+			g_ValidateFused = true;
+		}
+		else if (!wcscmp(L"-compute", __wargv[i]))
+		{
+			g_ComputeTonemap = true;
+		}
+		else if (!wcscmp(L"-nomips", __wargv[i]))
+		{
+			g_MipMaps = false;
+		}
+		else if (!wcscmp(L"-tiled", __wargv[i]))
+		{
+			g_TiledImages = true;
+		}
+		else if (!wcscmp(L"-rgb9e5", __wargv[i]))
+		{
+			g_RGB9E5 = true;
+		}
+		else if (!wcscmp(L"-bc6h", __wargv[i]))
+		{
+			// -bc6h <quality>, 0 fastest to 2 best
+			i += 1;
+			if (i < __argc)
+			{
+				g_BC6HQuality = (std::min)((std::max)(_wtoi(__wargv[i]), 0), BC6HMaxQuality);
+			}
+		}
+		else if (!wcscmp(L"-bc6hmaxde", __wargv[i]))
+		{
+			i += 1;
+			if (i < __argc)
+			{
+				g_BC6HMaxDeltaE = float(_wtof(__wargv[i]));
+			}
+		}
+		else if (!wcscmp(L"-sequence", __wargv[i]))
+		{
+			// -sequence <clip.####.exr>
+			char mbcs[256];
+			i += 1;
+			if (i < __argc)
+			{
+				wcstombs(mbcs, __wargv[i], 256);
+				g_Sequences.push_back(mbcs);
+			}
+		}
+		else if (!wcscmp(L"-fps", __wargv[i]))
+		{
+			i += 1;
+			if (i < __argc)
+			{
+				g_SequenceFPS = (std::max)(_wtof(__wargv[i]), 1.0);
+			}
+		}
+		else if (!wcscmp(L"-readahead", __wargv[i]))
+		{
+			i += 1;
+			if (i < __argc)
+			{
+				g_SequenceReadAhead = (std::max)(_wtoi(__wargv[i]), 1);
+			}
+		}
+		else if (!wcscmp(L"-hotreload", __wargv[i]))
+		{
+			g_ShaderHotReload = true;
+		}
+		else if (!wcscmp(L"-calibrate", __wargv[i]))
+		{
+			// -calibrate <luminance.csv>
+			char mbcs[256];
+			i += 1;
+			if (i < __argc)
+			{
+				wcstombs(mbcs, __wargv[i], 256);
+				g_CalibrationTable = mbcs;
+			}
+		}
+		else if (!wcscmp(L"-target", __wargv[i]))
+		{
+			// -target gsdf|gamma|pq
+			char mbcs[256];
+			i += 1;
+			if (i < __argc)
+			{
+				wcstombs(mbcs, __wargv[i], 256);
+				CalibrationTargetFromName(mbcs, &g_CalibrationSettings.target);
+			}
+		}
+		else if (!wcscmp(L"-export", __wargv[i]))
+		{
+			// -export <output directory>
+			char mbcs[256];
+			i += 1;
+			if (i < __argc)
+			{
+				wcstombs(mbcs, __wargv[i], 256);
+				g_CalibrationExport = mbcs;
+			}
+		}
+		else if (!wcscmp(L"-dicom2hdr", __wargv[i]))
+		{
+			// -dicom2hdr <luminance.csv> <file.dcm or directory> [output directory]
+			char mbcs[256];
+			i += 1;
+			if (i < __argc)
+			{
+				wcstombs(mbcs, __wargv[i], 256);
+				g_DicomTable = mbcs;
+			}
+			i += 1;
+			if (i < __argc)
+			{
+				wcstombs(mbcs, __wargv[i], 256);
+				g_DicomInput = mbcs;
+			}
+			if (i + 1 < __argc && wcsncmp(L"-", __wargv[i + 1], 1))
+			{
+				i += 1;
+				wcstombs(mbcs, __wargv[i], 256);
+				g_DicomOutput = mbcs;
+			}
+		}
 		else if (wcsncmp(L"-", __wargv[i], 1))
 		{
 			char mbcs[256];
@@ -1337,6 +2643,16 @@ int WINAPI wWinMain( HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdL
 
 	}
 
+	if (g_DicomTable.size() && g_DicomInput.size())
+	{
+		return ConvertDicom();
+	}
+
+	if (g_CalibrationTable.size() && g_CalibrationExport.size())
+	{
+		return ExportCalibrated();
+	}
+
 	g_device_manager = new DeviceManager();
 
 	auto scene_controller = SceneController();
@@ -1374,16 +2690,61 @@ int WINAPI wWinMain( HINSTANCE hInstance, HINSTANCE hPrevInstance, LPWSTR lpCmdL
 		return 1;
 	}
 	g_device_manager->SetVsyncEnabled(true);
+	g_device_manager->SetRenderOnChange(!g_Continuous);
 	PerfTracker::initialize();
 	PerfTracker::EventDesc perf_events[] = {
 		PERF_EVENT_DESC("Render Scene"),
 		PERF_EVENT_DESC("Render > Main"),
+		PERF_EVENT_DESC("Render > Tile Upload"),
+		PERF_EVENT_DESC("Render > Exposure"),
+		PERF_EVENT_DESC("Render > Fused"),
+		PERF_EVENT_DESC("Render > Transform"),
+		PERF_EVENT_DESC("Render > Tonemap"),
+		PERF_EVENT_DESC("Render > LDR"),
+		PERF_EVENT_DESC("Render > Composite"),
+		PERF_EVENT_DESC("Render > Calibration"),
+		PERF_EVENT_DESC("CPU > ACES LUT"),
+		PERF_EVENT_DESC("CPU > Calibration LUT"),
+		PERF_EVENT_DESC("CPU > Image Load"),
+		PERF_EVENT_DESC("CPU > BC6H Encode"),
+		PERF_EVENT_DESC("CPU > Mip Chain"),
+		PERF_EVENT_DESC("CPU > Tile Store"),
+		PERF_EVENT_DESC("CPU > Sequence Decode"),
+		PERF_EVENT_DESC("CPU > Sequence Upload"),
+		PERF_EVENT_DESC("CPU > Sequence Dropped"),
+		PERF_EVENT_DESC("CPU > Sequence Late"),
+		PERF_EVENT_DESC("CPU > Shader Compile"),
 	};
 	PerfTracker::ui_setup(perf_events, sizeof(perf_events)/sizeof(PerfTracker::EventDesc), nullptr);
 
+	// last minute or so at 60 Hz
+	PerfTracker::trace_enable(4096);
+
+	std::thread measureThread;
+	ViewerPatternSource measureSource;
+	if (g_MeasurePort.size() && g_MeasureOutput.size())
+	{
+		if (measureSource.levels.size())
+			measureThread = std::thread(RunMeasurement, &measureSource);
+		else
+			fprintf(stderr, "No pattern images to measure, their names need a level as in 03p1188.hdr\n");
+	}
+
 	g_device_manager->MessageLoop();
+
+	if (measureThread.joinable())
+	{
+		measureSource.cancel = true;
+		measureThread.join();
+	}
+
 	g_device_manager->Shutdown();
 
+	if (g_TraceOnExit && !PerfTracker::trace_write(g_TraceFile.c_str()))
+	{
+		fprintf(stderr, "Unable to write %s\n", g_TraceFile.c_str());
+	}
+
 	PerfTracker::shutdown();
 	delete g_device_manager;
 
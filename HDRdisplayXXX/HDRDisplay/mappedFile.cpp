@@ -0,0 +1,127 @@
+// Read only view of a whole file mapped into memory
+
+#include "mappedFile.h"
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile() : data(nullptr), size(0)
+{
+#ifdef _WIN32
+	file = INVALID_HANDLE_VALUE;
+	mapping = nullptr;
+#endif
+}
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+#ifdef _WIN32
+
+bool MappedFile::Open(const char *path)
+{
+	Close();
+
+	file = CreateFileA(path, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+
+	if (file == INVALID_HANDLE_VALUE)
+		return false;
+
+	LARGE_INTEGER length;
+
+	if (!GetFileSizeEx(file, &length))
+	{
+		Close();
+		return false;
+	}
+
+	// an empty file cannot be mapped, but it opened fine
+	if (length.QuadPart == 0)
+		return true;
+
+	mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	data = mapping ? static_cast<const uint8_t*>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+
+	if (!data)
+	{
+		Close();
+		return false;
+	}
+
+	size = size_t(length.QuadPart);
+
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (data)
+		UnmapViewOfFile(data);
+
+	if (mapping)
+		CloseHandle(mapping);
+
+	if (file != INVALID_HANDLE_VALUE)
+		CloseHandle(file);
+
+	data = nullptr;
+	size = 0;
+	mapping = nullptr;
+	file = INVALID_HANDLE_VALUE;
+}
+
+#else
+
+bool MappedFile::Open(const char *path)
+{
+	Close();
+
+	int fd = open(path, O_RDONLY);
+
+	if (fd < 0)
+		return false;
+
+	struct stat info;
+	bool opened = fstat(fd, &info) == 0;
+
+	if (opened && info.st_size > 0)
+	{
+		void *view = mmap(nullptr, size_t(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+
+		if (view == MAP_FAILED)
+		{
+			opened = false;
+		}
+		else
+		{
+			madvise(view, size_t(info.st_size), MADV_SEQUENTIAL);
+			data = static_cast<const uint8_t*>(view);
+			size = size_t(info.st_size);
+		}
+	}
+
+	// the mapping holds the file open by itself
+	close(fd);
+
+	return opened;
+}
+
+void MappedFile::Close()
+{
+	if (data)
+		munmap(const_cast<uint8_t*>(data), size);
+
+	data = nullptr;
+	size = 0;
+}
+
+#endif
@@ -0,0 +1,35 @@
+// Read only view of a whole file mapped into memory
+//
+// Pages are read in by the OS as they are touched, so parsing a mapped file
+// costs no copies into stdio buffers and no read calls. Portable, no D3D.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+
+	MappedFile(const MappedFile &) = delete;
+	MappedFile &operator=(const MappedFile &) = delete;
+
+	// false if path could not be opened or mapped, an empty file maps to no data
+	bool Open(const char *path);
+	void Close();
+
+	const uint8_t *Data() const { return data; }
+	size_t Size() const { return size; }
+
+protected:
+	const uint8_t *data;
+	size_t size;
+
+#ifdef _WIN32
+	void *file;
+	void *mapping;
+#endif
+};
@@ -0,0 +1,281 @@
+// Luminance response measurement engine
+
+#include "measurement.h"
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cctype>
+
+double MeasurementClock()
+{
+	using namespace std::chrono;
+	return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+void MeasurementSleepUntil(double time)
+{
+	double remaining = time - MeasurementClock();
+	if (remaining > 0.0)
+	{
+		std::this_thread::sleep_for(std::chrono::duration<double>(remaining));
+	}
+}
+
+void MeasurementSequencer::WaitSettled(double switchTime)
+{
+	MeasurementSleepUntil(switchTime + pattern->SettleTime());
+}
+
+bool MeasurementSequencer::ShowLevel(float level)
+{
+	if (pending && pendingLevel == level)
+		return true;
+
+	if (!pattern->Show(level))
+		return false;
+
+	pending = true;
+	pendingLevel = level;
+	pendingTime = MeasurementClock();
+	return true;
+}
+
+bool MeasurementSequencer::TargetMet(int count, double sum, double sumSq) const
+{
+	if (count < 2)
+		return false;
+
+	double mean = sum / count;
+	double var = std::max(0.0, (sumSq - sum * mean) / (count - 1));
+	double stdErr = sqrt(var / count);
+
+	return stdErr <= std::max(double(settings.relativeErrorTarget) * fabs(mean), double(settings.absoluteErrorTarget));
+}
+
+bool MeasurementSequencer::Measure(float level, MeasurementPoint &out)
+{
+	std::vector<MeasurementPoint> points;
+	std::vector<float> levels(1, level);
+
+	if (!Run(levels, points))
+		return false;
+
+	out = points[0];
+	return true;
+}
+
+MeasurementPoint MeasurementSequencer::MakePoint(float level, int count, double sum, double sumSq, double sumX, double sumY)
+{
+	MeasurementPoint point;
+	double mean = count > 0 ? sum / count : 0.0;
+
+	point.level = level;
+	point.luminance = float(mean);
+	point.stddev = count > 1 ? float(sqrt(std::max(0.0, (sumSq - sum * mean) / (count - 1)))) : 0.0f;
+	point.x = count > 0 ? float(sumX / count) : 0.0f;
+	point.y = count > 0 ? float(sumY / count) : 0.0f;
+	point.repeats = count;
+
+	return point;
+}
+
+bool MeasurementSequencer::Run(const std::vector<float> &levels, std::vector<MeasurementPoint> &out)
+{
+	return Run(LevelList(levels), out);
+}
+
+bool MeasurementSequencer::Run(const LevelSchedule &schedule, std::vector<MeasurementPoint> &out)
+{
+	pending = false;
+
+	// the schedule only sees what this run measured
+	std::vector<MeasurementPoint> measured;
+	float level;
+
+	if (!schedule.Next(measured, &level))
+		return true;
+
+	if (!ShowLevel(level))
+		return false;
+
+	for (;;)
+	{
+		double sum = 0.0, sumSq = 0.0, sumX = 0.0, sumY = 0.0;
+		int count = 0;
+
+		for (;;)
+		{
+			// a speculative switch may have left the wrong pattern up
+			if (!ShowLevel(level))
+				return false;
+			WaitSettled(pendingTime);
+
+			double integration = 0.0;
+			if (!instrument->BeginMeasurement(&integration))
+				return false;
+			if (!instrument->WaitMeasurement())
+				return false;
+
+			// The patch is no longer needed if this reading is the last one. Assume
+			// it is once the minimum count is reached, unless the readings so far
+			// already show the target can't be met, and start the next pattern
+			// while the result transfers.
+			const bool lastLikely = count + 1 >= settings.maxRepeats ||
+				(count + 1 >= settings.minRepeats && (count < 2 || TargetMet(count, sum, sumSq)));
+
+			if (lastLikely)
+			{
+				// guess the next level from the readings before this one
+				float guess;
+				measured.push_back(MakePoint(level, count, sum, sumSq, sumX, sumY));
+				bool hasNext = schedule.Next(measured, &guess);
+				measured.pop_back();
+
+				if (hasNext && !ShowLevel(guess))
+					return false;
+			}
+
+			MeasurementSample sample;
+			if (!instrument->ReadResult(sample))
+				return false;
+
+			sum += sample.Y;
+			sumSq += double(sample.Y) * double(sample.Y);
+			sumX += sample.x;
+			sumY += sample.y;
+			count++;
+
+			if (count >= settings.maxRepeats)
+				break;
+			if (count >= settings.minRepeats && (settings.minRepeats < 2 || TargetMet(count, sum, sumSq)))
+				break;
+		}
+
+		MeasurementPoint point = MakePoint(level, count, sum, sumSq, sumX, sumY);
+
+		measured.push_back(point);
+		out.push_back(point);
+
+		printf("level %8.4f  Y %10.4f  sd %8.4f  n %d\n", point.level, point.luminance, point.stddev, point.repeats);
+
+		if (!schedule.Next(measured, &level))
+			break;
+	}
+
+	return true;
+}
+
+bool WriteMeasurementCSV(const char *path, const std::vector<MeasurementPoint> &points)
+{
+	FILE *fp = fopen(path, "w");
+
+	if (!fp)
+		return false;
+
+	fprintf(fp, "level,luminance,x,y,stddev,repeats\n");
+
+	for (auto it = points.begin(); it != points.end(); it++)
+	{
+		fprintf(fp, "%g,%g,%g,%g,%g,%d\n", it->level, it->luminance, it->x, it->y, it->stddev, it->repeats);
+	}
+
+	bool ok = ferror(fp) == 0;
+	fclose(fp);
+	return ok;
+}
+
+bool ReadLuminanceTable(const char *path, std::vector<float> &levels, std::vector<float> &luminance)
+{
+	FILE *fp = fopen(path, "r");
+
+	if (!fp)
+		return false;
+
+	levels.clear();
+	luminance.clear();
+
+	char line[512];
+	bool first = true;
+
+	while (fgets(line, sizeof(line), fp))
+	{
+		char *walk = line;
+		char *end = nullptr;
+
+		float a = strtof(walk, &end);
+		bool ok = end != walk;
+
+		if (ok)
+		{
+			walk = end;
+			while (*walk == ',' || *walk == ';' || isspace((unsigned char)*walk))
+				walk++;
+
+			float b = strtof(walk, &end);
+			ok = end != walk;
+
+			if (ok)
+			{
+				levels.push_back(a);
+				luminance.push_back(b);
+			}
+		}
+
+		// only the first line may be a header, anything else malformed is an error
+		if (!ok && !first)
+		{
+			bool blank = true;
+			for (char *c = line; *c; c++)
+				blank = blank && isspace((unsigned char)*c);
+
+			if (!blank)
+			{
+				fclose(fp);
+				return false;
+			}
+		}
+		first = false;
+	}
+
+	fclose(fp);
+	return !levels.empty();
+}
+
+bool PatternLevelFromFilename(const std::string &path, float *level)
+{
+	size_t pos = path.find_last_of("\\/");
+	std::string name = pos != std::string::npos ? path.substr(pos + 1) : path;
+
+	const char *walk = name.c_str();
+
+	if (!isdigit((unsigned char)*walk))
+		return false;
+
+	int whole = 0;
+	while (isdigit((unsigned char)*walk))
+		whole = whole * 10 + (*walk++ - '0');
+
+	if (*walk++ != 'p')
+		return false;
+
+	double fraction = 0.0, scale = 0.1;
+	if (!isdigit((unsigned char)*walk))
+		return false;
+
+	while (isdigit((unsigned char)*walk))
+	{
+		fraction += (*walk++ - '0') * scale;
+		scale *= 0.1;
+	}
+
+	if (*walk != '.')
+		return false;
+
+	*level = float(whole + fraction);
+	return true;
+}
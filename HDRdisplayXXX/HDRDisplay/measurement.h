@@ -0,0 +1,183 @@
+// Luminance response measurement engine
+//
+// Native replacement for the hdr_pattern_measure.m / cs2000Class.m sweep. A
+// PatternSource puts a level on the screen, an Instrument measures it, and the
+// MeasurementSequencer steps through the levels, repeating each one until the
+// spread of the readings is small enough.
+
+#pragma once
+
+#include <string>
+#include <vector>
+
+// One colorimetric reading, same order as cs2000Class.measure returns it
+struct MeasurementSample
+{
+	float Y;	// luminance in cd/m^2
+	float x;	// CIE 1931 chromaticity
+	float y;
+};
+
+/*
+* Interface to a measurement device (spectroradiometer, colorimeter or simulator)
+*/
+class Instrument
+{
+public:
+	virtual ~Instrument() {}
+
+	virtual bool Open() = 0;
+	virtual void Close() = 0;
+
+	// Trigger an integration, returns the expected integration time in seconds
+	virtual bool BeginMeasurement(double *integrationSeconds) = 0;
+
+	// Block until the integration started by BeginMeasurement has completed
+	// The screen content is no longer needed once this returns
+	virtual bool WaitMeasurement() = 0;
+
+	// Transfer the result of the last completed measurement
+	virtual bool ReadResult(MeasurementSample &result) = 0;
+};
+
+/*
+* Interface to whatever puts the test patch on screen
+*/
+class PatternSource
+{
+public:
+	virtual ~PatternSource() {}
+
+	// Request that the given level is displayed, must not block on the display
+	virtual bool Show(float level) = 0;
+
+	// Seconds after Show() before the panel output is stable
+	virtual double SettleTime() const = 0;
+};
+
+struct MeasurementSettings
+{
+	int minRepeats;				// always take at least this many readings per level
+	int maxRepeats;				// give up on the variance target after this many
+	float relativeErrorTarget;	// target standard error of the mean, relative to the mean
+	float absoluteErrorTarget;	// floor in cd/m^2, so near-black levels can terminate
+
+	MeasurementSettings() :
+		minRepeats(2),
+		maxRepeats(8),
+		relativeErrorTarget(0.005f),
+		absoluteErrorTarget(0.005f)
+	{}
+};
+
+struct MeasurementPoint
+{
+	float level;		// input value of the pattern, [0,12.5] for the .hdr patterns
+	float luminance;	// mean Y over all repeats
+	float stddev;		// sample standard deviation of Y
+	float x;
+	float y;
+	int repeats;
+};
+
+/*
+* Decides which level to measure next from the points measured so far
+*/
+class LevelSchedule
+{
+public:
+	virtual ~LevelSchedule() {}
+
+	// Returns false when no more levels are needed
+	// Must only depend on measured, the sequencer also calls it with a provisional
+	// last point to guess the next level before the final reading is in. The
+	// provisional point has repeats == 0 if no reading has completed yet.
+	virtual bool Next(const std::vector<MeasurementPoint> &measured, float *level) const = 0;
+};
+
+/*
+* Fixed list of levels, measured in order
+*/
+class LevelList : public LevelSchedule
+{
+public:
+	LevelList(const std::vector<float> &inLevels) : levels(inLevels) {}
+
+	bool Next(const std::vector<MeasurementPoint> &measured, float *level) const override
+	{
+		if (measured.size() >= levels.size())
+			return false;
+
+		*level = levels[measured.size()];
+		return true;
+	}
+
+protected:
+	std::vector<float> levels;
+};
+
+/*
+* Steps an instrument through a list of levels
+*
+* The pattern switch to the next level is issued as soon as the integration of
+* the (probably) last reading has finished, so the panel settles while the
+* result is still being transferred from the instrument.
+*/
+class MeasurementSequencer
+{
+public:
+	MeasurementSequencer(Instrument *inInstrument, PatternSource *inPattern, const MeasurementSettings &inSettings = MeasurementSettings()) :
+		instrument(inInstrument),
+		pattern(inPattern),
+		settings(inSettings),
+		pending(false),
+		pendingLevel(0.0f),
+		pendingTime(0.0)
+	{}
+
+	// Measure one level
+	bool Measure(float level, MeasurementPoint &out);
+
+	// Measure a list of levels in order, results are appended to out
+	bool Run(const std::vector<float> &levels, std::vector<MeasurementPoint> &out);
+
+	// Measure levels until the schedule is done, results are appended to out in measurement order
+	bool Run(const LevelSchedule &schedule, std::vector<MeasurementPoint> &out);
+
+protected:
+	// Wait until the pattern shown at switchTime has settled
+	void WaitSettled(double switchTime);
+
+	// Bring the pattern for level up, unless it already is
+	bool ShowLevel(float level);
+
+	bool TargetMet(int count, double sum, double sumSq) const;
+
+	// Mean and spread of the readings taken for a level
+	static MeasurementPoint MakePoint(float level, int count, double sum, double sumSq, double sumX, double sumY);
+
+	Instrument *instrument;
+	PatternSource *pattern;
+	MeasurementSettings settings;
+
+	bool pending;			// a switch was already issued for pendingLevel
+	float pendingLevel;
+	double pendingTime;
+};
+
+// Seconds on a monotonic clock, shared by the sequencer and the simulator
+double MeasurementClock();
+
+// Sleep until MeasurementClock() reaches the given time
+void MeasurementSleepUntil(double time);
+
+// Write results as "level,luminance,x,y,stddev,repeats" with one header line,
+// so csvread(file,1,0) gives the same layout as lumdata in the luminance.mat files
+bool WriteMeasurementCSV(const char *path, const std::vector<MeasurementPoint> &points);
+
+// Read an input-to-luminance table from the first two columns of a CSV file
+// A non-numeric first line is treated as a header and skipped
+bool ReadLuminanceTable(const char *path, std::vector<float> &levels, std::vector<float> &luminance);
+
+// Parse the pattern level from a file name made by filename_gen.m, "03p1188.hdr" -> 3.1188
+bool PatternLevelFromFilename(const std::string &path, float *level);
@@ -0,0 +1,152 @@
+// CPU mip chain for loaded images
+
+#include "mipChain.h"
+
+#include "tileDispatch.h"
+
+#include <algorithm>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define MIPCHAIN_SSE
+#endif
+
+int MipCount(int width, int height)
+{
+	int count = 1;
+
+	for (int size = (std::max)(width, height); size > 1; size /= 2)
+		count++;
+
+	return count;
+}
+
+// Destination pixel i of dst covers source [i * src / dst, (i + 1) * src / dst),
+// two pixels wide when src is even and 2 + 1 / dst when it is odd
+struct Footprint
+{
+	int first;
+	float weight[3];
+};
+
+static void BuildFootprints(int src, int dst, std::vector<Footprint> &taps)
+{
+	taps.resize(dst);
+
+	for (int i = 0; i < dst; i++)
+	{
+		Footprint &tap = taps[i];
+
+		if (src == 1)
+		{
+			tap.first = 0;
+			tap.weight[0] = 1.0f;
+			tap.weight[1] = tap.weight[2] = 0.0f;
+		}
+		else if (src % 2 == 0)
+		{
+			tap.first = 2 * i;
+			tap.weight[0] = tap.weight[1] = 0.5f;
+			tap.weight[2] = 0.0f;
+		}
+		else
+		{
+			tap.first = 2 * i;
+			tap.weight[0] = float(dst - i) / src;
+			tap.weight[1] = float(dst) / src;
+			tap.weight[2] = float(i + 1) / src;
+		}
+	}
+}
+
+static void Downsample(const float *src, int srcWidth, int srcHeight, MipLevel &dst)
+{
+	dst.width = (std::max)(srcWidth / 2, 1);
+	dst.height = (std::max)(srcHeight / 2, 1);
+	dst.rgba.resize(size_t(dst.width) * dst.height * 4);
+
+	std::vector<Footprint> tapsX, tapsY;
+	BuildFootprints(srcWidth, dst.width, tapsX);
+	BuildFootprints(srcHeight, dst.height, tapsY);
+
+	float *out = dst.rgba.data();
+
+	auto filterRow = [&](int x0, int x1, int y)
+	{
+		const Footprint &ty = tapsY[y];
+
+		for (int x = x0; x < x1; x++)
+		{
+			const Footprint &tx = tapsX[x];
+
+#ifdef MIPCHAIN_SSE
+			__m128 sum = _mm_setzero_ps();
+
+			for (int j = 0; j < 3; j++)
+			{
+				if (ty.weight[j] == 0.0f)
+					continue;
+
+				const float *row = src + size_t(ty.first + j) * srcWidth * 4;
+				__m128 line = _mm_setzero_ps();
+
+				for (int i = 0; i < 3; i++)
+				{
+					if (tx.weight[i] != 0.0f)
+						line = _mm_add_ps(line, _mm_mul_ps(_mm_loadu_ps(row + (tx.first + i) * 4), _mm_set1_ps(tx.weight[i])));
+				}
+
+				sum = _mm_add_ps(sum, _mm_mul_ps(line, _mm_set1_ps(ty.weight[j])));
+			}
+
+			_mm_storeu_ps(out + (size_t(y) * dst.width + x) * 4, sum);
+#else
+			float sum[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+
+			for (int j = 0; j < 3; j++)
+			{
+				if (ty.weight[j] == 0.0f)
+					continue;
+
+				const float *row = src + size_t(ty.first + j) * srcWidth * 4;
+
+				for (int i = 0; i < 3; i++)
+				{
+					if (tx.weight[i] == 0.0f)
+						continue;
+
+					const float w = tx.weight[i] * ty.weight[j];
+
+					for (int c = 0; c < 4; c++)
+						sum[c] += row[(tx.first + i) * 4 + c] * w;
+				}
+			}
+
+			for (int c = 0; c < 4; c++)
+				out[(size_t(y) * dst.width + x) * 4 + c] = sum[c];
+#endif
+		}
+	};
+
+	std::vector<uint32_t> tiles;
+	TileRect rect = { 0, 0, dst.width, dst.height };
+
+	BuildTileList(dst.width, dst.height, rect, tiles);
+	ExecuteTiles(tiles, dst.width, dst.height, filterRow);
+}
+
+void BuildMipChain(const float *rgba, int width, int height, std::vector<MipLevel> &levels)
+{
+	levels.resize(MipCount(width, height) - 1);
+
+	const float *src = rgba;
+
+	for (auto &level : levels)
+	{
+		Downsample(src, width, height, level);
+
+		src = level.rgba.data();
+		width = level.width;
+		height = level.height;
+	}
+}
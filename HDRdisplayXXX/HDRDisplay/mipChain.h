@@ -0,0 +1,26 @@
+// CPU mip chain for loaded images
+//
+// Each level halves the one above, rounding down as D3D sizes mips, with a
+// box filter over the exact footprint of the destination pixel, so odd
+// sizes take three taps with fractional weights instead of dropping a row.
+// Filtering is done on the linear float RGBA the loaders produce, so HDR
+// values average in linear light. Rows are shared out over cores with
+// ExecuteTiles(), pixels are filtered four channels at once with SSE where
+// available. Portable, no D3D.
+
+#pragma once
+
+#include <vector>
+
+struct MipLevel
+{
+	int width, height;
+	std::vector<float> rgba;
+};
+
+// Levels in a full chain down to 1x1, including the top level
+int MipCount(int width, int height);
+
+// levels[0] is the first level below the width x height rgba source,
+// there are MipCount() - 1 of them
+void BuildMipChain(const float *rgba, int width, int height, std::vector<MipLevel> &levels);
@@ -53,7 +53,7 @@ public:
 
 	PatternGen(ID3D11Device * inDevice) : Tonemapper(inDevice)
 	{
-		shader = CompilePS("test_generator.hlsl", "main");
+		WatchPS(&shader, "test_generator.hlsl", "main");
 
 		D3D11_BUFFER_DESC desc;
 		ZeroMemory(&desc, sizeof(desc));
@@ -110,6 +110,11 @@ public:
 		ctx->PSSetShaderResources(0, 1, &srcData);
 	}
 
+	void TrackState(FrameState &state) const override
+	{
+		state.TrackConstants(current);
+	}
+
 	TwBar* InitUI() override
 	{
 		TwBar* settings_bar = TwNewBar("TestPatternParameters");
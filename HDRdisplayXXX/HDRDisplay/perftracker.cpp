@@ -32,6 +32,7 @@
 #include <string>
 #include <vector>
 #include <list>
+#include <stdio.h>
 
 ////////////////////////////////////////////////////////////////////////////////
 namespace {
@@ -89,6 +90,16 @@ public:
         return 1000.f * this->cpu_timer.value();
     };
 
+    double cpu_start() {
+        return this->cpu_timer.start_seconds();
+    };
+
+    UINT64 gpu_start(ID3D11DeviceContext * ctx) {
+        UINT64 gpu_begin_timestamp = 0;
+        ctx->GetData(this->gpu_timestamp_begin, &gpu_begin_timestamp, sizeof(UINT64), D3D11_ASYNC_GETDATA_DONOTFLUSH);
+        return gpu_begin_timestamp;
+    };
+
     float gpu_time(ID3D11DeviceContext * ctx, float frequency) {
         UINT64 gpu_begin_timestamp, gpu_end_timestamp;
         ctx->GetData(this->gpu_timestamp_begin, &gpu_begin_timestamp, sizeof(UINT64), D3D11_ASYNC_GETDATA_DONOTFLUSH);
@@ -115,6 +126,7 @@ struct FrameQueries {
     EventQuery * total_query;
     ID3D11Query * present_query;
     std::vector <EventQuery *> event_queries;
+    std::vector <PerfTracker::CPUZone> cpu_zones;
 };
 
 std::deque<FrameQueries> pending_frames;
@@ -124,6 +136,87 @@ std::vector<ID3D11Query *> disjoint_query_pool;
 
 std::list<PerfTracker::FrameMeasurements> frame_results;
 
+//------------------------------------------------------------------------------
+// Trace ring, fixed size records so recording never allocates
+
+const size_t TRACE_MAX_EVENTS = 32;
+
+struct TraceEvent {
+    UINT id;
+    UINT thread;        // 0 for query events, else the thread slot of a CPU zone
+    float cpu_start;    // ms from the start of the frame
+    float cpu_time;
+    float gpu_start;    // ms from the GPU start of the frame
+    float gpu_time;
+};
+
+struct TraceFrame {
+    UINT64 index;
+    double cpu_start;   // ms from trace_enable
+    float cpu_time;
+    float gpu_time;
+    size_t event_count;
+    TraceEvent events[TRACE_MAX_EVENTS];
+};
+
+std::vector<TraceFrame> trace_ring;
+size_t trace_head = 0;
+size_t trace_count = 0;
+UINT64 trace_frame_index = 0;
+double trace_origin = 0.0;
+
+void trace_record(ID3D11DeviceContext * ctx, float gpu_tick_frequency, FrameQueries & frame, const PerfTracker::FrameMeasurements & measurements) {
+    if (::trace_ring.empty()) {
+        return;
+    }
+
+    TraceFrame & record = ::trace_ring[::trace_head];
+    ::trace_head = (::trace_head + 1) % ::trace_ring.size();
+    ::trace_count = std::min(::trace_count + 1, ::trace_ring.size());
+
+    double frame_cpu_start = frame.total_query->cpu_start();
+    UINT64 frame_gpu_start = frame.total_query->gpu_start(ctx);
+
+    record.index = ::trace_frame_index++;
+    record.cpu_start = 1000.0 * (frame_cpu_start - ::trace_origin);
+    record.cpu_time = float(measurements.frame_total.cpu_time);
+    record.gpu_time = float(measurements.frame_total.gpu_time);
+    record.event_count = std::min(frame.event_queries.size(), TRACE_MAX_EVENTS);
+
+    for (size_t i = 0; i < record.event_count; ++i) {
+        EventQuery * query = frame.event_queries[i];
+        const PerfTracker::EventMeasurements & event = measurements.events[i];
+        TraceEvent & out = record.events[i];
+        out.id = event.id;
+        out.thread = 0;
+        out.cpu_start = float(1000.0 * (query->cpu_start() - frame_cpu_start));
+        out.cpu_time = float(event.data.cpu_time);
+        out.gpu_start = float(1000.0 * double(INT64(query->gpu_start(ctx) - frame_gpu_start)) / gpu_tick_frequency);
+        out.gpu_time = float(event.data.gpu_time);
+    }
+
+    // CPU zones go after the query events, as in measurements.events
+    for (auto z = frame.cpu_zones.begin(); z != frame.cpu_zones.end() && record.event_count < TRACE_MAX_EVENTS; ++z) {
+        TraceEvent & out = record.events[record.event_count++];
+        out.id = (*z).id;
+        out.thread = (*z).thread;
+        out.cpu_start = float(1000.0 * ((*z).start - frame_cpu_start));
+        out.cpu_time = float(1000.0 * (*z).duration);
+        out.gpu_start = 0.f;
+        out.gpu_time = 0.f;
+    }
+}
+
+// nearest rank percentile of sorted values
+double percentile(const std::vector<double> & sorted, double p) {
+    if (sorted.empty()) {
+        return 0.0;
+    }
+    size_t rank = size_t(p * double(sorted.size()) + 0.5);
+    rank = std::min(std::max(rank, size_t(1)), sorted.size());
+    return sorted[rank - 1];
+}
+
 //------------------------------------------------------------------------------
 
 TwBar * tweak_dlg = NULL;
@@ -161,8 +254,6 @@ void TW_CALL tweakui_get_cpu_event_perf(void * out_var, void * client_data) {
 } namespace PerfTracker {
 ////////////////////////////////////////////////////////////////////////////////
 
-CPUTimer::SystemInfo CPUTimer::system_info;
-
 EventReference::EventReference(UINT h, const char * s) {
     if (tracked_events.find(h) == ::tracked_events.end()) {
         add_perf_event(h, s);
@@ -208,6 +299,7 @@ void shutdown() {
     }
     ::tracked_events.clear();
     ::frame_results.clear();
+    trace_enable(0);
 }
 
 void get_results(std::vector<FrameMeasurements> & out_results) {
@@ -257,6 +349,16 @@ void frame_end(ID3D11DeviceContext * ctx) {
     _ASSERT(live_queries.empty());                
     ::pending_frames.back().total_query->end(ctx);
     ctx->End(::pending_frames.back().present_query);
+
+    // CPU zones completed on any thread since the last frame_end are reported with this frame
+    std::vector<CPUZone> & cpu_zones = ::pending_frames.back().cpu_zones;
+    cpu_collect(cpu_zones);
+    for (auto z = cpu_zones.begin(); z != cpu_zones.end(); ++z) {
+        if (::tracked_events.find((*z).id) == ::tracked_events.end()) {
+            add_perf_event((*z).id, (*z).name);
+        }
+    }
+
     do {
         FrameQueries & next_frame = ::pending_frames.front();
         D3D11_QUERY_DATA_TIMESTAMP_DISJOINT frame_query_data;
@@ -271,7 +373,9 @@ void frame_end(ID3D11DeviceContext * ctx) {
                     (*query)->get_measurements(ctx, gpu_tick_frequency, event_measurements.data);
                     frame_measurements.events.push_back(event_measurements);
                 }
+                cpu_measurements(next_frame.cpu_zones, frame_measurements.events);
                 next_frame.total_query->get_measurements(ctx, gpu_tick_frequency, frame_measurements.frame_total);
+                ::trace_record(ctx, gpu_tick_frequency, next_frame, frame_measurements);
                 ::frame_results.push_back(frame_measurements);
             }
             for (auto query = next_frame.event_queries.begin(); query != next_frame.event_queries.end(); ++query) {
@@ -406,5 +510,158 @@ void ui_toggle_visibility() {
     TwSetParam(::tweak_dlg, nullptr, "iconified", TW_PARAM_CSTRING, 1, ui_state);
 }
 
+bool ui_visible() {
+    return ::tweak_dlg_visible;
+}
+
+void trace_enable(size_t frame_capacity) {
+    std::vector<TraceFrame>(frame_capacity).swap(::trace_ring);
+    trace_clear();
+}
+
+void trace_clear() {
+    ::trace_head = 0;
+    ::trace_count = 0;
+    ::trace_frame_index = 0;
+
+    ::trace_origin = clock_seconds();
+}
+
+void trace_stats(std::vector<EventStats> & out_stats) {
+    out_stats.clear();
+
+    // per frame cost of each event, repeated events in a frame are summed
+    std::map<UINT, std::vector<double>> cpu_samples;
+    std::map<UINT, std::vector<double>> gpu_samples;
+
+    for (size_t f = 0; f < ::trace_count; ++f) {
+        const TraceFrame & frame = ::trace_ring[(::trace_head + ::trace_ring.size() - ::trace_count + f) % ::trace_ring.size()];
+
+        std::map<UINT, std::pair<double, double>> frame_events;
+        for (size_t e = 0; e < frame.event_count; ++e) {
+            std::pair<double, double> & sum = frame_events[frame.events[e].id];
+            sum.first += frame.events[e].cpu_time;
+            sum.second += frame.events[e].gpu_time;
+        }
+        frame_events[0] = std::make_pair(double(frame.cpu_time), double(frame.gpu_time));
+
+        for (auto e = frame_events.begin(); e != frame_events.end(); ++e) {
+            cpu_samples[(*e).first].push_back((*e).second.first);
+            gpu_samples[(*e).first].push_back((*e).second.second);
+        }
+    }
+
+    for (auto e = cpu_samples.begin(); e != cpu_samples.end(); ++e) {
+        std::vector<double> & cpu = (*e).second;
+        std::vector<double> & gpu = gpu_samples[(*e).first];
+        std::sort(cpu.begin(), cpu.end());
+        std::sort(gpu.begin(), gpu.end());
+
+        EventStats stats;
+        stats.id = (*e).first;
+        auto tracked = ::tracked_events.find(stats.id);
+        stats.name = tracked != ::tracked_events.end() ? (*tracked).second->name : (stats.id ? "Unknown" : "Total");
+        stats.samples = cpu.size();
+        stats.cpu_p50 = ::percentile(cpu, 0.50);
+        stats.cpu_p95 = ::percentile(cpu, 0.95);
+        stats.cpu_p99 = ::percentile(cpu, 0.99);
+        stats.cpu_max = cpu.back();
+        stats.gpu_p50 = ::percentile(gpu, 0.50);
+        stats.gpu_p95 = ::percentile(gpu, 0.95);
+        stats.gpu_p99 = ::percentile(gpu, 0.99);
+        stats.gpu_max = gpu.back();
+        out_stats.push_back(stats);
+    }
+}
+
+static const char * event_name(UINT id) {
+    auto tracked = ::tracked_events.find(id);
+    return tracked != ::tracked_events.end() ? (*tracked).second->name.c_str() : "Unknown";
+}
+
+static bool trace_write_csv(FILE * fp) {
+    fprintf(fp, "frame,event,cpu_start_ms,cpu_ms,gpu_start_ms,gpu_ms\n");
+    for (size_t f = 0; f < ::trace_count; ++f) {
+        const TraceFrame & frame = ::trace_ring[(::trace_head + ::trace_ring.size() - ::trace_count + f) % ::trace_ring.size()];
+        fprintf(fp, "%llu,Total,%.4f,%.4f,0,%.4f\n", frame.index, frame.cpu_start, frame.cpu_time, frame.gpu_time);
+        for (size_t e = 0; e < frame.event_count; ++e) {
+            const TraceEvent & event = frame.events[e];
+            fprintf(fp, "%llu,%s,%.4f,%.4f,%.4f,%.4f\n", frame.index, event_name(event.id), frame.cpu_start + event.cpu_start, event.cpu_time, event.gpu_start, event.gpu_time);
+        }
+    }
+    return ferror(fp) == 0;
+}
+
+static bool trace_write_json(FILE * fp, const std::vector<EventStats> & stats) {
+    // chrome://tracing "X" events, CPU on thread 1 and GPU on thread 2 in microseconds
+    // GPU events are placed relative to the CPU start of their frame
+    // CPU zones go on thread 2 + their thread slot
+    fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+    fprintf(fp, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":1,\"args\":{\"name\":\"CPU\"}},\n");
+    fprintf(fp, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":2,\"args\":{\"name\":\"GPU\"}}");
+    for (size_t f = 0; f < ::trace_count; ++f) {
+        const TraceFrame & frame = ::trace_ring[(::trace_head + ::trace_ring.size() - ::trace_count + f) % ::trace_ring.size()];
+        double base = 1000.0 * frame.cpu_start;
+        fprintf(fp, ",\n{\"name\":\"Frame\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%llu}}", base, 1000.0 * frame.cpu_time, frame.index);
+        fprintf(fp, ",\n{\"name\":\"Frame\",\"ph\":\"X\",\"pid\":1,\"tid\":2,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%llu}}", base, 1000.0 * frame.gpu_time, frame.index);
+        for (size_t e = 0; e < frame.event_count; ++e) {
+            const TraceEvent & event = frame.events[e];
+            const char * name = event_name(event.id);
+            if (event.thread) {
+                fprintf(fp, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}", name, 2 + event.thread, base + 1000.0 * event.cpu_start, 1000.0 * event.cpu_time);
+                continue;
+            }
+            fprintf(fp, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":1,\"ts\":%.3f,\"dur\":%.3f}", name, base + 1000.0 * event.cpu_start, 1000.0 * event.cpu_time);
+            fprintf(fp, ",\n{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":2,\"ts\":%.3f,\"dur\":%.3f}", name, base + 1000.0 * event.gpu_start, 1000.0 * event.gpu_time);
+        }
+    }
+    fprintf(fp, "\n],\n\"metadata\":{\"stats\":[");
+    for (size_t i = 0; i < stats.size(); ++i) {
+        const EventStats & s = stats[i];
+        fprintf(fp, "%s\n{\"event\":\"%s\",\"samples\":%zu,\"cpu_p50\":%.4f,\"cpu_p95\":%.4f,\"cpu_p99\":%.4f,\"cpu_max\":%.4f,\"gpu_p50\":%.4f,\"gpu_p95\":%.4f,\"gpu_p99\":%.4f,\"gpu_max\":%.4f}",
+            i ? "," : "", s.name.c_str(), s.samples, s.cpu_p50, s.cpu_p95, s.cpu_p99, s.cpu_max, s.gpu_p50, s.gpu_p95, s.gpu_p99, s.gpu_max);
+    }
+    fprintf(fp, "\n]}}\n");
+    return ferror(fp) == 0;
+}
+
+static bool trace_write_stats(const char * path, const std::vector<EventStats> & stats) {
+    FILE * fp = fopen(path, "w");
+    if (!fp) {
+        return false;
+    }
+    fprintf(fp, "event,samples,cpu_p50_ms,cpu_p95_ms,cpu_p99_ms,cpu_max_ms,gpu_p50_ms,gpu_p95_ms,gpu_p99_ms,gpu_max_ms\n");
+    for (auto s = stats.begin(); s != stats.end(); ++s) {
+        fprintf(fp, "%s,%zu,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f,%.4f\n", (*s).name.c_str(), (*s).samples,
+            (*s).cpu_p50, (*s).cpu_p95, (*s).cpu_p99, (*s).cpu_max, (*s).gpu_p50, (*s).gpu_p95, (*s).gpu_p99, (*s).gpu_max);
+    }
+    bool ok = ferror(fp) == 0;
+    fclose(fp);
+    return ok;
+}
+
+bool trace_write(const char * path) {
+    std::vector<EventStats> stats;
+    trace_stats(stats);
+
+    std::string name(path);
+    size_t dot = name.rfind('.');
+    bool json = dot != std::string::npos && name.compare(dot, std::string::npos, ".json") == 0;
+
+    FILE * fp = fopen(path, "w");
+    if (!fp) {
+        return false;
+    }
+    bool ok = json ? trace_write_json(fp, stats) : trace_write_csv(fp);
+    fclose(fp);
+
+    if (!json) {
+        std::string stats_path = (dot != std::string::npos ? name.substr(0, dot) : name) + "_stats.csv";
+        ok = trace_write_stats(stats_path.c_str(), stats) && ok;
+    }
+
+    return ok;
+}
+
 ////////////////////////////////////////////////////////////////////////////////
 }
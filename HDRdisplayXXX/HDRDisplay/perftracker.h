@@ -30,90 +30,21 @@
 
 #include "perftracker_int.h"
 
-namespace PerfTracker {
-    class CPUTimer {
-    private:
-        class SystemInfo {
-        public:
-            float freq_scale;
-            SystemInfo() {
-                LARGE_INTEGER f;
-                QueryPerformanceFrequency(&f);
-                this->freq_scale = 1.f / float(f.QuadPart);
-            }
-        };
-        static SystemInfo system_info;
-
-        LARGE_INTEGER start_time;
-        LARGE_INTEGER stop_time;
-
-    public:
-
-        void start() {
-            QueryPerformanceCounter(&this->start_time);
-        };
-
-        void stop() {
-            QueryPerformanceCounter(&this->stop_time);
-        };
-
-        float value() {
-            float dt = max(0.f, float(stop_time.QuadPart) - float(start_time.QuadPart));
-            return dt * CPUTimer::system_info.freq_scale;
-        };
-    };
-
-    struct PerfMeasurements {
-        double cpu_time;
-        double gpu_time;
-        struct {
-            double drawn_vertices;
-            double drawn_primitives;
-            double shaded_primitives;
-            double shaded_fragments;
-        } gpu_stats;
-
-        PerfMeasurements() {
-            this->cpu_time = 0;
-            this->gpu_time = 0;
-            this->gpu_stats.drawn_vertices = 0;
-            this->gpu_stats.drawn_primitives = 0;
-            this->gpu_stats.shaded_primitives = 0;
-            this->gpu_stats.shaded_fragments = 0;
-        }
-
-        void accumulate(const PerfMeasurements & other) {
-            this->cpu_time += other.cpu_time;
-            this->gpu_time += other.gpu_time;
-            this->gpu_stats.drawn_vertices += other.gpu_stats.drawn_vertices;
-            this->gpu_stats.drawn_primitives += other.gpu_stats.drawn_primitives;
-            this->gpu_stats.shaded_primitives += other.gpu_stats.shaded_primitives;
-            this->gpu_stats.shaded_fragments += other.gpu_stats.shaded_fragments;
-        };
+#include <string>
 
-        void scale(float scale) {
-            this->cpu_time /= scale;
-            this->gpu_time /= scale;
-            this->gpu_stats.drawn_vertices /= scale;
-            this->gpu_stats.drawn_primitives /= scale;
-            this->gpu_stats.shaded_primitives /= scale;
-            this->gpu_stats.shaded_fragments /= scale;
-        }
-    };
-
-    struct EventMeasurements {
+namespace PerfTracker {
+    struct EventDesc {
         UINT id;
-        PerfMeasurements data;
-    };
-
-    struct FrameMeasurements {
-        PerfMeasurements frame_total;
-        std::vector<EventMeasurements> events;
+        char * name;
     };
 
-    struct EventDesc {
+    // percentiles over the recorded trace, in ms
+    struct EventStats {
         UINT id;
-        char * name;
+        std::string name;
+        size_t samples;
+        double cpu_p50, cpu_p95, cpu_p99, cpu_max;
+        double gpu_p50, gpu_p95, gpu_p99, gpu_max;
     };
 
     void initialize();
@@ -122,6 +53,17 @@ namespace PerfTracker {
     void ui_setup(EventDesc * events, size_t event_count, const char * dialog_prefs);
     void ui_update(std::vector<PerfTracker::FrameMeasurements> & new_results);
     void ui_toggle_visibility();
+    bool ui_visible();
+
+    // Trace recorder, keeps the last frame_capacity frames in a ring allocated up front
+    // frame_capacity 0 stops recording and frees the ring
+    void trace_enable(size_t frame_capacity);
+    void trace_clear();
+    // per event statistics over the frames in the ring, id 0 is the frame total
+    void trace_stats(std::vector<EventStats> & out_stats);
+    // .json writes a chrome://tracing file, anything else a CSV of per frame samples
+    // the statistics go to a second CSV next to it, <name>_stats.csv
+    bool trace_write(const char * path);
 }
 
 #define PERF_EVENT_DESC(id) \
@@ -0,0 +1,163 @@
+// Portable CPU side of PerfTracker
+
+#include "perftracker_cpu.h"
+
+#include <atomic>
+
+////////////////////////////////////////////////////////////////////////////////
+namespace {
+////////////////////////////////////////////////////////////////////////////////
+const size_t ZONE_CAPACITY = 1024;
+const size_t ZONE_MAX_DEPTH = 32;
+
+struct OpenZone {
+    uint32_t id;
+    const char * name;
+    double start;
+};
+
+// Single producer ring per thread, the owning thread writes zones and advances
+// write, the collector copies them out and advances read. Buffers go on a list
+// that is only ever pushed to, so walking it needs no lock, and a buffer is
+// handed to the next new thread once its owner has exited.
+struct ThreadBuffer {
+    PerfTracker::CPUZone zones[ZONE_CAPACITY];
+    std::atomic<size_t> write;
+    std::atomic<size_t> read;
+    std::atomic<uint64_t> dropped;
+    std::atomic<bool> in_use;
+    ThreadBuffer * next;
+    uint32_t thread;
+
+    // only touched by the owner
+    OpenZone open[ZONE_MAX_DEPTH];
+    size_t depth;
+
+    ThreadBuffer() : write(0), read(0), dropped(0), in_use(true), next(nullptr), thread(0), depth(0) {}
+};
+
+std::atomic<ThreadBuffer *> buffer_list(nullptr);
+std::atomic<uint32_t> buffer_count(0);
+
+ThreadBuffer * acquire_buffer() {
+    for (ThreadBuffer * b = ::buffer_list.load(std::memory_order_acquire); b; b = b->next) {
+        bool expected = false;
+        if (b->in_use.compare_exchange_strong(expected, true, std::memory_order_acquire)) {
+            b->depth = 0;
+            return b;
+        }
+    }
+
+    ThreadBuffer * b = new ThreadBuffer();
+    b->thread = ::buffer_count.fetch_add(1, std::memory_order_relaxed) + 1;
+    b->next = ::buffer_list.load(std::memory_order_relaxed);
+    while (!::buffer_list.compare_exchange_weak(b->next, b, std::memory_order_release, std::memory_order_relaxed)) {
+    }
+    return b;
+}
+
+// hands the buffer back when the thread exits, zones still in it are collected as usual
+struct ThreadSlot {
+    ThreadBuffer * buffer;
+
+    ThreadSlot() : buffer(nullptr) {}
+
+    ~ThreadSlot() {
+        if (this->buffer) {
+            this->buffer->in_use.store(false, std::memory_order_release);
+        }
+    }
+
+    ThreadBuffer * get() {
+        if (!this->buffer) {
+            this->buffer = acquire_buffer();
+        }
+        return this->buffer;
+    }
+};
+
+thread_local ThreadSlot thread_slot;
+
+////////////////////////////////////////////////////////////////////////////////
+} namespace PerfTracker {
+////////////////////////////////////////////////////////////////////////////////
+
+ScopedCPUEvent::ScopedCPUEvent(uint32_t id, const char * name) {
+    cpu_event_begin(id, name);
+}
+
+ScopedCPUEvent::~ScopedCPUEvent() {
+    cpu_event_end();
+}
+
+void cpu_event_begin(uint32_t id, const char * name) {
+    ThreadBuffer * b = ::thread_slot.get();
+    // events nested deeper than the stack are counted but not recorded
+    if (b->depth < ZONE_MAX_DEPTH) {
+        OpenZone & zone = b->open[b->depth];
+        zone.id = id;
+        zone.name = name;
+        zone.start = clock_seconds();
+    }
+    ++b->depth;
+}
+
+void cpu_event_end() {
+    double stop = clock_seconds();
+    ThreadBuffer * b = ::thread_slot.get();
+    if (b->depth == 0) {
+        return;
+    }
+    --b->depth;
+    if (b->depth >= ZONE_MAX_DEPTH) {
+        return;
+    }
+
+    size_t write = b->write.load(std::memory_order_relaxed);
+    if (write - b->read.load(std::memory_order_acquire) >= ZONE_CAPACITY) {
+        b->dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+
+    const OpenZone & open = b->open[b->depth];
+    CPUZone & zone = b->zones[write % ZONE_CAPACITY];
+    zone.id = open.id;
+    zone.name = open.name;
+    zone.thread = b->thread;
+    zone.depth = uint32_t(b->depth);
+    zone.start = open.start;
+    zone.duration = stop - open.start;
+    b->write.store(write + 1, std::memory_order_release);
+}
+
+void cpu_collect(std::vector<CPUZone> & out_zones) {
+    for (ThreadBuffer * b = ::buffer_list.load(std::memory_order_acquire); b; b = b->next) {
+        size_t read = b->read.load(std::memory_order_relaxed);
+        size_t write = b->write.load(std::memory_order_acquire);
+        for (; read != write; ++read) {
+            out_zones.push_back(b->zones[read % ZONE_CAPACITY]);
+        }
+        b->read.store(read, std::memory_order_release);
+    }
+}
+
+uint64_t cpu_dropped() {
+    uint64_t dropped = 0;
+    for (ThreadBuffer * b = ::buffer_list.load(std::memory_order_acquire); b; b = b->next) {
+        dropped += b->dropped.load(std::memory_order_relaxed);
+    }
+    return dropped;
+}
+
+void cpu_measurements(const std::vector<CPUZone> & zones, std::vector<EventMeasurements> & out_events) {
+    out_events.reserve(out_events.size() + zones.size());
+    for (auto z = zones.begin(); z != zones.end(); ++z) {
+        EventMeasurements event;
+        event.id = (*z).id;
+        event.data.cpu_time = 1000.0 * (*z).duration;
+        out_events.push_back(event);
+    }
+}
+
+////////////////////////////////////////////////////////////////////////////////
+}
@@ -0,0 +1,152 @@
+// Portable CPU side of PerfTracker
+//
+// Timing on std::chrono::steady_clock and scoped CPU events that can be nested
+// and recorded from any thread. Nothing in here needs Windows or D3D, so the
+// converters and command line tools can be timed the same way as the viewer.
+
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include <stdint.h>
+#include <string.h>
+
+#define H1(s,i,x)   (x*65599u+(uint8_t)s[(i)<strlen(s)?strlen(s)-1-(i):strlen(s)])
+#define H4(s,i,x)   H1(s,i,H1(s,i+1,H1(s,i+2,H1(s,i+3,x))))
+#define H16(s,i,x)  H4(s,i,H4(s,i+4,H4(s,i+8,H4(s,i+12,x))))
+#define H64(s,i,x)  H16(s,i,H16(s,i+16,H16(s,i+32,H16(s,i+48,x))))
+#define H256(s,i,x) H64(s,i,H64(s,i+64,H64(s,i+128,H64(s,i+192,x))))
+#define HASH_STRING(s)    ((uint32_t)(H256(s,0,0)^(H256(s,0,0)>>16)))
+
+#define PERF_EVENT_VARNAME(x, y) perfevent_line##x##_##y
+
+namespace PerfTracker {
+    typedef std::chrono::steady_clock Clock;
+
+    // seconds on the tracker clock, only meaningful relative to each other
+    inline double clock_seconds() {
+        return std::chrono::duration<double>(Clock::now().time_since_epoch()).count();
+    }
+
+    class CPUTimer {
+    private:
+        Clock::time_point start_time;
+        Clock::time_point stop_time;
+
+    public:
+
+        void start() {
+            this->start_time = Clock::now();
+        };
+
+        void stop() {
+            this->stop_time = Clock::now();
+        };
+
+        float value() {
+            return (std::max)(0.f, std::chrono::duration<float>(this->stop_time - this->start_time).count());
+        };
+
+        // start time in seconds, same base as clock_seconds()
+        double start_seconds() {
+            return std::chrono::duration<double>(this->start_time.time_since_epoch()).count();
+        };
+    };
+
+    struct PerfMeasurements {
+        double cpu_time;
+        double gpu_time;
+        struct {
+            double drawn_vertices;
+            double drawn_primitives;
+            double shaded_primitives;
+            double shaded_fragments;
+        } gpu_stats;
+
+        PerfMeasurements() {
+            this->cpu_time = 0;
+            this->gpu_time = 0;
+            this->gpu_stats.drawn_vertices = 0;
+            this->gpu_stats.drawn_primitives = 0;
+            this->gpu_stats.shaded_primitives = 0;
+            this->gpu_stats.shaded_fragments = 0;
+        }
+
+        void accumulate(const PerfMeasurements & other) {
+            this->cpu_time += other.cpu_time;
+            this->gpu_time += other.gpu_time;
+            this->gpu_stats.drawn_vertices += other.gpu_stats.drawn_vertices;
+            this->gpu_stats.drawn_primitives += other.gpu_stats.drawn_primitives;
+            this->gpu_stats.shaded_primitives += other.gpu_stats.shaded_primitives;
+            this->gpu_stats.shaded_fragments += other.gpu_stats.shaded_fragments;
+        };
+
+        void scale(float scale) {
+            this->cpu_time /= scale;
+            this->gpu_time /= scale;
+            this->gpu_stats.drawn_vertices /= scale;
+            this->gpu_stats.drawn_primitives /= scale;
+            this->gpu_stats.shaded_primitives /= scale;
+            this->gpu_stats.shaded_fragments /= scale;
+        }
+    };
+
+    struct EventMeasurements {
+        uint32_t id;
+        PerfMeasurements data;
+    };
+
+    struct FrameMeasurements {
+        PerfMeasurements frame_total;
+        std::vector<EventMeasurements> events;
+    };
+
+    // one completed CPU event
+    struct CPUZone {
+        uint32_t id;
+        const char * name;  // not copied, PERF_CPU_SCOPED passes a literal
+        uint32_t thread;    // 1 based slot of the recording thread, reused after the thread exits
+        uint32_t depth;     // nesting level on that thread, 0 for the outermost event
+        double start;       // seconds, same base as clock_seconds()
+        double duration;    // seconds
+    };
+
+    class ScopedCPUEvent {
+    public:
+        ScopedCPUEvent(uint32_t id, const char * name);
+        ~ScopedCPUEvent();
+    };
+
+    // Events are kept per thread and must end on the thread they began on
+    // Recording never blocks, a thread that gets too far ahead of cpu_collect drops events
+    void cpu_event_begin(uint32_t id, const char * name);
+    void cpu_event_end();
+
+    // Move the completed events of all threads to out, in per thread order
+    // Only one thread may collect at a time, frame_end does it for the viewer
+    void cpu_collect(std::vector<CPUZone> & out_zones);
+    // events lost because a thread buffer was full
+    uint64_t cpu_dropped();
+    // convert to the measurements frame_end produces, cpu_time in ms and gpu_time 0
+    void cpu_measurements(const std::vector<CPUZone> & zones, std::vector<EventMeasurements> & out_events);
+}
+
+#ifdef DISABLE_PERF_TRACKING
+    #define PERF_CPU_SCOPED(eventname) ;
+    #define PERF_CPU_BEGIN(eventname) ;
+    #define PERF_CPU_END() ;
+#else
+    #define PERF_CPU_SCOPED_IMPL(eventname, location) \
+        PerfTracker::ScopedCPUEvent PERF_EVENT_VARNAME(location, cpu)(HASH_STRING(eventname), eventname);
+
+    #define PERF_CPU_SCOPED(eventname) \
+        PERF_CPU_SCOPED_IMPL(eventname, __LINE__)
+
+    #define PERF_CPU_BEGIN(eventname) \
+        PerfTracker::cpu_event_begin(HASH_STRING(eventname), eventname);
+
+    #define PERF_CPU_END() \
+        PerfTracker::cpu_event_end();
+#endif
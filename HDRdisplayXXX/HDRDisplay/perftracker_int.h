@@ -27,6 +27,8 @@
 #pragma once
 #include <d3d11.h>
 
+#include "perftracker_cpu.h"
+
 #include <algorithm>
 #include <vector>
 
@@ -60,15 +62,6 @@ namespace PerfTracker {
     void event_end(ID3D11DeviceContext * ctx);
 }
 
-#define H1(s,i,x)   (x*65599u+(uint8_t)s[(i)<strlen(s)?strlen(s)-1-(i):strlen(s)])
-#define H4(s,i,x)   H1(s,i,H1(s,i+1,H1(s,i+2,H1(s,i+3,x))))
-#define H16(s,i,x)  H4(s,i,H4(s,i+4,H4(s,i+8,H4(s,i+12,x))))
-#define H64(s,i,x)  H16(s,i,H16(s,i+16,H16(s,i+32,H16(s,i+48,x))))
-#define H256(s,i,x) H64(s,i,H64(s,i+64,H64(s,i+128,H64(s,i+192,x))))
-#define HASH_STRING(s)    ((uint32_t)(H256(s,0,0)^(H256(s,0,0)>>16)))
-
-#define PERF_EVENT_VARNAME(x, y) perfevent_line##x##_##y
-
 #define PERF_FRAME_BEGIN_IMPL(ctx) \
     PerfTracker::frame_begin(ctx);
 
@@ -0,0 +1,156 @@
+// Pool of large aligned buffers for decoded pixels and staging copies
+
+#include "pixelPool.h"
+
+#include <algorithm>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <malloc.h>
+#endif
+
+// smallest class, anything under it is not worth pooling but is rounded up all the same
+static const size_t MinClassSize = 4096;
+
+static void *AlignedAlloc(size_t bytes)
+{
+#ifdef _WIN32
+	return _aligned_malloc(bytes, PixelPool::Alignment);
+#else
+	void *buffer = nullptr;
+	return posix_memalign(&buffer, PixelPool::Alignment, bytes) ? nullptr : buffer;
+#endif
+}
+
+static void AlignedFree(void *buffer)
+{
+#ifdef _WIN32
+	_aligned_free(buffer);
+#else
+	free(buffer);
+#endif
+}
+
+PixelPool::PixelPool(size_t maxIdleBytes) : maxIdleBytes(maxIdleBytes)
+{
+	memset(&stats, 0, sizeof(stats));
+}
+
+PixelPool::~PixelPool()
+{
+	Trim();
+}
+
+size_t PixelPool::ClassSize(size_t bytes)
+{
+	if (bytes <= MinClassSize)
+		return MinClassSize;
+
+	size_t top = MinClassSize;
+
+	while (top * 2 <= bytes)
+		top *= 2;
+
+	// four classes between each power of two and the next
+	const size_t step = top / 4;
+
+	return (bytes + step - 1) / step * step;
+}
+
+void *PixelPool::Acquire(size_t bytes, size_t &capacity)
+{
+	capacity = ClassSize(bytes);
+
+	{
+		std::lock_guard<std::mutex> guard(lock);
+
+		stats.leases++;
+
+		// the most recently released of the class, it is the likeliest to still be in cache
+		for (size_t i = idle.size(); i-- > 0;)
+		{
+			if (idle[i].capacity != capacity)
+				continue;
+
+			void *buffer = idle[i].buffer;
+			idle.erase(idle.begin() + i);
+
+			stats.reused++;
+			stats.idleBytes -= capacity;
+			stats.leasedBytes += capacity;
+
+			return buffer;
+		}
+	}
+
+	void *buffer = AlignedAlloc(capacity);
+
+	std::lock_guard<std::mutex> guard(lock);
+
+	if (!buffer)
+	{
+		// nothing idle fits, give the heap back what is idle and try once more
+		FreeIdle(0);
+		buffer = AlignedAlloc(capacity);
+
+		if (!buffer)
+			return nullptr;
+	}
+
+	stats.leasedBytes += capacity;
+	stats.peakBytes = (std::max)(stats.peakBytes, stats.leasedBytes + stats.idleBytes);
+
+	return buffer;
+}
+
+void PixelPool::Release(void *buffer, size_t capacity)
+{
+	std::lock_guard<std::mutex> guard(lock);
+
+	stats.leasedBytes -= capacity;
+
+	if (capacity > maxIdleBytes)
+	{
+		AlignedFree(buffer);
+		return;
+	}
+
+	Idle entry = { buffer, capacity };
+	idle.push_back(entry);
+	stats.idleBytes += capacity;
+
+	FreeIdle(maxIdleBytes);
+}
+
+void PixelPool::Trim()
+{
+	std::lock_guard<std::mutex> guard(lock);
+	FreeIdle(0);
+}
+
+PixelPoolStats PixelPool::Stats()
+{
+	std::lock_guard<std::mutex> guard(lock);
+	return stats;
+}
+
+void PixelPool::FreeIdle(size_t keepBytes)
+{
+	size_t count = 0;
+
+	while (count < idle.size() && stats.idleBytes > keepBytes)
+	{
+		AlignedFree(idle[count].buffer);
+		stats.idleBytes -= idle[count].capacity;
+		count++;
+	}
+
+	idle.erase(idle.begin(), idle.begin() + count);
+}
+
+PixelPool &GetPixelPool()
+{
+	static PixelPool pool(size_t(1) << 30);
+	return pool;
+}
@@ -0,0 +1,126 @@
+// Pool of large aligned buffers for decoded pixels and staging copies
+//
+// Loaders and bakers need a few full size scratch buffers per image and
+// free them right after the upload, so paging through images would otherwise
+// push hundreds of MB through the heap each time. Buffers are rounded up to
+// a size class, four per power of two so at most a quarter is wasted, and a
+// released buffer is kept idle for the next lease of the same class. Idle
+// buffers beyond a byte budget are freed, oldest first. Every buffer is
+// 64 byte aligned, so SSE loads and cache lines never straddle its start.
+// Portable, no D3D.
+
+#pragma once
+
+#include <mutex>
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+struct PixelPoolStats
+{
+	uint64_t leases;
+	uint64_t reused;			// leases served from an idle buffer
+	size_t leasedBytes;			// by size class, out on lease now
+	size_t peakBytes;			// most leasedBytes and idle bytes held at once
+	size_t idleBytes;
+};
+
+class PixelPool
+{
+public:
+	static const size_t Alignment = 64;
+
+	// idle buffers are freed once they add up to more than maxIdleBytes
+	explicit PixelPool(size_t maxIdleBytes);
+	~PixelPool();
+
+	// At least bytes, aligned to Alignment and uninitialized
+	void *Acquire(size_t bytes, size_t &capacity);
+	void Release(void *buffer, size_t capacity);
+
+	// Frees every idle buffer
+	void Trim();
+
+	PixelPoolStats Stats();
+
+	// bytes rounded up to its size class
+	static size_t ClassSize(size_t bytes);
+
+protected:
+	struct Idle
+	{
+		void *buffer;
+		size_t capacity;
+	};
+
+	void FreeIdle(size_t keepBytes);
+
+	std::mutex lock;
+	size_t maxIdleBytes;
+	PixelPoolStats stats;
+
+	// most recently released at the back
+	std::vector<Idle> idle;
+};
+
+// Shared by the loaders and bakers, keeping up to 1 GB idle
+PixelPool &GetPixelPool();
+
+// A buffer on lease from a pool, returned when the lease goes
+class PixelLease
+{
+public:
+	PixelLease() : pool(nullptr), buffer(nullptr), capacity(0), bytes(0) {}
+	PixelLease(PixelPool &pool, size_t bytes) : pool(&pool), bytes(bytes) { buffer = pool.Acquire(bytes, capacity); }
+	~PixelLease() { Return(); }
+
+	PixelLease(PixelLease &&other) : pool(other.pool), buffer(other.buffer), capacity(other.capacity), bytes(other.bytes)
+	{
+		other.buffer = nullptr;
+	}
+
+	PixelLease &operator=(PixelLease &&other)
+	{
+		if (this != &other)
+		{
+			Return();
+			pool = other.pool;
+			buffer = other.buffer;
+			capacity = other.capacity;
+			bytes = other.bytes;
+			other.buffer = nullptr;
+		}
+
+		return *this;
+	}
+
+	PixelLease(const PixelLease &) = delete;
+	PixelLease &operator=(const PixelLease &) = delete;
+
+	template <typename T> T *As() const { return static_cast<T*>(buffer); }
+
+	// bytes asked for, the buffer may be larger
+	size_t Size() const { return bytes; }
+
+	explicit operator bool() const { return buffer != nullptr; }
+
+protected:
+	void Return()
+	{
+		if (buffer)
+			pool->Release(buffer, capacity);
+
+		buffer = nullptr;
+	}
+
+	PixelPool *pool;
+	void *buffer;
+	size_t capacity;
+	size_t bytes;
+};
+
+// Leases count elements of T from the shared pool
+template <typename T> PixelLease LeasePixels(size_t count)
+{
+	return PixelLease(GetPixelPool(), count * sizeof(T));
+}
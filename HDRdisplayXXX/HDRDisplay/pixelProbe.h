@@ -0,0 +1,282 @@
+// Readback of the colour probe written by the transform pass
+//
+// xform_input.hlsl stores the pixels in a window around the mouse into a small
+// UAV. Each frame that buffer is copied into one of a ring of staging buffers
+// and an event query is issued after the copy. A slot is only mapped once its
+// query reports the copy done, so reads never stall the pipeline and never see
+// partial data. Results arrive Latency() frames after they were rendered.
+// A fused kernel also stores its final colour at the centre after the window.
+
+#pragma once
+
+#include <d3d11.h>
+#include "common_util.h"
+
+#include <algorithm>
+#include <float.h>
+#include <stdint.h>
+#include <string.h>
+
+struct ProbeResult
+{
+	int x, y;		// window centre in back buffer pixels
+	int radius;		// window is 2 * radius + 1 pixels square
+	int count;		// pixels the transform pass covered
+	float center[3];
+	float mean[3];
+	float min[3];
+	float max[3];
+	float output[3];	// fused kernel output at the centre
+	bool hasOutput;		// false when the frame was drawn in several passes
+	uint64_t frame;	// frame the values were rendered in
+};
+
+class PixelProbe
+{
+public:
+	static const int RingSize = 3;
+	static const int MaxRadius = 7;
+
+protected:
+	static const int MaxSize = 2 * MaxRadius + 1;
+	static const int Elements = (MaxSize * MaxSize + 1) * 4;
+
+	struct Slot
+	{
+		ID3D11Buffer *staging;
+		ID3D11Query *query;
+		bool pending;
+		int x, y, radius;
+		uint64_t frame;
+	};
+
+	ID3D11Device *device;
+	ID3D11Buffer *feedbackBuf;
+	ID3D11UnorderedAccessView *feedbackUAV;
+
+	Slot slots[RingSize];
+	int next;			// slot the next frame copies into
+	uint64_t frame;
+	uint64_t latestFrame;
+	unsigned int skipped;	// frames not copied because every slot was still in flight
+
+	int radius;
+	int x, y;
+
+	ProbeResult result;
+
+	// Mean, min and max over the covered pixels of a window read back from the UAV
+	static void Reduce(const float *data, int inRadius, ProbeResult &out)
+	{
+		const int size = 2 * inRadius + 1;
+
+		out.count = 0;
+		for (int c = 0; c < 3; c++)
+		{
+			out.center[c] = 0.0f;
+			out.mean[c] = 0.0f;
+			out.min[c] = FLT_MAX;
+			out.max[c] = -FLT_MAX;
+		}
+
+		double sum[3] = { 0.0, 0.0, 0.0 };
+
+		for (int i = 0; i < size * size; i++)
+		{
+			const float *pixel = data + i * 4;
+
+			if (pixel[3] == 0.0f)
+				continue;
+
+			for (int c = 0; c < 3; c++)
+			{
+				sum[c] += pixel[c];
+				out.min[c] = (std::min)(out.min[c], pixel[c]);
+				out.max[c] = (std::max)(out.max[c], pixel[c]);
+			}
+			out.count++;
+		}
+
+		const float *center = data + (inRadius * size + inRadius) * 4;
+		const float *output = data + size * size * 4;
+
+		for (int c = 0; c < 3; c++)
+		{
+			if (out.count)
+			{
+				out.mean[c] = float(sum[c] / out.count);
+			}
+			else
+			{
+				out.min[c] = 0.0f;
+				out.max[c] = 0.0f;
+			}
+			out.center[c] = center[c];
+			out.output[c] = output[c];
+		}
+
+		out.hasOutput = output[3] != 0.0f;
+	}
+
+public:
+
+	PixelProbe(ID3D11Device *inDevice) :
+		device(inDevice),
+		feedbackBuf(nullptr),
+		feedbackUAV(nullptr),
+		next(0),
+		frame(0),
+		latestFrame(0),
+		skipped(0),
+		radius(0),
+		x(0),
+		y(0)
+	{
+		memset(&result, 0, sizeof(result));
+		memset(slots, 0, sizeof(slots));
+
+		D3D11_BUFFER_DESC desc;
+		ZeroMemory(&desc, sizeof(desc));
+		desc.ByteWidth = Elements * sizeof(float);
+		desc.Usage = D3D11_USAGE_DEFAULT;
+		desc.BindFlags = D3D11_BIND_UNORDERED_ACCESS;
+
+		device->CreateBuffer(&desc, nullptr, &feedbackBuf);
+
+		D3D11_UNORDERED_ACCESS_VIEW_DESC uavDesc;
+		ZeroMemory(&uavDesc, sizeof(uavDesc));
+		uavDesc.Format = DXGI_FORMAT_R32_FLOAT;
+		uavDesc.ViewDimension = D3D11_UAV_DIMENSION_BUFFER;
+		uavDesc.Buffer.FirstElement = 0;
+		uavDesc.Buffer.NumElements = Elements;
+
+		device->CreateUnorderedAccessView(feedbackBuf, &uavDesc, &feedbackUAV);
+
+		desc.Usage = D3D11_USAGE_STAGING;
+		desc.BindFlags = 0;
+		desc.CPUAccessFlags = D3D11_CPU_ACCESS_READ;
+
+		D3D11_QUERY_DESC queryDesc = { D3D11_QUERY_EVENT, 0 };
+
+		for (int i = 0; i < RingSize; i++)
+		{
+			device->CreateBuffer(&desc, nullptr, &slots[i].staging);
+			device->CreateQuery(&queryDesc, &slots[i].query);
+		}
+	}
+
+	~PixelProbe()
+	{
+		for (int i = 0; i < RingSize; i++)
+		{
+			SAFE_RELEASE(slots[i].staging);
+			SAFE_RELEASE(slots[i].query);
+		}
+		SAFE_RELEASE(feedbackUAV);
+		SAFE_RELEASE(feedbackBuf);
+	}
+
+	// Window size in pixels, even sizes round up to the next odd one, at most 2 * MaxRadius + 1
+	void SetSize(int size)
+	{
+		radius = (std::max)(0, (std::min)(int(MaxRadius), size / 2));
+	}
+
+	int Radius() const { return radius; }
+
+	// Frames between rendering a value and Latest() returning it, worst case
+	int Latency() const { return RingSize; }
+
+	unsigned int Skipped() const { return skipped; }
+
+	// Clear the window and return the UAV for the transform pass, centred on x, y
+	ID3D11UnorderedAccessView* Begin(ID3D11DeviceContext *ctx, int inX, int inY)
+	{
+		x = inX;
+		y = inY;
+
+		const float zero[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+		ctx->ClearUnorderedAccessViewFloat(feedbackUAV, zero);
+
+		return feedbackUAV;
+	}
+
+	// After the transform pass, queue the copy of this frame's window
+	void End(ID3D11DeviceContext *ctx)
+	{
+		frame++;
+
+		Slot &slot = slots[next];
+
+		// the GPU is a whole ring behind, drop this frame rather than wait for it
+		if (slot.pending)
+		{
+			skipped++;
+			return;
+		}
+
+		const int size = 2 * radius + 1;
+		D3D11_BOX box = { 0, 0, 0, UINT((size * size + 1) * 4 * sizeof(float)), 1, 1 };
+
+		ctx->CopySubresourceRegion(slot.staging, 0, 0, 0, 0, feedbackBuf, 0, &box);
+		ctx->End(slot.query);
+
+		slot.pending = true;
+		slot.x = x;
+		slot.y = y;
+		slot.radius = radius;
+		slot.frame = frame;
+
+		next = (next + 1) % RingSize;
+	}
+
+	// True while a copy has not been collected yet
+	bool Pending() const
+	{
+		for (int i = 0; i < RingSize; i++)
+		{
+			if (slots[i].pending)
+				return true;
+		}
+
+		return false;
+	}
+
+	// Collect every copy the GPU has finished, true if a newer result arrived
+	bool Poll(ID3D11DeviceContext *ctx)
+	{
+		bool updated = false;
+
+		// oldest first, so the last one read is the newest
+		for (int i = 0; i < RingSize; i++)
+		{
+			Slot &slot = slots[(next + i) % RingSize];
+
+			if (!slot.pending || ctx->GetData(slot.query, nullptr, 0, D3D11_ASYNC_GETDATA_DONOTFLUSH) != S_OK)
+				continue;
+
+			D3D11_MAPPED_SUBRESOURCE map;
+
+			if (FAILED(ctx->Map(slot.staging, 0, D3D11_MAP_READ, D3D11_MAP_FLAG_DO_NOT_WAIT, &map)))
+				continue;
+
+			if (slot.frame > latestFrame)
+			{
+				Reduce((const float*)map.pData, slot.radius, result);
+				result.x = slot.x;
+				result.y = slot.y;
+				result.radius = slot.radius;
+				result.frame = slot.frame;
+				latestFrame = slot.frame;
+				updated = true;
+			}
+
+			ctx->Unmap(slot.staging, 0);
+			slot.pending = false;
+		}
+
+		return updated;
+	}
+
+	const ProbeResult &Latest() const { return result; }
+};
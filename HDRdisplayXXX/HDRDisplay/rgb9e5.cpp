@@ -0,0 +1,164 @@
+// RGBE to DXGI_FORMAT_R9G9B9E5_SHAREDEXP conversion
+
+#include "rgb9e5.h"
+
+#include "rgbe.h"
+
+#include <algorithm>
+#include <math.h>
+
+#if defined(_M_X64) || defined(__SSE2__)
+#include <emmintrin.h>
+#define RGB9E5_SSE2
+#endif
+
+// RGBE is m * 2^(e - 136), RGB9E5 is m * 2^(E - 24). With m9 = m8 * 2 the
+// exponents line up at E = e - 113, which covers e from 113 to 144. Above
+// that the mantissas are scaled up at E = 31 and saturate, below it they are
+// scaled down, rounding half up, at E = 0.
+static const int ExponentBias = 113;
+
+static inline uint32_t Pack(uint32_t r, uint32_t g, uint32_t b, uint32_t e)
+{
+	return r | g << 9 | b << 18 | e << 27;
+}
+
+uint32_t RGBEToRGB9E5(const unsigned char rgbe[4])
+{
+	const int e = rgbe[3];
+	uint32_t m[3];
+
+	if (e == 0)
+		return 0;
+
+	int E = e - ExponentBias;
+
+	if (E > 31)
+	{
+		const int shift = e - 143;
+
+		for (int c = 0; c < 3; c++)
+			m[c] = shift > 9 && rgbe[c] ? 511u : (std::min)(uint32_t(rgbe[c]) << shift, 511u);
+
+		E = 31;
+	}
+	else if (E < 0)
+	{
+		const int shift = -E;
+
+		for (int c = 0; c < 3; c++)
+			m[c] = shift > 10 ? 0u : (uint32_t(rgbe[c]) * 2 + (1u << (shift - 1))) >> shift;
+
+		E = 0;
+	}
+	else
+	{
+		for (int c = 0; c < 3; c++)
+			m[c] = uint32_t(rgbe[c]) * 2;
+	}
+
+	return Pack(m[0], m[1], m[2], uint32_t(E));
+}
+
+#ifdef RGB9E5_SSE2
+
+// Four pixels at a time in float, where the per lane shifts SSE2 lacks
+// become multiplies by a power of two built from the exponent bits. The
+// mantissas are at most 8 bits and the scales exact, so m * scale + 0.5
+// truncated is the scalar path's rounding.
+static void ConvertSSE2(const unsigned char *rgbe, uint32_t *out, size_t count)
+{
+	const __m128i byteMask = _mm_set1_epi32(0xff);
+	const __m128 bias = _mm_set1_ps(float(ExponentBias));
+	const __m128 zero = _mm_setzero_ps();
+	const __m128 maxExponent = _mm_set1_ps(31.0f);
+	const __m128 maxMantissa = _mm_set1_ps(511.0f);
+	const __m128 half = _mm_set1_ps(0.5f);
+	const __m128i floatBias = _mm_set1_epi32(127 - ExponentBias + 1);
+
+	for (size_t i = 0; i < count; i += 4)
+	{
+		__m128i v = _mm_loadu_si128((const __m128i*)(rgbe + i * 4));
+
+		__m128i e = _mm_srli_epi32(v, 24);
+		__m128 ef = _mm_cvtepi32_ps(e);
+		__m128 E = _mm_min_ps(_mm_max_ps(_mm_sub_ps(ef, bias), zero), maxExponent);
+		__m128i Ei = _mm_cvttps_epi32(E);
+
+		// scale = 2^(e - 112 - E), as float bits
+		__m128i k = _mm_add_epi32(_mm_sub_epi32(e, Ei), floatBias);
+		__m128 scale = _mm_castsi128_ps(_mm_slli_epi32(k, 23));
+
+		__m128i m[3];
+
+		for (int c = 0; c < 3; c++)
+		{
+			__m128 mf = _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(v, 8 * c), byteMask));
+			mf = _mm_min_ps(_mm_add_ps(_mm_mul_ps(mf, scale), half), maxMantissa);
+			m[c] = _mm_cvttps_epi32(mf);
+		}
+
+		__m128i packed = _mm_or_si128(
+			_mm_or_si128(m[0], _mm_slli_epi32(m[1], 9)),
+			_mm_or_si128(_mm_slli_epi32(m[2], 18), _mm_slli_epi32(Ei, 27)));
+
+		// e == 0 is a zero pixel whatever the mantissas hold
+		packed = _mm_andnot_si128(_mm_cmpeq_epi32(e, _mm_setzero_si128()), packed);
+
+		_mm_storeu_si128((__m128i*)(out + i), packed);
+	}
+}
+
+#endif
+
+void ConvertRGBEToRGB9E5(const unsigned char *rgbe, uint32_t *out, size_t count)
+{
+	size_t done = 0;
+
+#ifdef RGB9E5_SSE2
+	done = count & ~size_t(3);
+	ConvertSSE2(rgbe, out, done);
+#endif
+
+	for (size_t i = done; i < count; i++)
+		out[i] = RGBEToRGB9E5(rgbe + i * 4);
+}
+
+void RGB9E5ToFloat(uint32_t packed, float rgb[3])
+{
+	const float scale = ldexpf(1.0f, int(packed >> 27) - 24);
+
+	rgb[0] = float(packed & 511) * scale;
+	rgb[1] = float(packed >> 9 & 511) * scale;
+	rgb[2] = float(packed >> 18 & 511) * scale;
+}
+
+RGB9E5Check CheckRGB9E5(const unsigned char *rgbe, const uint32_t *packed, size_t count)
+{
+	RGB9E5Check check = { 0.0f, 0 };
+
+	for (size_t i = 0; i < count; i++)
+	{
+		unsigned char pixel[4] = { rgbe[i * 4 + 0], rgbe[i * 4 + 1], rgbe[i * 4 + 2], rgbe[i * 4 + 3] };
+		float ref[3], got[3];
+
+		rgbe2float(&ref[0], &ref[1], &ref[2], pixel);
+		RGB9E5ToFloat(packed[i], got);
+
+		float peak = (std::max)((std::max)(ref[0], ref[1]), ref[2]);
+
+		if (peak > RGB9E5Max)
+		{
+			check.clamped++;
+			continue;
+		}
+
+		// near black the 2^-24 steps dominate, the error is taken as absolute there
+		peak = (std::max)(peak, ldexpf(1.0f, -14));
+
+		for (int c = 0; c < 3; c++)
+			check.maxError = (std::max)(check.maxError, fabsf(got[c] - ref[c]) / peak);
+	}
+
+	return check;
+}
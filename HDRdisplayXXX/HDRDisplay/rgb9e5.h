@@ -0,0 +1,35 @@
+// RGBE to DXGI_FORMAT_R9G9B9E5_SHAREDEXP conversion
+//
+// Both formats share one exponent across the three channels, so an RGBE
+// pixel maps onto RGB9E5 with integer shifts: the 8 bit mantissas gain a bit
+// and the exponent is rebased. Pixels from about 2^-16 up to 65408 come
+// through exactly, darker ones are rounded to RGB9E5's 2^-24 steps and
+// brighter ones clamp. Portable, SSE2 where available.
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// largest value RGB9E5 holds, 511 * 2^(31 - 15 - 9)
+static const float RGB9E5Max = 65408.0f;
+
+// CheckRGB9E5 errors above this mean the conversion is wrong, not just rounded
+static const float RGB9E5Tolerance = 1.0f / 512.0f;
+
+struct RGB9E5Check
+{
+	float maxError;		// largest channel error relative to the pixel's brightest channel
+	size_t clamped;		// pixels with a channel above RGB9E5Max
+};
+
+// One pixel, the definition the vector path has to match bit for bit
+uint32_t RGBEToRGB9E5(const unsigned char rgbe[4]);
+
+// count pixels of 4 byte RGBE, as RGBE_ReadPixels_Raw_RLE returns them
+void ConvertRGBEToRGB9E5(const unsigned char *rgbe, uint32_t *out, size_t count);
+
+void RGB9E5ToFloat(uint32_t packed, float rgb[3]);
+
+// Decode packed again and compare against rgbe2float of the source
+RGB9E5Check CheckRGB9E5(const unsigned char *rgbe, const uint32_t *packed, size_t count);
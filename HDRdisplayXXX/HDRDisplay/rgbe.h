@@ -27,12 +27,15 @@ typedef struct {
   float exposure;       /* a value of 1.0 in an image corresponds to
 			 * <exposure> watts/steradian/m^2. 
 			 * defaults to 1.0 */
+  float primaries[8];   /* CIE xy of red, green, blue and white.
+                         * only filled in by RGBEReader */
 } rgbe_header_info;
 
 /* flags indicating which fields in an rgbe_header_info are valid */
 #define RGBE_VALID_PROGRAMTYPE 0x01
 #define RGBE_VALID_GAMMA       0x02
 #define RGBE_VALID_EXPOSURE    0x04
+#define RGBE_VALID_PRIMARIES   0x08
 
 /* return codes for rgbe routines */
 #define RGBE_RETURN_SUCCESS 0
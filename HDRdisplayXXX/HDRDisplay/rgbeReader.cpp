@@ -0,0 +1,411 @@
+// RGBE (.hdr) reading from memory
+
+#include "rgbeReader.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+
+// 2^(e - 136), what rgbe2float scales the mantissas by, 0 for a zero exponent
+static const float *ExponentScales()
+{
+	struct Table
+	{
+		float scale[256];
+
+		Table()
+		{
+			scale[0] = 0.0f;
+
+			for (int e = 1; e < 256; e++)
+				scale[e] = float(ldexp(1.0, e - (128 + 8)));
+		}
+	};
+
+	static const Table table;
+	return table.scale;
+}
+
+RGBEReader::RGBEReader(const void *data, size_t size) :
+	data(static_cast<const uint8_t*>(data)),
+	size(size),
+	offset(0),
+	flat(false),
+	imageWidth(0),
+	imageHeight(0),
+	scanWidth(0),
+	scanCount(0),
+	columns(false),
+	flipX(false),
+	flipY(false)
+{
+}
+
+bool RGBEReader::ReadLine(const char *&line, size_t &length)
+{
+	if (offset >= size)
+		return false;
+
+	const uint8_t *start = data + offset;
+	const uint8_t *newline = static_cast<const uint8_t*>(memchr(start, '\n', size - offset));
+
+	if (!newline)
+		return false;
+
+	line = reinterpret_cast<const char*>(start);
+	length = size_t(newline - start);
+	offset += length + 1;
+
+	if (length && line[length - 1] == '\r')
+		length--;
+
+	return true;
+}
+
+// line as a C string for sscanf, long lines cut short, none of the fields we read come close
+static void LineText(const char *line, size_t length, char (&text)[128])
+{
+	length = length < sizeof(text) - 1 ? length : sizeof(text) - 1;
+	memcpy(text, line, length);
+	text[length] = 0;
+}
+
+bool RGBEReader::ReadHeader(int &width, int &height, rgbe_header_info *info)
+{
+	const char *line;
+	size_t length;
+	char text[128];
+
+	if (info)
+	{
+		info->valid = 0;
+		info->programtype[0] = 0;
+		info->gamma = info->exposure = 1.0f;
+	}
+
+	if (!ReadLine(line, length))
+		return false;
+
+	// the #? magic is optional, what follows it is the program type
+	if (length >= 2 && line[0] == '#' && line[1] == '?')
+	{
+		if (info)
+		{
+			size_t i = 0;
+
+			for (; i < sizeof(info->programtype) - 1 && i + 2 < length && line[i + 2] != ' ' && line[i + 2] != '\t'; i++)
+				info->programtype[i] = line[i + 2];
+
+			info->programtype[i] = 0;
+			info->valid |= RGBE_VALID_PROGRAMTYPE;
+		}
+
+		if (!ReadLine(line, length))
+			return false;
+	}
+
+	// variables up to the blank line, in any order. No FORMAT at all means RGBE, as Radiance takes it
+	static const char format[] = "FORMAT=";
+	static const char rgbe[] = "FORMAT=32-bit_rle_rgbe";
+
+	while (length)
+	{
+		if (length >= sizeof(format) - 1 && !memcmp(line, format, sizeof(format) - 1))
+		{
+			// XYZE or anything else would need converting
+			if (length != sizeof(rgbe) - 1 || memcmp(line, rgbe, length))
+				return false;
+		}
+		else if (info)
+		{
+			float value, p[8];
+			LineText(line, length, text);
+
+			if (sscanf(text, "GAMMA=%g", &value) == 1)
+			{
+				info->gamma = value;
+				info->valid |= RGBE_VALID_GAMMA;
+			}
+			else if (sscanf(text, "EXPOSURE=%g", &value) == 1)
+			{
+				info->exposure *= value;
+				info->valid |= RGBE_VALID_EXPOSURE;
+			}
+			else if (sscanf(text, "PRIMARIES=%g %g %g %g %g %g %g %g", &p[0], &p[1], &p[2], &p[3], &p[4], &p[5], &p[6], &p[7]) == 8)
+			{
+				memcpy(info->primaries, p, sizeof(p));
+				info->valid |= RGBE_VALID_PRIMARIES;
+			}
+		}
+
+		if (!ReadLine(line, length))
+			return false;
+	}
+
+	// the resolution line comes straight after the blank line
+	if (!ReadLine(line, length))
+		return false;
+
+	LineText(line, length, text);
+
+	if (!ReadResolution(text))
+		return false;
+
+	width = imageWidth;
+	height = imageHeight;
+
+	return true;
+}
+
+bool RGBEReader::ReadResolution(const char *text)
+{
+	char sign[2], axis[2];
+	int count[2];
+
+	if (sscanf(text, "%c%c %d %c%c %d", &sign[0], &axis[0], &count[0], &sign[1], &axis[1], &count[1]) != 6)
+		return false;
+
+	for (int i = 0; i < 2; i++)
+	{
+		if ((sign[i] != '-' && sign[i] != '+') || (axis[i] != 'X' && axis[i] != 'Y') || count[i] <= 0)
+			return false;
+	}
+
+	if (axis[0] == axis[1])
+		return false;
+
+	// the first axis is the one scanlines step along
+	columns = axis[0] == 'X';
+
+	const int x = columns ? 0 : 1;
+	const int y = 1 - x;
+
+	imageWidth = count[x];
+	imageHeight = count[y];
+	flipX = sign[x] == '-';
+	flipY = sign[y] == '+';
+	scanCount = count[0];
+	scanWidth = count[1];
+
+	// the least a scanline can take: the RLE marker and runs of 127 in each channel, or flat pixels
+	const uint64_t least = scanWidth >= 8 && scanWidth <= 0x7fff
+		? 4 + 8 * uint64_t((scanWidth + 126) / 127)
+		: uint64_t(scanWidth) * 4;
+
+	return least * uint64_t(scanCount) <= size - offset;
+}
+
+void RGBEReader::ScanlinePlacement(int s, int &x, int &y, int &dx, int &dy) const
+{
+	if (columns)
+	{
+		x = flipX ? imageWidth - 1 - s : s;
+		y = flipY ? imageHeight - 1 : 0;
+		dx = 0;
+		dy = flipY ? -1 : 1;
+	}
+	else
+	{
+		x = flipX ? imageWidth - 1 : 0;
+		y = flipY ? imageHeight - 1 - s : s;
+		dx = flipX ? -1 : 1;
+		dy = 0;
+	}
+}
+
+bool RGBEReader::ReadChannel(uint8_t *channel, int width)
+{
+	uint8_t *end = channel + width;
+	const uint8_t *src = data + offset;
+	const uint8_t *srcEnd = data + size;
+
+	while (channel < end)
+	{
+		if (srcEnd - src < 2)
+			return false;
+
+		int count = src[0];
+
+		if (count > 128)
+		{
+			// a run of the same value
+			count -= 128;
+
+			if (count > end - channel)
+				return false;
+
+			memset(channel, src[1], count);
+			src += 2;
+		}
+		else
+		{
+			// count literal bytes
+			if (count == 0 || count > end - channel || count > srcEnd - src - 1)
+				return false;
+
+			memcpy(channel, src + 1, count);
+			src += 1 + count;
+		}
+
+		channel += count;
+	}
+
+	offset = size_t(src - data);
+
+	return true;
+}
+
+bool RGBEReader::ReadScanline(uint8_t *rgbe, int width)
+{
+	// the FILE reader only allows RLE for these widths
+	if (!flat && width >= 8 && width <= 0x7fff)
+	{
+		if (size - offset < 4)
+			return false;
+
+		const uint8_t *marker = data + offset;
+
+		if (marker[0] == 2 && marker[1] == 2 && !(marker[2] & 0x80))
+		{
+			if ((marker[2] << 8 | marker[3]) != width)
+				return false;
+
+			offset += 4;
+			planes.resize(size_t(width) * 4);
+
+			for (int c = 0; c < 4; c++)
+			{
+				if (!ReadChannel(&planes[size_t(c) * width], width))
+					return false;
+			}
+
+			const uint8_t *r = &planes[0];
+			const uint8_t *g = r + width;
+			const uint8_t *b = g + width;
+			const uint8_t *e = b + width;
+
+			for (int x = 0; x < width; x++)
+			{
+				rgbe[x * 4 + 0] = r[x];
+				rgbe[x * 4 + 1] = g[x];
+				rgbe[x * 4 + 2] = b[x];
+				rgbe[x * 4 + 3] = e[x];
+			}
+
+			return true;
+		}
+
+		flat = true;
+	}
+
+	const size_t bytes = size_t(width) * 4;
+
+	if (size - offset < bytes)
+		return false;
+
+	memcpy(rgbe, data + offset, bytes);
+	offset += bytes;
+
+	return true;
+}
+
+bool RGBEReader::ReadPixelsRaw(uint8_t *rgbe, int width, int rows)
+{
+	if (width <= 0 || rows < 0)
+		return false;
+
+	for (int y = 0; y < rows; y++)
+	{
+		if (!ReadScanline(rgbe + size_t(y) * width * 4, width))
+			return false;
+	}
+
+	return true;
+}
+
+bool RGBEReader::ReadPixels(float *rgb, int width, int rows)
+{
+	if (width <= 0 || rows < 0)
+		return false;
+
+	const float *scales = ExponentScales();
+	scanline.resize(size_t(width) * 4);
+
+	for (int y = 0; y < rows; y++)
+	{
+		if (!ReadScanline(scanline.data(), width))
+			return false;
+
+		const uint8_t *src = scanline.data();
+		float *dst = rgb + size_t(y) * width * 3;
+
+		for (int x = 0; x < width; x++)
+		{
+			const float scale = scales[src[x * 4 + 3]];
+
+			dst[x * 3 + 0] = src[x * 4 + 0] * scale;
+			dst[x * 3 + 1] = src[x * 4 + 1] * scale;
+			dst[x * 3 + 2] = src[x * 4 + 2] * scale;
+		}
+	}
+
+	return true;
+}
+
+bool RGBEReader::ReadImageRaw(uint8_t *rgbe)
+{
+	if (RowOrder())
+		return ReadPixelsRaw(rgbe, scanWidth, scanCount);
+
+	scanline.resize(size_t(scanWidth) * 4);
+
+	for (int s = 0; s < scanCount; s++)
+	{
+		if (!ReadScanline(scanline.data(), scanWidth))
+			return false;
+
+		int x, y, dx, dy;
+		ScanlinePlacement(s, x, y, dx, dy);
+
+		const ptrdiff_t step = (ptrdiff_t(dy) * imageWidth + dx) * 4;
+		uint8_t *dst = rgbe + (size_t(y) * imageWidth + x) * 4;
+
+		for (int i = 0; i < scanWidth; i++, dst += step)
+			memcpy(dst, &scanline[size_t(i) * 4], 4);
+	}
+
+	return true;
+}
+
+bool RGBEReader::ReadImage(float *rgb)
+{
+	if (RowOrder())
+		return ReadPixels(rgb, scanWidth, scanCount);
+
+	const float *scales = ExponentScales();
+	scanline.resize(size_t(scanWidth) * 4);
+
+	for (int s = 0; s < scanCount; s++)
+	{
+		if (!ReadScanline(scanline.data(), scanWidth))
+			return false;
+
+		int x, y, dx, dy;
+		ScanlinePlacement(s, x, y, dx, dy);
+
+		const uint8_t *src = scanline.data();
+		const ptrdiff_t step = (ptrdiff_t(dy) * imageWidth + dx) * 3;
+		float *dst = rgb + (size_t(y) * imageWidth + x) * 3;
+
+		for (int i = 0; i < scanWidth; i++, dst += step)
+		{
+			const float scale = scales[src[i * 4 + 3]];
+
+			dst[0] = src[i * 4 + 0] * scale;
+			dst[1] = src[i * 4 + 1] * scale;
+			dst[2] = src[i * 4 + 2] * scale;
+		}
+	}
+
+	return true;
+}
@@ -0,0 +1,87 @@
+// RGBE (.hdr) reading from memory
+//
+// Reads the same header and scanlines as the FILE based calls in rgbe.h, from
+// a span of bytes instead: a file mapped with MappedFile, or a buffer out of
+// an archive or off the network. Every read is checked against the end of
+// the span and fails rather than run past it or past the scanline it fills.
+// Runs are filled with memset and literal bytes copied with memcpy, and
+// exponents are scaled through a table, so there is little per byte
+// branching. Like the FILE calls, a scanline without the RLE marker means the
+// rest of the image is flat RGBE.
+//
+// The header is read up to its blank line whatever order the variables come
+// in. EXPOSURE lines multiply, as Radiance writes one per adjustment, and
+// PRIMARIES is passed on in rgbe_header_info. The resolution line may start
+// from any corner and run along either axis: "-Y h +X w" is the usual top to
+// bottom rows, "+Y h +X w" is bottom up, and "+X w -Y h" has columns for
+// scanlines. ReadImage puts those back into rows top down. A header whose
+// image could not fit in the bytes after it is refused before anything is
+// allocated for it. Portable, no D3D.
+
+#pragma once
+
+#include "rgbe.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+class RGBEReader
+{
+public:
+	RGBEReader(const void *data, size_t size);
+
+	// The header up to and including the resolution line, info may be nullptr.
+	// width and height are the image's, whichever way its scanlines run.
+	bool ReadHeader(int &width, int &height, rgbe_header_info *info = nullptr);
+
+	// The image size ReadHeader returned
+	int Width() const { return imageWidth; }
+	int Height() const { return imageHeight; }
+
+	// True when scanlines are rows top down, left to right, so ReadPixels
+	// gives rows of the image and an image can be read in bands
+	bool RowOrder() const { return !columns && !flipX && !flipY; }
+
+	// Where scanline s lands in the image: pixel i of it at (x + i * dx, y + i * dy)
+	void ScanlinePlacement(int s, int &x, int &y, int &dx, int &dy) const;
+
+	// The next rows scanlines of width pixels, as RGB floats
+	bool ReadPixels(float *rgb, int width, int rows);
+
+	// The next rows scanlines of width pixels, as RGBE bytes
+	bool ReadPixelsRaw(uint8_t *rgbe, int width, int rows);
+
+	// All of the pixels after the header as rows top down, in either form
+	bool ReadImage(float *rgb);
+	bool ReadImageRaw(uint8_t *rgbe);
+
+	// Bytes consumed so far
+	size_t Offset() const { return offset; }
+
+protected:
+	// One line of the header without its newline, false at the end of the data
+	bool ReadLine(const char *&line, size_t &length);
+
+	// The resolution line, false if it is malformed or promises more than the data holds
+	bool ReadResolution(const char *text);
+
+	// One scanline as interleaved RGBE bytes
+	bool ReadScanline(uint8_t *rgbe, int width);
+	bool ReadChannel(uint8_t *channel, int width);
+
+	const uint8_t *data;
+	size_t size;
+	size_t offset;
+
+	bool flat;			// no RLE marker seen, the rest is 4 bytes a pixel
+
+	int imageWidth, imageHeight;
+	int scanWidth, scanCount;	// pixels in a scanline, scanlines in the file
+	bool columns;		// scanlines run down the image, +X or -X came first
+	bool flipX;			// -X, right to left
+	bool flipY;			// +Y, bottom up
+
+	std::vector<uint8_t> planes;	// the four channels of an RLE scanline
+	std::vector<uint8_t> scanline;
+};
@@ -0,0 +1,216 @@
+// Playback of a numbered image sequence at a fixed frame rate
+//
+// Frames come from a SequenceReader decoding ahead on the task scheduler and are
+// uploaded into a ring of dynamic textures, so the frame being written never
+// shares a texture with the ones the GPU may still be reading. The clock
+// starts when the first frame is decoded and Update() shows whichever frame
+// is due at that moment. A frame passed over because a later one was due
+// first is dropped, a refresh that has to keep showing an older frame than
+// is due is late. Both go to PerfTracker: each dropped frame as a
+// "CPU > Sequence Dropped" marker, each run of late refreshes as one
+// "CPU > Sequence Late" event lasting until playback catches up.
+
+#pragma once
+
+#include <d3d11.h>
+#include <string.h>
+#include <algorithm>
+#include "common_util.h"
+#include "frameSequence.h"
+#include "perftracker_cpu.h"
+
+class SequenceSource
+{
+	static const int RingSize = 3;
+
+	// gaps longer than this are the sequence not being shown, not playback falling behind
+	static constexpr double ResumeGap = 0.25;
+
+	ID3D11Device *device;
+	SequenceReader *reader;
+	SequenceClock clock;
+
+	ID3D11Texture2D *ring[RingSize];
+	ID3D11ShaderResourceView *ringSRV[RingSize];
+	int current;
+
+	int width, height;
+
+	bool started;
+	bool stalled;			// inside a CPU > Sequence Late event
+	int64_t shown;
+	int64_t lastLate;
+	double lastUpdate;
+
+	SequenceFrame frame;
+
+public:
+	struct Stats
+	{
+		uint64_t shown;
+		uint64_t dropped;
+		uint64_t late;
+	};
+
+	// width x height is the size of every frame, decode rejects any other
+	SequenceSource(ID3D11Device *inDevice, const std::vector<std::string> &files, const SequenceReader::Decoder &decode,
+		int inWidth, int inHeight, double fps, size_t readAhead) :
+		device(inDevice),
+		clock(fps),
+		current(0),
+		width(inWidth),
+		height(inHeight),
+		started(false),
+		stalled(false),
+		shown(-1),
+		lastLate(-1),
+		lastUpdate(0.0)
+	{
+		memset(&stats, 0, sizeof(stats));
+		memset(ring, 0, sizeof(ring));
+		memset(ringSRV, 0, sizeof(ringSRV));
+
+		D3D11_TEXTURE2D_DESC desc;
+		ZeroMemory(&desc, sizeof(desc));
+		desc.Width = width;
+		desc.Height = height;
+		desc.MipLevels = 1;
+		desc.ArraySize = 1;
+		desc.Format = DXGI_FORMAT_R16G16B16A16_FLOAT;
+		desc.SampleDesc.Count = 1;
+		desc.Usage = D3D11_USAGE_DYNAMIC;
+		desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+		desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+
+		for (int i = 0; i < RingSize; i++)
+		{
+			if (SUCCEEDED(device->CreateTexture2D(&desc, nullptr, &ring[i])))
+				device->CreateShaderResourceView(ring[i], nullptr, &ringSRV[i]);
+		}
+
+		reader = new SequenceReader(files, decode, readAhead);
+	}
+
+	~SequenceSource()
+	{
+		if (stalled)
+			PERF_CPU_END();
+
+		delete reader;
+
+		for (int i = 0; i < RingSize; i++)
+		{
+			SAFE_RELEASE(ringSRV[i]);
+			SAFE_RELEASE(ring[i]);
+		}
+	}
+
+	int Width() const { return width; }
+	int Height() const { return height; }
+	size_t Frames() const { return reader->Files(); }
+	double Rate() const { return clock.Rate(); }
+
+	// The texture of the frame on screen, nullptr until the first one is decoded
+	ID3D11ShaderResourceView *SRV() const { return started ? ringSRV[current] : nullptr; }
+
+	// Position of the frame on screen, changes whenever Update() shows a new one
+	int64_t Shown() const { return shown; }
+
+	const Stats &PlaybackStats() const { return stats; }
+
+	// Shows the frame due at now, in PerfTracker::clock_seconds()
+	void Update(ID3D11DeviceContext *ctx, double now)
+	{
+		if (!started)
+		{
+			if (!reader->Latest(0, frame))
+				return;
+
+			clock.Start(now, 0);
+			started = true;
+			Show(ctx);
+
+			lastUpdate = now;
+			return;
+		}
+
+		// not shown for a while, carry on from the frame after the one on screen
+		if (now - lastUpdate > ResumeGap)
+		{
+			EndStall();
+			clock.Start(now, shown + 1);
+			reader->Seek(shown + 1);
+		}
+
+		lastUpdate = now;
+
+		const int64_t due = clock.Due(now);
+
+		if (due > shown && reader->Latest(due, frame))
+		{
+			for (int64_t skipped = shown + 1; skipped < frame.position; skipped++)
+			{
+				PERF_CPU_BEGIN("CPU > Sequence Dropped");
+				PERF_CPU_END();
+				stats.dropped++;
+			}
+
+			Show(ctx);
+		}
+
+		if (shown < due)
+		{
+			if (!stalled)
+			{
+				PERF_CPU_BEGIN("CPU > Sequence Late");
+				stalled = true;
+			}
+
+			// once for each frame that was not on screen in time
+			if (due != lastLate)
+			{
+				lastLate = due;
+				stats.late++;
+			}
+		}
+		else
+		{
+			EndStall();
+		}
+	}
+
+protected:
+	Stats stats;
+
+	void EndStall()
+	{
+		if (stalled)
+		{
+			PERF_CPU_END();
+			stalled = false;
+		}
+	}
+
+	void Show(ID3D11DeviceContext *ctx)
+	{
+		PERF_CPU_SCOPED("CPU > Sequence Upload");
+
+		const int next = (current + 1) % RingSize;
+
+		D3D11_MAPPED_SUBRESOURCE mapped;
+
+		if (ring[next] && SUCCEEDED(ctx->Map(ring[next], 0, D3D11_MAP_WRITE_DISCARD, 0, &mapped)))
+		{
+			const size_t rowBytes = size_t(width) * 8;
+
+			for (int y = 0; y < height; y++)
+				memcpy((uint8_t*)mapped.pData + size_t(y) * mapped.RowPitch, frame.rgba.data() + size_t(y) * width * 4, rowBytes);
+
+			ctx->Unmap(ring[next], 0);
+			current = next;
+		}
+
+		shown = frame.position;
+		stats.shown++;
+	}
+};
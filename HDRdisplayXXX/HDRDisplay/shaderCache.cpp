@@ -0,0 +1,286 @@
+// On disk cache of compiled shader bytecode
+
+#include "shaderCache.h"
+
+#include <functional>
+#include <thread>
+
+#include <stdio.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <direct.h>
+#else
+#include <sys/stat.h>
+#endif
+
+static const char entryMagic[4] = { 'H', 'S', 'C', '1' };
+
+uint64_t ShaderHash(const void *data, size_t size, uint64_t hash)
+{
+	const unsigned char *bytes = (const unsigned char*)data;
+
+	for (size_t i = 0; i < size; i++)
+	{
+		hash ^= bytes[i];
+		hash *= 1099511628211ull;
+	}
+
+	return hash;
+}
+
+static uint64_t HashString(const std::string &s, uint64_t hash)
+{
+	// include the terminator so "ab"+"c" and "a"+"bc" differ
+	return ShaderHash(s.c_str(), s.size() + 1, hash);
+}
+
+static void MakeDirectory(const std::string &path)
+{
+#ifdef _WIN32
+	_mkdir(path.c_str());
+#else
+	mkdir(path.c_str(), 0755);
+#endif
+}
+
+ShaderCache::ShaderCache(ShaderBackend *inBackend, const std::string &inDirectory) :
+	backend(inBackend),
+	directory(inDirectory),
+	hits(0),
+	misses(0)
+{
+	if (directory.size())
+		MakeDirectory(directory);
+}
+
+uint64_t ShaderCache::Key(const ShaderRequest &request, const std::string &path, const std::vector<char> &source) const
+{
+	uint64_t hash = ShaderHash(source.data(), source.size());
+
+	hash = HashString(path, hash);
+	hash = HashString(request.entry, hash);
+	hash = HashString(request.profile, hash);
+	hash = ShaderHash(&request.flags, sizeof(request.flags), hash);
+
+	for (auto &define : request.defines)
+	{
+		hash = HashString(define.first, hash);
+		hash = HashString(define.second, hash);
+	}
+
+	return hash;
+}
+
+std::string ShaderCache::EntryPath(uint64_t key) const
+{
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+
+	return directory + "/" + name;
+}
+
+bool ShaderCache::Compile(const ShaderRequest &request, std::vector<char> &bytecode, std::string &errors, std::vector<std::string> *files)
+{
+	std::string path = backend->Resolve(request.file);
+	std::vector<char> source;
+
+	if (!backend->ReadFile(path, source))
+	{
+		errors = request.file + ": file not found";
+		return false;
+	}
+
+	uint64_t key = Key(request, path, source);
+	std::vector<std::string> includes;
+
+	if (directory.size() && Load(key, bytecode, includes))
+	{
+		hits++;
+	}
+	else
+	{
+		misses++;
+		includes.clear();
+
+		if (!backend->Compile(request, path, source, bytecode, includes, errors))
+			return false;
+
+		if (directory.size())
+			Store(key, includes, bytecode);
+	}
+
+	if (files)
+	{
+		files->assign(1, path);
+		files->insert(files->end(), includes.begin(), includes.end());
+	}
+
+	return true;
+}
+
+void ShaderCache::Store(uint64_t key, const std::vector<std::string> &includes, const std::vector<char> &bytecode)
+{
+	std::vector<Dependency> dependencies;
+	std::vector<char> contents;
+
+	for (auto &include : includes)
+	{
+		// the include could have changed while compiling, an entry that misses next time is harmless
+		if (!backend->ReadFile(include, contents))
+			return;
+
+		Dependency dependency;
+		dependency.path = include;
+		dependency.hash = ShaderHash(contents.data(), contents.size());
+		dependencies.push_back(dependency);
+	}
+
+	if (!Store(key, dependencies, bytecode))
+		fprintf(stderr, "ShaderCache: unable to write %s\n", EntryPath(key).c_str());
+}
+
+// Cursor over an entry file
+struct EntryReader
+{
+	const std::vector<char> &data;
+	size_t offset;
+
+	EntryReader(const std::vector<char> &inData) : data(inData), offset(0) {}
+
+	bool Read(void *out, size_t size)
+	{
+		if (data.size() - offset < size)
+			return false;
+
+		memcpy(out, data.data() + offset, size);
+		offset += size;
+		return true;
+	}
+
+	bool Read(std::string &out)
+	{
+		uint32_t size;
+		if (!Read(&size, sizeof(size)) || data.size() - offset < size)
+			return false;
+
+		out.assign(data.data() + offset, size);
+		offset += size;
+		return true;
+	}
+};
+
+// Entries are read straight from disk, the backend may keep what it reads in memory
+static bool ReadEntry(const std::string &path, std::vector<char> &data)
+{
+	FILE *fp = fopen(path.c_str(), "rb");
+
+	if (!fp)
+		return false;
+
+	char buffer[4096];
+	size_t count;
+
+	data.clear();
+	while ((count = fread(buffer, 1, sizeof(buffer), fp)) > 0)
+		data.insert(data.end(), buffer, buffer + count);
+
+	bool ok = !ferror(fp);
+	fclose(fp);
+	return ok;
+}
+
+bool ShaderCache::Load(uint64_t key, std::vector<char> &bytecode, std::vector<std::string> &includes)
+{
+	std::vector<char> data;
+
+	if (!ReadEntry(EntryPath(key), data))
+		return false;
+
+	EntryReader reader(data);
+
+	char magic[4];
+	uint64_t storedKey;
+	uint32_t count;
+
+	if (!reader.Read(magic, sizeof(magic)) || memcmp(magic, entryMagic, sizeof(magic)) != 0 ||
+		!reader.Read(&storedKey, sizeof(storedKey)) || storedKey != key ||
+		!reader.Read(&count, sizeof(count)))
+		return false;
+
+	std::vector<char> contents;
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		std::string path;
+		uint64_t hash;
+
+		if (!reader.Read(path) || !reader.Read(&hash, sizeof(hash)))
+			return false;
+
+		if (!backend->ReadFile(path, contents) || ShaderHash(contents.data(), contents.size()) != hash)
+			return false;
+
+		includes.push_back(path);
+	}
+
+	uint32_t size;
+
+	if (!reader.Read(&size, sizeof(size)) || data.size() - reader.offset != size || size == 0)
+		return false;
+
+	bytecode.assign(data.begin() + reader.offset, data.end());
+	return true;
+}
+
+static bool Write(FILE *fp, const void *data, size_t size)
+{
+	return fwrite(data, 1, size, fp) == size;
+}
+
+static bool Write(FILE *fp, const std::string &s)
+{
+	uint32_t size = uint32_t(s.size());
+	return Write(fp, &size, sizeof(size)) && Write(fp, s.data(), s.size());
+}
+
+bool ShaderCache::Store(uint64_t key, const std::vector<Dependency> &dependencies, const std::vector<char> &bytecode)
+{
+	std::string path = EntryPath(key);
+
+	// write under a per thread name and rename, so readers never see half an entry
+	char suffix[32];
+	snprintf(suffix, sizeof(suffix), ".%zx.tmp", std::hash<std::thread::id>()(std::this_thread::get_id()));
+	std::string temp = path + suffix;
+
+	FILE *fp = fopen(temp.c_str(), "wb");
+
+	if (!fp)
+		return false;
+
+	uint32_t count = uint32_t(dependencies.size());
+	uint32_t size = uint32_t(bytecode.size());
+
+	bool ok = Write(fp, entryMagic, sizeof(entryMagic)) &&
+		Write(fp, &key, sizeof(key)) &&
+		Write(fp, &count, sizeof(count));
+
+	for (size_t i = 0; ok && i < dependencies.size(); i++)
+		ok = Write(fp, dependencies[i].path) && Write(fp, &dependencies[i].hash, sizeof(dependencies[i].hash));
+
+	ok = ok && Write(fp, &size, sizeof(size)) && Write(fp, bytecode.data(), bytecode.size());
+
+	ok = fclose(fp) == 0 && ok;
+
+	// rename does not replace on Windows, another thread may have stored the same entry
+	if (ok)
+	{
+		remove(path.c_str());
+		ok = rename(temp.c_str(), path.c_str()) == 0;
+	}
+
+	if (!ok)
+		remove(temp.c_str());
+
+	return ok;
+}
@@ -0,0 +1,89 @@
+// On disk cache of compiled shader bytecode
+//
+// Entries are named by a hash of the top level source text, entry point,
+// profile, flags and defines. Each entry also records the resolved path and a
+// hash of every file the compiler included, and is only used while all of them
+// still hash the same. The compiler and the file system are reached through
+// ShaderBackend, so the cache itself has no D3D dependency.
+
+#pragma once
+
+#include <atomic>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include <stdint.h>
+
+struct ShaderRequest
+{
+	std::string file;		// as passed to CompileShaderFromFile, resolved by the backend
+	std::string entry;
+	std::string profile;
+	unsigned int flags;
+	std::vector<std::pair<std::string, std::string>> defines;
+
+	ShaderRequest() : flags(0) {}
+};
+
+/*
+* What the cache needs from the platform
+*/
+class ShaderBackend
+{
+public:
+	virtual ~ShaderBackend() {}
+
+	// Search path resolution for the top level file
+	virtual std::string Resolve(const std::string &file) = 0;
+
+	// Read a resolved file, false if it does not exist
+	virtual bool ReadFile(const std::string &path, std::vector<char> &contents) = 0;
+
+	// Compile source read from path, includes gets the resolved path of every file opened through the include handler
+	virtual bool Compile(const ShaderRequest &request, const std::string &path, const std::vector<char> &source,
+		std::vector<char> &bytecode, std::vector<std::string> &includes, std::string &errors) = 0;
+};
+
+// 64 bit FNV-1a
+uint64_t ShaderHash(const void *data, size_t size, uint64_t hash = 14695981039346656037ull);
+
+class ShaderCache
+{
+public:
+	// An empty directory disables the disk cache, every request is compiled
+	ShaderCache(ShaderBackend *inBackend, const std::string &inDirectory);
+
+	// Bytecode for the request, from the cache if the source and all its includes are unchanged
+	// files gets the resolved source path followed by every include, hit or miss
+	// Safe to call from several threads at once
+	bool Compile(const ShaderRequest &request, std::vector<char> &bytecode, std::string &errors, std::vector<std::string> *files = nullptr);
+
+	// Name of the entry a request with this source, resolved to path, would use.
+	// The path is part of it because relative includes resolve from there.
+	uint64_t Key(const ShaderRequest &request, const std::string &path, const std::vector<char> &source) const;
+
+	const std::string &Directory() const { return directory; }
+
+	unsigned int Hits() const { return hits; }
+	unsigned int Misses() const { return misses; }
+
+protected:
+	struct Dependency
+	{
+		std::string path;
+		uint64_t hash;
+	};
+
+	bool Load(uint64_t key, std::vector<char> &bytecode, std::vector<std::string> &includes);
+	void Store(uint64_t key, const std::vector<std::string> &includes, const std::vector<char> &bytecode);
+	bool Store(uint64_t key, const std::vector<Dependency> &dependencies, const std::vector<char> &bytecode);
+
+	std::string EntryPath(uint64_t key) const;
+
+	ShaderBackend *backend;
+	std::string directory;
+
+	std::atomic<unsigned int> hits;
+	std::atomic<unsigned int> misses;
+};
@@ -25,53 +25,45 @@
 // OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
 
 #include "shaderCompile.h"
+#include "shaderCache.h"
+#include "includeCache.h"
+#include "taskScheduler.h"
 
 #include <stdio.h>
-#include <sys/types.h>
-#include <sys/stat.h>
+#include <string.h>
+#include <algorithm>
+#include <atomic>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
 #include <string>
 #include <vector>
 
-std::string FindFile(const char* file, const char* alternate = nullptr)
+// Every compile resolves and reads through this, so shared includes are only
+// searched for and loaded once per process
+static IncludeCache &GetIncludeCache()
 {
-	const char* paths[] =
-	{
+	static IncludeCache cache({
 		"",
 		"..\\..\\HDRDisplay\\assets\\shaders\\",
 		".\\shaders\\"
-	};
-	struct _stat s;
-
-
-	for (size_t i = 0; i < sizeof(paths) / sizeof(char*); i++)
-	{
-		std::string path = std::string(paths[i]) + std::string(file);
-
-		if (_stat(path.c_str(), &s) == 0)
-		{
-			return path;
-		}
+	});
 
-		// try adding the sub-path
-		if (alternate)
-		{
-			std::string path = std::string(paths[i]) + std::string(alternate) + std::string(file);
-
-			if (_stat(path.c_str(), &s) == 0)
-			{
-				return path;
-			}
-		}
-	}
+	return cache;
+}
 
-	//failed, just return the original string
-	return std::string(file);
+std::string FindFile(const char* file, const char* alternate = nullptr)
+{
+	//falls back to the original string
+	return GetIncludeCache().Resolve(file, alternate ? alternate : "");
 }
 
 struct Includer : public ID3DInclude
 {
 	std::string altPath;
-	std::vector<char> buffer;
+	std::vector<std::string> *opened;
+	std::vector<IncludeCache::Buffer> held;	// kept until the compile is done, includes can nest
 	/*
 	std::string FindFile(const char* file)
 	{
@@ -101,11 +93,11 @@ struct Includer : public ID3DInclude
 	}
 	*/
 
-	Includer(const std::string alt) : altPath(alt)
+	Includer(const std::string alt, std::vector<std::string> *inOpened = nullptr) : altPath(alt), opened(inOpened)
 	{
 	}
 
-	Includer()
+	Includer() : opened(nullptr)
 	{
 	}
 
@@ -113,35 +105,222 @@ struct Includer : public ID3DInclude
 	{
 		std::string path = FindFile(pFileName, altPath.c_str());
 
-		FILE* fp = fopen(path.c_str(), "rb");
-		if (!fp)
+		IncludeCache::Buffer contents = GetIncludeCache().Read(path);
+		if (!contents)
 		{
 			return E_FAIL;
 		}
 
-		fseek(fp, 0, SEEK_END);
-		int size = ftell(fp);
-
-		buffer.resize(size + 1);
+		held.push_back(contents);
+		*ppData = contents->data();
+		*pBytes = UINT(contents->size());
 
-		fseek(fp, 0, SEEK_SET);
-		fread(&buffer[0], 1, size, fp);
-		buffer[size] = 0;
+		if (opened)
+			opened->push_back(path);
 
-		*ppData = &buffer[0];
-		*pBytes = size;
-
-		fclose(fp);
 		return S_OK;
 	}
 
 	HRESULT Close(LPCVOID pData)
 	{
-		buffer.clear();
 		return S_OK;
 	}
 };
 
+/*
+* ShaderBackend on D3DCompile, the include cache and Includer
+*/
+class D3DShaderBackend : public ShaderBackend
+{
+public:
+	std::string Resolve(const std::string &file) override
+	{
+		return FindFile(file.c_str());
+	}
+
+	bool ReadFile(const std::string &path, std::vector<char> &contents) override
+	{
+		IncludeCache::Buffer cached = GetIncludeCache().Read(path);
+		if (cached)
+			contents = *cached;
+		return cached != nullptr;
+	}
+
+	bool Compile(const ShaderRequest &request, const std::string &path, const std::vector<char> &source,
+		std::vector<char> &bytecode, std::vector<std::string> &includes, std::string &errors) override
+	{
+		// extract an alternate root path
+		size_t pos = request.file.find_last_of("\\/");
+		std::string alt = pos != std::string::npos ? request.file.substr(0, pos + 1) : std::string();
+
+		std::vector<D3D_SHADER_MACRO> macros;
+		for (auto &define : request.defines)
+		{
+			D3D_SHADER_MACRO macro = { define.first.c_str(), define.second.c_str() };
+			macros.push_back(macro);
+		}
+		D3D_SHADER_MACRO terminator = { nullptr, nullptr };
+		macros.push_back(terminator);
+
+		Includer inc(alt, &includes);
+		ID3DBlob *shader = nullptr;
+		ID3DBlob *errorMsgs = nullptr;
+
+		HRESULT hr = D3DCompile(
+			source.data(),
+			source.size(),
+			request.file.c_str(),
+			macros.data(),
+			&inc,
+			request.entry.c_str(),
+			request.profile.c_str(),
+			request.flags,
+			0,
+			&shader,
+			&errorMsgs
+			);
+
+		if (errorMsgs)
+		{
+			errors.assign((const char*)errorMsgs->GetBufferPointer(), errorMsgs->GetBufferSize());
+			errorMsgs->Release();
+		}
+
+		if (FAILED(hr) || !shader)
+		{
+			if (shader)
+				shader->Release();
+			return false;
+		}
+
+		const char *data = (const char*)shader->GetBufferPointer();
+		bytecode.assign(data, data + shader->GetBufferSize());
+		shader->Release();
+
+		return true;
+	}
+};
+
+static std::string g_ShaderCacheDirectory = "shadercache";
+
+void SetShaderCacheDirectory(const char *directory)
+{
+	g_ShaderCacheDirectory = directory ? directory : "";
+}
+
+ShaderCache &GetShaderCache()
+{
+	static D3DShaderBackend backend;
+	static ShaderCache cache(&backend, g_ShaderCacheDirectory);
+
+	return cache;
+}
+
+// Bytecode compiled ahead by PrecompileShaders, kept until ReleasePrecompiledShaders
+// as several passes can use the same shader
+struct PreparedShader
+{
+	std::vector<char> bytecode;
+	bool used;
+};
+
+static std::mutex g_PreparedMutex;
+static std::map<std::string, PreparedShader> g_Prepared;
+
+static std::string PreparedKey(const char *file, const char *entry, const char *profile, DWORD flags, const D3D_SHADER_MACRO *defines = nullptr)
+{
+	char flagText[16];
+	snprintf(flagText, sizeof(flagText), "%lx", (unsigned long)flags);
+
+	std::string key = std::string(file) + "|" + entry + "|" + profile + "|" + flagText;
+
+	for (const D3D_SHADER_MACRO *define = defines; define && define->Name; define++)
+		key += std::string("|") + define->Name + "=" + (define->Definition ? define->Definition : "");
+
+	return key;
+}
+
+static void AddDefines(ShaderRequest &request, const D3D_SHADER_MACRO *defines)
+{
+	for (const D3D_SHADER_MACRO *define = defines; define && define->Name; define++)
+		request.defines.push_back(std::make_pair(std::string(define->Name), std::string(define->Definition ? define->Definition : "")));
+}
+
+// Source and include paths each shader read on its last successful compile, by PreparedKey
+static std::mutex g_ClosureMutex;
+static std::map<std::string, std::vector<std::string>> g_Closures;
+
+static void RecordClosure(const std::string &key, std::vector<std::string> &files)
+{
+	std::lock_guard<std::mutex> lock(g_ClosureMutex);
+	g_Closures[key].swap(files);
+}
+
+int PrecompileShaders(const ShaderJob *jobs, size_t count, DWORD flags)
+{
+	std::atomic<int> compiled(0);
+
+	GetTaskScheduler().ParallelFor(0, int(count), 1, [&](int first, int last)
+	{
+		for (int i = first; i < last; i++)
+		{
+			ShaderRequest request;
+			request.file = jobs[i].file;
+			request.entry = jobs[i].entry;
+			request.profile = jobs[i].profile;
+			request.flags = flags;
+			AddDefines(request, jobs[i].defines);
+
+			std::vector<char> bytecode;
+			std::vector<std::string> files;
+			std::string errors;
+
+			// failures are left for the pass to compile again, so it reports them as before
+			if (!GetShaderCache().Compile(request, bytecode, errors, &files))
+				continue;
+
+			std::string key = PreparedKey(jobs[i].file, jobs[i].entry, jobs[i].profile, flags, jobs[i].defines);
+
+			// watches only cover shaders without defines
+			if (!jobs[i].defines)
+				RecordClosure(key, files);
+
+			std::lock_guard<std::mutex> lock(g_PreparedMutex);
+			PreparedShader &prepared = g_Prepared[key];
+			prepared.bytecode.swap(bytecode);
+			prepared.used = false;
+			compiled++;
+		}
+	});
+
+	return compiled;
+}
+
+void ReleasePrecompiledShaders()
+{
+	std::lock_guard<std::mutex> lock(g_PreparedMutex);
+
+	// an unused entry means the startup list names a shader no pass compiles
+	for (auto &prepared : g_Prepared)
+	{
+		if (!prepared.second.used)
+			fprintf(stderr, "PrecompileShaders: %s was never used\n", prepared.first.c_str());
+	}
+
+	g_Prepared.clear();
+}
+
+static ID3DBlob *MakeBlob(const void *data, size_t size)
+{
+	ID3DBlob *blob = nullptr;
+
+	if (FAILED(D3DCreateBlob(size, &blob)))
+		return nullptr;
+
+	memcpy(blob->GetBufferPointer(), data, size);
+	return blob;
+}
+
 HRESULT CompileShaderFromFile(
 	const char*             pSrcFile,
 	const D3D_SHADER_MACRO            *pDefines,
@@ -154,51 +333,132 @@ HRESULT CompileShaderFromFile(
 {
 	//initialize the error pointer
 	*ppErrorMsgs = nullptr;
+	*ppShader = nullptr;
+
+	{
+		std::lock_guard<std::mutex> lock(g_PreparedMutex);
+
+		auto prepared = g_Prepared.find(PreparedKey(pSrcFile, pFunctionName, pProfile, Flags, pDefines));
+		if (prepared != g_Prepared.end())
+		{
+			*ppShader = MakeBlob(prepared->second.bytecode.data(), prepared->second.bytecode.size());
+			prepared->second.used = true;
+
+			if (*ppShader)
+				return S_OK;
+		}
+	}
+
+	ShaderRequest request;
+	request.file = pSrcFile;
+	request.entry = pFunctionName;
+	request.profile = pProfile;
+	request.flags = Flags;
 
-	FILE *fp = nullptr;
+	AddDefines(request, pDefines);
 
-	// extract an alternate root path
-	size_t pos = std::string(pSrcFile).find_last_of("\\/");
-	std::string alt = pos != std::string::npos ? std::string(pSrcFile, pos + 1) : std::string();
+	std::vector<char> bytecode;
+	std::vector<std::string> files;
+	std::string errors;
 
-	//search in expected paths
-	std::string fn = FindFile(pSrcFile);
+	bool ok = GetShaderCache().Compile(request, bytecode, errors, &files);
 
-	fp = fopen(fn.c_str(), "rb");
+	// watches only cover shaders without defines
+	if (ok && !pDefines)
+		RecordClosure(PreparedKey(pSrcFile, pFunctionName, pProfile, Flags), files);
 
-	if (!fp)
+	// warnings come back with a successful compile too
+	if (errors.size())
+		*ppErrorMsgs = MakeBlob(errors.c_str(), errors.size() + 1);
+
+	if (!ok)
+		return E_FAIL;
+
+	*ppShader = MakeBlob(bytecode.data(), bytecode.size());
+
+	return *ppShader ? S_OK : E_OUTOFMEMORY;
+}
+
+struct ShaderWatch
+{
+	std::string file;
+	std::string entry;
+	std::string profile;
+	DWORD flags;
+	std::function<void(ID3DBlob*)> callback;
+};
+
+static std::map<int, ShaderWatch> g_Watches;
+static int g_NextWatch = 1;
+
+int WatchShader(const char *file, const char *entry, const char *profile, DWORD flags, std::function<void(ID3DBlob*)> callback)
+{
+	ShaderWatch &watch = g_Watches[g_NextWatch];
+	watch.file = file;
+	watch.entry = entry;
+	watch.profile = profile;
+	watch.flags = flags;
+	watch.callback = callback;
+
+	return g_NextWatch++;
+}
+
+void UnwatchShader(int handle)
+{
+	g_Watches.erase(handle);
+}
+
+int ReloadChangedShaders()
+{
+	std::vector<std::string> changed;
+	GetIncludeCache().Refresh(changed);
+
+	if (changed.empty())
+		return 0;
+
+	int reloaded = 0;
+
+	for (auto &it : g_Watches)
 	{
-		return ERROR_FILE_NOT_FOUND;
-	}
+		ShaderWatch &watch = it.second;
+		bool affected = true;
 
+		{
+			std::lock_guard<std::mutex> lock(g_ClosureMutex);
 
-	fseek(fp, 0, SEEK_END);
-	int size = ftell(fp);
+			// no closure means it never compiled, so any change could fix it
+			auto closure = g_Closures.find(PreparedKey(watch.file.c_str(), watch.entry.c_str(), watch.profile.c_str(), watch.flags));
+			if (closure != g_Closures.end())
+			{
+				affected = std::find_first_of(closure->second.begin(), closure->second.end(), changed.begin(), changed.end()) != closure->second.end();
+			}
+		}
 
-	std::vector<char> buffer;
-	buffer.resize(size + 1);
+		if (!affected)
+			continue;
 
-	fseek(fp, 0, SEEK_SET);
-	fread(&buffer[0], 1, size, fp);
-	buffer[size] = 0;
+		ID3DBlob *shader = nullptr;
+		ID3DBlob *errors = nullptr;
 
-	fclose(fp);
+		HRESULT hr = CompileShaderFromFile(watch.file.c_str(), nullptr, watch.entry.c_str(), watch.profile.c_str(), watch.flags, &shader, &errors);
 
-	Includer inc(alt);
+		if (errors)
+		{
+			fprintf(stderr, "%s\n", (const char*)errors->GetBufferPointer());
+			errors->Release();
+		}
 
-	HRESULT hr = D3DCompile(
-		&buffer[0],
-		size,
-		pSrcFile,
-		pDefines,
-		&inc, //D3D_COMPILE_STANDARD_FILE_INCLUDE,
-		pFunctionName,
-		pProfile,
-		Flags,
-		0,
-		ppShader,
-		ppErrorMsgs
-		);
+		// a shader that fails keeps running the old code
+		if (FAILED(hr))
+		{
+			fprintf(stderr, "Reload failed: %s %s, keeping the previous shader\n", watch.file.c_str(), watch.entry.c_str());
+			continue;
+		}
 
-	return hr;
-}
\ No newline at end of file
+		watch.callback(shader);
+		shader->Release();
+		reloaded++;
+	}
+
+	return reloaded;
+}
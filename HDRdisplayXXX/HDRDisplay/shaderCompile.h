@@ -29,6 +29,8 @@
 
 #include <d3dcompiler.h>
 
+#include <functional>
+
 
 // Simple replacement for D3DX CompileShaderFromFile
 // Also implements checking app-standard search paths for shaders
@@ -41,3 +43,40 @@ HRESULT CompileShaderFromFile(
 	ID3DBlob         **ppShader,
 	ID3DBlob         **ppErrorMsgs
 	);
+
+class ShaderCache;
+
+// Compiled shaders are kept in this directory, "shadercache" by default
+// Must be set before the first compile, an empty string disables the disk cache
+void SetShaderCacheDirectory(const char *directory);
+
+// The cache CompileShaderFromFile goes through
+ShaderCache &GetShaderCache();
+
+struct ShaderJob
+{
+	const char *file;
+	const char *entry;
+	const char *profile;
+	const D3D_SHADER_MACRO *defines;	// null terminated, nullptr for none
+};
+
+// Compile a list of shaders on all cores, sharing include buffers between them
+// Later CompileShaderFromFile calls with the same file, entry, profile, flags
+// and defines get the prepared bytecode. Returns the number that compiled.
+int PrecompileShaders(const ShaderJob *jobs, size_t count, DWORD flags);
+
+// Drop prepared bytecode nobody asked for, listing it on stderr
+void ReleasePrecompiledShaders();
+
+// Call back with freshly compiled bytecode whenever the file or anything it
+// includes changes. The shader should already have been compiled once through
+// CompileShaderFromFile, with no defines. Returns a handle for UnwatchShader.
+int WatchShader(const char *file, const char *entry, const char *profile, DWORD flags, std::function<void(ID3DBlob*)> callback);
+
+void UnwatchShader(int handle);
+
+// Re-check every file the compiler has read and recompile only the watched
+// shaders whose include closure changed. Returns the number reloaded.
+// Callbacks run on the calling thread and must not add or remove watches.
+int ReloadChangedShaders();
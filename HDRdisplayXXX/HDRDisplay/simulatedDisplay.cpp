@@ -0,0 +1,135 @@
+// Simulated display and instrument for exercising the measurement engine
+
+#include "simulatedDisplay.h"
+
+#include <algorithm>
+#include <cmath>
+
+SimulatedDisplay::SimulatedDisplay(const std::vector<float> &inLevels, const std::vector<float> &inLuminance, double inSettleTime, double inResponseTime) :
+	levels(inLevels),
+	luminance(inLuminance),
+	settleTime(inSettleTime),
+	responseTime(inResponseTime),
+	fromLuminance(0.0f),
+	toLuminance(0.0f),
+	switchTime(0.0),
+	switches(0)
+{
+	levels.resize(std::min(levels.size(), luminance.size()));
+	luminance.resize(levels.size());
+}
+
+float SimulatedDisplay::Response(float level) const
+{
+	if (levels.empty())
+		return 0.0f;
+
+	if (level <= levels.front())
+		return luminance.front();
+	if (level >= levels.back())
+		return luminance.back();
+
+	size_t hi = std::upper_bound(levels.begin(), levels.end(), level) - levels.begin();
+	size_t lo = hi - 1;
+
+	float span = levels[hi] - levels[lo];
+	float t = span > 0.0f ? (level - levels[lo]) / span : 0.0f;
+
+	return luminance[lo] + t * (luminance[hi] - luminance[lo]);
+}
+
+float SimulatedDisplay::Luminance(double time) const
+{
+	double dt = time - switchTime;
+
+	if (dt <= 0.0)
+		return fromLuminance;
+	if (responseTime <= 0.0)
+		return toLuminance;
+
+	return toLuminance + (fromLuminance - toLuminance) * float(exp(-dt / responseTime));
+}
+
+bool SimulatedDisplay::Show(float level)
+{
+	double now = MeasurementClock();
+
+	// start from wherever the panel is now, the last transition may not be done
+	fromLuminance = Luminance(now);
+	toLuminance = Response(level);
+	switchTime = now;
+	switches++;
+
+	return true;
+}
+
+SimulatedInstrument::SimulatedInstrument(const SimulatedDisplay *inDisplay, float inRelativeNoise, float inAbsoluteNoise, double inIntegrationTime, double inTransferTime, unsigned int seed) :
+	display(inDisplay),
+	relativeNoise(inRelativeNoise),
+	absoluteNoise(inAbsoluteNoise),
+	integrationTime(inIntegrationTime),
+	transferTime(inTransferTime),
+	rng(seed),
+	startTime(0.0),
+	integrated(0.0f),
+	busy(false),
+	measurements(0)
+{
+}
+
+bool SimulatedInstrument::BeginMeasurement(double *integrationSeconds)
+{
+	if (busy)
+		return false;
+
+	startTime = MeasurementClock();
+	busy = true;
+
+	if (integrationSeconds)
+		*integrationSeconds = integrationTime;
+
+	return true;
+}
+
+bool SimulatedInstrument::WaitMeasurement()
+{
+	if (!busy)
+		return false;
+
+	// sample the panel across the window, so readings taken before it settled are biased
+	const int steps = 16;
+	double sum = 0.0;
+
+	for (int i = 0; i < steps; i++)
+	{
+		double t = startTime + integrationTime * (i + 0.5) / steps;
+		MeasurementSleepUntil(t);
+		sum += display->Luminance(t);
+	}
+
+	MeasurementSleepUntil(startTime + integrationTime);
+
+	integrated = float(sum / steps);
+	busy = false;
+	measurements++;
+
+	return true;
+}
+
+bool SimulatedInstrument::ReadResult(MeasurementSample &result)
+{
+	if (busy)
+		return false;
+
+	MeasurementSleepUntil(MeasurementClock() + transferTime);
+
+	std::normal_distribution<float> gauss(0.0f, 1.0f);
+
+	float Y = integrated * (1.0f + relativeNoise * gauss(rng)) + absoluteNoise * gauss(rng);
+
+	result.Y = std::max(Y, 0.0f);
+	result.x = 0.3127f;	// D65
+	result.y = 0.3290f;
+
+	return true;
+}
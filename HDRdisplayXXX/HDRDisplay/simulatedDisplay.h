@@ -0,0 +1,77 @@
+// Simulated display and instrument for exercising the measurement engine
+// without hardware
+
+#pragma once
+
+#include "measurement.h"
+
+#include <random>
+#include <vector>
+
+/*
+* Display with a tabulated input-to-luminance response and a first order
+* temporal response after each pattern switch
+*/
+class SimulatedDisplay : public PatternSource
+{
+public:
+	// levels/luminance as in lumdata(:,1) and lumdata(:,2) of a luminance.mat file
+	SimulatedDisplay(const std::vector<float> &inLevels, const std::vector<float> &inLuminance, double inSettleTime = 0.05, double inResponseTime = 0.01);
+
+	bool Show(float level) override;
+	double SettleTime() const override { return settleTime; }
+
+	// Steady state luminance for an input level, linear in the table and clamped at its ends
+	float Response(float level) const;
+
+	// Luminance leaving the panel at a time on MeasurementClock()
+	float Luminance(double time) const;
+
+	int SwitchCount() const { return switches; }
+
+protected:
+	std::vector<float> levels;
+	std::vector<float> luminance;
+
+	double settleTime;		// what the sequencer is told to wait
+	double responseTime;	// time constant the panel actually has
+
+	float fromLuminance;
+	float toLuminance;
+	double switchTime;
+	int switches;
+};
+
+/*
+* Instrument reading a SimulatedDisplay, with multiplicative and additive
+* Gaussian noise on Y
+*/
+class SimulatedInstrument : public Instrument
+{
+public:
+	SimulatedInstrument(const SimulatedDisplay *inDisplay, float inRelativeNoise = 0.003f, float inAbsoluteNoise = 0.001f, double inIntegrationTime = 0.02, double inTransferTime = 0.01, unsigned int seed = 1);
+
+	bool Open() override { return true; }
+	void Close() override {}
+
+	bool BeginMeasurement(double *integrationSeconds) override;
+	bool WaitMeasurement() override;
+	bool ReadResult(MeasurementSample &result) override;
+
+	int MeasurementCount() const { return measurements; }
+
+protected:
+	const SimulatedDisplay *display;
+
+	float relativeNoise;
+	float absoluteNoise;
+	double integrationTime;
+	double transferTime;
+
+	std::mt19937 rng;
+
+	double startTime;
+	float integrated;
+	bool busy;
+	int measurements;
+};
@@ -0,0 +1,292 @@
+// Work stealing task scheduler for the CPU side stages
+
+#include "taskScheduler.h"
+
+#include <algorithm>
+#include <stdint.h>
+
+struct TaskScheduler::Task
+{
+	std::function<void()> run;
+	const TaskCancel *cancel;
+
+	std::atomic<int> pending;		// unfinished dependencies, plus one until Submit() is through
+	std::atomic<bool> done;
+
+	std::mutex lock;
+	std::vector<Handle> dependents;
+};
+
+// the scheduler and worker index of the current thread, if it is a worker
+static thread_local TaskScheduler *t_scheduler = nullptr;
+static thread_local int t_worker = 0;
+
+TaskScheduler::TaskScheduler(unsigned int threads) : queued(0), waiting(0), quit(false)
+{
+	if (threads == 0)
+		threads = (std::max)(std::thread::hardware_concurrency(), 1u);
+
+	// at least one worker, so submitted tasks run without anyone waiting on them
+	outside = int((std::max)(threads, 2u)) - 1;
+
+	for (int i = 0; i <= outside; i++)
+		queues.push_back(std::unique_ptr<Queue>(new Queue));
+
+	for (int i = 0; i < outside; i++)
+		workers.push_back(std::thread(&TaskScheduler::Run, this, i));
+}
+
+TaskScheduler::~TaskScheduler()
+{
+	{
+		std::lock_guard<std::mutex> guard(sleepLock);
+		quit = true;
+	}
+
+	wake.notify_all();
+
+	for (auto &worker : workers)
+		worker.join();
+}
+
+TaskScheduler::Handle TaskScheduler::Submit(std::function<void()> task, const std::vector<Handle> &after, const TaskCancel *cancel)
+{
+	Handle handle = std::make_shared<Task>();
+	handle->run = std::move(task);
+	handle->cancel = cancel;
+	handle->pending = 1;
+	handle->done = false;
+
+	for (const Handle &dependency : after)
+	{
+		if (!dependency)
+			continue;
+
+		std::lock_guard<std::mutex> guard(dependency->lock);
+
+		if (!dependency->done)
+		{
+			handle->pending++;
+			dependency->dependents.push_back(handle);
+		}
+	}
+
+	Release(handle);
+
+	return handle;
+}
+
+void TaskScheduler::Wait(const Handle &task)
+{
+	const int self = Self();
+
+	while (!task->done)
+	{
+		Handle other = Take(self);
+
+		if (other)
+		{
+			Execute(other);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> guard(sleepLock);
+
+		waiting++;
+		wake.wait(guard, [&] { return task->done || queued > 0; });
+		waiting--;
+	}
+}
+
+bool TaskScheduler::Done(const Handle &task) const
+{
+	return task->done;
+}
+
+bool TaskScheduler::ParallelFor(int begin, int end, int grain, const std::function<void(int begin, int end)> &body, const TaskCancel *cancel)
+{
+	grain = (std::max)(grain, 1);
+
+	const int64_t count = (std::max)(int64_t(end) - begin, int64_t(0));
+	const int pieces = int((count + grain - 1) / grain);
+
+	std::atomic<int> next(0);
+
+	// pieces are handed out in order to whoever is free, so uneven ones balance out
+	auto loop = [&]()
+	{
+		for (int piece = next++; piece < pieces; piece = next++)
+		{
+			if (cancel && cancel->Cancelled())
+				return;
+
+			const int first = int(begin + int64_t(piece) * grain);
+			body(first, int((std::min)(int64_t(first) + grain, int64_t(end))));
+		}
+	};
+
+	// the caller works through the loop as well, one helper for each other thread that can
+	std::vector<Handle> helpers;
+	const int helperCount = (std::min)(pieces - 1, outside);
+
+	for (int i = 0; i < helperCount; i++)
+		helpers.push_back(Submit(loop));
+
+	loop();
+
+	for (const Handle &helper : helpers)
+		Wait(helper);
+
+	return !(cancel && cancel->Cancelled());
+}
+
+bool TaskScheduler::ParallelFor(const TaskBox &range, int grainX, int grainY, int grainZ, const std::function<void(const TaskBox &box)> &body, const TaskCancel *cancel)
+{
+	grainX = (std::max)(grainX, 1);
+	grainY = (std::max)(grainY, 1);
+	grainZ = (std::max)(grainZ, 1);
+
+	const int boxesX = (std::max)((range.x1 - range.x0 + grainX - 1) / grainX, 0);
+	const int boxesY = (std::max)((range.y1 - range.y0 + grainY - 1) / grainY, 0);
+	const int boxesZ = (std::max)((range.z1 - range.z0 + grainZ - 1) / grainZ, 0);
+
+	return ParallelFor(0, boxesX * boxesY * boxesZ, 1, [&](int first, int last)
+	{
+		for (int i = first; i < last; i++)
+		{
+			TaskBox box;
+			box.x0 = range.x0 + (i % boxesX) * grainX;
+			box.y0 = range.y0 + (i / boxesX % boxesY) * grainY;
+			box.z0 = range.z0 + (i / boxesX / boxesY) * grainZ;
+			box.x1 = (std::min)(box.x0 + grainX, range.x1);
+			box.y1 = (std::min)(box.y0 + grainY, range.y1);
+			box.z1 = (std::min)(box.z0 + grainZ, range.z1);
+
+			body(box);
+		}
+	}, cancel);
+}
+
+void TaskScheduler::Run(int self)
+{
+	t_scheduler = this;
+	t_worker = self;
+
+	for (;;)
+	{
+		Handle task = Take(self);
+
+		if (task)
+		{
+			Execute(task);
+			continue;
+		}
+
+		std::unique_lock<std::mutex> guard(sleepLock);
+		wake.wait(guard, [this] { return quit || queued > 0; });
+
+		if (quit)
+			return;
+	}
+}
+
+void TaskScheduler::Push(const Handle &task)
+{
+	Queue &queue = *queues[Self()];
+
+	{
+		std::lock_guard<std::mutex> guard(queue.lock);
+		queue.tasks.push_back(task);
+	}
+
+	queued++;
+
+	// taking the lock orders this with a sleeper checking queued
+	{
+		std::lock_guard<std::mutex> guard(sleepLock);
+	}
+
+	wake.notify_one();
+}
+
+void TaskScheduler::Release(const Handle &task)
+{
+	if (--task->pending == 0)
+		Push(task);
+}
+
+void TaskScheduler::Execute(const Handle &task)
+{
+	if (!task->cancel || !task->cancel->Cancelled())
+		task->run();
+
+	// drop what the task holds on to now rather than when the last handle goes
+	task->run = nullptr;
+
+	std::vector<Handle> dependents;
+
+	{
+		std::lock_guard<std::mutex> guard(task->lock);
+		task->done = true;
+		dependents.swap(task->dependents);
+	}
+
+	for (const Handle &dependent : dependents)
+		Release(dependent);
+
+	if (waiting > 0)
+	{
+		{
+			std::lock_guard<std::mutex> guard(sleepLock);
+		}
+
+		wake.notify_all();
+	}
+}
+
+TaskScheduler::Handle TaskScheduler::Take(int self)
+{
+	Handle task;
+
+	// newest of our own first, it is the one whose data is warm
+	if (self != outside)
+	{
+		Queue &queue = *queues[self];
+		std::lock_guard<std::mutex> guard(queue.lock);
+
+		if (!queue.tasks.empty())
+		{
+			task = queue.tasks.back();
+			queue.tasks.pop_back();
+		}
+	}
+
+	// then the oldest from outside or another worker, the biggest piece left
+	for (int i = 0; !task && i <= outside; i++)
+	{
+		Queue &queue = *queues[(self + 1 + i) % (outside + 1)];
+		std::lock_guard<std::mutex> guard(queue.lock);
+
+		if (!queue.tasks.empty())
+		{
+			task = queue.tasks.front();
+			queue.tasks.pop_front();
+		}
+	}
+
+	if (task)
+		queued--;
+
+	return task;
+}
+
+int TaskScheduler::Self() const
+{
+	return t_scheduler == this ? t_worker : outside;
+}
+
+TaskScheduler &GetTaskScheduler()
+{
+	static TaskScheduler scheduler;
+	return scheduler;
+}
@@ -0,0 +1,102 @@
+// Work stealing task scheduler for the CPU side stages
+//
+// One worker thread per core but the first, the thread waiting on work takes
+// part too. Each worker has its own deque, running its newest task first and
+// having its oldest stolen by idle workers, and tasks submitted from outside
+// the pool go on a shared queue. Wait() runs other tasks while the one waited
+// on is outstanding, so tasks and loop bodies can submit and wait on more
+// work themselves without tying up the pool. A task can depend on others and
+// only becomes runnable once they are done. Tasks given a TaskCancel that is
+// cancelled before they start are skipped but still count as done, so their
+// dependents are not held up. Portable, no D3D.
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Stops the tasks and loops given it from starting any more work
+class TaskCancel
+{
+public:
+	TaskCancel() : cancelled(false) {}
+
+	void Cancel() { cancelled = true; }
+	bool Cancelled() const { return cancelled; }
+
+protected:
+	std::atomic<bool> cancelled;
+};
+
+// x0..x1, y0..y1, z0..z1 (exclusive), z0 = 0, z1 = 1 for a 2D range
+struct TaskBox
+{
+	int x0, y0, z0;
+	int x1, y1, z1;
+};
+
+class TaskScheduler
+{
+public:
+	struct Task;
+	typedef std::shared_ptr<Task> Handle;
+
+	// threads 0 for one per core, counting the thread that waits
+	explicit TaskScheduler(unsigned int threads = 0);
+	~TaskScheduler();
+
+	// Threads work is shared out over, including the one waiting
+	unsigned int Threads() const { return unsigned(outside) + 1; }
+
+	// Runs task once every one of after is done, an empty handle in after is ignored
+	Handle Submit(std::function<void()> task, const std::vector<Handle> &after = std::vector<Handle>(), const TaskCancel *cancel = nullptr);
+
+	// Returns once task is done, running other work in the meantime
+	void Wait(const Handle &task);
+
+	// Whether task has run, or been skipped as cancelled
+	bool Done(const Handle &task) const;
+
+	// Calls body over begin..end in pieces of up to grain and returns when all
+	// are done, false if cancel stopped it first
+	bool ParallelFor(int begin, int end, int grain, const std::function<void(int begin, int end)> &body, const TaskCancel *cancel = nullptr);
+
+	// Calls body over boxes of up to grainX x grainY x grainZ covering range, x fastest
+	bool ParallelFor(const TaskBox &range, int grainX, int grainY, int grainZ, const std::function<void(const TaskBox &box)> &body, const TaskCancel *cancel = nullptr);
+
+protected:
+	struct Queue
+	{
+		std::mutex lock;
+		std::deque<Handle> tasks;
+	};
+
+	void Run(int self);
+	void Push(const Handle &task);
+	void Release(const Handle &task);
+	void Execute(const Handle &task);
+	Handle Take(int self);
+
+	// queue of the calling thread, the outside one if it is not a worker
+	int Self() const;
+
+	// queues[outside] is for threads that are not workers
+	std::vector<std::unique_ptr<Queue>> queues;
+	std::vector<std::thread> workers;
+	int outside;
+
+	std::mutex sleepLock;
+	std::condition_variable wake;
+	std::atomic<int> queued;		// tasks in the queues, so sleepers know to look
+	std::atomic<int> waiting;		// threads inside Wait() to wake when a task is done
+	bool quit;
+};
+
+// Shared by loaders, bakers and analyzers, sized from the number of cores
+TaskScheduler &GetTaskScheduler();
@@ -0,0 +1,252 @@
+// Tile selection, caching and loading for tiled images
+
+#include "tileCache.h"
+
+#include <algorithm>
+#include <math.h>
+
+VisibleSet VisibleTiles(const TileView &view, const TileStoreInfo &info)
+{
+	VisibleSet set = { 0, 0, 0, 0, 0 };
+
+	if (view.outWidth <= 0 || view.outHeight <= 0 || info.width <= 0 || info.height <= 0)
+		return set;
+
+	const float zoomScale = powf(2.0f, float(-view.zoom));
+	float u0, v0, u1, v1;
+	float texelsPerPixel;
+
+	if (view.filter)
+	{
+		const float aspectIn = float(info.width) / float(info.height);
+		const float aspectOut = float(view.outWidth) / float(view.outHeight);
+		float aspectScaleX = 1.0f, aspectScaleY = 1.0f;
+
+		if (view.matchAspect)
+		{
+			aspectScaleX = aspectIn < aspectOut ? aspectOut / aspectIn : 1.0f;
+			aspectScaleY = aspectIn > aspectOut ? aspectIn / aspectOut : 1.0f;
+		}
+
+		// uv = (TC - 0.5) * uvScale + 0.5 + pan
+		const float uvScaleX = zoomScale * aspectScaleX;
+		const float uvScaleY = zoomScale * aspectScaleY;
+
+		u0 = 0.5f - 0.5f * uvScaleX + view.pan[0];
+		v0 = 0.5f - 0.5f * uvScaleY + view.pan[1];
+		u1 = u0 + uvScaleX;
+		v1 = v0 + uvScaleY;
+
+		texelsPerPixel = (std::max)(uvScaleX * info.width / view.outWidth, uvScaleY * info.height / view.outHeight);
+	}
+	else
+	{
+		// texel = (P + (in / zoomScale - out) / 2) * zoomScale + pan * in
+		u0 = (0.5f - 0.5f * view.outWidth * zoomScale / info.width) + view.pan[0];
+		v0 = (0.5f - 0.5f * view.outHeight * zoomScale / info.height) + view.pan[1];
+		u1 = u0 + view.outWidth * zoomScale / info.width;
+		v1 = v0 + view.outHeight * zoomScale / info.height;
+
+		texelsPerPixel = zoomScale;
+	}
+
+	u0 = (std::max)(u0, 0.0f);
+	v0 = (std::max)(v0, 0.0f);
+	u1 = (std::min)(u1, 1.0f);
+	v1 = (std::min)(v1, 1.0f);
+
+	if (u0 >= u1 || v0 >= v1)
+		return set;
+
+	// a hair under a power of two stays on the finer level
+	if (texelsPerPixel > 1.0f)
+		set.level = (std::min)(int(ceilf(log2f(texelsPerPixel) - 1e-3f)), info.levels - 1);
+
+	// level texels, one more either side for the bilinear footprint
+	const float scaleX = ldexpf(float(info.width), -set.level);
+	const float scaleY = ldexpf(float(info.height), -set.level);
+
+	const int tx0 = int(floorf(u0 * scaleX)) - 1;
+	const int ty0 = int(floorf(v0 * scaleY)) - 1;
+	const int tx1 = int(ceilf(u1 * scaleX)) + 1;
+	const int ty1 = int(ceilf(v1 * scaleY)) + 1;
+
+	set.x0 = (std::max)(tx0, 0) / VirtualTileSize;
+	set.y0 = (std::max)(ty0, 0) / VirtualTileSize;
+	set.x1 = (std::min)((tx1 + VirtualTileSize - 1) / VirtualTileSize, info.TilesX(set.level));
+	set.y1 = (std::min)((ty1 + VirtualTileSize - 1) / VirtualTileSize, info.TilesY(set.level));
+
+	set.x1 = (std::min)(set.x1, set.x0 + MaxVisibleTiles(view.outWidth));
+	set.y1 = (std::min)(set.y1, set.y0 + MaxVisibleTiles(view.outHeight));
+
+	return set;
+}
+
+int MaxVisibleTiles(int outSize)
+{
+	// up to a texel a pixel plus the border, straddling a tile edge
+	return (outSize + 4 + VirtualTileSize - 1) / VirtualTileSize + 1;
+}
+
+void VisibleKeys(const VisibleSet &set, std::vector<TileKey> &keys)
+{
+	keys.clear();
+
+	for (int y = set.y0; y < set.y1; y++)
+	{
+		for (int x = set.x0; x < set.x1; x++)
+		{
+			TileKey key = { set.level, x, y };
+			keys.push_back(key);
+		}
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+TileCache::TileCache(size_t capacity) : capacity(capacity), frame(0)
+{
+	stats.hits = 0;
+	stats.misses = 0;
+	stats.evictions = 0;
+}
+
+void TileCache::BeginFrame()
+{
+	frame++;
+}
+
+const std::vector<uint16_t> *TileCache::Find(const TileKey &key)
+{
+	auto found = lookup.find(key.Packed());
+
+	if (found == lookup.end())
+	{
+		stats.misses++;
+		return nullptr;
+	}
+
+	stats.hits++;
+
+	auto entry = found->second;
+	entry->frame = frame;
+	entries.splice(entries.begin(), entries, entry);
+
+	return &entry->rgba;
+}
+
+void TileCache::Insert(const TileKey &key, std::vector<uint16_t> &&rgba)
+{
+	const uint64_t packed = key.Packed();
+	auto found = lookup.find(packed);
+
+	if (found != lookup.end())
+	{
+		found->second->rgba = std::move(rgba);
+		found->second->frame = frame;
+		entries.splice(entries.begin(), entries, found->second);
+		return;
+	}
+
+	Entry entry;
+	entry.key = packed;
+	entry.frame = frame;
+	entry.rgba = std::move(rgba);
+
+	entries.push_front(std::move(entry));
+	lookup[packed] = entries.begin();
+
+	Evict();
+}
+
+void TileCache::Evict()
+{
+	auto it = entries.end();
+
+	// tiles used this frame stay even if that takes the cache over capacity
+	while (entries.size() > capacity && it != entries.begin())
+	{
+		--it;
+
+		if (it->frame == frame)
+			continue;
+
+		lookup.erase(it->key);
+		it = entries.erase(it);
+		stats.evictions++;
+	}
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+TileLoader::TileLoader(TileStore &store) : store(store), quit(false), reading(false)
+{
+	thread = std::thread(&TileLoader::Run, this);
+}
+
+TileLoader::~TileLoader()
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		quit = true;
+	}
+
+	wake.notify_one();
+	thread.join();
+}
+
+void TileLoader::Request(const std::vector<TileKey> &keys)
+{
+	{
+		std::lock_guard<std::mutex> guard(lock);
+		requests.assign(keys.rbegin(), keys.rend());
+	}
+
+	wake.notify_one();
+}
+
+bool TileLoader::Completed(std::vector<Loaded> &loaded)
+{
+	std::lock_guard<std::mutex> guard(lock);
+
+	loaded.clear();
+	loaded.swap(completed);
+
+	return !loaded.empty();
+}
+
+bool TileLoader::Busy()
+{
+	std::lock_guard<std::mutex> guard(lock);
+
+	return reading || !requests.empty() || !completed.empty();
+}
+
+void TileLoader::Run()
+{
+	std::unique_lock<std::mutex> guard(lock);
+
+	for (;;)
+	{
+		wake.wait(guard, [this] { return quit || !requests.empty(); });
+
+		if (quit)
+			return;
+
+		Loaded tile;
+		tile.key = requests.back();
+		requests.pop_back();
+		reading = true;
+
+		guard.unlock();
+
+		tile.rgba.resize(VirtualTileTexels * 4);
+		bool read = store.ReadTile(tile.key, tile.rgba.data());
+
+		guard.lock();
+		reading = false;
+
+		if (read)
+			completed.push_back(std::move(tile));
+	}
+}
@@ -0,0 +1,123 @@
+// Tile selection, caching and loading for tiled images
+//
+// VisibleTiles() works out from the transform pass settings which level of
+// a TileStore the screen needs and which of its tiles are in view, following
+// the uv mapping of xform_input.hlsl. The level is the finest with no more
+// than one texel per screen pixel. TileCache keeps recently used tiles in
+// memory up to a capacity, dropping the least recently used first but never
+// one used in the current frame. TileLoader reads tiles on its own thread,
+// working through the latest request first and dropping requests for tiles
+// that have gone out of view. Portable, no D3D, so all of it runs headless.
+
+#pragma once
+
+#include "tileStore.h"
+
+#include <condition_variable>
+#include <list>
+#include <thread>
+#include <unordered_map>
+
+// What the transform pass shows, as in its constants
+struct TileView
+{
+	int outWidth, outHeight;
+	int zoom;				// 2^zoom screen pixels per image pixel
+	bool filter;
+	bool matchAspect;
+	float pan[2];			// in image uv
+};
+
+// Tiles x0..x1, y0..y1 (exclusive) of level
+struct VisibleSet
+{
+	int level;
+	int x0, y0;
+	int x1, y1;
+
+	int Count() const { return (x1 - x0) * (y1 - y0); }
+};
+
+VisibleSet VisibleTiles(const TileView &view, const TileStoreInfo &info);
+
+// Most tiles a VisibleSet can hold across and down for a screen size
+int MaxVisibleTiles(int outSize);
+
+void VisibleKeys(const VisibleSet &set, std::vector<TileKey> &keys);
+
+struct TileCacheStats
+{
+	size_t hits, misses;
+	size_t evictions;
+};
+
+class TileCache
+{
+public:
+	explicit TileCache(size_t capacity);
+
+	// Tiles found or inserted from here on count as in use this frame
+	void BeginFrame();
+
+	// nullptr if key is not cached
+	const std::vector<uint16_t> *Find(const TileKey &key);
+
+	void Insert(const TileKey &key, std::vector<uint16_t> &&rgba);
+
+	size_t Size() const { return entries.size(); }
+	const TileCacheStats &Stats() const { return stats; }
+
+protected:
+	struct Entry
+	{
+		uint64_t key;
+		uint64_t frame;			// last frame the tile was used
+		std::vector<uint16_t> rgba;
+	};
+
+	void Evict();
+
+	size_t capacity;
+	uint64_t frame;
+	TileCacheStats stats;
+
+	// most recently used at the front
+	std::list<Entry> entries;
+	std::unordered_map<uint64_t, std::list<Entry>::iterator> lookup;
+};
+
+class TileLoader
+{
+public:
+	explicit TileLoader(TileStore &store);
+	~TileLoader();
+
+	// Replaces the outstanding requests, the first is loaded first
+	void Request(const std::vector<TileKey> &keys);
+
+	struct Loaded
+	{
+		TileKey key;
+		std::vector<uint16_t> rgba;
+	};
+
+	// Moves the tiles read since the last call into loaded, false if there are none
+	bool Completed(std::vector<Loaded> &loaded);
+
+	// True while requests are queued or being read, or read tiles wait for Completed
+	bool Busy();
+
+protected:
+	void Run();
+
+	TileStore &store;
+
+	std::mutex lock;
+	std::condition_variable wake;
+	bool quit;
+	bool reading;
+	std::vector<TileKey> requests;	// taken from the back
+	std::vector<Loaded> completed;
+
+	std::thread thread;
+};
@@ -0,0 +1,53 @@
+// Screen tiling for the compute tonemap path, and a CPU executor for it
+
+#include "tileDispatch.h"
+#include "taskScheduler.h"
+
+#include <algorithm>
+
+void BuildTileList(int width, int height, const TileRect &rect, std::vector<uint32_t> &tiles)
+{
+	tiles.clear();
+
+	const int x0 = (std::max)(rect.x0, 0);
+	const int y0 = (std::max)(rect.y0, 0);
+	const int x1 = (std::min)(rect.x1, width);
+	const int y1 = (std::min)(rect.y1, height);
+
+	if (x0 >= x1 || y0 >= y1)
+		return;
+
+	const int tx0 = x0 / TileSize;
+	const int ty0 = y0 / TileSize;
+	const int tx1 = (x1 + TileSize - 1) / TileSize;
+	const int ty1 = (y1 + TileSize - 1) / TileSize;
+
+	tiles.reserve(size_t(tx1 - tx0) * (ty1 - ty0));
+
+	for (int ty = ty0; ty < ty1; ty++)
+	{
+		for (int tx = tx0; tx < tx1; tx++)
+			tiles.push_back(uint32_t(tx) | uint32_t(ty) << 16);
+	}
+}
+
+void ExecuteTiles(const std::vector<uint32_t> &tiles, int width, int height,
+	const std::function<void(int x0, int x1, int y)> &kernel)
+{
+	// tiles are small, hand them out a quarter row at a time to keep the counter cold
+	const int batch = (std::max)(TilesAcross(width) / 4, 1);
+
+	GetTaskScheduler().ParallelFor(0, int(tiles.size()), batch, [&](int first, int last)
+	{
+		for (int i = first; i < last; i++)
+		{
+			const int x0 = int(tiles[i] & 0xffff) * TileSize;
+			const int y0 = int(tiles[i] >> 16) * TileSize;
+			const int x1 = (std::min)(x0 + TileSize, width);
+			const int y1 = (std::min)(y0 + TileSize, height);
+
+			for (int y = y0; y < y1; y++)
+				kernel(x0, x1, y);
+		}
+	});
+}
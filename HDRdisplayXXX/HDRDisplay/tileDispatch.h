@@ -0,0 +1,34 @@
+// Screen tiling for the compute tonemap path, and a CPU executor for it
+//
+// The target is cut into TileSize square tiles and only the tiles touching
+// the image rectangle are listed, so letterbox bars cost no shader work. A
+// tile is packed as x | y << 16 in tile units, which is what tiled.hlsl reads
+// from its tile buffer. ExecuteTiles() walks the same list on the CPU, for
+// running the reference kernels with the GPU's tiling where there is no D3D.
+
+#pragma once
+
+#include <functional>
+#include <vector>
+
+#include <stdint.h>
+
+static const int TileSize = 8;
+
+// Pixel rectangle, x1 and y1 exclusive
+struct TileRect
+{
+	int x0, y0;
+	int x1, y1;
+};
+
+inline int TilesAcross(int width) { return (width + TileSize - 1) / TileSize; }
+
+// Tiles of a width x height target that overlap rect, row by row
+void BuildTileList(int width, int height, const TileRect &rect, std::vector<uint32_t> &tiles);
+
+// Call kernel(x0, x1, y) for each row span of each listed tile, clipped to
+// width x height. Tiles are handed out over the task scheduler in list order,
+// kernel must be safe to call concurrently on different tiles.
+void ExecuteTiles(const std::vector<uint32_t> &tiles, int width, int height,
+	const std::function<void(int x0, int x1, int y)> &kernel);
@@ -0,0 +1,371 @@
+// On disk tile pyramid for images larger than a texture
+
+#include "tileStore.h"
+
+#include <algorithm>
+#include <math.h>
+#include <string.h>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <sys/stat.h>
+#endif
+
+// the stores outgrow 32 bit file offsets
+#ifdef _WIN32
+#define TileSeek _fseeki64
+#else
+#define TileSeek fseeko
+#endif
+
+struct StoreHeader
+{
+	char magic[4];
+	uint32_t version;		// 0 until the tile table is written
+	uint32_t width, height;
+	uint32_t tileSize;
+	uint32_t levels;
+	uint64_t sourceSize;
+	uint64_t sourceTime;
+};
+
+static const uint32_t StoreVersion = 2;
+
+static bool SourceStamp(const std::string &source, uint64_t &size, uint64_t &time)
+{
+	// whole seconds would miss a same size save within the second
+#ifdef _WIN32
+	WIN32_FILE_ATTRIBUTE_DATA data;
+
+	if (!GetFileAttributesExA(source.c_str(), GetFileExInfoStandard, &data))
+		return false;
+
+	size = uint64_t(data.nFileSizeHigh) << 32 | data.nFileSizeLow;
+	time = uint64_t(data.ftLastWriteTime.dwHighDateTime) << 32 | data.ftLastWriteTime.dwLowDateTime;
+#else
+	struct stat info;
+
+	if (stat(source.c_str(), &info) != 0)
+		return false;
+
+	size = uint64_t(info.st_size);
+#ifdef __APPLE__
+	time = uint64_t(info.st_mtimespec.tv_sec) * 1000000000 + uint64_t(info.st_mtimespec.tv_nsec);
+#else
+	time = uint64_t(info.st_mtim.tv_sec) * 1000000000 + uint64_t(info.st_mtim.tv_nsec);
+#endif
+#endif
+
+	return true;
+}
+
+static uint16_t FloatToHalf(float f)
+{
+	// NaN to 0, out of range to the largest half either way
+	if (f != f)
+		return 0;
+
+	const uint16_t sign = f < 0.0f ? 0x8000 : 0;
+	f = fabsf(f);
+
+	if (f >= 65504.0f)
+		return sign | 0x7bff;
+
+	int e;
+	float m = frexpf(f, &e);	// f = m * 2^e, m in [0.5, 1)
+
+	if (e < -13)
+		return sign | uint16_t(lrintf(ldexpf(f, 24)));
+
+	int mant = int(lrintf(ldexpf(m, 11)));
+	return sign | uint16_t((std::min)(((e + 14) << 10) + mant - 1024, 0x7bff));
+}
+
+TileStoreInfo TileStoreLayout(int width, int height)
+{
+	TileStoreInfo info = { width, height, 1 };
+
+	while ((std::max)(info.LevelWidth(info.levels - 1), info.LevelHeight(info.levels - 1)) > VirtualTileSize)
+		info.levels++;
+
+	return info;
+}
+
+// Tiles are numbered level by level, row by row
+static size_t TileIndex(const TileStoreInfo &info, const TileKey &key)
+{
+	size_t index = 0;
+
+	for (int level = 0; level < key.level; level++)
+		index += size_t(info.TilesX(level)) * info.TilesY(level);
+
+	return index + size_t(key.y) * info.TilesX(key.level) + key.x;
+}
+
+static size_t TileCount(const TileStoreInfo &info)
+{
+	TileKey end = { info.levels, 0, 0 };
+	return TileIndex(info, end);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+TileStoreWriter::TileStoreWriter() : fp(nullptr), failed(false)
+{
+}
+
+TileStoreWriter::~TileStoreWriter()
+{
+	if (fp)
+	{
+		fclose(fp);
+		remove(path.c_str());
+	}
+}
+
+bool TileStoreWriter::Begin(const std::string &source, int width, int height)
+{
+	StoreHeader header;
+	memset(&header, 0, sizeof(header));
+
+	if (width <= 0 || height <= 0 || !SourceStamp(source, header.sourceSize, header.sourceTime))
+		return false;
+
+	info = TileStoreLayout(width, height);
+	this->source = source;
+	path = source + ".tiles";
+	fp = fopen(path.c_str(), "wb");
+
+	if (!fp)
+		return false;
+
+	failed = false;
+	offsets.assign(TileCount(info), 0);
+	tile.resize(VirtualTileTexels * 4);
+	levels.resize(info.levels);
+
+	for (int level = 0; level < info.levels; level++)
+	{
+		Level &l = levels[level];
+		l.width = info.LevelWidth(level);
+		l.height = info.LevelHeight(level);
+		l.rows = 0;
+		l.bandY = 0;
+		l.band.resize(size_t(l.width) * VirtualTileSize * 4);
+		l.pending.clear();
+	}
+
+	// the header goes in again with the version once the table is complete
+	memcpy(header.magic, "TILE", 4);
+	header.width = uint32_t(width);
+	header.height = uint32_t(height);
+	header.tileSize = VirtualTileSize;
+	header.levels = uint32_t(info.levels);
+
+	failed = fwrite(&header, sizeof(header), 1, fp) != 1
+		|| fwrite(offsets.data(), sizeof(uint64_t), offsets.size(), fp) != offsets.size();
+
+	end = sizeof(header) + offsets.size() * sizeof(uint64_t);
+	return !failed;
+}
+
+bool TileStoreWriter::AddRows(const float *rgba, int rows)
+{
+	for (int y = 0; y < rows && !failed; y++)
+		PushRow(0, rgba + size_t(y) * info.width * 4);
+
+	return !failed;
+}
+
+void TileStoreWriter::PushRow(int level, const float *row)
+{
+	Level &l = levels[level];
+
+	memcpy(&l.band[size_t(l.rows) * l.width * 4], row, size_t(l.width) * 4 * sizeof(float));
+
+	if (++l.rows == VirtualTileSize)
+		FlushBand(level);
+
+	if (level + 1 == info.levels)
+		return;
+
+	if (l.pending.empty())
+		l.pending.assign(row, row + size_t(l.width) * 4);
+	else
+		Reduce(level, row);
+}
+
+// 2x2 box of the pending row and row into the next level, repeating the last column of an odd width
+void TileStoreWriter::Reduce(int level, const float *row)
+{
+	Level &l = levels[level];
+	const int width = levels[level + 1].width;
+	std::vector<float> reduced(size_t(width) * 4);
+
+	for (int x = 0; x < width; x++)
+	{
+		const int x0 = 2 * x;
+		const int x1 = (std::min)(x0 + 1, l.width - 1);
+
+		for (int c = 0; c < 4; c++)
+		{
+			reduced[x * 4 + c] = 0.25f * (l.pending[x0 * 4 + c] + l.pending[x1 * 4 + c] + row[x0 * 4 + c] + row[x1 * 4 + c]);
+		}
+	}
+
+	l.pending.clear();
+	PushRow(level + 1, reduced.data());
+}
+
+void TileStoreWriter::FlushBand(int level)
+{
+	Level &l = levels[level];
+
+	if (l.rows == 0 || failed)
+		return;
+
+	const int ty = l.bandY / VirtualTileSize;
+
+	for (int tx = 0; tx < info.TilesX(level); tx++)
+	{
+		for (int y = 0; y < VirtualTileSize; y++)
+		{
+			const float *src = &l.band[size_t((std::min)(y, l.rows - 1)) * l.width * 4];
+			uint16_t *dst = &tile[size_t(y) * VirtualTileSize * 4];
+
+			for (int x = 0; x < VirtualTileSize; x++)
+			{
+				const int sx = (std::min)(tx * VirtualTileSize + x, l.width - 1);
+
+				for (int c = 0; c < 4; c++)
+					dst[x * 4 + c] = FloatToHalf(src[sx * 4 + c]);
+			}
+		}
+
+		TileKey key = { level, tx, ty };
+		offsets[TileIndex(info, key)] = end;
+		end += tile.size() * sizeof(uint16_t);
+
+		failed |= fwrite(tile.data(), sizeof(uint16_t), tile.size(), fp) != tile.size();
+	}
+
+	l.bandY += l.rows;
+	l.rows = 0;
+}
+
+bool TileStoreWriter::End()
+{
+	if (!fp)
+		return false;
+
+	for (int level = 0; level < info.levels && !failed; level++)
+	{
+		Level &l = levels[level];
+
+		// an odd height pairs the last row with itself
+		if (!l.pending.empty())
+		{
+			std::vector<float> row(l.pending);
+			Reduce(level, row.data());
+		}
+
+		FlushBand(level);
+	}
+
+	StoreHeader header;
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, "TILE", 4);
+
+	failed |= !SourceStamp(source, header.sourceSize, header.sourceTime);
+
+	header.version = StoreVersion;
+	header.width = uint32_t(info.width);
+	header.height = uint32_t(info.height);
+	header.tileSize = VirtualTileSize;
+	header.levels = uint32_t(info.levels);
+
+	if (!failed)
+	{
+		failed = TileSeek(fp, 0, SEEK_SET) != 0
+			|| fwrite(&header, sizeof(header), 1, fp) != 1
+			|| fwrite(offsets.data(), sizeof(uint64_t), offsets.size(), fp) != offsets.size();
+	}
+
+	// a short write must not look like a valid store next time
+	if (fclose(fp) != 0 || failed)
+		remove(path.c_str());
+
+	fp = nullptr;
+	levels.clear();
+	return !failed;
+}
+
+////////////////////////////////////////////////////////////////////////////////
+
+TileStore::TileStore() : fp(nullptr)
+{
+	memset(&info, 0, sizeof(info));
+}
+
+TileStore::~TileStore()
+{
+	if (fp)
+		fclose(fp);
+}
+
+bool TileStore::Open(const std::string &source)
+{
+	uint64_t size, time;
+
+	if (fp || !SourceStamp(source, size, time))
+		return false;
+
+	fp = fopen((source + ".tiles").c_str(), "rb");
+
+	if (!fp)
+		return false;
+
+	StoreHeader header;
+	bool ok = fread(&header, sizeof(header), 1, fp) == 1
+		&& !memcmp(header.magic, "TILE", 4)
+		&& header.version == StoreVersion
+		&& header.tileSize == uint32_t(VirtualTileSize)
+		&& header.sourceSize == size
+		&& header.sourceTime == time
+		&& header.width > 0 && header.height > 0;
+
+	if (ok)
+	{
+		info = TileStoreLayout(int(header.width), int(header.height));
+		offsets.resize(TileCount(info));
+
+		ok = header.levels == uint32_t(info.levels)
+			&& fread(offsets.data(), sizeof(uint64_t), offsets.size(), fp) == offsets.size();
+	}
+
+	if (!ok)
+	{
+		fclose(fp);
+		fp = nullptr;
+	}
+
+	return ok;
+}
+
+bool TileStore::ReadTile(const TileKey &key, uint16_t *rgba)
+{
+	if (key.level < 0 || key.level >= info.levels
+		|| key.x < 0 || key.x >= info.TilesX(key.level)
+		|| key.y < 0 || key.y >= info.TilesY(key.level))
+	{
+		return false;
+	}
+
+	std::lock_guard<std::mutex> guard(lock);
+
+	return fp
+		&& TileSeek(fp, offsets[TileIndex(info, key)], SEEK_SET) == 0
+		&& fread(rgba, sizeof(uint16_t) * 4, VirtualTileTexels, fp) == VirtualTileTexels;
+}
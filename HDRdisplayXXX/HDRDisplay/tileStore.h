@@ -0,0 +1,106 @@
+// On disk tile pyramid for images larger than a texture
+//
+// The image is cut into VirtualTileSize square tiles of half float RGBA at
+// each level of a pyramid, level l being the source reduced 2^l times with a
+// 2x2 box that repeats the last row and column of odd sizes. Levels stop at
+// the first that fits in one tile. TileStoreWriter takes the source a band
+// of rows at a time and keeps only a band per level, so the whole image is
+// never in memory. The store goes next to the source as name.tiles and is
+// tied to its size and time, as the BC6H cache is. Portable, no D3D.
+
+#pragma once
+
+#include <mutex>
+#include <stdio.h>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+static const int VirtualTileSize = 256;
+
+// Texels in a tile, 4 halves each
+static const size_t VirtualTileTexels = size_t(VirtualTileSize) * VirtualTileSize;
+
+struct TileKey
+{
+	int level;
+	int x, y;		// in tiles at level
+
+	uint64_t Packed() const { return uint64_t(level) << 48 | uint64_t(y) << 24 | uint64_t(x); }
+	static TileKey Unpack(uint64_t packed) { TileKey key = { int(packed >> 48), int(packed & 0xffffff), int(packed >> 24 & 0xffffff) }; return key; }
+};
+
+struct TileStoreInfo
+{
+	int width, height;	// of level 0, the source
+	int levels;
+
+	int LevelWidth(int level) const { return (width + (1 << level) - 1) >> level; }
+	int LevelHeight(int level) const { return (height + (1 << level) - 1) >> level; }
+	int TilesX(int level) const { return (LevelWidth(level) + VirtualTileSize - 1) / VirtualTileSize; }
+	int TilesY(int level) const { return (LevelHeight(level) + VirtualTileSize - 1) / VirtualTileSize; }
+};
+
+TileStoreInfo TileStoreLayout(int width, int height);
+
+class TileStoreWriter
+{
+public:
+	TileStoreWriter();
+	~TileStoreWriter();
+
+	// Starts source's store for a width x height image
+	bool Begin(const std::string &source, int width, int height);
+
+	// rows of width float RGBA, top down, alpha kept
+	bool AddRows(const float *rgba, int rows);
+
+	// Writes the last partial bands and the tile table, false if anything failed
+	bool End();
+
+protected:
+	struct Level
+	{
+		int width, height;
+		int rows;					// filled rows of band, which starts at row bandY
+		int bandY;
+		std::vector<float> band;	// VirtualTileSize rows
+		std::vector<float> pending;	// even row waiting for its pair to go down a level
+	};
+
+	void PushRow(int level, const float *row);
+	void Reduce(int level, const float *row);
+	void FlushBand(int level);
+
+	std::string source, path;
+	FILE *fp;
+	uint64_t end;			// where the next tile goes
+	bool failed;
+	TileStoreInfo info;
+	std::vector<Level> levels;
+	std::vector<uint64_t> offsets;	// by TileIndex
+	std::vector<uint16_t> tile;
+};
+
+// Reads tiles of an existing store, from any thread
+class TileStore
+{
+public:
+	TileStore();
+	~TileStore();
+
+	// false if there is no store for source or it is out of date
+	bool Open(const std::string &source);
+
+	const TileStoreInfo &Info() const { return info; }
+
+	// VirtualTileTexels half RGBA, texels past the level's edge repeat its last
+	// row and column
+	bool ReadTile(const TileKey &key, uint16_t *rgba);
+
+protected:
+	std::mutex lock;
+	FILE *fp;
+	TileStoreInfo info;
+	std::vector<uint64_t> offsets;
+};
@@ -0,0 +1,208 @@
+// Streaming source for images too large for one texture
+//
+// The image lives in a TileStore on disk. Each frame the tiles the transform
+// pass can see are worked out at a single pyramid level and copied from the
+// tile cache into a screen sized window texture, which xform_input.hlsl
+// samples through the uv transform Window() gives. Tiles not in the cache are
+// requested from the loader thread and show black until they arrive, Poll()
+// moves arrivals into the cache and bumps a generation for the frame loop to
+// redraw on. Only window slots whose tile changed are uploaded.
+
+#pragma once
+
+#include <d3d11.h>
+#include <algorithm>
+#include <math.h>
+#include <vector>
+#include "common_util.h"
+#include "tileCache.h"
+
+class TiledImageSource
+{
+	// slot contents other than a tile key
+	static const uint64_t SlotUnset = ~0ull;
+	static const uint64_t SlotBlack = ~0ull - 1;
+
+	ID3D11Device *device;
+	TileStore *store;
+	TileCache cache;
+	TileLoader *loader;
+
+	ID3D11Texture2D *windowTex;
+	ID3D11ShaderResourceView *windowSRV;
+	int windowTilesX, windowTilesY;
+
+	// key of the tile each window slot holds, row by row
+	std::vector<uint64_t> slots;
+
+	VisibleSet visible;
+	float window[4];
+	uint64_t generation;
+
+	std::vector<uint16_t> blackTile;
+	std::vector<TileKey> keys, missing;
+	std::vector<TileLoader::Loaded> loaded;
+
+public:
+	// Takes ownership of an open store
+	TiledImageSource(ID3D11Device *inDevice, TileStore *inStore, size_t cacheTiles) :
+		device(inDevice),
+		store(inStore),
+		cache(cacheTiles),
+		windowTex(nullptr),
+		windowSRV(nullptr),
+		windowTilesX(0),
+		windowTilesY(0),
+		generation(0),
+		blackTile(VirtualTileTexels * 4, 0)
+	{
+		loader = new TileLoader(*store);
+
+		memset(&visible, 0, sizeof(visible));
+		window[0] = window[1] = 1.0f;
+		window[2] = window[3] = 0.0f;
+	}
+
+	~TiledImageSource()
+	{
+		// the loader thread reads the store until it is joined
+		delete loader;
+		delete store;
+
+		SAFE_RELEASE(windowSRV);
+		SAFE_RELEASE(windowTex);
+	}
+
+	int Width() const { return store->Info().width; }
+	int Height() const { return store->Info().height; }
+
+	// Moves loaded tiles into the cache, the result changes whenever there are new ones to show
+	uint64_t Poll()
+	{
+		if (loader->Completed(loaded))
+		{
+			for (auto &tile : loaded)
+				cache.Insert(tile.key, std::move(tile.rgba));
+
+			generation++;
+		}
+
+		return generation;
+	}
+
+	// True until every requested tile has been read and moved into the cache
+	bool Loading() { return loader->Busy(); }
+
+	// Fills the window for view and returns it, nullptr if it could not be created
+	ID3D11ShaderResourceView *Update(ID3D11DeviceContext *ctx, const TileView &view)
+	{
+		const TileStoreInfo &info = store->Info();
+
+		if (!CreateWindowTexture(MaxVisibleTiles(view.outWidth), MaxVisibleTiles(view.outHeight)))
+			return nullptr;
+
+		cache.BeginFrame();
+
+		visible = VisibleTiles(view, info);
+		VisibleKeys(visible, keys);
+		missing.clear();
+
+		for (const TileKey &key : keys)
+		{
+			const std::vector<uint16_t> *rgba = cache.Find(key);
+			const uint64_t want = rgba ? key.Packed() : SlotBlack;
+
+			if (!rgba)
+				missing.push_back(key);
+
+			const int sx = key.x - visible.x0;
+			const int sy = key.y - visible.y0;
+			uint64_t &slot = slots[sy * windowTilesX + sx];
+
+			if (slot == want)
+				continue;
+
+			D3D11_BOX box = { UINT(sx * VirtualTileSize), UINT(sy * VirtualTileSize), 0, UINT((sx + 1) * VirtualTileSize), UINT((sy + 1) * VirtualTileSize), 1 };
+			ctx->UpdateSubresource(windowTex, 0, &box, rgba ? rgba->data() : blackTile.data(), VirtualTileSize * 8, 0);
+			slot = want;
+		}
+
+		// nearest the middle of the screen first, anything no longer in view is dropped
+		const float cx = 0.5f * (visible.x0 + visible.x1 - 1);
+		const float cy = 0.5f * (visible.y0 + visible.y1 - 1);
+
+		std::sort(missing.begin(), missing.end(), [cx, cy](const TileKey &a, const TileKey &b)
+		{
+			return (a.x - cx) * (a.x - cx) + (a.y - cy) * (a.y - cy) < (b.x - cx) * (b.x - cx) + (b.y - cy) * (b.y - cy);
+		});
+
+		loader->Request(missing);
+
+		// image uv to window uv, level texels are 2^level image texels
+		const float texelsX = ldexpf(float(info.width), -visible.level);
+		const float texelsY = ldexpf(float(info.height), -visible.level);
+		const float windowWidth = float(windowTilesX * VirtualTileSize);
+		const float windowHeight = float(windowTilesY * VirtualTileSize);
+
+		window[0] = texelsX / windowWidth;
+		window[1] = texelsY / windowHeight;
+		window[2] = -float(visible.x0 * VirtualTileSize) / windowWidth;
+		window[3] = -float(visible.y0 * VirtualTileSize) / windowHeight;
+
+		return windowSRV;
+	}
+
+	// uv scale xy and offset zw from image to window, for XformPass::SetSourceWindow
+	const float *Window() const { return window; }
+
+	// Texels of the window holding image at the current level, from its top left
+	int ValidWidth() const
+	{
+		const int level = store->Info().LevelWidth(visible.level) - visible.x0 * VirtualTileSize;
+		return (std::max)((std::min)((visible.x1 - visible.x0) * VirtualTileSize, level), 0);
+	}
+
+	int ValidHeight() const
+	{
+		const int level = store->Info().LevelHeight(visible.level) - visible.y0 * VirtualTileSize;
+		return (std::max)((std::min)((visible.y1 - visible.y0) * VirtualTileSize, level), 0);
+	}
+
+	const TileCacheStats &CacheStats() const { return cache.Stats(); }
+
+protected:
+	bool CreateWindowTexture(int tilesX, int tilesY)
+	{
+		if (windowTex && tilesX == windowTilesX && tilesY == windowTilesY)
+			return true;
+
+		SAFE_RELEASE(windowSRV);
+		SAFE_RELEASE(windowTex);
+
+		D3D11_TEXTURE2D_DESC desc;
+		ZeroMemory(&desc, sizeof(desc));
+		desc.Width = tilesX * VirtualTileSize;
+		desc.Height = tilesY * VirtualTileSize;
+		desc.MipLevels = 1;
+		desc.ArraySize = 1;
+		desc.Format = DXGI_FORMAT_R16G16B16A16_FLOAT;
+		desc.SampleDesc.Count = 1;
+		desc.Usage = D3D11_USAGE_DEFAULT;
+		desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+
+		if (FAILED(device->CreateTexture2D(&desc, nullptr, &windowTex)))
+			return false;
+
+		if (FAILED(device->CreateShaderResourceView(windowTex, nullptr, &windowSRV)))
+		{
+			SAFE_RELEASE(windowTex);
+			return false;
+		}
+
+		windowTilesX = tilesX;
+		windowTilesY = tilesY;
+		slots.assign(size_t(tilesX) * tilesY, SlotUnset);
+
+		return true;
+	}
+};
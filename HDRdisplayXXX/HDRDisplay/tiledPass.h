@@ -0,0 +1,197 @@
+// Compute dispatch of a tonemapper over the tiles of the image
+//
+// The tonemapper binds its constants, textures and samplers for the pixel
+// shader as it always does, those bindings are copied across to the compute
+// stage, and the TILED variant of its shader runs one 8x8 group per listed
+// tile. Tiles wholly in the letterbox are not dispatched, the target is
+// cleared to black there instead.
+
+#pragma once
+
+#include <d3d11.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include "common_util.h"
+#include "tileDispatch.h"
+#include "tonemapper.h"
+
+class TiledPass
+{
+	// slots the tonemappers bind, b6/t7 are the pass's own
+	static const UINT MirrorConstants = 6;
+	static const UINT MirrorResources = 7;
+	static const UINT MirrorSamplers = 4;
+
+	// groups per dispatch row, keeps large tile lists under the 65535 limit
+	static const UINT MaxColumns = 1024;
+
+	ID3D11Device *device;
+	ID3D11Buffer *constants;
+
+	// setup to match cbTiles in tiled.hlsl
+	struct ConstantData
+	{
+		unsigned int dimensions[2];
+		unsigned int tileCount;
+		unsigned int tileColumns;
+	};
+
+	ID3D11Buffer *tileBuffer;
+	ID3D11ShaderResourceView *tileSRV;
+	size_t tileCapacity;
+
+	std::vector<uint32_t> tiles;
+
+	void ReserveTiles(size_t count)
+	{
+		if (count <= tileCapacity)
+			return;
+
+		SAFE_RELEASE(tileSRV);
+		SAFE_RELEASE(tileBuffer);
+
+		D3D11_BUFFER_DESC desc;
+
+		desc.StructureByteStride = sizeof(uint32_t);
+		desc.BindFlags = D3D11_BIND_SHADER_RESOURCE;
+		desc.ByteWidth = unsigned(count * sizeof(uint32_t));
+		desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+		desc.Usage = D3D11_USAGE_DYNAMIC;
+		desc.MiscFlags = D3D11_RESOURCE_MISC_BUFFER_STRUCTURED;
+
+		D3D11_SHADER_RESOURCE_VIEW_DESC srvDesc;
+
+		srvDesc.Format = DXGI_FORMAT_UNKNOWN;
+		srvDesc.ViewDimension = D3D11_SRV_DIMENSION_BUFFER;
+		srvDesc.Buffer.FirstElement = 0;
+		srvDesc.Buffer.NumElements = unsigned(count);
+
+		device->CreateBuffer(&desc, nullptr, &tileBuffer);
+		device->CreateShaderResourceView(tileBuffer, &srvDesc, &tileSRV);
+
+		tileCapacity = count;
+	}
+
+	// copy what the tonemapper bound for the pixel shader to the compute shader
+	void MirrorBindings(ID3D11DeviceContext* ctx)
+	{
+		ID3D11Buffer *cbs[MirrorConstants];
+		ID3D11ShaderResourceView *srvs[MirrorResources];
+		ID3D11SamplerState *samplers[MirrorSamplers];
+
+		ctx->PSGetConstantBuffers(0, MirrorConstants, cbs);
+		ctx->PSGetShaderResources(0, MirrorResources, srvs);
+		ctx->PSGetSamplers(0, MirrorSamplers, samplers);
+
+		ctx->CSSetConstantBuffers(0, MirrorConstants, cbs);
+		ctx->CSSetShaderResources(0, MirrorResources, srvs);
+		ctx->CSSetSamplers(0, MirrorSamplers, samplers);
+
+		// the Get calls add a reference
+		for (UINT i = 0; i < MirrorConstants; i++)
+			SAFE_RELEASE(cbs[i]);
+		for (UINT i = 0; i < MirrorResources; i++)
+			SAFE_RELEASE(srvs[i]);
+		for (UINT i = 0; i < MirrorSamplers; i++)
+			SAFE_RELEASE(samplers[i]);
+	}
+
+public:
+
+	TiledPass(ID3D11Device *inDevice) :
+		device(inDevice),
+		tileBuffer(nullptr),
+		tileSRV(nullptr),
+		tileCapacity(0)
+	{
+		D3D11_BUFFER_DESC desc;
+
+		desc.StructureByteStride = 0;
+		desc.BindFlags = D3D11_BIND_CONSTANT_BUFFER;
+		desc.ByteWidth = unsigned(sizeof(ConstantData));
+		desc.CPUAccessFlags = D3D11_CPU_ACCESS_WRITE;
+		desc.Usage = D3D11_USAGE_DYNAMIC;
+		desc.MiscFlags = 0;
+
+		device->CreateBuffer(&desc, nullptr, &constants);
+
+		// enough for 4k, grows if a larger target shows up
+		ReserveTiles(size_t(TilesAcross(3840)) * TilesAcross(2160));
+	}
+
+	~TiledPass()
+	{
+		SAFE_RELEASE(constants);
+		SAFE_RELEASE(tileSRV);
+		SAFE_RELEASE(tileBuffer);
+	}
+
+	// Run stage over the tiles of the width x height target that touch rect,
+	// writing through target. The target must not be bound as a render target.
+	// Returns false when stage has no compute variant, the caller should draw
+	// it with the pixel shader instead.
+	bool Run(ID3D11DeviceContext* ctx, Tonemapper* stage, ID3D11ShaderResourceView* srcData,
+		ID3D11UnorderedAccessView* target, int width, int height, const TileRect& rect)
+	{
+		ID3D11ComputeShader *shader = stage->TiledCS();
+
+		if (!shader)
+			return false;
+
+		BuildTileList(width, height, rect, tiles);
+
+		// skipped tiles are left black, as the input transform leaves the letterbox
+		if (tiles.size() < size_t(TilesAcross(width)) * TilesAcross(height))
+		{
+			const float black[4] = { 0.0f, 0.0f, 0.0f, 0.0f };
+			ctx->ClearUnorderedAccessViewFloat(target, black);
+		}
+
+		if (tiles.empty())
+			return true;
+
+		ReserveTiles(tiles.size());
+
+		D3D11_MAPPED_SUBRESOURCE map;
+
+		ctx->Map(tileBuffer, 0, D3D11_MAP_WRITE_DISCARD, 0, &map);
+		memcpy(map.pData, tiles.data(), tiles.size() * sizeof(uint32_t));
+		ctx->Unmap(tileBuffer, 0);
+
+		const UINT count = unsigned(tiles.size());
+		const UINT columns = (std::min)(count, MaxColumns);
+		const UINT rows = (count + columns - 1) / columns;
+
+		ConstantData data;
+
+		data.dimensions[0] = width;
+		data.dimensions[1] = height;
+		data.tileCount = count;
+		data.tileColumns = columns;
+
+		ctx->Map(constants, 0, D3D11_MAP_WRITE_DISCARD, 0, &map);
+		memcpy(map.pData, &data, sizeof(ConstantData));
+		ctx->Unmap(constants, 0);
+
+		stage->SetupTonemapShader(ctx, srcData);
+		MirrorBindings(ctx);
+
+		ctx->CSSetShader(shader, nullptr, 0);
+		ctx->CSSetConstantBuffers(6, 1, &constants);
+		ctx->CSSetShaderResources(7, 1, &tileSRV);
+		ctx->CSSetUnorderedAccessViews(0, 1, &target, nullptr);
+
+		ctx->Dispatch(columns, rows, 1);
+
+		// unbind so the target can be read by the next pass
+		ID3D11UnorderedAccessView *nullUAV = nullptr;
+		ID3D11ShaderResourceView *nullSRV[MirrorResources + 1] = { nullptr };
+
+		ctx->CSSetUnorderedAccessViews(0, 1, &nullUAV, nullptr);
+		ctx->CSSetShaderResources(0, MirrorResources + 1, nullSRV);
+		ctx->CSSetShader(nullptr, nullptr, 0);
+
+		return true;
+	}
+};
@@ -28,6 +28,8 @@
 
 #include "ACES.h"
 
+int Tonemapper::reloadGeneration = 0;
+
 const float Tonemapper::ColorMatrices[12 * 3] =
 {
 	// rec 709
@@ -32,11 +32,14 @@
 
 #include <d3d11.h>
 #include "shaderCompile.h"
+#include "frameState.h"
+#include "fusedReference.h"
 
 #include "common_util.h"
 
 #include "AntTweakBar.h"
 #include <string>
+#include <vector>
 
 // Macro for standard settings
 #define TONEMAPPER_UI_SETTINGS "color='19 25 19' alpha=255 text=light size='500 250' iconified=false valueswidth=200 position='10 220'"
@@ -46,31 +49,64 @@ class Tonemapper
 protected:
 	ID3D11Device *device;
 
+	std::vector<int> watches;
+
+	// shader WatchPS was given, and the same source compiled with FUSED and TILED
+	std::string shaderFile;
+	std::string shaderEntry;
+	ID3D11PixelShader *fusedShader;
+	ID3D11ComputeShader *tiledShader;
+	bool fusedBuilt;
+	bool tiledBuilt;
+	int variantGeneration;
+
+	// bumped by every hot reload, fused variants include files of several passes
+	static int reloadGeneration;
+
 	static const float ColorMatrices[12 * 3];
 	static const float ColorMatricesInv[12 * 3];
 public:
 
-	Tonemapper(ID3D11Device *inDevice) : device(inDevice)
+	Tonemapper(ID3D11Device *inDevice) :
+		device(inDevice),
+		fusedShader(nullptr),
+		tiledShader(nullptr),
+		fusedBuilt(false),
+		tiledBuilt(false),
+		variantGeneration(0)
 	{}
 
-	virtual ~Tonemapper() {}
+	virtual ~Tonemapper()
+	{
+		for (auto it = watches.begin(); it != watches.end(); it++)
+			UnwatchShader(*it);
+
+		SAFE_RELEASE(fusedShader);
+		SAFE_RELEASE(tiledShader);
+	}
 
 	virtual void SetupTonemapShader(ID3D11DeviceContext* ctx, ID3D11ShaderResourceView* srcData) = 0;
 
 	virtual TwBar* InitUI() { return nullptr; }
 
+	// Fold every setting the output depends on into state, used to skip frames that would come out the same
+	virtual void TrackState(FrameState &state) const {}
+
 	virtual void SetDimensions(int inX, int inY, int outX, int outY) {}
-	virtual void SetReadback(int x, int y) {}
+	virtual void SetReadback(int x, int y, int radius = 0) {}
 
+	// CPU version of the pass for one pixel, false if there is none for the current settings
+	virtual bool Reference(const float in[3], float out[3]) const { return false; }
 
-	ID3D11PixelShader* CompilePS(const char* shaderFile, const char* entry)
+
+	ID3D11PixelShader* CompilePS(const char* shaderFile, const char* entry, const D3D_SHADER_MACRO* defines = NULL)
 	{
 		ID3D11PixelShader *shader = nullptr;
 		HRESULT hr = S_OK;
 		ID3DBlob* pErrorBlob = nullptr;
 		ID3DBlob* pShaderBuffer = nullptr;
 
-		hr = CompileShaderFromFile(shaderFile, NULL, entry, "ps_5_0", D3D10_SHADER_ENABLE_STRICTNESS, &pShaderBuffer, &pErrorBlob);
+		hr = CompileShaderFromFile(shaderFile, defines, entry, "ps_5_0", D3D10_SHADER_ENABLE_STRICTNESS, &pShaderBuffer, &pErrorBlob);
 		if (FAILED(hr))
 		{
 			OutputDebugStringA((char*)pErrorBlob->GetBufferPointer());
@@ -83,6 +119,93 @@ public:
 
 		return shader;
 	}
+
+	// CompilePS into *slot, and swap in a new shader whenever the source is edited
+	void WatchPS(ID3D11PixelShader** slot, const char* shaderFile, const char* entry)
+	{
+		*slot = CompilePS(shaderFile, entry);
+
+		this->shaderFile = shaderFile;
+		shaderEntry = entry;
+
+		ID3D11Device *dev = device;
+		watches.push_back(WatchShader(shaderFile, entry, "ps_5_0", D3D10_SHADER_ENABLE_STRICTNESS, [dev, slot](ID3DBlob* blob)
+		{
+			ID3D11PixelShader *shader = nullptr;
+
+			if (SUCCEEDED(dev->CreatePixelShader(blob->GetBufferPointer(), blob->GetBufferSize(), nullptr, &shader)))
+			{
+				SAFE_RELEASE(*slot);
+				*slot = shader;
+			}
+
+			reloadGeneration++;
+		}));
+	}
+
+	// The WatchPS shader compiled with FUSED, so it evaluates the transform pass
+	// itself and applies the composite fade (see fused.hlsl). Only meaningful for
+	// shaders that include fused.hlsl. Built on first use and again after any
+	// hot reload, nullptr if it does not compile.
+	ID3D11PixelShader* FusedPS()
+	{
+		DropStaleVariants();
+
+		if (!fusedBuilt && shaderFile.size())
+		{
+			const D3D_SHADER_MACRO defines[] = { { "FUSED", "1" }, { NULL, NULL } };
+
+			fusedShader = CompilePS(shaderFile.c_str(), shaderEntry.c_str(), defines);
+			fusedBuilt = true;
+		}
+
+		return fusedShader;
+	}
+
+	// The WatchPS shader's main() as a compute shader over a list of 8x8 tiles
+	// writing to a UAV (see tiled.hlsl and TiledPass), for shaders that include
+	// tiled.hlsl. Otherwise the same as FusedPS().
+	ID3D11ComputeShader* TiledCS()
+	{
+		DropStaleVariants();
+
+		if (!tiledBuilt && shaderFile.size())
+		{
+			const D3D_SHADER_MACRO defines[] = { { "TILED", "1" }, { NULL, NULL } };
+			ID3DBlob* pErrorBlob = nullptr;
+			ID3DBlob* pShaderBuffer = nullptr;
+
+			HRESULT hr = CompileShaderFromFile(shaderFile.c_str(), defines, "tiledMain", "cs_5_0", D3D10_SHADER_ENABLE_STRICTNESS, &pShaderBuffer, &pErrorBlob);
+			if (FAILED(hr))
+			{
+				if (pErrorBlob)
+					OutputDebugStringA((char*)pErrorBlob->GetBufferPointer());
+			}
+			else
+			{
+				device->CreateComputeShader(pShaderBuffer->GetBufferPointer(), pShaderBuffer->GetBufferSize(), nullptr, &tiledShader);
+			}
+			SAFE_RELEASE(pErrorBlob);
+			SAFE_RELEASE(pShaderBuffer);
+
+			tiledBuilt = true;
+		}
+
+		return tiledShader;
+	}
+
+protected:
+	void DropStaleVariants()
+	{
+		if (variantGeneration == reloadGeneration)
+			return;
+
+		SAFE_RELEASE(fusedShader);
+		SAFE_RELEASE(tiledShader);
+		fusedBuilt = false;
+		tiledBuilt = false;
+		variantGeneration = reloadGeneration;
+	}
 };
 
 
@@ -95,7 +218,7 @@ public:
 
 	SimpleTonemapper(ID3D11Device * inDevice, const char* shaderFile, const char* entry = "main") : Tonemapper(inDevice)
 	{
-		shader = CompilePS(shaderFile, entry);
+		WatchPS(&shader, shaderFile, entry);
 	}
 
 	~SimpleTonemapper()
@@ -136,7 +259,7 @@ public:
 
 	Linear(ID3D11Device * inDevice) : Tonemapper(inDevice)
 	{
-		shader = CompilePS("linear.hlsl", "main");
+		WatchPS(&shader, "linear.hlsl", "main");
 
 		D3D11_BUFFER_DESC desc;
 		ZeroMemory(&desc, sizeof(desc));
@@ -177,6 +300,18 @@ public:
 		ctx->PSSetShaderResources(0, 1, &srcData);
 	}
 
+	void TrackState(FrameState &state) const override
+	{
+		state.TrackConstants(constants);
+		state.Track(selectedColorMatrix);
+	}
+
+	bool Reference(const float in[3], float out[3]) const override
+	{
+		ReferenceLinear(constants.scale, constants.gamma, constants.mode, &ColorMatrices[selectedColorMatrix * 12], in, out);
+		return true;
+	}
+
 	TwBar* InitUI() override
 	{
 		TwBar* settings_bar = TwNewBar("LinearTonemapParameters");
@@ -234,7 +369,7 @@ public:
 
 	Reinhard(ID3D11Device * inDevice) : Tonemapper(inDevice)
 	{
-		shader = CompilePS("reinhard.hlsl", "main");
+		WatchPS(&shader, "reinhard.hlsl", "main");
 
 		D3D11_BUFFER_DESC desc;
 		ZeroMemory(&desc, sizeof(desc));
@@ -272,6 +407,17 @@ public:
 		ctx->PSSetShaderResources(0, 1, &srcData);
 	}
 
+	void TrackState(FrameState &state) const override
+	{
+		state.TrackConstants(constants);
+	}
+
+	bool Reference(const float in[3], float out[3]) const override
+	{
+		ReferenceReinhard(constants.maxOutput, constants.gamma, constants.mode, in, out);
+		return true;
+	}
+
 	TwBar* InitUI() override
 	{
 		TwBar* settings_bar = TwNewBar("ReinhardTonemapParameters");
@@ -0,0 +1,504 @@
+// Throughput benchmark for the CPU pixel kernels
+//
+// Times the RGBE RLE reader and writer, the in memory RGBE reader, EvalACES, the ACES LUT bake, PQ encode
+// and decode, float2half, RGBE to RGB9E5, the mip chain and the tiled linear
+// tonemap on synthetic 1080p/4K/8K images and on any .hdr files given on the
+// command line. Results go to stdout (or -o file) as CSV, one line per kernel
+// and image, so runs can be diffed when a kernel changes.
+//
+// Needs nothing but the portable sources, on Linux:
+//   g++ -O2 -std=c++14 -I../HDRDisplay -o kernelBench kernelBench.cpp
+//       ../HDRDisplay/ACES.cpp ../HDRDisplay/rgbe.cpp ../HDRDisplay/perftracker_cpu.cpp
+//       ../HDRDisplay/fusedReference.cpp ../HDRDisplay/tileDispatch.cpp ../HDRDisplay/rgb9e5.cpp
+//       ../HDRDisplay/mipChain.cpp ../HDRDisplay/taskScheduler.cpp ../HDRDisplay/rgbeReader.cpp -pthread
+//   ./kernelBench ../sample_images/*.hdr > results.csv
+
+#include "ACES.h"
+#include "fusedReference.h"
+#include "mipChain.h"
+#include "rgbe.h"
+#include "rgbeReader.h"
+#include "perftracker_cpu.h"
+#include "rgb9e5.h"
+#include "tileDispatch.h"
+
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+struct BenchImage
+{
+	std::string name;
+	int width;
+	int height;
+	std::vector<float> rgb;
+};
+
+struct BenchSettings
+{
+	double minTime;		// repeat each kernel until it has run this many seconds
+	int maxPixels;		// per pass cap for EvalACES, 0 for none
+	bool synthetic;
+
+	BenchSettings() :
+		minTime(0.5),
+		maxPixels(1920 * 1080),
+		synthetic(true)
+	{}
+};
+
+static FILE *g_Out = stdout;
+
+// keeps results alive so the kernels are not optimized away
+static volatile float g_Sink = 0.0f;
+
+static void Report(const char *kernel, const BenchImage &image, double pixels, int iterations, double seconds)
+{
+	double rate = seconds > 0.0 ? pixels * iterations / seconds * 1e-6 : 0.0;
+
+	fprintf(g_Out, "%s,%s,%d,%d,%.0f,%d,%.6f,%.3f\n", kernel, image.name.c_str(), image.width, image.height, pixels, iterations, seconds, rate);
+	fflush(g_Out);
+}
+
+// Run pass until minTime has elapsed, at least once
+template <typename Pass>
+static void Time(const char *kernel, const BenchImage &image, double pixels, const BenchSettings &settings, Pass pass)
+{
+	PerfTracker::CPUTimer timer;
+	double elapsed = 0.0;
+	int iterations = 0;
+
+	// the first pass warms the caches and the allocator, it only counts if it
+	// already took longer than minTime
+	timer.start();
+	pass();
+	timer.stop();
+
+	if (timer.value() >= settings.minTime)
+	{
+		elapsed = timer.value();
+		iterations = 1;
+	}
+
+	while (iterations == 0 || elapsed < settings.minTime)
+	{
+		timer.start();
+		pass();
+		timer.stop();
+
+		elapsed += timer.value();
+		iterations++;
+	}
+
+	Report(kernel, image, pixels, iterations, elapsed);
+}
+
+// Log distributed luminance from 1e-3 to 1e4 with some chroma, so RLE sees
+// the mix of runs and literals real images have
+static void MakeSynthetic(BenchImage &image, const char *name, int width, int height)
+{
+	image.name = name;
+	image.width = width;
+	image.height = height;
+	image.rgb.resize(size_t(width) * height * 3);
+
+	unsigned int seed = 1;
+	float *p = image.rgb.data();
+
+	for (int y = 0; y < height; y++)
+	{
+		for (int x = 0; x < width; x++)
+		{
+			seed = seed * 1664525u + 1013904223u;
+			float noise = float(seed >> 8) / float(1 << 24);
+
+			// flat bands in the top quarter, gradient plus noise below
+			float t = y < height / 4 ? float((x * 8) / width) / 8.0f : float(x) / width + 0.02f * noise;
+			float L = powf(10.0f, -3.0f + 7.0f * t);
+			float hue = float(y) / height;
+
+			p[0] = L * (0.6f + 0.4f * hue);
+			p[1] = L;
+			p[2] = L * (1.0f - 0.5f * hue);
+			p += 3;
+		}
+	}
+}
+
+static bool LoadHDR(BenchImage &image, const char *path)
+{
+	FILE *fp = fopen(path, "rb");
+
+	if (!fp)
+	{
+		fprintf(stderr, "%s: unable to open\n", path);
+		return false;
+	}
+
+	int width, height;
+	bool ok = RGBE_ReadHeader(fp, &width, &height, nullptr) == RGBE_RETURN_SUCCESS;
+
+	if (ok)
+	{
+		image.rgb.resize(size_t(width) * height * 3);
+		ok = RGBE_ReadPixels_RLE(fp, image.rgb.data(), width, height) == RGBE_RETURN_SUCCESS;
+	}
+
+	fclose(fp);
+
+	if (!ok)
+	{
+		fprintf(stderr, "%s: not a readable .hdr file\n", path);
+		return false;
+	}
+
+	const char *slash = strrchr(path, '/');
+	const char *backslash = strrchr(path, '\\');
+	if (backslash > slash)
+		slash = backslash;
+
+	image.name = slash ? slash + 1 : path;
+	image.width = width;
+	image.height = height;
+
+	return true;
+}
+
+// Same set up as LutACES with the 1000 nit preset and Rec.709 primaries
+static ACESparams MakeAcesParams()
+{
+	static const Float3x3 XYZ_2_709 =
+	{
+		3.24096942f, -1.53738296f, -0.49861076f,
+		-0.96924388f, 1.87596786f, 0.04155510f,
+		0.05563002f, -0.20397684f, 1.05697131f,
+	};
+	static const Float3x3 REC709_2_XYZ =
+	{
+		0.41239089f, 0.35758430f, 0.18048081f,
+		0.21263906f, 0.71516860f, 0.07219233f,
+		0.01933082f, 0.11919472f, 0.95053232f,
+	};
+
+	ACESparams params;
+	params.C = GetAcesODTData(ODT_1000Nit_Adj, -12.0f, 10.0f, -1.0f, 1.0f);
+	params.XYZ_2_DISPLAY_PRI_MAT = XYZ_2_709;
+	params.DISPLAY_PRI_MAT_2_XYZ = REC709_2_XYZ;
+	params.CinemaLimits.X = params.C.minPoint.Y;
+	params.CinemaLimits.Y = params.C.maxPoint.Y;
+	params.OutputMode = 2;
+	params.surroundGamma = 0.9811f;
+	params.desaturate = false;
+	params.surroundAdjust = true;
+	params.applyCAT = true;
+	params.tonemapLuminance = false;
+	params.saturationLevel = 1.0f;
+
+	return params;
+}
+
+static void BenchImageKernels(const BenchImage &image, const ACESparams &params, const BenchSettings &settings)
+{
+	const size_t pixels = size_t(image.width) * image.height;
+	const float *rgb = image.rgb.data();
+
+	// RLE writer, to an unlinked temporary file that stays in the page cache
+	FILE *fp = tmpfile();
+
+	if (!fp)
+	{
+		fprintf(stderr, "unable to create a temporary file\n");
+		return;
+	}
+
+	std::vector<float> scratch(image.rgb);
+
+	Time("rgbe_write_rle", image, double(pixels), settings, [&]()
+	{
+		rewind(fp);
+		RGBE_WriteHeader(fp, image.width, image.height, nullptr);
+		RGBE_WritePixels_RLE(fp, scratch.data(), image.width, image.height);
+		fflush(fp);
+	});
+
+	Time("rgbe_read_rle", image, double(pixels), settings, [&]()
+	{
+		int width, height;
+		rewind(fp);
+		if (RGBE_ReadHeader(fp, &width, &height, nullptr) == RGBE_RETURN_SUCCESS)
+			RGBE_ReadPixels_RLE(fp, scratch.data(), width, height);
+		g_Sink = scratch[0];
+	});
+
+	// the same file parsed from memory, as the loaders read a mapped file
+	fseek(fp, 0, SEEK_END);
+	std::vector<unsigned char> bytes(size_t(ftell(fp)));
+	rewind(fp);
+
+	if (fread(bytes.data(), 1, bytes.size(), fp) == bytes.size())
+	{
+		Time("rgbe_read_memory", image, double(pixels), settings, [&]()
+		{
+			RGBEReader reader(bytes.data(), bytes.size());
+			int width, height;
+			if (reader.ReadHeader(width, height))
+				reader.ReadPixels(scratch.data(), width, height);
+			g_Sink = scratch[0];
+		});
+	}
+
+	fclose(fp);
+
+	// EvalACES is far slower than the rest, only time the first maxPixels
+	size_t acesPixels = pixels;
+	if (settings.maxPixels > 0 && acesPixels > size_t(settings.maxPixels))
+		acesPixels = size_t(settings.maxPixels);
+
+	Time("eval_aces", image, double(acesPixels), settings, [&]()
+	{
+		float sum = 0.0f;
+		for (size_t i = 0; i < acesPixels; i++)
+		{
+			Float3 color = { rgb[3 * i + 0], rgb[3 * i + 1], rgb[3 * i + 2] };
+			Float3 out = EvalACES(color, params);
+			sum += out.X + out.Y + out.Z;
+		}
+		g_Sink = sum;
+	});
+
+	// scene values scaled to cd/m^2 with 1.0 at 80 nits, as scRGB
+	Time("pq_encode", image, double(pixels), settings, [&]()
+	{
+		float *out = scratch.data();
+		for (size_t i = 0; i < pixels * 3; i++)
+			out[i] = pq_r(std::min(rgb[i] * 80.0f, 10000.0f));
+		g_Sink = out[0];
+	});
+
+	Time("pq_decode", image, double(pixels), settings, [&]()
+	{
+		const float *in = scratch.data();
+		float sum = 0.0f;
+		for (size_t i = 0; i < pixels * 3; i++)
+			sum += pq_f(in[i]);
+		g_Sink = sum;
+	});
+
+	// RGB to RGBA half, as the texture upload does
+	std::vector<unsigned short> half(pixels * 4);
+
+	Time("float2half", image, double(pixels), settings, [&]()
+	{
+		unsigned short *out = half.data();
+		for (size_t i = 0; i < pixels; i++)
+		{
+			out[0] = float2half(rgb[3 * i + 0]);
+			out[1] = float2half(rgb[3 * i + 1]);
+			out[2] = float2half(rgb[3 * i + 2]);
+			out[3] = 0x3c00;
+			out += 4;
+		}
+		g_Sink = float(half[0]);
+	});
+
+	// raw RGBE to RGB9E5, as -rgb9e5 uploads, checked against the scalar
+	// conversion and the float decode once timed
+	std::vector<unsigned char> rgbe(pixels * 4);
+
+	for (size_t i = 0; i < pixels; i++)
+		float2rgbe(&rgbe[i * 4], rgb[3 * i + 0], rgb[3 * i + 1], rgb[3 * i + 2]);
+
+	std::vector<uint32_t> packed(pixels);
+
+	Time("rgbe_to_rgb9e5", image, double(pixels), settings, [&]()
+	{
+		ConvertRGBEToRGB9E5(rgbe.data(), packed.data(), pixels);
+		g_Sink = float(packed[0]);
+	});
+
+	size_t mismatched = 0;
+
+	for (size_t i = 0; i < pixels; i++)
+		mismatched += packed[i] != RGBEToRGB9E5(&rgbe[i * 4]);
+
+	RGB9E5Check check = CheckRGB9E5(rgbe.data(), packed.data(), pixels);
+
+	if (mismatched || check.maxError > RGB9E5Tolerance)
+		fprintf(stderr, "%s: rgb9e5 %d pixels differ from the scalar path, max error %g\n", image.name.c_str(), int(mismatched), check.maxError);
+
+	// full mip chain from RGBA float, as the loaders build it, counting the top level's pixels
+	std::vector<float> rgba(pixels * 4);
+
+	for (size_t i = 0; i < pixels; i++)
+	{
+		rgba[i * 4 + 0] = rgb[3 * i + 0];
+		rgba[i * 4 + 1] = rgb[3 * i + 1];
+		rgba[i * 4 + 2] = rgb[3 * i + 2];
+		rgba[i * 4 + 3] = 1.0f;
+	}
+
+	std::vector<MipLevel> mips;
+
+	Time("mip_chain", image, double(pixels), settings, [&]()
+	{
+		BuildMipChain(rgba.data(), image.width, image.height, mips);
+		g_Sink = mips.back().rgba[0];
+	});
+
+	// linear.hlsl to Rec.709 sRGB through the tile executor, over the whole
+	// frame and then over only the tiles of a 2.39:1 picture letterboxed in
+	// it, as -compute dispatches. Both count the full frame's pixels.
+	static const float XYZ_2_709[12] =
+	{
+		3.24096942f, -1.53738296f, -0.49861076f, 0.0f,
+		-0.96924388f, 1.87596786f, 0.04155510f, 0.0f,
+		0.05563002f, -0.20397684f, 1.05697131f, 0.0f,
+	};
+
+	auto linearSpan = [&](int x0, int x1, int y)
+	{
+		for (int x = x0; x < x1; x++)
+		{
+			size_t i = (size_t(y) * image.width + x) * 3;
+			ReferenceLinear(1.0f, 2.2f, 0, XYZ_2_709, rgb + i, scratch.data() + i);
+		}
+	};
+
+	std::vector<uint32_t> tiles;
+	TileRect frame = { 0, 0, image.width, image.height };
+
+	BuildTileList(image.width, image.height, frame, tiles);
+
+	Time("linear_tiles_full", image, double(pixels), settings, [&]()
+	{
+		ExecuteTiles(tiles, image.width, image.height, linearSpan);
+		g_Sink = scratch[0];
+	});
+
+	int picture = std::min(int(image.width / 2.39f), image.height);
+	TileRect letterbox = { 0, (image.height - picture) / 2, image.width, (image.height + picture) / 2 };
+
+	BuildTileList(image.width, image.height, letterbox, tiles);
+
+	Time("linear_tiles_letterbox", image, double(pixels), settings, [&]()
+	{
+		ExecuteTiles(tiles, image.width, image.height, linearSpan);
+		g_Sink = scratch[0];
+	});
+}
+
+// LUT cells per second, with the log2 shaper LutACES uses by default
+static void BenchLutBake(int dim, const ACESparams &params, const BenchSettings &settings)
+{
+	float log_min = log2f(std::max(params.C.limits.X, 0.0000001f));
+	float log_max = log2f(params.C.limits.Y);
+	float scale = 1.0f / (log_max - log_min);
+	float bias = -(scale * log_min);
+
+	std::function<float(float)> shaper = [=](float t) -> float { return powf(2.0f, (t - bias) / scale); };
+
+	BenchImage lut;
+	lut.name = "lut" + std::to_string(dim);
+	lut.width = dim * dim;
+	lut.height = dim;
+
+	std::vector<unsigned short> data(size_t(dim) * dim * dim * 4);
+
+	Time("aces_lut_bake", lut, double(dim) * dim * dim, settings, [&]()
+	{
+		BakeAcesLUT(data.data(), dim, dim, dim, shaper, params);
+		g_Sink = float(data[0]);
+	});
+}
+
+static void Usage()
+{
+	fprintf(stderr,
+		"usage: kernelBench [options] [file.hdr ...]\n"
+		"  -o file        write the CSV to file instead of stdout\n"
+		"  -time seconds  minimum time per kernel and image, default 0.5\n"
+		"  -aces pixels   limit EvalACES to the first pixels of each image,\n"
+		"                 default 2073600 (1080p), 0 for the whole image\n"
+		"  -nosynthetic   only run the files given\n");
+}
+
+int main(int argc, char **argv)
+{
+	BenchSettings settings;
+	std::vector<const char *> files;
+	const char *outPath = nullptr;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-o") && i + 1 < argc)
+			outPath = argv[++i];
+		else if (!strcmp(argv[i], "-time") && i + 1 < argc)
+			settings.minTime = atof(argv[++i]);
+		else if (!strcmp(argv[i], "-aces") && i + 1 < argc)
+			settings.maxPixels = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-nosynthetic"))
+			settings.synthetic = false;
+		else if (argv[i][0] == '-')
+		{
+			Usage();
+			return 1;
+		}
+		else
+			files.push_back(argv[i]);
+	}
+
+	if (outPath && !(g_Out = fopen(outPath, "w")))
+	{
+		fprintf(stderr, "%s: unable to create\n", outPath);
+		return 1;
+	}
+
+	ACESparams params = MakeAcesParams();
+
+	fprintf(g_Out, "kernel,image,width,height,pixels,iterations,seconds,mpix_per_s\n");
+
+	BenchLutBake(32, params, settings);
+	BenchLutBake(64, params, settings);
+
+	if (settings.synthetic)
+	{
+		static const struct { const char *name; int width; int height; } sizes[] =
+		{
+			{ "synthetic_1080p", 1920, 1080 },
+			{ "synthetic_4k", 3840, 2160 },
+			{ "synthetic_8k", 7680, 4320 },
+		};
+
+		for (auto &size : sizes)
+		{
+			BenchImage image;
+			MakeSynthetic(image, size.name, size.width, size.height);
+			BenchImageKernels(image, params, settings);
+		}
+	}
+
+	int failed = 0;
+
+	for (const char *path : files)
+	{
+		BenchImage image;
+
+		if (!LoadHDR(image, path))
+		{
+			failed++;
+			continue;
+		}
+
+		BenchImageKernels(image, params, settings);
+	}
+
+	if (g_Out != stdout)
+		fclose(g_Out);
+
+	return failed ? 1 : 0;
+}
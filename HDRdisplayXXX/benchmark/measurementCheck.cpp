@@ -0,0 +1,402 @@
+// Checks the measurement engine against the simulated display and instrument
+//
+// Runs MeasurementSequencer over a SimulatedDisplay with a LevelList and
+// checks how many readings each level takes, that every reading starts with
+// its own level on screen and settled, that a level the sequencer switched
+// away from too early is shown again, and that WriteMeasurementCSV writes
+// what ReadLuminanceTable and csvread expect. Then runs AdaptiveSampler on a
+// gamma 2.2 panel that clips at 9.6 of 12.5 and checks it needs far fewer
+// levels than the 126 of a uniform sweep, interpolates the curve within a few
+// percent and finds the clipping point. The simulator runs on short timings,
+// so the whole check takes about a second. Exits 0 on success, 1 on a failed
+// check.
+//
+// Needs nothing but the portable sources, on Linux:
+//   g++ -O2 -std=c++14 -I../HDRDisplay -o measurementCheck measurementCheck.cpp
+//       ../HDRDisplay/measurement.cpp ../HDRDisplay/simulatedDisplay.cpp
+//       ../HDRDisplay/adaptiveSampler.cpp -pthread
+//   ./measurementCheck
+
+#include "adaptiveSampler.h"
+#include "measurement.h"
+#include "simulatedDisplay.h"
+
+#include <algorithm>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+static int g_Failures = 0;
+
+static void Check(bool ok, const char *test, const char *what)
+{
+	if (ok)
+		return;
+
+	fprintf(stderr, "%s: %s\n", test, what);
+	g_Failures++;
+}
+
+// the simulator's defaults are close to a real panel, a few ms keeps the run short
+static const double SettleTime = 0.004;
+static const double ResponseTime = 0.0004;
+static const double IntegrationTime = 0.002;
+static const double TransferTime = 0.001;
+
+// gamma 2.2 reaching peak at clipLevel and flat above, as in lumdata of a luminance.mat file
+static void GammaPanel(float clipLevel, float peak, std::vector<float> &levels, std::vector<float> &luminance)
+{
+	levels.clear();
+	luminance.clear();
+
+	for (int i = 0; i <= 500; i++)
+	{
+		float level = 12.5f * i / 500;
+		levels.push_back(level);
+		luminance.push_back(0.05f + peak * powf((std::min)(level, clipLevel) / clipLevel, 2.2f));
+	}
+}
+
+// Forwards to a SimulatedDisplay, noting what was shown when
+class RecordingPattern : public PatternSource
+{
+public:
+	RecordingPattern(SimulatedDisplay *inDisplay) : display(inDisplay), shownLevel(-1.0f), shownTime(0.0) {}
+
+	bool Show(float level) override
+	{
+		shown.push_back(level);
+		shownLevel = level;
+		shownTime = MeasurementClock();
+		return display->Show(level);
+	}
+
+	double SettleTime() const override { return display->SettleTime(); }
+
+	SimulatedDisplay *display;
+	std::vector<float> shown;
+	float shownLevel;
+	double shownTime;
+};
+
+// Reads the steady state response times a scripted factor, and notes the
+// level on screen and how long it had been up when each reading started
+class ScriptedInstrument : public Instrument
+{
+public:
+	ScriptedInstrument(const RecordingPattern *inPattern, const std::vector<float> &inFactors) :
+		pattern(inPattern), factors(inFactors), readings(0), level(0.0f) {}
+
+	bool Open() override { return true; }
+	void Close() override {}
+
+	bool BeginMeasurement(double *integrationSeconds) override
+	{
+		level = pattern->shownLevel;
+		levels.push_back(level);
+		settled.push_back(MeasurementClock() - pattern->shownTime);
+
+		*integrationSeconds = IntegrationTime;
+		return true;
+	}
+
+	bool WaitMeasurement() override
+	{
+		MeasurementSleepUntil(MeasurementClock() + IntegrationTime);
+		return true;
+	}
+
+	bool ReadResult(MeasurementSample &result) override
+	{
+		result.Y = pattern->display->Response(level) * factors[size_t(readings++) % factors.size()];
+		result.x = 0.3127f;
+		result.y = 0.3290f;
+		return true;
+	}
+
+	const RecordingPattern *pattern;
+	std::vector<float> factors;
+	int readings;
+	float level;
+
+	std::vector<float> levels;		// on screen as each reading started
+	std::vector<double> settled;	// seconds it had been up by then
+};
+
+// Noiseless readings meet any target after minRepeats, noisy ones against a
+// tight target run to maxRepeats, and the readings are the settled response
+static void RepeatCounts()
+{
+	std::vector<float> panelLevels, panelLuminance;
+	GammaPanel(12.5f, 1000.0f, panelLevels, panelLuminance);
+
+	const float list[] = { 0.0f, 1.0f, 2.5f, 5.0f, 7.5f, 10.0f, 12.5f, 6.0f };
+	const std::vector<float> levels(list, list + sizeof(list) / sizeof(list[0]));
+
+	{
+		SimulatedDisplay display(panelLevels, panelLuminance, SettleTime, ResponseTime);
+		SimulatedInstrument instrument(&display, 0.0f, 0.0f, IntegrationTime, TransferTime);
+
+		MeasurementSettings settings;
+		settings.minRepeats = 3;
+		settings.maxRepeats = 6;
+
+		MeasurementSequencer sequencer(&instrument, &display, settings);
+		std::vector<MeasurementPoint> points;
+
+		Check(sequencer.Run(levels, points), "noiseless", "run failed");
+		Check(points.size() == levels.size(), "noiseless", "wrong number of points");
+
+		bool repeats = true, settled = true, order = true;
+
+		for (size_t i = 0; i < points.size() && i < levels.size(); i++)
+		{
+			const float expected = display.Response(levels[i]);
+
+			order = order && points[i].level == levels[i];
+			repeats = repeats && points[i].repeats == settings.minRepeats;
+
+			// settleTime is ten time constants, what is left of the step is far below this
+			settled = settled && fabsf(points[i].luminance - expected) <= 1e-3f * expected + 1e-4f;
+		}
+
+		Check(order, "noiseless", "levels measured out of order");
+		Check(repeats, "noiseless", "took more than minRepeats readings");
+		Check(settled, "noiseless", "reading differs from the settled response");
+
+		// each level is shown once, the early switch to the next one is its only switch
+		Check(display.SwitchCount() == int(levels.size()), "noiseless", "a level was shown more than once");
+		Check(instrument.MeasurementCount() == int(levels.size()) * settings.minRepeats, "noiseless", "wrong number of readings");
+	}
+
+	{
+		SimulatedDisplay display(panelLevels, panelLuminance, SettleTime, ResponseTime);
+		SimulatedInstrument instrument(&display, 0.05f, 0.01f, IntegrationTime, TransferTime);
+
+		MeasurementSettings settings;
+		settings.minRepeats = 2;
+		settings.maxRepeats = 5;
+		settings.relativeErrorTarget = 1e-5f;
+		settings.absoluteErrorTarget = 1e-6f;
+
+		MeasurementSequencer sequencer(&instrument, &display, settings);
+		std::vector<MeasurementPoint> points;
+
+		Check(sequencer.Run(levels, points), "noisy", "run failed");
+
+		bool repeats = points.size() == levels.size();
+		for (auto &point : points)
+			repeats = repeats && point.repeats == settings.maxRepeats && point.stddev > 0.0f;
+
+		Check(repeats, "noisy", "stopped before maxRepeats with an unreachable target");
+	}
+}
+
+// A reading that breaks the spread after the sequencer has already switched
+// to the next level brings the level back, settled, for the next reading
+static void Reshow()
+{
+	std::vector<float> panelLevels, panelLuminance;
+	GammaPanel(12.5f, 1000.0f, panelLevels, panelLuminance);
+
+	SimulatedDisplay display(panelLevels, panelLuminance, SettleTime, ResponseTime);
+	RecordingPattern pattern(&display);
+
+	// per level: two agreeing readings make the third look like the last, so
+	// the next level goes up early, but it is off by 10% and a fourth is needed
+	const float script[] = { 1.0f, 1.0f, 1.1f, 1.0f };
+	ScriptedInstrument instrument(&pattern, std::vector<float>(script, script + 4));
+
+	MeasurementSettings settings;
+	settings.minRepeats = 3;
+	settings.maxRepeats = 6;
+	settings.relativeErrorTarget = 0.03f;
+
+	MeasurementSequencer sequencer(&instrument, &pattern, settings);
+	std::vector<MeasurementPoint> points;
+
+	const float list[] = { 2.0f, 4.0f, 8.0f };
+	const std::vector<float> levels(list, list + 3);
+
+	Check(sequencer.Run(levels, points), "reshow", "run failed");
+
+	bool repeats = points.size() == 3;
+	for (auto &point : points)
+		repeats = repeats && point.repeats == 4;
+
+	Check(repeats, "reshow", "wrong number of readings per level");
+
+	// each level goes up early and comes back once, the last has nothing to go to early
+	const float expected[] = { 2.0f, 4.0f, 2.0f, 4.0f, 8.0f, 4.0f, 8.0f };
+	Check(pattern.shown == std::vector<float>(expected, expected + 7), "reshow", "levels not shown in the expected order");
+
+	bool onScreen = instrument.levels.size() == 12, settled = true;
+	for (size_t i = 0; i < instrument.levels.size(); i++)
+	{
+		onScreen = onScreen && instrument.levels[i] == levels[i / 4];
+		settled = settled && instrument.settled[i] >= SettleTime;
+	}
+
+	Check(onScreen, "reshow", "a reading started with another level on screen");
+	Check(settled, "reshow", "a reading started before the pattern settled");
+}
+
+// One header line, then level,luminance,x,y,stddev,repeats per point, and
+// the first two columns read back with ReadLuminanceTable
+static void CSV()
+{
+	std::vector<MeasurementPoint> points;
+
+	for (int i = 0; i < 4; i++)
+	{
+		MeasurementPoint point;
+		point.level = 0.5f + 3.0f * i;
+		point.luminance = 0.125f + 100.0f * i * i;
+		point.stddev = 0.25f * i;
+		point.x = 0.3127f;
+		point.y = 0.3290f;
+		point.repeats = 2 + i;
+		points.push_back(point);
+	}
+
+	const char *path = "measurementCheck.csv";
+
+	Check(WriteMeasurementCSV(path, points), "csv", "write failed");
+
+	FILE *fp = fopen(path, "r");
+	std::vector<std::string> lines;
+	char line[256];
+
+	while (fp && fgets(line, sizeof(line), fp))
+		lines.push_back(line);
+
+	if (fp)
+		fclose(fp);
+
+	Check(lines.size() == points.size() + 1, "csv", "wrong number of lines");
+	Check(lines.size() && lines[0] == "level,luminance,x,y,stddev,repeats\n", "csv", "wrong header");
+
+	bool rows = lines.size() == points.size() + 1;
+	for (size_t i = 0; rows && i < points.size(); i++)
+	{
+		float level, luminance, x, y, stddev;
+		int repeats;
+
+		rows = sscanf(lines[i + 1].c_str(), "%f,%f,%f,%f,%f,%d", &level, &luminance, &x, &y, &stddev, &repeats) == 6 &&
+			level == points[i].level && luminance == points[i].luminance && x == points[i].x && y == points[i].y &&
+			stddev == points[i].stddev && repeats == points[i].repeats;
+	}
+
+	Check(rows, "csv", "rows do not match the points");
+
+	std::vector<float> levels, luminance;
+	bool table = ReadLuminanceTable(path, levels, luminance) && levels.size() == points.size();
+
+	for (size_t i = 0; table && i < points.size(); i++)
+		table = levels[i] == points[i].level && luminance[i] == points[i].luminance;
+
+	Check(table, "csv", "ReadLuminanceTable does not read back level and luminance");
+
+	remove(path);
+}
+
+// Largest error of the measured points linearly interpolated against the
+// panel, relative to the luminance but at least floor, and where it is
+static double InterpolationError(const std::vector<MeasurementPoint> &measured, const SimulatedDisplay &display, float floor, float *where)
+{
+	std::vector<MeasurementPoint> sorted = measured;
+	std::sort(sorted.begin(), sorted.end(), [](const MeasurementPoint &a, const MeasurementPoint &b) { return a.level < b.level; });
+
+	double worst = 0.0;
+
+	for (int i = 0; i <= 1250 && sorted.size() > 1; i++)
+	{
+		const float level = 0.01f * i;
+
+		size_t hi = 1;
+		while (hi + 1 < sorted.size() && sorted[hi].level < level)
+			hi++;
+
+		const MeasurementPoint &a = sorted[hi - 1], &b = sorted[hi];
+		const float t = (std::min)((std::max)((level - a.level) / (b.level - a.level), 0.0f), 1.0f);
+		const float estimate = a.luminance + t * (b.luminance - a.luminance);
+		const float actual = display.Response(level);
+		const double error = fabs(estimate - actual) / (std::max)(actual, floor);
+
+		if (error > worst)
+		{
+			worst = error;
+			*where = level;
+		}
+	}
+
+	return worst;
+}
+
+// Any level, and only the 126 levels of the pattern files 0.1 apart as with
+// -adaptive in the viewer: both stop well short of a uniform sweep and pin
+// down the knee where the panel clips
+static void Adaptive()
+{
+	std::vector<float> panelLevels, panelLuminance;
+	GammaPanel(9.6f, 700.0f, panelLevels, panelLuminance);
+
+	std::vector<float> files;
+	for (int i = 0; i <= 125; i++)
+		files.push_back(0.1f * i);
+
+	for (int run = 0; run < 2; run++)
+	{
+		const char *test = run ? "adaptive files" : "adaptive";
+
+		SimulatedDisplay display(panelLevels, panelLuminance, SettleTime, ResponseTime);
+		SimulatedInstrument instrument(&display, 0.003f, 0.001f, IntegrationTime, TransferTime);
+		MeasurementSequencer sequencer(&instrument, &display);
+
+		AdaptiveSettings settings;
+		AdaptiveSampler sampler = run ? AdaptiveSampler(files, settings) : AdaptiveSampler(0.0f, 12.5f, settings);
+		std::vector<MeasurementPoint> points;
+
+		Check(sequencer.Run(sampler, points), test, "run failed");
+
+		float where = 0.0f;
+		const double error = InterpolationError(points, display, settings.luminanceFloor, &where);
+		const float saturation = sampler.SaturationLevel(points);
+
+		printf("%s: %d levels, %.2f%% worst interpolation error at %.2f, saturated from %.2f\n", test, int(points.size()), 100.0 * error, where, saturation);
+
+		// 38 levels and about 2% at the knee when this was written
+		Check(points.size() <= size_t(settings.maxPoints) && points.size() < files.size() / 3, test, "too many levels");
+		Check(error < 0.03, test, "interpolation error too large");
+		Check(saturation >= 9.6f && saturation <= 10.0f, test, "saturation not found at the knee");
+	}
+}
+
+int main(int argc, char **argv)
+{
+	(void)argv;
+
+	if (argc > 1)
+	{
+		fprintf(stderr, "measurementCheck takes no arguments\n");
+		return 1;
+	}
+
+	RepeatCounts();
+	Reshow();
+	CSV();
+	Adaptive();
+
+	if (g_Failures)
+	{
+		fprintf(stderr, "%d failures\n", g_Failures);
+		return 1;
+	}
+
+	printf("measurement checks passed\n");
+	return 0;
+}
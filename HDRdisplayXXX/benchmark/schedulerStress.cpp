@@ -0,0 +1,437 @@
+// Stress test for the task scheduler and the sequence reader built on it
+//
+// Runs nested ParallelFor loops, dependency chains and diamonds, loops and
+// tasks cancelled before and while they run, several outside threads
+// submitting and waiting at once, and a SequenceReader seeking at random, for
+// a number of rounds. Every case checks its own results. A watchdog fails the
+// run if a round has not finished in time, which is how a lost wakeup or a
+// dependency that is never released shows up. Exits 0 on success, 1 on a
+// wrong result, 2 on a timeout.
+//
+// Needs nothing but the portable sources, on Linux:
+//   g++ -O2 -std=c++14 -I../HDRDisplay -o schedulerStress schedulerStress.cpp
+//       ../HDRDisplay/taskScheduler.cpp ../HDRDisplay/frameSequence.cpp -pthread
+//   ./schedulerStress -rounds 200
+// and with -fsanitize=thread in place of -O2 to look for races.
+
+#include "frameSequence.h"
+#include "taskScheduler.h"
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <thread>
+#include <vector>
+
+struct StressSettings
+{
+	int rounds;
+	unsigned int threads;		// scheduler threads, 0 for one per core
+	int outsiders;				// outside threads submitting at once
+	double timeout;				// seconds a round may take
+
+	StressSettings() :
+		rounds(50),
+		threads(0),
+		outsiders(8),
+		timeout(30.0)
+	{}
+};
+
+static std::atomic<int> g_Failures(0);
+
+static void Check(bool ok, const char *test, const char *what)
+{
+	if (ok)
+		return;
+
+	fprintf(stderr, "%s: %s\n", test, what);
+	g_Failures++;
+}
+
+// Fails the run if Kick() is not called within timeout of the last one
+class Watchdog
+{
+public:
+	Watchdog(double timeout) : timeout(timeout), stage(""), quit(false), kicked(false)
+	{
+		thread = std::thread(&Watchdog::Run, this);
+	}
+
+	~Watchdog()
+	{
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			quit = true;
+		}
+
+		wake.notify_one();
+		thread.join();
+	}
+
+	void Kick(const char *inStage)
+	{
+		{
+			std::lock_guard<std::mutex> guard(lock);
+			stage = inStage;
+			kicked = true;
+		}
+
+		wake.notify_one();
+	}
+
+protected:
+	void Run()
+	{
+		std::unique_lock<std::mutex> guard(lock);
+
+		while (!quit)
+		{
+			kicked = false;
+
+			if (!wake.wait_for(guard, std::chrono::duration<double>(timeout), [this] { return quit || kicked; }))
+			{
+				fprintf(stderr, "watchdog: %s still running after %.0f seconds\n", stage, timeout);
+				fflush(stderr);
+				_Exit(2);
+			}
+		}
+	}
+
+	double timeout;
+	const char *stage;
+	bool quit;
+	bool kicked;
+
+	std::mutex lock;
+	std::condition_variable wake;
+	std::thread thread;
+};
+
+// ParallelFor bodies that run ParallelFor loops of their own, two deep
+static void NestedLoops(TaskScheduler &scheduler)
+{
+	const int outer = 37, middle = 23, inner = 1000;
+	std::atomic<int64_t> sum(0);
+
+	bool finished = scheduler.ParallelFor(0, outer, 1, [&](int begin, int end)
+	{
+		for (int i = begin; i < end; i++)
+		{
+			scheduler.ParallelFor(0, middle, 3, [&](int begin, int end)
+			{
+				for (int j = begin; j < end; j++)
+				{
+					scheduler.ParallelFor(0, inner, 64, [&](int begin, int end)
+					{
+						int64_t local = 0;
+
+						for (int k = begin; k < end; k++)
+							local += k;
+
+						sum += local;
+					});
+				}
+			});
+		}
+	});
+
+	Check(finished, "nested", "loop reported cancelled");
+	Check(sum == int64_t(outer) * middle * (int64_t(inner) * (inner - 1) / 2), "nested", "wrong sum");
+
+	// boxes cover the range exactly once
+	TaskBox range = { 3, -5, 0, 131, 60, 4 };
+	std::vector<std::atomic<int>> hits(size_t(128 * 65 * 4));
+	for (auto &hit : hits)
+		hit = 0;
+
+	scheduler.ParallelFor(range, 17, 9, 3, [&](const TaskBox &box)
+	{
+		for (int z = box.z0; z < box.z1; z++)
+			for (int y = box.y0; y < box.y1; y++)
+				for (int x = box.x0; x < box.x1; x++)
+					hits[size_t(((z * 65) + (y + 5)) * 128 + (x - 3))]++;
+	});
+
+	bool once = true;
+	for (auto &hit : hits)
+		once = once && hit == 1;
+
+	Check(once, "nested", "boxes do not cover the range once");
+}
+
+// Chains where each task must see the one before it finished, and diamonds
+// whose join must see both sides
+static void Dependencies(TaskScheduler &scheduler)
+{
+	const int length = 500;
+	std::vector<int> order(length, -1);
+	std::atomic<int> position(0);
+	TaskScheduler::Handle previous;
+
+	for (int i = 0; i < length; i++)
+	{
+		std::vector<TaskScheduler::Handle> after;
+		after.push_back(previous);
+
+		previous = scheduler.Submit([&, i]() { order[size_t(i)] = position++; }, after);
+	}
+
+	scheduler.Wait(previous);
+
+	bool inOrder = true;
+	for (int i = 0; i < length; i++)
+		inOrder = inOrder && order[size_t(i)] == i;
+
+	Check(inOrder, "chain", "tasks ran out of order");
+
+	const int diamonds = 200;
+	std::vector<TaskScheduler::Handle> joins;
+	std::vector<int> left(diamonds, 0), right(diamonds, 0), joined(diamonds, 0);
+
+	for (int i = 0; i < diamonds; i++)
+	{
+		TaskScheduler::Handle top = scheduler.Submit([]() {});
+		TaskScheduler::Handle a = scheduler.Submit([&, i]() { left[size_t(i)] = i + 1; }, { top });
+		TaskScheduler::Handle b = scheduler.Submit([&, i]() { right[size_t(i)] = i + 2; }, { top, TaskScheduler::Handle() });
+
+		joins.push_back(scheduler.Submit([&, i]() { joined[size_t(i)] = left[size_t(i)] + right[size_t(i)]; }, { a, b }));
+	}
+
+	// a wide join on every diamond at once
+	std::atomic<bool> all(false);
+	TaskScheduler::Handle last = scheduler.Submit([&]() { all = true; }, joins);
+	scheduler.Wait(last);
+
+	bool sums = all;
+	for (int i = 0; i < diamonds; i++)
+		sums = sums && joined[size_t(i)] == 2 * i + 3;
+
+	Check(sums, "diamond", "join ran before both sides");
+}
+
+// Cancelled before starting nothing runs, cancelled part way the loop stops
+// early, and dependents of skipped tasks still run
+static void Cancellation(TaskScheduler &scheduler)
+{
+	{
+		TaskCancel cancel;
+		cancel.Cancel();
+
+		std::atomic<int> ran(0);
+		bool finished = scheduler.ParallelFor(0, 10000, 10, [&](int, int) { ran++; }, &cancel);
+
+		Check(!finished && ran == 0, "cancel before", "loop ran");
+
+		TaskScheduler::Handle skipped = scheduler.Submit([&]() { ran++; }, std::vector<TaskScheduler::Handle>(), &cancel);
+		TaskScheduler::Handle dependent = scheduler.Submit([&]() { ran += 100; }, { skipped });
+		scheduler.Wait(dependent);
+
+		Check(ran == 100 && scheduler.Done(skipped), "cancel before", "skipped task ran or held up its dependent");
+	}
+
+	{
+		TaskCancel cancel;
+		const int pieces = 100000;
+		std::atomic<int> ran(0);
+
+		bool finished = scheduler.ParallelFor(0, pieces, 1, [&](int, int)
+		{
+			if (++ran == 1000)
+				cancel.Cancel();
+		}, &cancel);
+
+		// pieces already handed out finish, at most one per thread past the cancel
+		Check(!finished, "cancel during", "loop reported finished");
+		Check(ran >= 1000 && ran < 1000 + int(scheduler.Threads()) + 1, "cancel during", "loop kept going after the cancel");
+	}
+
+	{
+		// tasks queued behind a busy pool are cancelled before any of them starts
+		TaskCancel cancel;
+		std::atomic<bool> release(false);
+		std::atomic<int> ran(0);
+		std::vector<TaskScheduler::Handle> blockers, tasks;
+
+		for (unsigned int i = 0; i < scheduler.Threads(); i++)
+			blockers.push_back(scheduler.Submit([&]() { while (!release) std::this_thread::yield(); }));
+
+		for (int i = 0; i < 1000; i++)
+			tasks.push_back(scheduler.Submit([&]() { ran++; }, blockers, &cancel));
+
+		cancel.Cancel();
+		release = true;
+
+		for (auto &task : tasks)
+			scheduler.Wait(task);
+
+		Check(ran == 0, "cancel queued", "cancelled tasks ran");
+	}
+}
+
+// Outside threads submitting trees of tasks and waiting on them all at once
+static void Outsiders(TaskScheduler &scheduler, int outsiders)
+{
+	std::vector<std::thread> threads;
+	std::atomic<int> wrong(0);
+
+	for (int t = 0; t < outsiders; t++)
+	{
+		threads.push_back(std::thread([&, t]()
+		{
+			for (int repeat = 0; repeat < 20; repeat++)
+			{
+				std::atomic<int> count(0);
+				std::vector<TaskScheduler::Handle> leaves;
+
+				for (int i = 0; i < 50; i++)
+				{
+					leaves.push_back(scheduler.Submit([&]()
+					{
+						scheduler.ParallelFor(0, 64, 4, [&](int begin, int end) { count += end - begin; });
+					}));
+				}
+
+				TaskScheduler::Handle root = scheduler.Submit([&]() { count += 1000000; }, leaves);
+
+				// half wait on the root alone, half on each leaf first
+				if (t & 1)
+				{
+					for (auto &leaf : leaves)
+						scheduler.Wait(leaf);
+				}
+
+				scheduler.Wait(root);
+
+				if (count != 50 * 64 + 1000000)
+					wrong++;
+			}
+		}));
+	}
+
+	for (auto &thread : threads)
+		thread.join();
+
+	Check(wrong == 0, "outsiders", "wrong count");
+}
+
+// Frames come back in order, each the one decoded for its position, across
+// random seeks and a reader destroyed with decodes in flight
+static void Sequence()
+{
+	const int fileCount = 17;
+	std::vector<std::string> files;
+
+	for (int i = 0; i < fileCount; i++)
+		files.push_back(std::to_string(i));
+
+	SequenceReader::Decoder decode = [](const std::string &file, SequenceFrame &frame)
+	{
+		frame.width = 1;
+		frame.height = 1;
+		frame.rgba.assign(1, uint16_t(atoi(file.c_str())));
+
+		// some decodes are slow, some fail
+		if (frame.position % 5 == 0)
+			std::this_thread::sleep_for(std::chrono::microseconds(200));
+
+		return frame.position % 11 != 7;
+	};
+
+	srand(1);
+
+	for (int reader = 0; reader < 10; reader++)
+	{
+		SequenceReader sequence(files, decode, 6, reader % 3);
+		int64_t position = 0, last = -1;
+
+		for (int step = 0; step < 400; step++)
+		{
+			if (rand() % 50 == 0)
+			{
+				position = rand() % 1000;
+				last = position - 1;
+				sequence.Seek(position);
+			}
+
+			SequenceFrame frame;
+
+			if (sequence.Latest(position, frame))
+			{
+				Check(frame.position <= position && frame.position > last, "sequence", "frame out of order");
+				Check(frame.rgba.size() == 1 && frame.rgba[0] == frame.position % fileCount, "sequence", "frame from the wrong file");
+				last = frame.position;
+			}
+
+			if (rand() % 3 == 0)
+				position++;
+
+			std::this_thread::yield();
+		}
+	}
+}
+
+static void Usage()
+{
+	fprintf(stderr, "schedulerStress [-rounds n] [-threads n] [-outsiders n] [-timeout seconds]\n");
+}
+
+int main(int argc, char **argv)
+{
+	StressSettings settings;
+
+	for (int i = 1; i < argc; i++)
+	{
+		if (!strcmp(argv[i], "-rounds") && i + 1 < argc)
+			settings.rounds = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-threads") && i + 1 < argc)
+			settings.threads = unsigned(atoi(argv[++i]));
+		else if (!strcmp(argv[i], "-outsiders") && i + 1 < argc)
+			settings.outsiders = atoi(argv[++i]);
+		else if (!strcmp(argv[i], "-timeout") && i + 1 < argc)
+			settings.timeout = atof(argv[++i]);
+		else
+		{
+			Usage();
+			return 1;
+		}
+	}
+
+	Watchdog watchdog(settings.timeout);
+
+	for (int round = 0; round < settings.rounds && g_Failures == 0; round++)
+	{
+		// a new scheduler each round also covers startup and shutdown
+		TaskScheduler scheduler(settings.threads);
+
+		watchdog.Kick("nested");
+		NestedLoops(scheduler);
+
+		watchdog.Kick("dependencies");
+		Dependencies(scheduler);
+
+		watchdog.Kick("cancellation");
+		Cancellation(scheduler);
+
+		watchdog.Kick("outsiders");
+		Outsiders(scheduler, settings.outsiders);
+
+		watchdog.Kick("sequence");
+		Sequence();
+
+		watchdog.Kick("shutdown");
+	}
+
+	if (g_Failures)
+	{
+		fprintf(stderr, "%d failures\n", int(g_Failures));
+		return 1;
+	}
+
+	printf("%d rounds on %u threads passed\n", settings.rounds, TaskScheduler(settings.threads).Threads());
+	return 0;
+}
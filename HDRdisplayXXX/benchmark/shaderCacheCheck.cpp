@@ -0,0 +1,346 @@
+// Checks the shader bytecode cache with a stub compiler
+//
+// ShaderCache reaches the compiler and the file system through ShaderBackend,
+// so it runs here over an in memory backend whose "compiler" pastes the
+// source and its #include files together. The checks: a request misses and
+// then hits, also from a new cache on the same directory; changing the
+// source, an include, the entry, the defines or where the file resolves to
+// misses; and an entry that is truncated, has bytes added, a wrong magic or
+// another request's key is rejected and compiled again rather than used.
+// Exits 0 on success, 1 on a failed check.
+//
+// Needs nothing but the portable sources, on Linux:
+//   g++ -O2 -std=c++14 -I../HDRDisplay -o shaderCacheCheck shaderCacheCheck.cpp
+//       ../HDRDisplay/shaderCache.cpp -pthread
+//   ./shaderCacheCheck [cache directory, shaderCacheCheck.cache by default]
+
+#include "shaderCache.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+static int g_Failures = 0;
+
+static void Check(bool ok, const char *test, const char *what)
+{
+	if (ok)
+		return;
+
+	fprintf(stderr, "%s: %s\n", test, what);
+	g_Failures++;
+}
+
+// Files in memory under "search path/name", #include "name" lines pasted in
+// from the same search path
+class StubBackend : public ShaderBackend
+{
+public:
+	StubBackend() : searchPath("shaders/"), compiles(0) {}
+
+	std::string Resolve(const std::string &file) override
+	{
+		return searchPath + file;
+	}
+
+	bool ReadFile(const std::string &path, std::vector<char> &contents) override
+	{
+		auto it = files.find(path);
+
+		if (it == files.end())
+			return false;
+
+		contents.assign(it->second.begin(), it->second.end());
+		return true;
+	}
+
+	bool Compile(const ShaderRequest &request, const std::string &path, const std::vector<char> &source,
+		std::vector<char> &bytecode, std::vector<std::string> &includes, std::string &errors) override
+	{
+		compiles++;
+
+		std::string text(source.begin(), source.end());
+		std::string output = request.entry + "|" + request.profile + "|";
+
+		for (auto &define : request.defines)
+			output += define.first + "=" + define.second + "|";
+
+		size_t start = 0;
+
+		while (start < text.size())
+		{
+			size_t end = text.find('\n', start);
+			std::string line = text.substr(start, end == std::string::npos ? std::string::npos : end - start);
+			start = end == std::string::npos ? text.size() : end + 1;
+
+			if (line.compare(0, 10, "#include \"") != 0)
+			{
+				output += line + "\n";
+				continue;
+			}
+
+			// relative to the including file, as the viewer's include handler does
+			std::string include = path.substr(0, path.rfind('/') + 1) + line.substr(10, line.size() - 11);
+			std::vector<char> contents;
+
+			if (!ReadFile(include, contents))
+			{
+				errors = include + ": file not found";
+				return false;
+			}
+
+			includes.push_back(include);
+			output.append(contents.begin(), contents.end());
+		}
+
+		bytecode.assign(output.begin(), output.end());
+		return true;
+	}
+
+	std::string searchPath;
+	std::map<std::string, std::string> files;
+	int compiles;
+};
+
+static std::string g_Directory = "shaderCacheCheck.cache";
+
+// a define unique to this run, so entries left by one that did not finish are never hit
+static std::string g_Run;
+
+static ShaderRequest Request()
+{
+	ShaderRequest request;
+	request.file = "tonemap.hlsl";
+	request.entry = "main";
+	request.profile = "ps_5_0";
+	request.defines.push_back(std::make_pair(std::string("CHECK_RUN"), g_Run));
+
+	return request;
+}
+
+// every entry a check may have written, removed at the end
+static std::set<uint64_t> g_Keys;
+
+static std::string EntryPath(uint64_t key)
+{
+	char name[32];
+	snprintf(name, sizeof(name), "%016llx.bin", (unsigned long long)key);
+
+	return g_Directory + "/" + name;
+}
+
+static uint64_t KeyOf(const ShaderCache &cache, StubBackend &backend, const ShaderRequest &request)
+{
+	std::string path = backend.Resolve(request.file);
+	std::vector<char> source;
+	backend.ReadFile(path, source);
+
+	uint64_t key = cache.Key(request, path, source);
+	g_Keys.insert(key);
+	return key;
+}
+
+static bool ReadBytes(const std::string &path, std::vector<char> &data)
+{
+	FILE *fp = fopen(path.c_str(), "rb");
+
+	if (!fp)
+		return false;
+
+	fseek(fp, 0, SEEK_END);
+	data.resize(size_t(ftell(fp)));
+	fseek(fp, 0, SEEK_SET);
+
+	bool ok = fread(data.data(), 1, data.size(), fp) == data.size();
+	fclose(fp);
+	return ok;
+}
+
+static bool WriteBytes(const std::string &path, const std::vector<char> &data)
+{
+	FILE *fp = fopen(path.c_str(), "wb");
+
+	if (!fp)
+		return false;
+
+	bool ok = data.empty() || fwrite(data.data(), 1, data.size(), fp) == data.size();
+	return fclose(fp) == 0 && ok;
+}
+
+// Compiles request and checks whether it hit and what came back
+static void Expect(ShaderCache &cache, StubBackend &backend, const ShaderRequest &request, bool hit, const char *test, const char *what)
+{
+	const unsigned int hits = cache.Hits();
+	const int compiles = backend.compiles;
+
+	std::vector<char> bytecode, fresh;
+	std::vector<std::string> files, includes;
+	std::string errors;
+
+	KeyOf(cache, backend, request);
+
+	bool ok = cache.Compile(request, bytecode, errors, &files);
+
+	// what compiling it now gives, without the cache
+	std::string path = backend.Resolve(request.file);
+	std::vector<char> source;
+	backend.ReadFile(path, source);
+	backend.Compile(request, path, source, fresh, includes, errors);
+	backend.compiles--;
+
+	includes.insert(includes.begin(), path);
+
+	Check(ok, test, "compile failed");
+	Check((cache.Hits() == hits + 1) == hit && (backend.compiles == compiles) == hit, test, what);
+	Check(bytecode == fresh, test, "bytecode differs from a fresh compile");
+	Check(files == includes, test, "wrong source and include list");
+}
+
+static void Basic(StubBackend &backend)
+{
+	ShaderRequest request = Request();
+
+	{
+		ShaderCache cache(&backend, g_Directory);
+
+		Expect(cache, backend, request, false, "miss", "first compile hit");
+		Expect(cache, backend, request, true, "hit", "second compile missed");
+	}
+
+	// a new process finds the entry the last one stored
+	ShaderCache cache(&backend, g_Directory);
+	Expect(cache, backend, request, true, "reopen", "stored entry missed");
+
+	backend.files["shaders/common.hlsl"] = "float3 Common() { return 2; }\n";
+	Expect(cache, backend, request, false, "include", "changed include hit");
+	Expect(cache, backend, request, true, "include", "entry for the new include missed");
+
+	backend.files["shaders/common.hlsl"] = "float3 Common() { return 1; }\n";
+	Expect(cache, backend, request, false, "include back", "include changed back hit an entry for other contents");
+
+	backend.files.erase("shaders/common.hlsl");
+	{
+		std::vector<char> bytecode;
+		std::string errors;
+		Check(!cache.Compile(request, bytecode, errors), "include gone", "compiled without its include");
+	}
+	backend.files["shaders/common.hlsl"] = "float3 Common() { return 1; }\n";
+
+	backend.files["shaders/tonemap.hlsl"] += "// edited\n";
+	Expect(cache, backend, request, false, "source", "changed source hit");
+
+	ShaderRequest other = request;
+	other.entry = "mainLinear";
+	Expect(cache, backend, other, false, "entry", "other entry point hit");
+
+	other = request;
+	other.defines.push_back(std::make_pair(std::string("FUSED"), std::string("1")));
+	Expect(cache, backend, other, false, "defines", "other defines hit");
+	Expect(cache, backend, other, true, "defines", "same defines missed");
+
+	other.flags = 1;
+	Expect(cache, backend, other, false, "flags", "other flags hit");
+
+	// the same text found in another directory includes that directory's files
+	backend.files["override/tonemap.hlsl"] = backend.files["shaders/tonemap.hlsl"];
+	backend.files["override/common.hlsl"] = "float3 Common() { return 3; }\n";
+	backend.searchPath = "override/";
+	Expect(cache, backend, request, false, "path", "same source at another path hit");
+	backend.searchPath = "shaders/";
+	Expect(cache, backend, request, true, "path", "original path missed");
+}
+
+// Damaged entries are compiled again and replaced, never used
+static void Damaged(StubBackend &backend)
+{
+	ShaderRequest request = Request();
+
+	ShaderCache cache(&backend, g_Directory);
+	Expect(cache, backend, request, true, "damaged", "entry to damage missed");
+
+	const std::string path = EntryPath(KeyOf(cache, backend, request));
+	std::vector<char> good;
+	Check(ReadBytes(path, good), "damaged", "entry not on disk");
+
+	// every shorter length, from nothing to one byte of bytecode missing
+	int accepted = 0;
+	for (size_t length = 0; length < good.size(); length++)
+	{
+		WriteBytes(path, std::vector<char>(good.begin(), good.begin() + length));
+
+		const unsigned int hits = cache.Hits();
+		std::vector<char> bytecode;
+		std::string errors;
+
+		cache.Compile(request, bytecode, errors);
+		accepted += cache.Hits() != hits;
+	}
+
+	Check(accepted == 0, "truncated", "truncated entry used");
+
+	std::vector<char> longer = good;
+	longer.push_back('x');
+	WriteBytes(path, longer);
+	Expect(cache, backend, request, false, "appended", "entry with bytes added used");
+
+	std::vector<char> magic = good;
+	magic[0] = 'X';
+	WriteBytes(path, magic);
+	Expect(cache, backend, request, false, "magic", "entry with a wrong magic used");
+
+	// another request's entry under this request's name, one Basic did not store
+	ShaderRequest other = request;
+	other.entry = "mainOther";
+	Expect(cache, backend, other, false, "wrong key", "setup compile hit");
+
+	std::vector<char> otherEntry;
+	ReadBytes(EntryPath(KeyOf(cache, backend, other)), otherEntry);
+	WriteBytes(path, otherEntry);
+	Expect(cache, backend, request, false, "wrong key", "entry stored for another key used");
+
+	// and each miss stored a good entry again
+	Expect(cache, backend, request, true, "restored", "entry not replaced after a rejection");
+}
+
+static void RemoveEntries()
+{
+	for (uint64_t key : g_Keys)
+		remove(EntryPath(key).c_str());
+}
+
+int main(int argc, char **argv)
+{
+	if (argc > 2)
+	{
+		fprintf(stderr, "shaderCacheCheck [cache directory]\n");
+		return 1;
+	}
+
+	if (argc == 2)
+		g_Directory = argv[1];
+
+	g_Run = std::to_string((long long)time(nullptr));
+
+	StubBackend backend;
+	backend.files["shaders/tonemap.hlsl"] = "#include \"common.hlsl\"\nfloat4 main() : SV_Target { return float4(Common(), 1); }\n";
+	backend.files["shaders/common.hlsl"] = "float3 Common() { return 1; }\n";
+
+	Basic(backend);
+	Damaged(backend);
+
+	RemoveEntries();
+
+	if (g_Failures)
+	{
+		fprintf(stderr, "%d failures\n", g_Failures);
+		return 1;
+	}
+
+	printf("shader cache checks passed\n");
+	return 0;
+}
@@ -0,0 +1,326 @@
+// Checks tile selection and the tile cache without a GPU
+//
+// VisibleTiles() is run over stores too large for a texture (only their
+// layout, nothing is written) for zooms -3 to 3, filtered and unfiltered,
+// with and without matching the aspect, at many pans. Each screen column and
+// row is mapped to the image the way xform_input.hlsl does, and every texel
+// a visible pixel reads, with its bilinear neighbours when filtered, has to
+// be in a tile of the set. The level has to be the finest with at most one
+// texel per pixel, the set inside TilesX/TilesY of that level and no larger
+// than MaxVisibleTiles allows, empty when panned off the image and the whole
+// level across the letterboxed direction. TileCache is then run over frames
+// of sliding windows of tiles, some larger than its capacity, checking after
+// every insert that no tile used in the frame was evicted and that the least
+// recently used goes first. Exits 0 on success, 1 on a failed check.
+//
+// Needs nothing but the portable sources, on Linux:
+//   g++ -O2 -std=c++14 -I../HDRDisplay -o tileCacheCheck tileCacheCheck.cpp
+//       ../HDRDisplay/tileCache.cpp ../HDRDisplay/tileStore.cpp -pthread
+//   ./tileCacheCheck
+
+#include "tileCache.h"
+
+#include <math.h>
+#include <stdio.h>
+
+#include <algorithm>
+#include <vector>
+
+static int g_Failures = 0;
+
+static void Check(bool ok, const char *test, const char *what)
+{
+	if (ok)
+		return;
+
+	fprintf(stderr, "%s: %s\n", test, what);
+	g_Failures++;
+}
+
+static void Describe(const char *test, const TileView &view, const TileStoreInfo &info, const VisibleSet &set)
+{
+	fprintf(stderr, "%s: %dx%d on %dx%d zoom %d filter %d aspect %d pan %g,%g -> level %d [%d,%d)x[%d,%d)\n",
+		test, info.width, info.height, view.outWidth, view.outHeight, view.zoom, int(view.filter), int(view.matchAspect),
+		view.pan[0], view.pan[1], set.level, set.x0, set.x1, set.y0, set.y1);
+}
+
+// Small deterministic generator, the same views on every platform
+static unsigned int g_Seed = 12345;
+
+static float Random(float low, float high)
+{
+	g_Seed = g_Seed * 1664525u + 1013904223u;
+	return low + (high - low) * float(g_Seed >> 8) / float(1 << 24);
+}
+
+// Texels per screen pixel of the filtered path, with the uv scale per axis
+static float TexelsPerPixel(const TileView &view, const TileStoreInfo &info, float uvScale[2])
+{
+	const float aspectIn = float(info.width) / float(info.height);
+	const float aspectOut = float(view.outWidth) / float(view.outHeight);
+
+	uvScale[0] = powf(2.0f, float(-view.zoom));
+	uvScale[1] = uvScale[0];
+
+	if (view.matchAspect)
+	{
+		uvScale[0] *= aspectIn < aspectOut ? aspectOut / aspectIn : 1.0f;
+		uvScale[1] *= aspectIn > aspectOut ? aspectIn / aspectOut : 1.0f;
+	}
+
+	return (std::max)(uvScale[0] * info.width / view.outWidth, uvScale[1] * info.height / view.outHeight);
+}
+
+static int ExpectedLevel(const TileView &view, const TileStoreInfo &info)
+{
+	if (!view.filter)
+		return (std::min)((std::max)(-view.zoom, 0), info.levels - 1);
+
+	float uvScale[2];
+	const float texelsPerPixel = TexelsPerPixel(view, info, uvScale);
+
+	// the same allowance as VisibleTiles for a hair over a power of two
+	int level = 0;
+	while (level < info.levels - 1 && texelsPerPixel > ldexpf(1.001f, level))
+		level++;
+
+	return level;
+}
+
+// The level texels pixel p of an axis reads, false if it shows no image.
+// Filtered reads are the bilinear pair, taken as the texel under the pixel
+// and both neighbours.
+static bool PixelTexels(const TileView &view, const TileStoreInfo &info, int level, int axis, int p, int &first, int &last)
+{
+	const int in = axis ? info.height : info.width;
+	const int out = axis ? view.outHeight : view.outWidth;
+	const int levelSize = axis ? info.LevelHeight(level) : info.LevelWidth(level);
+
+	// level texels are 2^level image texels, as tiledImageSource.h maps them
+	if (view.filter)
+	{
+		float uvScale[2];
+		TexelsPerPixel(view, info, uvScale);
+
+		const float uv = ((float(p) + 0.5f) / float(out) - 0.5f) * uvScale[axis] + 0.5f + view.pan[axis];
+
+		if (uv < 0.0f || uv > 1.0f)
+			return false;
+
+		const int texel = (std::min)(int(floorf(uv * ldexpf(float(in), -level))), levelSize - 1);
+		first = (std::max)(texel - 1, 0);
+		last = (std::min)(texel + 1, levelSize - 1);
+		return true;
+	}
+
+	// integer conversions truncate, as in the shader
+	const float zoomScale = powf(2.0f, float(-view.zoom));
+	const int offset = int((float(in) / zoomScale - float(out)) / 2.0f);
+	const int uv = int((float(p) + 0.5f + float(offset)) * zoomScale + view.pan[axis] * float(in));
+
+	if (uv < 0 || uv >= in)
+		return false;
+
+	first = last = uv >> level;
+	return true;
+}
+
+// Every texel a visible pixel reads is in the set, one axis at a time
+static bool Covered(const TileView &view, const TileStoreInfo &info, const VisibleSet &set, int axis, bool &anyVisible)
+{
+	const int out = axis ? view.outHeight : view.outWidth;
+	const int t0 = (axis ? set.y0 : set.x0) * VirtualTileSize;
+	const int t1 = (axis ? set.y1 : set.x1) * VirtualTileSize;
+
+	anyVisible = false;
+
+	for (int p = 0; p < out; p++)
+	{
+		int first, last;
+
+		if (!PixelTexels(view, info, set.level, axis, p, first, last))
+			continue;
+
+		anyVisible = true;
+
+		if (first < t0 || last >= t1)
+			return false;
+	}
+
+	return true;
+}
+
+static void CheckView(const char *test, const TileView &view, const TileStoreInfo &info)
+{
+	const VisibleSet set = VisibleTiles(view, info);
+	const int failures = g_Failures;
+
+	bool visibleX, visibleY;
+	const bool coveredX = Covered(view, info, set, 0, visibleX);
+	const bool coveredY = Covered(view, info, set, 1, visibleY);
+
+	if (!visibleX || !visibleY)
+		Check(set.Count() == 0, test, "tiles for a view with no image in it");
+	else
+	{
+		Check(set.level == ExpectedLevel(view, info), test, "not the finest level with a texel a pixel or less");
+		Check(coveredX && coveredY, test, "a texel in view is outside the set");
+		Check(set.x0 >= 0 && set.x0 < set.x1 && set.x1 <= info.TilesX(set.level), test, "columns outside the level");
+		Check(set.y0 >= 0 && set.y0 < set.y1 && set.y1 <= info.TilesY(set.level), test, "rows outside the level");
+		Check(set.x1 - set.x0 <= MaxVisibleTiles(view.outWidth) && set.y1 - set.y0 <= MaxVisibleTiles(view.outHeight),
+			test, "more tiles than MaxVisibleTiles");
+	}
+
+	if (g_Failures != failures)
+		Describe(test, view, info, set);
+}
+
+static void Selection()
+{
+	// wide, tall and small enough for a handful of tiles
+	const TileStoreInfo images[] = { TileStoreLayout(100000, 50000), TileStoreLayout(3000, 40000), TileStoreLayout(1001, 777) };
+	const int screens[][2] = { { 1920, 1080 }, { 1080, 1920 }, { 3840, 2160 } };
+
+	int views = 0;
+
+	for (const TileStoreInfo &info : images)
+	{
+		for (auto &screen : screens)
+		{
+			for (int zoom = -3; zoom <= 3; zoom++)
+			{
+				for (int mode = 0; mode < 3; mode++)
+				{
+					TileView view = { screen[0], screen[1], zoom, mode != 0, mode == 2, { 0.0f, 0.0f } };
+					CheckView("centred", view, info);
+					views++;
+
+					// pans up to a view's width off the image either way
+					for (int i = 0; i < 40; i++)
+					{
+						view.pan[0] = Random(-1.2f, 1.2f);
+						view.pan[1] = Random(-1.2f, 1.2f);
+						CheckView("panned", view, info);
+						views++;
+					}
+
+					// further off than the widest view reaches
+					view.pan[0] = 1000.0f;
+					view.pan[1] = 0.0f;
+					CheckView("off image", view, info);
+				}
+			}
+		}
+	}
+
+	// a 5:1 image fitted to 16:9 shows all of its height with bars above and
+	// below, the tall one all of its width with bars either side
+	const TileStoreInfo wide = TileStoreLayout(100000, 20000);
+	TileView view = { 1920, 1080, 0, true, true, { 0.0f, 0.0f } };
+	VisibleSet set = VisibleTiles(view, wide);
+	Check(set.x0 == 0 && set.x1 == wide.TilesX(set.level) && set.y0 == 0 && set.y1 == wide.TilesY(set.level),
+		"letterbox", "fitted wide image not whole");
+
+	const TileStoreInfo tall = images[1];
+	set = VisibleTiles(view, tall);
+	Check(set.x0 == 0 && set.x1 == tall.TilesX(set.level) && set.y0 == 0 && set.y1 == tall.TilesY(set.level),
+		"pillarbox", "fitted tall image not whole");
+
+	printf("%d views\n", views);
+}
+
+static std::vector<uint16_t> Tile()
+{
+	return std::vector<uint16_t>(4);
+}
+
+static void Eviction()
+{
+	// least recently used first: a tile found again outlives one inserted after it
+	{
+		TileCache cache(3);
+		TileKey a = { 0, 0, 0 }, b = { 0, 1, 0 }, c = { 0, 2, 0 }, d = { 0, 3, 0 };
+
+		cache.BeginFrame();
+		cache.Insert(a, Tile());
+		cache.BeginFrame();
+		cache.Insert(b, Tile());
+		cache.BeginFrame();
+		cache.Insert(c, Tile());
+		cache.BeginFrame();
+		Check(cache.Find(a) != nullptr, "order", "tile missing before the cache was full");
+		cache.Insert(d, Tile());
+
+		Check(cache.Size() == 3 && cache.Stats().evictions == 1, "order", "not one tile evicted");
+		Check(cache.Find(b) == nullptr, "order", "least recently used tile kept");
+		Check(cache.Find(a) && cache.Find(c) && cache.Find(d), "order", "recently used tile evicted");
+	}
+
+	// windows sliding over a grid, now and then larger than the capacity
+	const size_t capacity = 48;
+	TileCache cache(capacity);
+
+	int frames = 0;
+	int x = 0, y = 0;
+
+	for (int frame = 0; frame < 2000; frame++, frames++)
+	{
+		const int width = frame % 50 == 0 ? 10 : 6;
+		const int height = frame % 50 == 0 ? 9 : 5;
+
+		x = (std::max)(0, (std::min)(x + int(Random(-3.0f, 4.0f)), 60));
+		y = (std::max)(0, (std::min)(y + int(Random(-3.0f, 4.0f)), 60));
+
+		VisibleSet set = { frame % 3, x, y, x + width, y + height };
+		std::vector<TileKey> keys;
+		VisibleKeys(set, keys);
+
+		cache.BeginFrame();
+
+		std::vector<TileKey> used;
+		bool inserted = false;
+
+		for (const TileKey &key : keys)
+		{
+			if (!cache.Find(key))
+			{
+				cache.Insert(key, Tile());
+				inserted = true;
+			}
+
+			used.push_back(key);
+
+			// finding again marks nothing new, these are all in use this frame
+			for (const TileKey &earlier : used)
+			{
+				if (!cache.Find(earlier))
+				{
+					Check(false, "frame", "tile used this frame evicted");
+					fprintf(stderr, "frame %d: tile %d %d,%d\n", frame, earlier.level, earlier.x, earlier.y);
+					return;
+				}
+			}
+		}
+
+		if (inserted)
+			Check(cache.Size() <= (std::max)(capacity, keys.size()), "frame", "cache above capacity with tiles to spare");
+	}
+
+	Check(cache.Stats().evictions > 0, "frame", "nothing was evicted, the check proves nothing");
+	printf("%d frames, %zu evictions\n", frames, cache.Stats().evictions);
+}
+
+int main()
+{
+	Selection();
+	Eviction();
+
+	if (g_Failures)
+	{
+		fprintf(stderr, "%d failures\n", g_Failures);
+		return 1;
+	}
+
+	printf("tile checks passed\n");
+	return 0;
+}
@@ -0,0 +1,91 @@
+// Fuzz target for the in memory RGBE reader
+//
+// Reads the header with RGBEReader and decodes the image with DecodeRGBE into
+// a packed target, half float for inputs of odd length and float otherwise.
+// Row order images go in two bands, so a decode picking up where the last
+// one stopped is covered as well. The sanitizers catch reads past the input
+// or writes past the target, anything ReadHeader accepts has to decode
+// without either. corpus/ holds the seeds: the header and first scanlines of
+// some of the sample images, small images in each of the eight scanline
+// orientations, RLE and flat, a header with EXPOSURE, GAMMA and PRIMARIES,
+// one with a FORMAT other than RGBE and one with no FORMAT line.
+//
+// With clang and libFuzzer, on Linux:
+//   clang++ -g -O1 -std=c++14 -fsanitize=fuzzer,address,undefined -I../HDRDisplay -o rgbeFuzz rgbeFuzz.cpp
+//       ../HDRDisplay/rgbeReader.cpp ../HDRDisplay/decodeTarget.cpp ../HDRDisplay/ACES.cpp
+//       ../HDRDisplay/rgbe.cpp ../HDRDisplay/taskScheduler.cpp -pthread
+//   mkdir -p findings && ./rgbeFuzz -max_len=65536 findings corpus
+// Without libFuzzer, -DRGBE_FUZZ_MAIN and -fsanitize=address,undefined build
+// a program that runs the target once on each file it is given.
+
+#include "decodeTarget.h"
+#include "rgbeReader.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <vector>
+
+// decodes larger than this are only a slower way to find the same bugs
+static const size_t MaxPixels = 1 << 22;
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size)
+{
+	RGBEReader reader(data, size);
+	rgbe_header_info info;
+	int width = 0, height = 0;
+
+	if (!reader.ReadHeader(width, height, &info))
+		return 0;
+
+	if (width <= 0 || height <= 0 || size_t(width) * size_t(height) > MaxPixels)
+		return 0;
+
+	const DecodeFormat format = size & 1 ? DecodeRGBA16F : DecodeRGBA32F;
+	std::vector<uint8_t> pixels(size_t(width) * height * DecodeBytesPerPixel(format));
+
+	if (reader.RowOrder() && height > 1)
+	{
+		const int top = height / 2;
+		const size_t topBytes = size_t(width) * top * DecodeBytesPerPixel(format);
+
+		if (DecodeRGBE(reader, PackedTarget(pixels.data(), width, top, format)))
+			DecodeRGBE(reader, PackedTarget(pixels.data() + topBytes, width, height - top, format));
+	}
+	else
+		DecodeRGBE(reader, PackedTarget(pixels.data(), width, height, format));
+
+	return 0;
+}
+
+#ifdef RGBE_FUZZ_MAIN
+
+#include <stdio.h>
+
+int main(int argc, char **argv)
+{
+	for (int i = 1; i < argc; i++)
+	{
+		FILE *fp = fopen(argv[i], "rb");
+
+		if (!fp)
+		{
+			fprintf(stderr, "%s: unable to open\n", argv[i]);
+			return 1;
+		}
+
+		std::vector<uint8_t> data;
+		uint8_t buffer[4096];
+		size_t read;
+
+		while ((read = fread(buffer, 1, sizeof(buffer), fp)) > 0)
+			data.insert(data.end(), buffer, buffer + read);
+
+		fclose(fp);
+
+		LLVMFuzzerTestOneInput(data.data(), data.size());
+	}
+
+	return 0;
+}
+
+#endif
@@ -438,6 +438,8 @@ DeviceManager::MessageLoop()
     LARGE_INTEGER perfFreq, previousTime;
     QueryPerformanceFrequency(&perfFreq);
     QueryPerformanceCounter(&previousTime);
+
+    double presentedSeconds = 0;
     
     while (WM_QUIT != msg.message)
     {
@@ -455,12 +457,27 @@ DeviceManager::MessageLoop()
                 ? m_FixedFrameInterval  
                 : (double)(newTime.QuadPart - previousTime.QuadPart) / (double)perfFreq.QuadPart;
 
+            bool rendered = false;
+
             if(m_SwapChain && GetWindowState() != kWindowMinimized)
             {
                 Animate(elapsedSeconds);
-                Render(); 
-                m_SwapChain->Present(m_SyncInterval, 0);
-                Sleep(0);
+
+                if(!m_RenderOnChange || m_PendingFrames > 0)
+                {
+                    Render(); 
+                    m_SwapChain->Present(m_SyncInterval, 0);
+                    Sleep(0);
+
+                    if(m_PendingFrames > 0)
+                        m_PendingFrames--;
+                    rendered = true;
+                }
+                else
+                {
+                    // Nothing changed, sleep until a message arrives or a controller needs polling
+                    MsgWaitForMultipleObjects(0, NULL, FALSE, IdleTimeout(), QS_ALLINPUT);
+                }
             }
             else
             {
@@ -468,8 +485,14 @@ DeviceManager::MessageLoop()
                 Sleep(1);
             }
 
+            // average over the time between presented frames, skipped iterations are not frames
+            presentedSeconds += elapsedSeconds;
+
+            if(rendered)
             {
-                m_vFrameTimes.push_back(elapsedSeconds);
+                m_vFrameTimes.push_back(presentedSeconds);
+                presentedSeconds = 0;
+
                 double timeSum = 0;
                 for(auto it = m_vFrameTimes.begin(); it != m_vFrameTimes.end(); it++)
                     timeSum += *it;
@@ -489,6 +512,14 @@ DeviceManager::MessageLoop()
 LRESULT 
 DeviceManager::MsgProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam)
 {
+    // input can change any UI value, the rest means the window itself needs a new frame
+    if( uMsg >= WM_MOUSEFIRST && uMsg <= WM_MOUSELAST || 
+        uMsg >= WM_KEYFIRST && uMsg <= WM_KEYLAST ||
+        uMsg == WM_PAINT || uMsg == WM_SIZE || uMsg == WM_ACTIVATE || uMsg == WM_DISPLAYCHANGE )
+    {
+        Invalidate();
+    }
+
     switch(uMsg)
     {
         case WM_DESTROY:
@@ -612,6 +643,20 @@ DeviceManager::Animate(double fElapsedTimeSeconds)
     }
 }
 
+DWORD
+DeviceManager::IdleTimeout()
+{
+    DWORD timeout = INFINITE;
+
+    for(auto it = m_vControllers.begin(); it != m_vControllers.end(); it++)
+    {
+        if((*it)->IsEnabled())
+            timeout = std::min(timeout, (*it)->IdleTimeout());
+    }
+
+    return timeout;
+}
+
 void
 DeviceManager::DeviceCreated()
 {
@@ -90,6 +90,10 @@ public:
     virtual LRESULT MsgProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam) { return 1; }
     virtual void Render(ID3D11Device* pDevice, ID3D11DeviceContext* pDeviceContext, ID3D11RenderTargetView* pRTV, ID3D11DepthStencilView* pDSV) { }
     virtual void Animate(double fElapsedTimeSeconds) { }
+    // Milliseconds the idle loop may wait for a message before this controller needs an
+    // Animate pass, for work that changes the frame without one (GPU readbacks, background
+    // loads, timers). INFINITE when only messages can change anything.
+    virtual DWORD IdleTimeout() { return INFINITE; }
     virtual HRESULT DeviceCreated(ID3D11Device* pDevice) { return S_OK; }
     virtual void DeviceDestroyed() { }
     virtual void BackBufferResized(ID3D11Device* pDevice, const DXGI_SURFACE_DESC* pBackBufferSurfaceDesc) { }
@@ -133,6 +137,8 @@ protected:
     double                  m_AverageTimeUpdateInterval;
     bool                    m_InSizingModalLoop;
     SIZE                    m_NewWindowSize;
+    bool                    m_RenderOnChange;
+    int                     m_PendingFrames;
 private:
     HRESULT                 CreateRenderTargetAndDepthStencil();
     void                    ResizeSwapChain();
@@ -154,6 +160,8 @@ public:
         , m_AverageFrameTime(0)
         , m_AverageTimeUpdateInterval(0.5)
         , m_InSizingModalLoop(false)
+        , m_RenderOnChange(false)
+        , m_PendingFrames(1)
     { }
 
     virtual ~DeviceManager() 
@@ -171,6 +179,7 @@ public:
     virtual LRESULT MsgProc(HWND hWnd, UINT uMsg, WPARAM wParam, LPARAM lParam);
     virtual void    Render();
     virtual void    Animate(double fElapsedTimeSeconds);
+    virtual DWORD   IdleTimeout();
     virtual void    DeviceCreated();
     virtual void    DeviceDestroyed();
     virtual void    BackBufferResized();
@@ -182,6 +191,15 @@ public:
     void            SetFixedFrameInterval(double seconds) { m_FixedFrameInterval = seconds; }
     void            DisableFixedFrameInterval() { m_FixedFrameInterval = -1; }
 
+    // With render on change, frames are only rendered and presented after Invalidate() or
+    // a window message that can change what is on screen. Otherwise the window keeps the last frame.
+    void            SetRenderOnChange(bool enabled) { m_RenderOnChange = enabled; Invalidate(); }
+    bool            GetRenderOnChange() { return m_RenderOnChange; }
+    // Render at least this many of the coming frames
+    void            Invalidate(int frames = 1) { if(frames > m_PendingFrames) m_PendingFrames = frames; }
+    // Wakes the idle loop for an Animate pass, safe to call from any thread
+    void            Wake() { if(m_hWnd) PostMessage(m_hWnd, WM_NULL, 0, 0); }
+
 	bool			IsNvidia() const { return m_IsNvidia; }
     HWND            GetHWND() { return m_hWnd; }
     ID3D11Device*   GetDevice() { return m_Device; }
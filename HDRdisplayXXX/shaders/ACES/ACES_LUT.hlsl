@@ -47,6 +47,8 @@ struct VS_OUTPUT
 	float2 TC : TEXCOORD0;
 };
 
+#include "../fused.hlsl"
+
 ////////////////////////////////////////////////////////////////////////////////
 // Pixel Shader
 
@@ -72,7 +74,7 @@ float3 pq(float3 val)
 //Derived from rec709 ODT
 float4 main(VS_OUTPUT input) : SV_Target0
 {
-	float4 texLookup = texInput.SampleLevel(sampLinearWrap, input.TC, 0);
+	float4 texLookup = READ_INPUT(input);
 
 	float3 lutCoord = 0.0f;
 
@@ -98,7 +100,7 @@ float4 main(VS_OUTPUT input) : SV_Target0
 		outputCV = sRGB_2_Linear(outputCV);
 	}
 
-	return float4(outputCV, 1);
+	return WRITE_OUTPUT(float4(outputCV, 1), input);
 }
 
-
+#include "../tiled.hlsl"
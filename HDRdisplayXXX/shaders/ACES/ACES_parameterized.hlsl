@@ -43,6 +43,8 @@ struct VS_OUTPUT
 	float2 TC : TEXCOORD0;
 };
 
+#include "../fused.hlsl"
+
 ////////////////////////////////////////////////////////////////////////////////
 // Pixel Shader
 
@@ -153,7 +155,7 @@ static const float3 AP1_RGB2Y =
 //Derived from rec709 ODT
 float4 main(VS_OUTPUT input) : SV_Target0
 {
-	float4 texLookup = texInput.SampleLevel(sampLinearWrap, input.TC, 0);
+	float4 texLookup = READ_INPUT(input);
 
 	float3 aces = mul(XYZ_2_AP0_MAT, mul(D65_2_D60_CAT,	mul(sRGB_2_XYZ_MAT, texLookup.rgb)));
 
@@ -297,7 +299,7 @@ float4 main(VS_OUTPUT input) : SV_Target0
 		outputCV = sRGB_2_Linear(outputCV);
 	}
 
-	return float4(outputCV, 1);
+	return WRITE_OUTPUT(float4(outputCV, 1), input);
 }
 
-
+#include "../tiled.hlsl"
@@ -0,0 +1,70 @@
+// Display calibration pass
+//
+// Maps the composited signal through the 1D LUT built by CalibrationLUT, so
+// the display produces the target luminance for it. Must match
+// CalibrationLUT::Coordinate and CalibrationLUT::Apply.
+
+#include "ACES/ACES_util.hlsl"
+
+////////////////////////////////////////////////////////////////////////////////
+// Resources
+
+Texture2D texInput : register(t0);
+Texture1D<float> lut : register(t1);
+
+////////////////////////////////////////////////////////////////////////////////
+// IO Structures
+
+struct VS_OUTPUT
+{
+	float4 P  : SV_POSITION;
+	float2 TC : TEXCOORD0;
+};
+
+cbuffer cbObject : register(b0)
+{
+	uint target;		// 0 GSDF, 1 gamma, 2 PQ
+	float inputWhite;
+	uint lutSize;
+	float pad;
+};
+
+// scRGB reference white
+static const float scRGBWhite = 80.0;
+
+////////////////////////////////////////////////////////////////////////////////
+
+float Calibrate(float signal)
+{
+	float u;
+
+	if (target == 2)
+	{
+		u = pq_r(max(signal, 0.0) * scRGBWhite);
+	}
+	else
+	{
+		u = signal / inputWhite;
+	}
+
+	// interpolate by hand, the shared sampler wraps
+	float x = saturate(u) * (lutSize - 1);
+	int i = min(int(x), int(lutSize) - 2);
+	float f = x - i;
+
+	return lerp(lut.Load(int2(i, 0)), lut.Load(int2(i + 1, 0)), f);
+}
+
+////////////////////////////////////////////////////////////////////////////////
+// Pixel Shader
+
+float4 main(VS_OUTPUT input) : SV_Target0
+{
+	float3 rgb = texInput.Load(int3(input.P.xy, 0)).rgb;
+
+	rgb.r = Calibrate(rgb.r);
+	rgb.g = Calibrate(rgb.g);
+	rgb.b = Calibrate(rgb.b);
+
+	return float4(rgb, 1);
+}
@@ -0,0 +1,47 @@
+// Hooks that let a stage shader run as a fused kernel
+//
+// Compiled normally, READ_INPUT samples the intermediate the transform pass
+// wrote and WRITE_OUTPUT returns the colour untouched. With FUSED defined the
+// transform from xform_input.hlsl is evaluated in place of the texture read
+// and the composite fade is applied on the way out, so transform, tonemap and
+// a fullscreen composite run as one draw with no intermediates. The fused
+// output under the probe is also written to the probe UAV.
+//
+// Include after the shader's own texInput, sampLinearWrap and VS_OUTPUT.
+
+#ifndef FUSED_HLSL
+#define FUSED_HLSL
+
+#ifdef FUSED
+
+// transform resources, above anything a tonemapper binds
+#define XFORM_TEX_REGISTER t4
+#define XFORM_EXPOSURE_REGISTER t5
+#define XFORM_CB_REGISTER b4
+
+// leading members of the compositor constants
+cbuffer cbFused : register(b5)
+{
+	uint fusedMode;
+	uint fusedTexA;
+	uint fusedTexB;
+	float fusedFade;
+};
+
+#ifndef XFORM_INPUT_HLSL
+#define XFORM_STAGE_ONLY
+#include "xform_input.hlsl"
+#endif
+
+// FusedOutput() is in xform_input.hlsl, next to the probe it writes
+#define READ_INPUT(input) XformInput(input.P, input.TC)
+#define WRITE_OUTPUT(color, input) FusedOutput(color, input.P)
+
+#else
+
+#define READ_INPUT(input) texInput.SampleLevel(sampLinearWrap, input.TC, 0)
+#define WRITE_OUTPUT(color, input) (color)
+
+#endif
+
+#endif
@@ -43,6 +43,8 @@ struct VS_OUTPUT
 	float2 TC : TEXCOORD0;
 };
 
+#include "fused.hlsl"
+
 
 cbuffer cbObject : register(b0)
 {
@@ -64,7 +66,7 @@ static const float3x3 sRGB_2_XYZ_MAT =
 
 float4 main(VS_OUTPUT input) : SV_Target0
 {
-	float4 texLookup = texInput.SampleLevel(sampLinearWrap, input.TC, 0);
+	float4 texLookup = READ_INPUT(input);
 
 	float3 rgb = texLookup.rgb;
 
@@ -106,7 +108,7 @@ float4 main(VS_OUTPUT input) : SV_Target0
 		rgb = sRGB_2_Linear(rgb);
 	}
 
-	return float4(rgb, 1);
+	return WRITE_OUTPUT(float4(rgb, 1), input);
 }
 
-
+#include "tiled.hlsl"
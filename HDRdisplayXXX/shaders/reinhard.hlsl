@@ -43,6 +43,8 @@ struct VS_OUTPUT
 	float2 TC : TEXCOORD0;
 };
 
+#include "fused.hlsl"
+
 
 cbuffer cbObject : register(b0)
 {
@@ -56,7 +58,7 @@ cbuffer cbObject : register(b0)
 
 float4 main(VS_OUTPUT input) : SV_Target0
 {
-	float4 texLookup = texInput.SampleLevel(sampLinearWrap, input.TC, 0);
+	float4 texLookup = READ_INPUT(input);
 
 	float3 rgb = texLookup.rgb;
 
@@ -97,7 +99,7 @@ float4 main(VS_OUTPUT input) : SV_Target0
 		rgb = sRGB_2_Linear(rgb);
 	}
 
-	return float4(rgb, 1);
+	return WRITE_OUTPUT(float4(rgb, 1), input);
 }
 
-
+#include "tiled.hlsl"
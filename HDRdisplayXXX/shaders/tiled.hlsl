@@ -0,0 +1,53 @@
+// Compute entry point for a stage shader
+//
+// With TILED defined, tiledMain runs the shader's main() over a list of 8x8
+// tiles and stores the result to a UAV instead of drawing a quad. The tile
+// list only holds the tiles that touch the image, see tileDispatch.h, so the
+// letterbox around it is never shaded. P and TC are rebuilt to match what
+// vs_quad.hlsl would have interpolated at the pixel centre.
+//
+// Include at the end of the shader, after main.
+
+#ifndef TILED_HLSL
+#define TILED_HLSL
+
+#ifdef TILED
+
+#define TILE_SIZE 8
+
+// x | y << 16 in tiles
+StructuredBuffer<uint> tileList : register(t7);
+
+RWTexture2D<float4> tiledOutput : register(u0);
+
+cbuffer cbTiles : register(b6)
+{
+	uint2 tiledDim;
+	uint tileCount;
+	uint tileColumns;	// groups are dispatched tileColumns wide, the list can pass the 65535 group limit
+};
+
+[numthreads(TILE_SIZE, TILE_SIZE, 1)]
+void tiledMain(uint3 group : SV_GroupID, uint3 thread : SV_GroupThreadID)
+{
+	uint index = group.y * tileColumns + group.x;
+
+	if (index >= tileCount)
+		return;
+
+	uint tile = tileList[index];
+	uint2 pixel = uint2(tile & 0xffff, tile >> 16) * TILE_SIZE + thread.xy;
+
+	if (any(pixel >= tiledDim))
+		return;
+
+	VS_OUTPUT input;
+	input.P = float4(float2(pixel) + 0.5f, 0.0f, 1.0f);
+	input.TC = (float2(pixel) + 0.5f) / float2(tiledDim);
+
+	tiledOutput[pixel] = main(input);
+}
+
+#endif
+
+#endif
@@ -40,12 +40,14 @@ struct VS_OUTPUT
 	float2 TC : TEXCOORD0;
 };
 
+#include "fused.hlsl"
+
 ////////////////////////////////////////////////////////////////////////////////
 // Pixel Shader
 
 float4 main(VS_OUTPUT input) : SV_Target0
 {
-	float4 texLookup = texInput.SampleLevel(sampLinearWrap, input.TC, 0);
+	float4 texLookup = READ_INPUT(input);
 
 	// find brightest component
 	float lum = max(texLookup.r, max(texLookup.g, texLookup.b));
@@ -72,7 +74,7 @@ float4 main(VS_OUTPUT input) : SV_Target0
 	float4 result;
 	result.rgb = lerp(Colors[index], Colors[index + 1], Scale - index);
 	result.a = 1;
-	return result;
+	return WRITE_OUTPUT(result, input);
 }
 
-
+#include "tiled.hlsl"
@@ -31,15 +31,33 @@ Border
 0.9658, 0.4963, 0.5024 
 */
 
+#define XFORM_INPUT_HLSL
+
+// fused.hlsl moves the resources below clear of the tonemapper slots when
+// FUSED is defined, and includes this file with XFORM_STAGE_ONLY to get
+// XformInput() without a main
+#include "fused.hlsl"
+
+#ifndef XFORM_TEX_REGISTER
+#define XFORM_TEX_REGISTER t0
+#define XFORM_EXPOSURE_REGISTER t1
+#define XFORM_CB_REGISTER b0
+#endif
+
 ////////////////////////////////////////////////////////////////////////////////
 // Resources
 
-Texture2D texInput : register(t0);
-SamplerState sampLinearWrap : register(s0);
-Buffer<float> autoExposure : register(t1);
+Texture2D texSource : register(XFORM_TEX_REGISTER);
+Buffer<float> autoExposure : register(XFORM_EXPOSURE_REGISTER);
 
 RWBuffer<float> uav : register(u1);
 
+// trilinear and anisotropic over the image's mip chain, bound in both the fused and separate passes
+SamplerState sampMipWrap : register(s2);
+
+#ifndef XFORM_STAGE_ONLY
+SamplerState sampLinearWrap : register(s0);
+
 ////////////////////////////////////////////////////////////////////////////////
 // IO Structures
 
@@ -48,9 +66,10 @@ struct VS_OUTPUT
 	float4 P  : SV_POSITION;
 	float2 TC : TEXCOORD0;
 };
+#endif
 
 
-cbuffer cbObject : register(b0)
+cbuffer cbXform : register(XFORM_CB_REGISTER)
 {
 	uint filter;
 	int zoom;
@@ -68,7 +87,7 @@ cbuffer cbObject : register(b0)
 	float xlrScaleC;
 	float xlrBiasA;
 	float xlrBiasB;
-	float pad;
+	int readback_radius;
 	float3 rgbSaturation;
 	float3 rgbContrast;
 	float3 rgbGamma;
@@ -81,6 +100,8 @@ cbuffer cbObject : register(b0)
 	float iptBiasC;
 	float iptBiasA;
 	float iptBiasB;
+	float2 pan;				// in image uv
+	float4 sourceWindow;	// image uv to texSource uv, scale xy and offset zw
 };
 
 
@@ -122,14 +143,15 @@ static const float3x3 Aab_2_LMS_MAT =
 	1.0000, -0.1568, -4.4904
 };
 
-static const float3x3 sRGB_2_XYZ_MAT =
+// XF_ prefix keeps these apart from the tonemapper copies in a fused kernel
+static const float3x3 XF_sRGB_2_XYZ_MAT =
 {
 	0.41239089f, 0.35758430f, 0.18048084f,
 	0.21263906f, 0.71516860f, 0.07219233f,
 	0.01933082f, 0.11919472f, 0.95053232f
 };
 
-static const float3x3 XYZ_2_sRGB_MAT =
+static const float3x3 XF_XYZ_2_sRGB_MAT =
 {
 	3.24096942f, -1.53738296f, -0.49861076f,
 	-0.96924388f, 1.87596786f, 0.04155510f,
@@ -141,7 +163,7 @@ float3 XLR_CAM_Forward(float3 LinearColor, float3 inWhite, float La, float Displ
 
 	// map to ZYZ
 	float3 XYZ;
-	XYZ = mul(sRGB_2_XYZ_MAT, LinearColor);
+	XYZ = mul(XF_sRGB_2_XYZ_MAT, LinearColor);
 
 	float3 XYZw = inWhite;
 
@@ -324,22 +346,15 @@ float3 XLR_CAM_Inverse(float3 Color, float3 outWhite, float La, float DisplayFac
 		XYZp = mul(MCAT02i, XYZp);
 	}
 
-	float3 RGB = mul(XYZ_2_sRGB_MAT, XYZp);
+	float3 RGB = mul(XF_XYZ_2_sRGB_MAT, XYZp);
 
 	return RGB;
 }
 
 ////////////////////////////////////////////////////////////////////////////////
-// Pixel Shader
-
-static const float3x3 XYZ_2_DISPLAY_PRI_MAT =
-{
-	3.24096942f, -1.53738296f, -0.49861076f,
-	-0.96924388f, 1.87596786f, 0.04155510f,
-	0.05563002f, -0.20397684f, 1.05697131f
-};
+// Transform, P is the pixel position and TC the texture coordinate of the quad
 
-float4 main(VS_OUTPUT input) : SV_Target0
+float4 XformInput(float4 P, float2 TC)
 {
 	float4 texLookup = 0;
 
@@ -353,28 +368,47 @@ float4 main(VS_OUTPUT input) : SV_Target0
 			aspectScale.x = aspectIn < aspectOut ? aspectOut / aspectIn : 1.0f;
 			aspectScale.y = aspectIn > aspectOut ? aspectIn / aspectOut : 1.0f;
 		}
-		float2 uv = (input.TC - 0.5) * pow(2.0f, float(-zoom)) *aspectScale + 0.5;
-		texLookup = texInput.SampleLevel(sampLinearWrap, uv, 0);
+		float2 uvScale = pow(2.0f, float(-zoom)) * aspectScale;
+		float2 uv = (TC - 0.5) * uvScale + 0.5 + pan;
+
+		// a screen pixel's footprint in uv picks the mip, given explicitly as the
+		// mapping is linear and compute has no derivatives
+		float2 footprint = uvScale / float2(outDim) * sourceWindow.xy;
+		float2 texUV = uv * sourceWindow.xy + sourceWindow.zw;
+		texLookup = texSource.SampleGrad(sampMipWrap, texUV, float2(footprint.x, 0.0f), float2(0.0f, footprint.y));
 		if (tile == 0 && (any(uv < 0.0) || any(uv > 1.0)))
 			texLookup = 0.0;
 	}
 	else
 	{
-		float scale = pow(2.0f, float(-zoom));
-		int2 offset = (inDim/scale - outDim) / 2;
-		int2 uv = (input.P.xy + offset) * scale;
-		texLookup = texInput.Load(int3(uv, 0));
+		float zoomScale = pow(2.0f, float(-zoom));
+		int2 offset = (inDim/zoomScale - outDim) / 2;
+		int2 uv = (P.xy + offset) * zoomScale + pan * inDim;
+
+		// the texel under uv in a windowed source, the same one for a whole image
+		uint2 texDim;
+		texSource.GetDimensions(texDim.x, texDim.y);
+		float2 texUV = (uv + 0.5) / float2(inDim) * sourceWindow.xy + sourceWindow.zw;
+		texLookup = texSource.Load(int3(floor(texUV * texDim), 0));
+		if (any(uv < 0) || any(uv >= inDim))
+			texLookup = 0.0;
 	}
 
 	// Filter any input NaNs (convoluted logic handles HLSL compiler transforms)
 	texLookup.rgb = max(-65505.0f, texLookup.rgb);
 	texLookup.rgb = (texLookup.rgb == -65505.0f) ? 0.0f : texLookup.rgb;
 
-	if (int(input.P.x) == readback_pos.x && int(input.P.y) == readback_pos.y)
+	// probe window around readback_pos, 4 floats a pixel with w marking it as written
+	int2 probe = int2(P.xy) - readback_pos + readback_radius;
+	int probeSize = 2 * readback_radius + 1;
+
+	if (all(probe >= 0) && all(probe < probeSize))
 	{
-		uav[0] = texLookup.r;
-		uav[1] = texLookup.g;
-		uav[2] = texLookup.b;
+		uint index = (probe.y * probeSize + probe.x) * 4;
+		uav[index + 0] = texLookup.r;
+		uav[index + 1] = texLookup.g;
+		uav[index + 2] = texLookup.b;
+		uav[index + 3] = 1.0f;
 	}
 
 	float3 rgb = texLookup.rgb;
@@ -399,12 +433,12 @@ float4 main(VS_OUTPUT input) : SV_Target0
 		rgb = rgb < 0.0f ? -trgb : trgb;
 	}
 
-	bool grade = (gradingFlags & 0x8) ? input.TC.x >= 0.5f : true;
+	bool grade = (gradingFlags & 0x8) ? TC.x >= 0.5f : true;
 
 	// grade in xlrCAM space
 	if (gradingFlags & 0x1 && grade)
 	{
-		const float3 white = mul(sRGB_2_XYZ_MAT, float3(1, 1, 1)) / 80.0f * 10000.0f; // white is 10,000 nit
+		const float3 white = mul(XF_sRGB_2_XYZ_MAT, float3(1, 1, 1)) / 80.0f * 10000.0f; // white is 10,000 nit
 		float3 Jch = XLR_CAM_Forward(rgb, white, 0.001f, 1.0f, true, false);
 
 		// adjust contrast
@@ -458,7 +492,7 @@ float4 main(VS_OUTPUT input) : SV_Target0
 
 		static const float3 AP1_RGB2Y = { 0.27222872f, 0.67408168f, 0.05368952f };
 
-		rgb = mul(XYZ_2_AP1_MAT, mul(sRGB_2_XYZ_MAT, rgb));
+		rgb = mul(XYZ_2_AP1_MAT, mul(XF_sRGB_2_XYZ_MAT, rgb));
 
 		// saturation
 		float l = dot(rgb, AP1_RGB2Y);
@@ -473,7 +507,7 @@ float4 main(VS_OUTPUT input) : SV_Target0
 		// gain + bias
 		rgb = rgb*rgbGain + rgbBias;
 
-		rgb = mul(XYZ_2_sRGB_MAT, mul(AP1_2_XYZ_MAT, rgb));
+		rgb = mul(XF_XYZ_2_sRGB_MAT, mul(AP1_2_XYZ_MAT, rgb));
 	}
 
 	// IPT grading
@@ -518,11 +552,11 @@ float4 main(VS_OUTPUT input) : SV_Target0
 		};
 #endif
 		float3 midGray = 0.18;
-		midGray = mul(XYZ_2_LMS_MAT, mul(sRGB_2_XYZ_MAT, midGray));
+		midGray = mul(XYZ_2_LMS_MAT, mul(XF_sRGB_2_XYZ_MAT, midGray));
 		midGray = midGray < 0.0 ? -pow(-midGray, 0.43) : pow(midGray, 0.43);
 		midGray = mul(LMS_2_IPT_MAT, midGray);
 
-		float3 lms = mul(XYZ_2_LMS_MAT, mul(sRGB_2_XYZ_MAT, rgb));
+		float3 lms = mul(XYZ_2_LMS_MAT, mul(XF_sRGB_2_XYZ_MAT, rgb));
 
 		lms = lms < 0.0 ? -pow(-lms, 0.43) : pow(lms, 0.43);
 
@@ -545,10 +579,39 @@ float4 main(VS_OUTPUT input) : SV_Target0
 
 		lms = lms < 0.0 ? -pow(-lms, 1.0 / 0.43) : pow(lms, 1.0 / 0.43);
 
-		rgb = mul(XYZ_2_sRGB_MAT, mul(LMS_2_XYZ_MAT, lms));
+		rgb = mul(XF_XYZ_2_sRGB_MAT, mul(LMS_2_XYZ_MAT, lms));
 	}
 
 	return float4(rgb, 1);
 }
 
+#ifdef FUSED
+// Composite fade of a fused kernel. The colour under the probe centre goes to
+// the UAV right after the probe window, for checking against the CPU reference.
+float4 FusedOutput(float4 color, float4 P)
+{
+	color = float4(lerp(color.rgb, 0.0f, fusedFade), 1.0f);
+
+	if (all(int2(P.xy) == readback_pos))
+	{
+		int probeSize = 2 * readback_radius + 1;
+		uint index = probeSize * probeSize * 4;
+		uav[index + 0] = color.r;
+		uav[index + 1] = color.g;
+		uav[index + 2] = color.b;
+		uav[index + 3] = 1.0f;
+	}
+
+	return color;
+}
+#endif
+
+////////////////////////////////////////////////////////////////////////////////
+// Pixel Shader
 
+#ifndef XFORM_STAGE_ONLY
+float4 main(VS_OUTPUT input) : SV_Target0
+{
+	return WRITE_OUTPUT(XformInput(input.P, input.TC), input);
+}
+#endif